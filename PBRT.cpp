@@ -1,7 +1,11 @@
 ﻿// PBRT.cpp: 定义应用程序的入口点。
 //
 #include <omp.h>
-#include <time.h>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/opencv.hpp>
@@ -21,10 +25,115 @@
 #include "transform.h"
 #include "loadobj.h"
 #include "primitive.h"
+#include "meomery.h"
+#include "light.h"
+#include "lightdistrib.h"
+#include "sampling.h"
+#include "options.h"
+#include "scene.h"
+#include "parser.h"
+#include "film.h"
+#include "denoise.h"
+#include "raysort.h"
+#include "assetcache.h"
+#include "localsocket.h"
+
+// Rays traced by the calling thread (camera, bounce and shadow rays). The
+// render loop samples it around each pixel, so counting needs no atomics.
+static thread_local int64_t nRaysTraced = 0;
+
+// Reflectance of the triangle meshes in _SceneConfig::prims_, which carry no
+// material of their own
+static const color meshAlbedo = color(191, 184, 241) / 255.0;
+
+// Light sampling for next-event estimation: picks one light from
+// _lightDistrib_ and returns its contribution as if nothing were in the way,
+// MIS-weighted (power heuristic) against _scatter_, the pdf the path is
+// continued with. _f_ gives the reflected fraction (BRDF times cosine) for
+// a direction. *_visibility_ receives the segment a shadow ray must test;
+// nothing is traced when the result is black.
+template <typename ScatterFunc>
+Color SampleLight(const Interaction& ref, const LightDistribution& lightDistrib,
+    const pdf& scatter, ScatterFunc f, VisibilityTester* visibility) {
+    Float lightPmf;
+    const Light* light = lightDistrib.Sample(ref, RandomFloat(), &lightPmf);
+    if (!light || lightPmf == 0)
+        return Color(0.f);
 
-Color ray_color(const ray& r, const Color& background, const std::vector<shared_ptr<Primitive>> &obj, const hittable& world, shared_ptr<hittable>& lights) {
-    if (r.depth >= 50)
+    Vector3f wi;
+    Float lightPdf = 0;
+    Color Li = light->Sample_Li(ref, Point2f(RandomFloat(), RandomFloat()), &wi, &lightPdf, visibility);
+    if (lightPdf == 0 || Li.IsBlack())
+        return Color(0.f);
+    Color fr = f(wi);
+    if (fr.IsBlack())
         return Color(0.f);
+
+    lightPdf *= lightPmf;
+    if (IsDeltaLight(light->flags))
+        return fr * Li / lightPdf;
+    Float weight = PowerHeuristic(1, lightPdf, 1, scatter.value(wi));
+    return fr * Li * weight / lightPdf;
+}
+
+// Traces the shadow ray of _visibility_: 0 if a surface of _world_ or a
+// primitive of _obj_ blocks it, else the transmittance of the media it
+// crosses
+Float ShadowTransmittance(const VisibilityTester& visibility, const hittable& world,
+    const std::vector<shared_ptr<Primitive>>* obj) {
+    ++nRaysTraced;
+    Float tr = visibility.Tr(world);
+    if (tr == 0)
+        return 0;
+    if (obj) {
+        Ray shadow = visibility.ShadowRay();
+        for (const auto& prim : *obj)
+            if (prim->IntersectP(shadow))
+                return 0;
+    }
+    return tr;
+}
+
+// Next-event estimation: SampleLight() followed by its shadow ray
+template <typename ScatterFunc>
+Color SampleOneLight(const Interaction& ref, const hittable& world,
+    const std::vector<shared_ptr<Primitive>>* obj,
+    const LightDistribution& lightDistrib, const pdf& scatter, ScatterFunc f) {
+    VisibilityTester visibility;
+    Color Ld = SampleLight(ref, lightDistrib, scatter, f, &visibility);
+    if (Ld.IsBlack())
+        return Ld;
+    return Ld * ShadowTransmittance(visibility, world, obj);
+}
+
+// MIS weight for emission from _light_ found by a scattered ray.
+// _scatterPdf_ is the pdf the previous vertex _prev_ sampled _r_ with, or 0
+// when the ray left the camera or a specular bounce, which light sampling
+// can't reproduce.
+inline Float EmissionWeight(const ray& r, const Light* light, const hit_record* prev,
+    Float scatterPdf, const LightDistribution& lightDistrib) {
+    if (scatterPdf == 0 || !prev || !light)
+        return 1;
+    Float lightPdf = lightDistrib.PMF(*prev, light)
+        * light->Pdf_Li(*prev, unit_vector(r.direction()));
+    return PowerHeuristic(1, scatterPdf, 1, lightPdf);
+}
+
+// Radiance for a ray that left the scene: the constant _background_ plus
+// any environment lights, MIS-weighted like other emitters
+Color Escaped(const ray& r, const Color& background, const hittable_list& world,
+    const LightDistribution& lightDistrib, Float scatterPdf, const hit_record* prev) {
+    Color L = background;
+    for (const auto& light : world.infinite_lights)
+        L += light->Le(r) * EmissionWeight(r, light.get(), prev, scatterPdf, lightDistrib);
+    return L;
+}
+
+Color ray_color(const ray& r, const Color& background, const std::vector<shared_ptr<Primitive>> &obj, const hittable_list& world,
+    const MaterialTable& materials, const LightDistribution& lightDistrib, MemoryArena& arena, Float scatterPdf = 0, const hit_record* prev = nullptr) {
+    if (r.depth >= PbrtOptions.maxDepth)
+        return Color(0.f);
+    ++nRaysTraced;
     SurfaceInteraction isec;
     hit_record rec;
 
@@ -42,7 +151,7 @@ Color ray_color(const ray& r, const Color& background, const std::vector<shared_
     if (!world.hit(r, 0.001, r.tMax, rec))
     {   
         if (flag_obj == false)
-            return background;
+            return Escaped(r, background, world, lightDistrib, scatterPdf, prev);
         else //intersect triangle obj
         {
             // light
@@ -50,40 +159,48 @@ Color ray_color(const ray& r, const Color& background, const std::vector<shared_
             //lambert
             if(Dot(r.d,vec3(isec.n)) > 0)
                 isec.n = -isec.n;
-            
-            auto light_ptr = make_shared<hittable_pdf>(lights, isec.p);
-            auto scatter_pdf = make_shared<cosine_pdf>(vec3(isec.n));
-            mixture_pdf p(light_ptr, scatter_pdf);
-
-            ray scattered = ray(isec.p, p.generate(), r);
-            auto pdf_val = p.value(scattered.direction());
 
-            auto cosine = Dot(vec3(isec.n), unit_vector(scattered.direction()));
-            cosine = cosine < 0 ? 0 : cosine / Pi;
-            return Color::FromRGB(vec3(191,184,241)/255.0) * cosine
-                * ray_color(scattered, background, obj, world, lights) / pdf_val;
+            const Color albedo = Color::FromRGB(meshAlbedo);
+            auto scatter_pdf = ARENA_ALLOC(arena, cosine_pdf)(vec3(isec.n));
+            auto f = [&](const vec3& wi) {
+                auto cosine = Dot(vec3(isec.n), unit_vector(wi));
+                return albedo * (cosine < 0 ? 0 : cosine / Pi);
+            };
+            Color Ld = SampleOneLight(isec, world, &obj, lightDistrib, *scatter_pdf, f);
+
+            ray scattered = ray(isec.p, scatter_pdf->generate(), r);
+            auto pdf_val = scatter_pdf->value(scattered.direction());
+            if (pdf_val == 0)
+                return Ld;
+            return Ld + f(scattered.direction())
+                * ray_color(scattered, background, obj, world, materials, lightDistrib, arena, pdf_val, &isec) / pdf_val;
         }
            
     }
     else
     {
         scatter_record srec;
-        Color emitted = rec.mat_ptr->emitted(r, rec, rec.u, rec.v, rec.p);
-        if (!rec.mat_ptr->scatter(r, rec, srec))
+        Color emitted = materials.Emitted(r, rec)
+            * EmissionWeight(r, rec.area_light, prev, scatterPdf, lightDistrib);
+        if (!materials.Scatter(r, rec, srec, arena))
             return emitted;
         if (srec.is_specular) {
             return srec.attenuation
-                * ray_color(ray(srec.specular_ray, true), background, obj, world, lights);
+                * ray_color(ray(srec.specular_ray, true), background, obj, world, materials, lightDistrib, arena);
         }
-        auto light_ptr = make_shared<hittable_pdf>(lights, rec.p);
-        mixture_pdf p(light_ptr, srec.pdf_ptr);
+        auto f = [&](const vec3& wi) {
+            return srec.attenuation * materials.ScatteringPdf(r, rec, ray(rec.p, wi, r));
+        };
+        Color Ld = SampleOneLight(rec, world, &obj, lightDistrib, *srec.pdf_ptr, f);
 
-        ray scattered = ray(rec.p, p.generate(), r);
-        auto pdf_val = p.value(scattered.direction());
+        ray scattered = ray(rec.p, srec.pdf_ptr->generate(), r);
+        auto pdf_val = srec.pdf_ptr->value(scattered.direction());
+        if (pdf_val == 0)
+            return emitted + Ld;
 
-        return emitted
-            + srec.attenuation * rec.mat_ptr->scattering_pdf(r, rec, scattered)
-            * ray_color(scattered, background, obj, world, lights) / pdf_val;
+        return emitted + Ld
+            + f(scattered.direction())
+            * ray_color(scattered, background, obj, world, materials, lightDistrib, arena, pdf_val, &rec) / pdf_val;
 
     }
     //if (flag_obj ==false)
@@ -92,33 +209,42 @@ Color ray_color(const ray& r, const Color& background, const std::vector<shared_
     //    return Color::FromRGB(vec3(isec.n));
 }
 
-Color ray_color(const ray& r, const Color& background, const hittable& world,  shared_ptr<hittable>& lights) {
+Color ray_color(const ray& r, const Color& background, const hittable_list& world,
+    const MaterialTable& materials, const LightDistribution& lightDistrib, MemoryArena& arena, Float scatterPdf = 0, const hit_record* prev = nullptr) {
     hit_record rec;
 
     // If we've exceeded the ray bounce limit, no more light is gathered.
-    if (r.depth >= 50)
+    if (r.depth >= PbrtOptions.maxDepth)
         return Color(0.f);
+    ++nRaysTraced;
 
-    // If the ray hits nothing, return the background color.
+    // If the ray hits nothing, return the background and environment light.
     if (!world.hit(r, 0.001, Infinity, rec))
-        return background;
+        return Escaped(r, background, world, lightDistrib, scatterPdf, prev);
     scatter_record srec;
-    Color emitted = rec.mat_ptr->emitted(r, rec, rec.u, rec.v, rec.p);
-    if (!rec.mat_ptr->scatter(r, rec, srec))
+    Color emitted = materials.Emitted(r, rec)
+        * EmissionWeight(r, rec.area_light, prev, scatterPdf, lightDistrib);
+    if (!materials.Scatter(r, rec, srec, arena))
         return emitted;
     if (srec.is_specular) {
         return srec.attenuation
-            * ray_color(ray(srec.specular_ray,true), background, world, lights);
+            * ray_color(ray(srec.specular_ray,true), background, world, materials, lightDistrib, arena);
     }
-    auto light_ptr = make_shared<hittable_pdf>(lights, rec.p);
-    mixture_pdf p(light_ptr, srec.pdf_ptr);
-
-    ray scattered = ray(rec.p, p.generate(), r);
-    auto pdf_val = p.value(scattered.direction());
+    // Direct lighting from one sampled light, plus the BSDF-sampled
+    // continuation; both strategies are weighted with the power heuristic
+    auto f = [&](const vec3& wi) {
+        return srec.attenuation * materials.ScatteringPdf(r, rec, ray(rec.p, wi, r));
+    };
+    Color Ld = SampleOneLight(rec, world, nullptr, lightDistrib, *srec.pdf_ptr, f);
+
+    ray scattered = ray(rec.p, srec.pdf_ptr->generate(), r);
+    auto pdf_val = srec.pdf_ptr->value(scattered.direction());
+    if (pdf_val == 0)
+        return emitted + Ld;
    
-    return emitted
-        + srec.attenuation * rec.mat_ptr->scattering_pdf(r, rec, scattered)
-        * ray_color(scattered, background, world, lights) / pdf_val;
+    return emitted + Ld
+        + f(scattered.direction())
+        * ray_color(scattered, background, world, materials, lightDistrib, arena, pdf_val, &rec) / pdf_val;
 }
 
 extern std::vector<std::shared_ptr<Shape>> CreateTriangleMesh(
@@ -130,9 +256,13 @@ extern std::vector<std::shared_ptr<Shape>> CreateTriangleMesh(
     //const std::shared_ptr<Texture<Float>>& shadowAlphaMask,
     const int* faceIndices);
 
-std::vector<shared_ptr<Primitive>> new_scene()
+// Transforms shared by the shapes of the scene being built; cleared by
+// BuildScene() once the shapes hold their own references
+static TransformCache transformCache;
+
+std::vector<shared_ptr<Primitive>> new_scene(const std::string& model)
 {
-    shared_ptr<Transform> id = make_shared<Transform>();
+    shared_ptr<Transform> id = transformCache.Lookup(Transform());
     Sphere obj1(id, id, 1);
     auto S1 = GeometricPrimitive(make_shared<Sphere>(obj1));
     
@@ -145,9 +275,13 @@ std::vector<shared_ptr<Primitive>> new_scene()
     shared_ptr<Transform> cube_trans = make_shared<Transform>((*big) * cube_pre* Rotate(45, vec3(0, 1, 0)));
     shared_ptr<Transform> hot_dog_trans = make_shared<Transform>(Translate(vec3(-450, 0, -100)) * Scale(2, 2, 2) * Translate(vec3(365, 100, 200)) * Scale(2.5, 2.5, 2.5) * Rotate(20,vec3(1,0,0))*Rotate(45, vec3(0, 0, 1)) * Rotate(180, vec3(0, 1, 0)));
     std::vector< shared_ptr<Primitive> > scene;
-    Model qwq("D:\\QWQ\\data\\mesh\\triangle mesh\\Hot\ dog.obj");
+    Model qwq(model);
+    if (qwq.meshes.empty())
+        return {};
     Mesh pwp = qwq.meshes[0];
-    auto cube=CreateTriangleMesh(hot_dog_trans,make_shared<Transform>(Inverse(*hot_dog_trans)), false, pwp.f_num, pwp.f_indics, pwp.v_num, pwp.v_pos, pwp.vt, pwp.vn, pwp.uv, nullptr);
+    shared_ptr<Transform> objectToWorld, worldToObject;
+    transformCache.Lookup(*hot_dog_trans, &objectToWorld, &worldToObject);
+    auto cube=CreateTriangleMesh(objectToWorld, worldToObject, false, pwp.f_num, pwp.f_indics, pwp.v_num, pwp.v_pos, pwp.vt, pwp.vn, pwp.uv, nullptr);
     for (auto& iter : cube)
     {
         scene.push_back(make_shared<GeometricPrimitive>(iter));
@@ -165,7 +299,9 @@ hittable_list test()
     //auto ground_t = make_shared<solid_color>(color(0.35, 0.3, 0.25));
    // world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(ground_t)));
     auto light = make_shared<diffuse_light>(color(4, 4, 4));
-    world.add(make_shared<xz_rect>(-100,100, -100, 100, 10, light));
+    auto light_rect = make_shared<xz_rect>(-100,100, -100, 100, 10, light);
+    world.add(light_rect);
+    world.add_area_light(light_rect, Color::FromRGB(color(4, 4, 4), SpectrumType::Illuminant));
 
     return world;
 }
@@ -219,7 +355,11 @@ hittable_list random_scene() {
     auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
     world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
 
-    return world;
+    // Over the shutter interval the moving spheres' bounds are tested per
+    // time segment (see bvh_node)
+    hittable_list scene(make_shared<bvh_node>(world, 0.0, 1.0));
+    scene.setTime(0.0, 1.0);
+    return scene;
 }
 
 hittable_list two_spheres() {
@@ -236,9 +376,30 @@ hittable_list two_spheres() {
     return objects;
 }
 
+// Spheres lit only by a lat-long environment map; the light's +z axis is
+// rotated onto the scene's +y up direction
+hittable_list environment_spheres(const std::string& envmap) {
+    hittable_list objects;
+    auto checker = make_shared<checker_texture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
+    objects.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(checker)));
+    objects.add(make_shared<sphere>(point3(0, 1, 0), 1.0, make_shared<lambertian>(color(0.8, 0.8, 0.8))));
+    objects.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, make_shared<metal>(color(0.7, 0.6, 0.5), 0.0)));
+    objects.add(make_shared<sphere>(point3(4, 1, 0), 1.0, make_shared<dielectric>(1.5)));
+    objects.add_light(make_shared<InfiniteAreaLight>(RotateX(-90), Color(1.f), 1, envmap));
+    return objects;
+}
+
+// Returns _tex_ baked over _bounds_ when --bake is given, else _tex_
+static shared_ptr<texture> BakeTexture(shared_ptr<texture> tex, const aabb& bounds) {
+    if (PbrtOptions.bakeResolution <= 0) return tex;
+    return make_shared<baked_texture>(tex, bounds, PbrtOptions.bakeResolution);
+}
+
 hittable_list two_perlin_spheres() {
     hittable_list objects;
-    auto pertext = make_shared<noise_texture>(4);
+    // Baked around the small sphere and the ground in front of the camera
+    auto pertext = BakeTexture(make_shared<noise_texture>(4),
+        aabb(point3(-8, -0.1, -5), point3(5, 4.1, 5)));
     objects.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(pertext)));
     objects.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<lambertian>(pertext)));
     objects.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<lambertian>(pertext)));
@@ -246,14 +407,16 @@ hittable_list two_perlin_spheres() {
     return objects;
 }
 
-hittable_list earth() {
+hittable_list earth(const std::string& texture) {
     hittable_list objects;
-    auto earth_texture = make_shared<image_texture>("E:\\PBRT\\PBRT-Learning\\image\\test_.png");
+    auto earth_texture = make_shared<image_texture>(texture.c_str());
     auto earth_surface = make_shared<lambertian>(earth_texture);
     auto globe = make_shared<sphere>(point3(0, 0, 0), 2, earth_surface);
     objects.add(globe);
     auto difflight = make_shared<diffuse_light>(color(4, 4, 4));
-    objects.add(make_shared<xy_rect>(3, 5, 1, 3, -2, difflight));
+    auto light_rect = make_shared<xy_rect>(3, 5, 1, 3, -2, difflight);
+    objects.add(light_rect);
+    objects.add_area_light(light_rect, Color::FromRGB(color(4, 4, 4), SpectrumType::Illuminant));
     return objects;
 }
 
@@ -268,7 +431,9 @@ hittable_list cornell_box() {
     //walls
     objects.add(make_shared<yz_rect>(0, 555, 0, 555, 555, green));
     objects.add(make_shared<yz_rect>(0, 555, 0, 555, 0, red));
-    objects.add(make_shared<xz_rect>(213, 343, 227, 332, 554, light));
+    auto light_rect = make_shared<xz_rect>(213, 343, 227, 332, 554, light);
+    objects.add(light_rect);
+    objects.add_area_light(light_rect, Color::FromRGB(color(20, 18, 15) * 2, SpectrumType::Illuminant));
     objects.add(make_shared<xz_rect>(0, 555, 0, 555, 0, white));
     objects.add(make_shared<xz_rect>(0, 555, 0, 555, 555, white));
     objects.add(make_shared<xy_rect>(0, 555, 0, 555, 555, white));
@@ -298,7 +463,9 @@ hittable_list cornell_smoke() {
 
     objects.add(make_shared<yz_rect>(0, 555, 0, 555, 555, green));
     objects.add(make_shared<yz_rect>(0, 555, 0, 555, 0, red));
-    objects.add(make_shared<xz_rect>(113, 443, 127, 432, 554, light));
+    auto light_rect = make_shared<xz_rect>(113, 443, 127, 432, 554, light);
+    objects.add(light_rect);
+    objects.add_area_light(light_rect, Color::FromRGB(color(7, 7, 7), SpectrumType::Illuminant));
     objects.add(make_shared<xz_rect>(0, 555, 0, 555, 555, white));
     objects.add(make_shared<xz_rect>(0, 555, 0, 555, 0, white));
     objects.add(make_shared<xy_rect>(0, 555, 0, 555, 555, white));
@@ -317,7 +484,42 @@ hittable_list cornell_smoke() {
     return objects;
 }
 
-hittable_list final_scene() {
+// Cornell box holding a cloud: turbulent noise on a sparse 128^3 grid,
+// fading out towards the edges of its box
+hittable_list cornell_cloud() {
+    hittable_list objects;
+
+    auto red = make_shared<lambertian>(color(.65, .05, .05));
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    auto green = make_shared<lambertian>(color(.12, .45, .15));
+    auto light = make_shared<diffuse_light>(color(7, 7, 7));
+
+    objects.add(make_shared<yz_rect>(0, 555, 0, 555, 555, green));
+    objects.add(make_shared<yz_rect>(0, 555, 0, 555, 0, red));
+    auto light_rect = make_shared<xz_rect>(113, 443, 127, 432, 554, light);
+    objects.add(light_rect);
+    objects.add_area_light(light_rect, Color::FromRGB(color(7, 7, 7), SpectrumType::Illuminant));
+    objects.add(make_shared<xz_rect>(0, 555, 0, 555, 555, white));
+    objects.add(make_shared<xz_rect>(0, 555, 0, 555, 0, white));
+    objects.add(make_shared<xy_rect>(0, 555, 0, 555, 555, white));
+
+    const int n = 128;
+    perlin noise;
+    auto grid = make_shared<const SparseGrid>(n, n, n, [&](int x, int y, int z) {
+        point3 p((x + .5f) / n, (y + .5f) / n, (z + .5f) / n);
+        Float r = (p - point3(.5, .5, .5)).Length() * 2;
+        if (r >= 1) return (Float)0;
+        return std::max((Float)0, noise.turb(4 * p, 5) * 2 - r * r);
+    });
+    aabb bounds(point3(90, 90, 90), point3(465, 465, 465));
+    auto cloud = make_shared<GridDensityMedium>(0.05, bounds, grid);
+    objects.add(make_shared<constant_medium>(
+        make_shared<box>(bounds.pMin, bounds.pMax, white), cloud, color(.9, .9, .9)));
+
+    return objects;
+}
+
+hittable_list final_scene(const std::string& texture) {
     hittable_list boxes1;
     auto ground = make_shared<lambertian>(color(0.48, 0.83, 0.53));
 
@@ -341,7 +543,9 @@ hittable_list final_scene() {
     objects.add(make_shared<bvh_node>(boxes1, 0, 1));
 
     auto light = make_shared<diffuse_light>(color(7, 7, 7));
-    objects.add(make_shared<xz_rect>(123, 423, 147, 412, 554, light));
+    auto light_rect = make_shared<xz_rect>(123, 423, 147, 412, 554, light);
+    objects.add(light_rect);
+    objects.add_area_light(light_rect, Color::FromRGB(color(7, 7, 7), SpectrumType::Illuminant));
 
     auto center1 = point3(400, 400, 200);
     auto center2 = center1 + vec3(30, 0, 0);
@@ -359,7 +563,7 @@ hittable_list final_scene() {
     boundary = make_shared<sphere>(point3(0, 0, 0), 5000, make_shared<dielectric>(1.5));
     objects.add(make_shared<constant_medium>(boundary, .0001, color(1, 1, 1)));
 
-    auto emat = make_shared<lambertian>(make_shared<image_texture>("E:\\PBRT\\PBRT-Learning\\image\\test_.png"));
+    auto emat = make_shared<lambertian>(make_shared<image_texture>(texture.c_str()));
     objects.add(make_shared<sphere>(point3(400, 200, 400), 100, emat));
    // auto pertext = make_shared<noise_texture>(0.1);
     //objects.add(make_shared<sphere>(point3(220, 280, 300), 80, make_shared<lambertian>(pertext)));
@@ -382,156 +586,1382 @@ hittable_list final_scene() {
 }
 
 
-int main() {
+// Scene Registry
+// Each builder lists the asset files it loads in the scene's _files_, so
+// that the render server rebuilds the scene when one of them changes
+struct SceneEntry {
+    const char* name;
+    std::function<SceneConfig()> build;
+};
+
+SceneConfig cornell_config(hittable_list world) {
+    SceneConfig sc;
+    sc.world = std::move(world);
+    sc.aspect_ratio = 1.0;
+    sc.image_width = 600;
+    sc.samples_per_pixel = 100;
+    sc.lookfrom = point3(278, 278, -800);
+    sc.lookat = point3(278, 278, 0);
+    sc.vfov = 40.0;
+    return sc;
+}
+
+const std::vector<SceneEntry>& SceneRegistry() {
+    static const std::vector<SceneEntry> registry = {
+        { "random_scene", [] {
+            SceneConfig sc;
+            sc.world = random_scene();
+            sc.background = color(0.70, 0.80, 1.00);
+            sc.aperture = 0.1;
+            return sc;
+        } },
+        { "two_spheres", [] {
+            SceneConfig sc;
+            sc.world = two_spheres();
+            sc.background = color(0.70, 0.80, 1.00);
+            return sc;
+        } },
+        { "two_perlin_spheres", [] {
+            SceneConfig sc;
+            sc.world = two_perlin_spheres();
+            sc.background = color(0.70, 0.80, 1.00);
+            return sc;
+        } },
+        { "earth", [] {
+            SceneConfig sc;
+            sc.files = { AssetPath("test_.png") };
+            sc.world = earth(sc.files[0]);
+            sc.samples_per_pixel = 100;
+            sc.lookfrom = point3(26, 3, 6);
+            sc.lookat = point3(0, 2, 0);
+            return sc;
+        } },
+        { "cornell_box", [] { return cornell_config(cornell_box()); } },
+        { "cornell_mesh", [] {
+            SceneConfig sc = cornell_config(cornell_box());
+            sc.files = { AssetPath("Hot dog.obj") };
+            sc.prims = new_scene(sc.files[0]);
+            return sc;
+        } },
+        { "cornell_smoke", [] {
+            SceneConfig sc = cornell_config(cornell_smoke());
+            sc.samples_per_pixel = 200;
+            return sc;
+        } },
+        { "cornell_cloud", [] {
+            SceneConfig sc = cornell_config(cornell_cloud());
+            sc.samples_per_pixel = 200;
+            return sc;
+        } },
+        { "test", [] {
+            SceneConfig sc;
+            sc.world = test();
+            sc.background = color(0.2, 0.2, 0.2);
+            return sc;
+        } },
+        { "environment_spheres", [] {
+            SceneConfig sc;
+            sc.files = { AssetPath("environment.hdr") };
+            sc.world = environment_spheres(sc.files[0]);
+            return sc;
+        } },
+        { "final_scene", [] {
+            SceneConfig sc;
+            sc.files = { AssetPath("test_.png") };
+            sc.world = final_scene(sc.files[0]);
+            sc.aspect_ratio = 1.0;
+            sc.image_width = 800;
+            sc.samples_per_pixel = 16;
+            sc.lookfrom = point3(478, 278, -600);
+            sc.lookat = point3(278, 278, 0);
+            sc.vfov = 40.0;
+            return sc;
+        } },
+    };
+    return registry;
+}
 
-    SampledSpectrum::Init();
-    //std::cout << v << std::endl;
-    // Image
-    auto aspect_ratio = 16.0 / 9.0;
-    int image_width = 400;
-    int samples_per_pixel =20;
-    const int max_depth = 50;
+const SceneEntry* FindScene(const std::string& name) {
+    for (const SceneEntry& entry : SceneRegistry())
+        if (name == entry.name)
+            return &entry;
+    return nullptr;
+}
 
-    // World
+bool IsSceneFile(const std::string& name) {
+    size_t n = name.size();
+    return n > 5 && name.compare(n - 5, 5, ".pbrt") == 0;
+}
 
-    hittable_list world;
+// Builds the registered scene _name_, or parses it as a scene file when it
+// names a .pbrt file, taking the assets _assets_ holds from there
+bool BuildScene(const std::string& name, SceneConfig* sc, AssetCache* assets = nullptr) {
+    if (IsSceneFile(name)) {
+        std::string error;
+        if (!ParseSceneFile(name, sc, &error, assets)) {
+            std::cerr << error << "\n";
+            return false;
+        }
+    }
+    else {
+        const SceneEntry* entry = FindScene(name);
+        if (!entry) {
+            std::cerr << "Unknown scene '" << name << "' (see --list)\n";
+            return false;
+        }
+        *sc = entry->build();
+        transformCache.Clear();
+        for (std::string& file : sc->files)
+            file = AbsolutePath(file);
+    }
+    // Shading reads materials and textures from the flat table
+    sc->world.compile_materials(sc->materials);
+    sc->materials.Build();
+    return true;
+}
+
+// Emitters registered by the scene through add_area_light() are picked
+// for next-event estimation by importance relative to the shading point
+std::unique_ptr<LightDistribution> PrepareLights(const hittable_list& world) {
+    aabb worldBound;
+    world.bounding_box(0.0, 1.0, worldBound);
+    for (const auto& light : world.lights)
+        light->Preprocess(worldBound);
+    return CreateLightSampleDistribution("bvh", world.lights);
+}
+
+// Render Statistics
+struct RenderStats {
+    double seconds = 0;     // wall time of the pixel loop
+    int64_t paths = 0;      // camera rays
+    int64_t rays = 0;       // camera, bounce and shadow rays
+};
+
+// Debug integrator: shading normal of the first hit mapped to RGB
+Color normal_color(const ray& r, const SceneConfig& sc) {
+    ++nRaysTraced;
+    hit_record rec;
+    vec3 n;
+    bool hit = sc.world.hit(r, 0.001, Infinity, rec);
+    if (hit)
+        n = rec.normal;
+    SurfaceInteraction isect;
+    for (const auto& prim : sc.prims)
+        if (prim->Intersect(r, &isect)) {
+            n = vec3(isect.n);
+            hit = true;
+        }
+    // Misses and scattering events inside media have no normal
+    if (!hit || n.LengthSquared() == 0)
+        return Color(0.f);
+    n = unit_vector(n);
+    return Color::FromRGB(0.5f * color(n.x + 1, n.y + 1, n.z + 1));
+}
+
+// Features of the surface a camera ray hits first, for the AOVs
+struct FirstHit {
+    color albedo;
+    vec3 normal;        // unit, facing the ray; zero for misses and media
+    Float depth = 0;    // distance from the ray origin, 0 for misses
+    uint32_t objectId = 0;
+};
+
+FirstHit FirstHitFeatures(const ray& cameraRay, const SceneConfig& sc) {
+    // Primitives shorten _tMax_ as they are hit, which also bounds the
+    // world query, so work on a copy
+    ++nRaysTraced;
+    ray r = cameraRay;
+    FirstHit first;
+    SurfaceInteraction isect;
+    const Primitive* prim = nullptr;
+    size_t primIndex = 0;
+    for (size_t i = 0; i < sc.prims.size(); ++i)
+        if (sc.prims[i]->Intersect(r, &isect)) {
+            prim = sc.prims[i].get();
+            primIndex = i;
+        }
+    hit_record rec;
+    uint64_t object = 0;
+    point3 p;
+    if (sc.world.hit(r, 0.001, r.tMax, rec)) {
+        first.albedo = sc.materials.SurfaceAlbedo(rec);
+        first.normal = rec.normal;
+        p = rec.p;
+        object = rec.material_id != 0 ? rec.material_id : (uint64_t)(uintptr_t)rec.mat_ptr;
+    }
+    else if (prim) {
+        first.albedo = meshAlbedo;
+        first.normal = vec3(isect.n);
+        if (Dot(r.direction(), first.normal) > 0)
+            first.normal = -first.normal;
+        p = isect.p;
+        object = ((uint64_t)1 << 32) | primIndex;
+    }
+    else
+        return first;
+    if (first.normal.LengthSquared() > 0)
+        first.normal = unit_vector(first.normal);
+    first.depth = (p - r.origin()).Length();
+    // Surfaces are told apart by material (or primitive) index, hashed so
+    // that neighboring IDs differ; 0 is kept for misses. Indices, unlike
+    // addresses, are the same in every process rendering the scene.
+    first.objectId = (uint32_t)MixBits(object);
+    if (first.objectId == 0)
+        first.objectId = 1;
+    return first;
+}
+
+// Wavefront Integrator Declarations
+// Rays of one bounce for a batch of paths, as a structure of arrays. All
+// of them are at the same depth; _path_ is the path's slot in the batch.
+struct RayQueue {
+    void Resize(size_t n) {
+        path.resize(n); o.resize(n); d.resize(n); time.resize(n); beta.resize(n);
+        scatterPdf.resize(n); prevP.resize(n); prevN.resize(n);
+    }
+    void Set(size_t i, uint32_t p, const ray& r, const Color& throughput) {
+        path[i] = p;
+        o[i] = r.o;
+        d[i] = r.d;
+        time[i] = r.time;
+        beta[i] = throughput;
+        scatterPdf[i] = 0;
+    }
+    // Records the vertex the ray left and the pdf it was sampled with, for
+    // MIS against light sampling
+    void SetPrevious(size_t i, Float pdf, const Interaction& prev) {
+        scatterPdf[i] = pdf;
+        prevP[i] = prev.p;
+        prevN[i] = prev.n != Normal() ? vec3(prev.n) : prev.normal;
+    }
+    // The vertex the ray left, with what the light distribution and the
+    // lights' pdfs look at, or null for camera rays and specular bounces
+    const Interaction* Previous(size_t i, Interaction* prev) const {
+        if (scatterPdf[i] == 0)
+            return nullptr;
+        prev->p = prevP[i];
+        prev->normal = prevN[i];
+        return prev;
+    }
+    void Move(size_t from, size_t to) {
+        path[to] = path[from]; o[to] = o[from]; d[to] = d[from]; time[to] = time[from];
+        beta[to] = beta[from]; scatterPdf[to] = scatterPdf[from];
+        prevP[to] = prevP[from]; prevN[to] = prevN[from];
+    }
+
+    std::vector<uint32_t> path;
+    std::vector<point3> o;
+    std::vector<vec3> d;
+    std::vector<Float> time;
+    std::vector<Color> beta;        // path throughput
+    std::vector<Float> scatterPdf;  // 0 for camera rays and specular bounces
+    std::vector<point3> prevP;
+    std::vector<vec3> prevN;
+};
+
+// Shadow rays of one bounce, with the contribution each adds to its path
+// when unoccluded. Contributions are only summed from here on, and
+// ToColor() is linear, so they are kept in RGB rather than as spectra.
+struct ShadowQueue {
+    void Resize(size_t n) { path.resize(n); visibility.resize(n); Ld.resize(n); }
+    void Move(size_t from, size_t to) {
+        path[to] = path[from]; visibility[to] = visibility[from]; Ld[to] = Ld[from];
+    }
+
+    std::vector<uint32_t> path;
+    std::vector<VisibilityTester> visibility;
+    std::vector<color> Ld;
+};
+
+// Moves the first _n_ entries of _queue_ with _keep_ set to the front,
+// keeping their order, and returns how many there are
+template <typename Queue>
+size_t Compact(Queue& queue, const std::vector<uint8_t>& keep, size_t n) {
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i)
+        if (keep[i]) {
+            if (k != i)
+                queue.Move(i, k);
+            ++k;
+        }
+    return k;
+}
+
+// Runs _kernel_(i, arena) for i in [0, _n_) on the OpenMP workers in fixed
+// chunks of items. Each chunk reseeds its thread's generator from (_seed_,
+// chunk) and then releases the worker's arena, so the random numbers an
+// item sees depend neither on the thread count nor on the schedule.
+// Returns the rays traced.
+template <typename Kernel>
+int64_t ParallelKernel(size_t n, uint64_t seed, MemoryArena* arenas, Kernel kernel) {
+    const size_t chunkSize = 256;
+    int nChunks = int((n + chunkSize - 1) / chunkSize);
+    int64_t rays = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+:rays)
+    for (int chunk = 0; chunk < nChunks; ++chunk) {
+        MemoryArena& arena = arenas[omp_get_thread_num()];
+        int64_t raysBefore = nRaysTraced;
+        SeedRandom(MixBits(seed ^ MixBits((uint64_t)chunk)));
+        size_t end = std::min(n, (chunk + 1) * chunkSize);
+        for (size_t i = chunk * chunkSize; i < end; ++i)
+            kernel(i, arena);
+        arena.Reset();
+        rays += nRaysTraced - raysBefore;
+    }
+    return rays;
+}
+
+// The path tracer of ray_color() restructured breadth first: the pixel
+// samples of a batch of pixels are traced together, one bounce at a time.
+// Each bounce is a sequence of kernels over queues of path states: the
+// closest-hit kernel intersects every ray and sorts it into a queue by
+// what it hit (nothing, a mesh, or a surface by its material type); a
+// shading kernel per queue adds emission, samples a light and the
+// continuation ray; and the shadow kernel traces the light samples. The
+// continuation and shadow queues are compacted between kernels, so each
+// kernel runs over dense arrays of uniform work. It estimates the same
+// image as ray_color(), with different random numbers, except that every
+// bounce counts towards the depth limit: ray_color() restarts the count
+// after specular bounces.
+class WavefrontIntegrator {
+public:
+    // WavefrontIntegrator Public Methods
+    WavefrontIntegrator(const SceneConfig& sc, const LightDistribution& lightDistrib,
+        const Color& background, int maxPaths, bool sortRays);
+    // Renders the _n_ film pixels _pixels_ (film.Index() values), at
+    // most _maxPaths_ / _spp_ of them. For each pixel, _setup_(pixel) is
+    // called and then _pixelSample_(pixel, s) for s = 0, 1, ... to get the
+    // camera rays; at the end _store_(pixel, sum, sumSquares) gets the
+    // sums over its samples. _seed_ seeds the kernels. Returns the rays
+    // traced.
+    template <typename SetupFunc, typename CameraFunc, typename StoreFunc>
+    int64_t RenderPixels(const int* pixels, int n, int spp, uint64_t seed,
+        SetupFunc setup, CameraFunc pixelSample, StoreFunc store);
+    // Coherence of the secondary rays in the order they were generated
+    // and in the order they were traced (the same unless sorted)
+    const RayCoherence& GeneratedCoherence() const { return generated; }
+    const RayCoherence& TracedCoherence() const { return traced; }
+
+private:
+    // WavefrontIntegrator Private Types
+    enum Queue : uint8_t { MissQueue, MeshQueue, MaterialQueue };
+    static const int nQueues = MaterialQueue + (int)MaterialTable::MaterialType::Isotropic + 1;
+
+    // WavefrontIntegrator Private Methods
+    void Intersect(size_t i);
+    void ShadeMiss(size_t i);
+    void ShadeMesh(size_t i, MemoryArena& arena);
+    void ShadeSurface(size_t i, MemoryArena& arena);
+    template <typename ScatterFunc>
+    void Scatter(size_t i, const ray& r, const Interaction& ref, const pdf& scatter,
+        ScatterFunc f);
+    void TraceShadow(size_t i);
+    ray RayAt(size_t i) const {
+        return ray(current->o[i], current->d[i], current->time[i], 0, Infinity, depth);
+    }
+
+    // WavefrontIntegrator Private Data
+    const SceneConfig& sc;
+    const LightDistribution& lightDistrib;
+    const std::vector<shared_ptr<Primitive>>* prims;
+    Color background;
+    bool sortRays;
+    aabb bounds;
+    RayCoherence generated, traced;
+    std::unique_ptr<MemoryArena[]> arenas;
+    int depth = 0;
+    RayQueue queues[2];
+    RayQueue* current = &queues[0];
+    RayQueue* next = &queues[1];
+    ShadowQueue shadows;
+    // Per entry of _current_: closest-hit results and the queue each ray
+    // is shaded in, and whether it continues or casts a shadow ray
+    std::vector<hit_info> hits;
+    std::vector<const Primitive*> meshHits;
+    std::vector<uint8_t> queueOf, keep, keepShadow;
+    // _current_'s entries in the order they are traced, and sorted by queue
+    std::vector<uint32_t> traceOrder, order;
+    // Radiance gathered by each path in the batch, in RGB like the shadow
+    // queue's contributions
+    std::vector<color> L;
+};
+
+// WavefrontIntegrator Method Definitions
+WavefrontIntegrator::WavefrontIntegrator(const SceneConfig& sc,
+    const LightDistribution& lightDistrib, const Color& background, int maxPaths,
+    bool sortRays)
+    : sc(sc), lightDistrib(lightDistrib), prims(sc.prims.empty() ? nullptr : &sc.prims),
+    background(background), sortRays(sortRays),
+    arenas(new MemoryArena[omp_get_max_threads()]) {
+    sc.world.bounding_box(0, 1, bounds);
+    for (const auto& prim : sc.prims)
+        bounds = Union(bounds, prim->WorldBound());
+    queues[0].Resize(maxPaths);
+    queues[1].Resize(maxPaths);
+    shadows.Resize(maxPaths);
+    hits.resize(maxPaths);
+    meshHits.resize(maxPaths);
+    queueOf.resize(maxPaths);
+    keep.resize(maxPaths);
+    keepShadow.resize(maxPaths);
+    order.resize(maxPaths);
+    L.resize(maxPaths);
+}
 
-    point3 lookfrom;
-    point3 lookat;
-    auto vfov = 40.0;
-    auto aperture = 0.0;
-
-    color background(0, 0, 0);
-
-    switch (5) {
-    case 1:
-        world = random_scene();
-        background = color(0.70, 0.80, 1.00);
-        lookfrom = point3(13, 2, 3);
-        lookat = point3(0, 0, 0);
-        vfov = 20.0;
-        aperture = 0.1;
-        break;
-
-    case 2:
-        world = two_spheres();
-        background = color(0.70, 0.80, 1.00);
-        lookfrom = point3(13, 2, 3);
-        lookat = point3(0, 0, 0);
-        vfov = 20.0;
-        break;
-
-    case 3:
-        world = two_perlin_spheres();
-        background = color(0.70, 0.80, 1.00);
-        lookfrom = point3(13, 2, 3);
-        lookat = point3(0, 0, 0);
-        vfov = 20.0;
-        break;
-
-    case 4:
-        world = earth();
-        samples_per_pixel = 100;
-        background = color(0, 0, 0);
-        lookfrom = point3(26, 3, 6);
-        lookat = point3(0, 2, 0);
-        vfov = 20.0;
-        break;
-
-    case 5:
-        world = cornell_box();
-        aspect_ratio = 1.0;
-        image_width = 600;
-        samples_per_pixel = 100;
-        background = color(0, 0, 0);
-        lookfrom = point3(278, 278, -800);
-        lookat = point3(278, 278, 0);
-        vfov = 40.0;
-        break;
-
-    case 6:
-        world = cornell_smoke();
-        aspect_ratio = 1.0;
-        image_width = 600;
-        samples_per_pixel = 200;
-        lookfrom = point3(278, 278, -800);
-        lookat = point3(278, 278, 0);
-        vfov = 40.0;
-        break;
-
-    case 7:
-        world = test();
-        background = color(0.2, 0.2, 0.2);
-        lookfrom = point3(13, 2, 3);
-        lookat = point3(0, 0, 0);
-        vfov = 20.0;
-        break;
-
-    default:
-    case 8:
-        world = final_scene();
-        aspect_ratio = 1.0;
-        image_width = 800;
-        samples_per_pixel = 16;
-        background = color(0, 0, 0);
-        lookfrom = point3(478, 278, -600);
-        lookat = point3(278, 278, 0);
-        vfov = 40.0;
-        break;
-    }
-    shared_ptr<hittable> lights = make_shared<xz_rect>(213, 343, 227, 332, 554, shared_ptr<material>());
-
-
-    //bvh_node bvh(world, world._time0, world._time1);
-    // Camera
-
-    vec3 vup(0, 1, 0);
-    auto dist_to_focus = 10.0;
-    int image_height = static_cast<int>(image_width / aspect_ratio);
-
-    camera cam(lookfrom, lookat, vup, vfov, aspect_ratio, aperture, dist_to_focus, 0.0, 1.0);
-
-    // Render
-    cv::Mat image_ = cv::Mat::zeros(image_height, image_width, CV_8UC3);
-    clock_t start = clock();
-    printf("P3\n%d %d\n255\n", image_width, image_height);
-    Color background_sp = Color::FromRGB(background,SpectrumType::Illuminant);
-    std::vector<shared_ptr<Primitive>> scene11 = new_scene();
-    for (int j = image_height - 1; j >= 0; --j) {
-        std::cerr << "\rScanlines remaining: " << j << ' ' << std::flush;
-#pragma omp parallel for
-        for (int i = 0; i < image_width; ++i) {
-            Color pixel_color(0.f);
-
-            for (int s = 0; s < samples_per_pixel; ++s) {
-                auto u = (i + RandomFloat()) / (image_width - 1);
-                auto v = (j + RandomFloat()) / (image_height - 1);
-                ray r = cam.get_ray(u, v);
-                //pixel_color += ray_color(r,background_sp, world,lights);
-                pixel_color += ray_color(r, background_sp, scene11, world, lights);
+template <typename SetupFunc, typename CameraFunc, typename StoreFunc>
+int64_t WavefrontIntegrator::RenderPixels(const int* pixels, int nPixels, int spp,
+    uint64_t seed, SetupFunc setup, CameraFunc pixelSample, StoreFunc store) {
+    // Camera generation, with the pixel's own random numbers
+    current = &queues[0];
+    next = &queues[1];
+    int64_t rays = 0;
+#pragma omp parallel for schedule(dynamic, 16) reduction(+:rays)
+    for (int k = 0; k < nPixels; ++k) {
+        int64_t raysBefore = nRaysTraced;
+        setup(pixels[k]);
+        for (int s = 0; s < spp; ++s) {
+            uint32_t path = uint32_t(k) * spp + s;
+            current->Set(path, path, pixelSample(pixels[k], s), Color(1.f));
+            L[path] = color(0, 0, 0);
+        }
+        rays += nRaysTraced - raysBefore;
+    }
+
+    size_t n = size_t(nPixels) * spp;
+    for (depth = 0; depth < PbrtOptions.maxDepth && n > 0; ++depth) {
+        // Every kernel of the bounce draws from its own sequence
+        auto kernelSeed = [&](int kernel) {
+            return MixBits(seed ^ MixBits(((uint64_t)pixels[0] << 32) | ((uint64_t)depth << 8) | kernel));
+        };
+        // Secondary rays leave from all over the scene in all directions;
+        // traced sorted by direction octant and origin, neighboring rays
+        // mostly visit the same BVH nodes
+        const uint32_t* trace = nullptr;
+        if (depth > 0) {
+            generated.Add(current->o.data(), current->d.data(), nullptr, n, bounds);
+            if (sortRays) {
+                SortRays(current->o.data(), current->d.data(), n, bounds, &traceOrder);
+                trace = traceOrder.data();
             }
-            //write_color( pixel_color, samples_per_pixel);
-            cv_write_color(image_, i, image_height - 1 - j, pixel_color.ToColor(), samples_per_pixel);
+            traced.Add(current->o.data(), current->d.data(), trace, n, bounds);
         }
+        rays += ParallelKernel(n, kernelSeed(0), arenas.get(),
+            [&](size_t k, MemoryArena&) { Intersect(trace ? trace[k] : k); });
+
+        // Sort the rays into the shading queues (a stable counting sort)
+        size_t queueStart[nQueues + 1] = {};
+        for (size_t i = 0; i < n; ++i)
+            ++queueStart[queueOf[i] + 1];
+        for (int q = 0; q < nQueues; ++q)
+            queueStart[q + 1] += queueStart[q];
+        size_t queueEnd[nQueues];
+        std::copy(queueStart, queueStart + nQueues, queueEnd);
+        for (size_t i = 0; i < n; ++i)
+            order[queueEnd[queueOf[i]]++] = uint32_t(i);
+
+        std::fill(keep.begin(), keep.begin() + n, 0);
+        std::fill(keepShadow.begin(), keepShadow.begin() + n, 0);
+        for (int q = 0; q < nQueues; ++q) {
+            size_t start = queueStart[q], count = queueStart[q + 1] - start;
+            if (count == 0)
+                continue;
+            const uint32_t* items = &order[start];
+            if (q == MissQueue)
+                rays += ParallelKernel(count, kernelSeed(1 + q), arenas.get(),
+                    [&](size_t k, MemoryArena&) { ShadeMiss(items[k]); });
+            else if (q == MeshQueue)
+                rays += ParallelKernel(count, kernelSeed(1 + q), arenas.get(),
+                    [&](size_t k, MemoryArena& arena) { ShadeMesh(items[k], arena); });
+            else
+                rays += ParallelKernel(count, kernelSeed(1 + q), arenas.get(),
+                    [&](size_t k, MemoryArena& arena) { ShadeSurface(items[k], arena); });
+        }
+
+        // Shadow rays, then the paths that go on
+        size_t nShadows = Compact(shadows, keepShadow, n);
+        rays += ParallelKernel(nShadows, kernelSeed(1 + nQueues), arenas.get(),
+            [&](size_t i, MemoryArena&) { TraceShadow(i); });
+        n = Compact(*next, keep, n);
+        std::swap(current, next);
     }
-    clock_t end = clock();
-    std::cerr << "\nSpend time:" << (end - start) / 1000 << "s. Done.\n";
 
-    cv::imwrite("E:\\PBRT\\PBRT-Learning\\image\\qwq.png", image_);
-    //去噪
-    cv::Mat result1, result2, result3, result4;
-    blur(image_, result1, cv::Size(3, 3));
-    cv::imwrite("E:\\PBRT\\PBRT-Learning\\image\\qwq_1.png", result1);
+    // Resolve the batch's pixels
+#pragma omp parallel for schedule(static)
+    for (int k = 0; k < nPixels; ++k) {
+        color sum(0, 0, 0), sumSquares(0, 0, 0);
+        for (int s = 0; s < spp; ++s) {
+            const color& c = L[size_t(k) * spp + s];
+            sum += c;
+            sumSquares += c * c;
+        }
+        store(pixels[k], sum, sumSquares);
+    }
+    return rays;
+}
 
-    GaussianBlur(image_, result2, cv::Size(3, 3), 0);
-    cv::imwrite("E:\\PBRT\\PBRT-Learning\\image\\qwq_2.png", result2);
+void WavefrontIntegrator::Intersect(size_t i) {
+    // Meshes are tested first and shorten the interval left for the world,
+    // as in ray_color()
+    ++nRaysTraced;
+    ray r = RayAt(i);
+    const Primitive* mesh = nullptr;
+    if (prims) {
+        SurfaceInteraction isect;
+        for (const auto& prim : *prims)
+            if (prim->Intersect(r, &isect))
+                mesh = prim.get();
+    }
+    hit_info& hit = hits[i];
+    hit.t = Infinity;
+    hit.object = nullptr;
+    hit.nInstances = 0;
+    if (sc.world.intersect(r, 0.001, r.tMax, hit))
+        queueOf[i] = uint8_t(MaterialQueue + (int)sc.materials.Type(hit.object->material_id));
+    else
+        queueOf[i] = mesh ? MeshQueue : MissQueue;
+    meshHits[i] = mesh;
+}
 
-    medianBlur(image_, result3, 3);
-    cv::imwrite("E:\\PBRT\\PBRT-Learning\\image\\qwq_3.png", result3);
+void WavefrontIntegrator::ShadeMiss(size_t i) {
+    Interaction prev;
+    const Interaction* prevPtr = current->Previous(i, &prev);
+    L[current->path[i]] += Color(current->beta[i]
+        * Escaped(RayAt(i), background, sc.world, lightDistrib, current->scatterPdf[i], prevPtr)).ToColor();
+}
 
-    fastNlMeansDenoisingColored(image_, result4);
-    cv::imwrite("E:\\PBRT\\PBRT-Learning\\image\\qwq_4.png", result4);
-    
+void WavefrontIntegrator::ShadeMesh(size_t i, MemoryArena& arena) {
+    // Meshes are lambertian with _meshAlbedo_
+    ray r = RayAt(i);
+    SurfaceInteraction isect;
+    meshHits[i]->Intersect(r, &isect);
+    if (Dot(r.d, vec3(isect.n)) > 0)
+        isect.n = -isect.n;
+    const Color albedo = Color::FromRGB(meshAlbedo);
+    auto scatter_pdf = ARENA_ALLOC(arena, cosine_pdf)(vec3(isect.n));
+    auto f = [&](const vec3& wi) {
+        auto cosine = Dot(vec3(isect.n), unit_vector(wi));
+        return albedo * (cosine < 0 ? 0 : cosine / Pi);
+    };
+    Scatter(i, r, isect, *scatter_pdf, f);
+}
+
+void WavefrontIntegrator::ShadeSurface(size_t i, MemoryArena& arena) {
+    ray r = RayAt(i);
+    hit_record rec;
+    hittable::record_hit(r, hits[i], rec);
+    uint32_t path = current->path[i];
+    const Color& beta = current->beta[i];
+    Interaction prev;
+    const Interaction* prevPtr = current->Previous(i, &prev);
+    Color emitted = sc.materials.Emitted(r, rec);
+    if (!emitted.IsBlack())
+        L[path] += Color(beta * emitted * EmissionWeight(r, rec.area_light, prevPtr,
+            current->scatterPdf[i], lightDistrib)).ToColor();
+
+    scatter_record srec;
+    if (!sc.materials.Scatter(r, rec, srec, arena))
+        return;
+    if (srec.is_specular) {
+        next->Set(i, path, srec.specular_ray, beta * srec.attenuation);
+        keep[i] = 1;
+        return;
+    }
+    auto f = [&](const vec3& wi) {
+        return srec.attenuation * sc.materials.ScatteringPdf(r, rec, ray(rec.p, wi, r));
+    };
+    Scatter(i, r, rec, *srec.pdf_ptr, f);
+}
+
+// Queues the light sample and the continuation of path _i_ at _ref_
+template <typename ScatterFunc>
+void WavefrontIntegrator::Scatter(size_t i, const ray& r, const Interaction& ref,
+    const pdf& scatter, ScatterFunc f) {
+    uint32_t path = current->path[i];
+    const Color& beta = current->beta[i];
+    VisibilityTester visibility;
+    Color Ld = SampleLight(ref, lightDistrib, scatter, f, &visibility);
+    if (!Ld.IsBlack()) {
+        shadows.path[i] = path;
+        shadows.visibility[i] = visibility;
+        shadows.Ld[i] = Color(beta * Ld).ToColor();
+        keepShadow[i] = 1;
+    }
+
+    ray scattered = ray(ref.p, scatter.generate(), r);
+    auto pdf_val = scatter.value(scattered.direction());
+    if (pdf_val == 0)
+        return;
+    next->Set(i, path, scattered, beta * f(scattered.direction()) / pdf_val);
+    next->SetPrevious(i, pdf_val, ref);
+    keep[i] = 1;
+}
+
+void WavefrontIntegrator::TraceShadow(size_t i) {
+    Float tr = ShadowTransmittance(shadows.visibility[i], sc.world, prims);
+    if (tr > 0)
+        L[shadows.path[i]] += shadows.Ld[i] * tr;
+}
+
+// Renders _sc_ into _film_, which covers the crop window of the
+// full-resolution image and gets AOVs with --aov or --denoise. Tiles of
+// _options.tileSize_ pixels are handed out to OpenMP workers dynamically.
+// Every pixel reseeds its thread's generator from (seed, pixel), so the
+// result depends only on the seed and not on the thread count, tile size
+// or schedule. The wavefront integrator renders batches of pixels with
+// WavefrontIntegrator instead; its kernels reseed per fixed chunk of work,
+// so there the result also depends on the batch size.
+//
+// With --part k n only the tiles whose index is k modulo n are rendered,
+// and with --sample-range a b only samples a to b - 1 of every pixel.
+// Samples from a = 0 on use the same random numbers as a full render, so
+// the parts of a frame split by tiles merge into exactly the single-process
+// image. If _part_ is not null, it receives the sums of the samples taken.
+RenderStats RenderScene(const SceneConfig& sc, const LightDistribution& lightDistrib,
+    const Options& options, Film& film, PartialFilm* part = nullptr) {
+    int image_width = options.xResolution > 0 ? options.xResolution : sc.image_width;
+    int image_height = options.yResolution > 0 ? options.yResolution
+        : static_cast<int>(image_width / sc.aspect_ratio);
+    int samples_per_pixel = options.spp > 0 ? options.spp : sc.samples_per_pixel;
+    int firstSample = 0;
+    if (options.sampleEnd > 0) {
+        firstSample = options.sampleBegin;
+        samples_per_pixel = options.sampleEnd - options.sampleBegin;
+    }
+    uint64_t seed = firstSample == 0 ? options.seed
+        : MixBits(options.seed ^ MixBits((uint64_t)firstSample));
+    point3 lookfrom = sc.lookfrom, lookat = sc.lookat;
+    if (options.setCamera) {
+        lookfrom = point3(options.lookFrom[0], options.lookFrom[1], options.lookFrom[2]);
+        lookat = point3(options.lookAt[0], options.lookAt[1], options.lookAt[2]);
+    }
+    camera cam(lookfrom, lookat, sc.vup, options.fov > 0 ? options.fov : sc.vfov,
+        Float(image_width) / image_height, sc.aperture, sc.focus_dist, 0.0, 1.0);
+
+    // Pixel bounds of the crop window, with (0,0) the top-left pixel
+    int x0 = (int)std::ceil(image_width * options.cropWindow[0][0]);
+    int x1 = (int)std::ceil(image_width * options.cropWindow[0][1]);
+    int y0 = (int)std::ceil(image_height * options.cropWindow[1][0]);
+    int y1 = (int)std::ceil(image_height * options.cropWindow[1][1]);
+    film = Film(std::max(x1 - x0, 0), std::max(y1 - y0, 0), options.aovs || options.denoise);
+    bool aovs = film.HasAOVs();
+    if (part)
+        *part = PartialFilm(film.width, film.height, aovs);
+    int tileSize = std::max(options.tileSize, 1);
+    int nTilesX = (x1 - x0 + tileSize - 1) / tileSize;
+    int nTilesY = (y1 - y0 + tileSize - 1) / tileSize;
+    auto renderTile = [&](int tile) { return tile % options.nParts == options.part; };
+
+    Color background_sp = Color::FromRGB(sc.background, SpectrumType::Illuminant);
+    bool normals = options.integrator == "normals";
+    // Every pixel reseeds the thread's generator before its samples
+    auto seedPixel = [&](int i, int j) {
+        SeedRandom(MixBits(seed ^ MixBits(((uint64_t)j << 32) | (uint32_t)i)));
+    };
+    // Camera ray for the _s_th sample taken of pixel (_i_, _j_), whose
+    // first hit's features are added to the AOVs
+    auto cameraSample = [&](int i, int j, size_t pixel, int s) {
+        auto u = (i + RandomFloat()) / (image_width - 1);
+        auto v = (j + RandomFloat()) / (image_height - 1);
+        ray r = cam.get_ray(u, v);
+        if (aovs) {
+            FirstHit first = FirstHitFeatures(r, sc);
+            film.albedo[pixel] += first.albedo / samples_per_pixel;
+            film.normal[pixel] += first.normal / samples_per_pixel;
+            film.depth[pixel] += first.depth / samples_per_pixel;
+            if (s == firstSample)
+                film.objectId[pixel] = first.objectId;
+        }
+        return r;
+    };
+
+    auto storePixel = [&](size_t pixel, const color& sum, const color& sumSquares) {
+        film.SetPixel(pixel, sum, sumSquares, samples_per_pixel);
+        if (part)
+            part->SetPixel(pixel, firstSample, samples_per_pixel, sum, sumSquares);
+    };
+
+    RenderStats stats;
+    int64_t rays = 0;
+    int64_t pixelsRendered = 0;
+    auto start = std::chrono::steady_clock::now();
+    if (options.integrator == "wavefront") {
+        // Batches of whole pixels of this part's tiles, with at most
+        // _options.wavefrontPaths_ paths in flight
+        std::vector<int> pixels;
+        for (int y = 0; y < film.height; ++y)
+            for (int x = 0; x < film.width; ++x)
+                if (renderTile(x / tileSize + (y / tileSize) * nTilesX))
+                    pixels.push_back((int)film.Index(x, y));
+        int nPixels = (int)pixels.size();
+        int batchPixels = std::max(1, std::min(nPixels, options.wavefrontPaths / samples_per_pixel));
+        int nBatches = (nPixels + batchPixels - 1) / batchPixels;
+        pixelsRendered = nPixels;
+        WavefrontIntegrator integrator(sc, lightDistrib, background_sp,
+            batchPixels * samples_per_pixel, options.sortRays);
+        auto setup = [&](int p) {
+            int i = x0 + p % film.width, j = image_height - 1 - (y0 + p / film.width);
+            seedPixel(i, j);
+        };
+        auto pixelSample = [&](int p, int s) {
+            int i = x0 + p % film.width, j = image_height - 1 - (y0 + p / film.width);
+            return cameraSample(i, j, p, firstSample + s);
+        };
+        for (int batch = 0; batch < nBatches; ++batch) {
+            int p0 = batch * batchPixels, p1 = std::min(p0 + batchPixels, nPixels);
+            rays += integrator.RenderPixels(&pixels[p0], p1 - p0, samples_per_pixel, seed,
+                setup, pixelSample, storePixel);
+            if (!options.quiet)
+                std::cerr << "\rBatches done: " << batch + 1 << '/' << nBatches << ' ' << std::flush;
+        }
+        if (!options.quiet) {
+            const RayCoherence& g = integrator.GeneratedCoherence();
+            const RayCoherence& t = integrator.TracedCoherence();
+            char buf[256];
+            snprintf(buf, sizeof(buf), "\nSecondary rays, consecutive pairs (generated -> traced): "
+                "direction cosine %.3f -> %.3f, origin distance %.4f -> %.4f, "
+                "octant changes %.1f%% -> %.1f%%",
+                g.MeanCosine(), t.MeanCosine(), g.MeanDistance(), t.MeanDistance(),
+                100 * g.OctantChanges(), 100 * t.OctantChanges());
+            std::cerr << buf;
+        }
+    }
+    else {
+        // One arena per OpenMP worker; per-sample pdfs are carved out of it and
+        // released wholesale by Reset() so the hot loop never hits the heap
+        std::unique_ptr<MemoryArena[]> arenas(new MemoryArena[omp_get_max_threads()]);
+        int nTiles = nTilesX * nTilesY, tilesDone = 0;
+
+#pragma omp parallel for schedule(dynamic, 1) reduction(+:rays, pixelsRendered)
+        for (int tile = 0; tile < nTiles; ++tile) {
+            if (!renderTile(tile))
+                continue;
+            MemoryArena& arena = arenas[omp_get_thread_num()];
+            int tx0 = x0 + (tile % nTilesX) * tileSize, tx1 = std::min(tx0 + tileSize, x1);
+            int ty0 = y0 + (tile / nTilesX) * tileSize, ty1 = std::min(ty0 + tileSize, y1);
+            int64_t raysBefore = nRaysTraced;
+            for (int y = ty0; y < ty1; ++y) {
+                int j = image_height - 1 - y;
+                for (int i = tx0; i < tx1; ++i) {
+                    color sum(0, 0, 0), sumSquares(0, 0, 0);
+                    size_t pixel = film.Index(i - x0, y - y0);
+                    seedPixel(i, j);
+                    for (int s = firstSample; s < firstSample + samples_per_pixel; ++s) {
+                        ray r = cameraSample(i, j, pixel, s);
+                        Color L(0.f);
+                        if (normals)
+                            L = normal_color(r, sc);
+                        else if (sc.prims.empty())
+                            L = ray_color(r, background_sp, sc.world, sc.materials, lightDistrib, arena);
+                        else
+                            L = ray_color(r, background_sp, sc.prims, sc.world, sc.materials, lightDistrib, arena);
+                        arena.Reset();
+                        color c = L.ToColor();
+                        sum += c;
+                        sumSquares += c * c;
+                    }
+                    storePixel(pixel, sum, sumSquares);
+                }
+            }
+            rays += nRaysTraced - raysBefore;
+            pixelsRendered += (int64_t)(tx1 - tx0) * (ty1 - ty0);
+            if (!options.quiet) {
+#pragma omp critical
+                std::cerr << "\rTiles done: " << ++tilesDone << '/' << nTiles << ' ' << std::flush;
+            }
+        }
+    }
+    if (!options.quiet)
+        std::cerr << '\n';
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.rays = rays;
+    stats.paths = pixelsRendered * samples_per_pixel;
+    if (part)
+        part->CopyAOVs(film);
+    return stats;
 }
 
+// Headless benchmark: renders each of _options.scenes_ (all registered
+// scenes if empty) at a fixed seed and writes wall times, throughput and
+// peak RSS as JSON to _options.benchFile_ (stdout if empty). Peak RSS is
+// process-wide, so run one scene per invocation to attribute it to a scene.
+int RunBenchmark(Options options) {
+    std::vector<std::string> names = options.scenes;
+    if (names.empty())
+        for (const SceneEntry& entry : SceneRegistry())
+            names.push_back(entry.name);
+    if (options.spp == 0)
+        options.spp = 8;
+    options.quiet = true;
+
+    std::ostringstream json;
+    json << "{\n  \"benchmark\": \"scenes\",\n";
+    json << "  \"config\": {\"spp\": " << options.spp << ", \"seed\": " << options.seed
+        << ", \"threads\": " << omp_get_max_threads() << ", \"tile\": " << options.tileSize
+        << ", \"integrator\": \"" << options.integrator << "\"},\n";
+    json << "  \"results\": [\n";
+    for (size_t n = 0; n < names.size(); ++n) {
+        const char* name = names[n].c_str();
+        using clock = std::chrono::steady_clock;
+        SeedRandom(options.seed);
+        auto t0 = clock::now();
+        SceneConfig sc;
+        if (!BuildScene(name, &sc))
+            return 1;
+        auto t1 = clock::now();
+        std::unique_ptr<LightDistribution> lightDistrib = PrepareLights(sc.world);
+        auto t2 = clock::now();
+        Film film;
+        RenderStats stats = RenderScene(sc, *lightDistrib, options, film);
+
+        double buildMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        double lightMs = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        double mrays = stats.rays / stats.seconds * 1e-6;
+        double mpaths = stats.paths / stats.seconds * 1e-6;
+        double rssMb = PeakResidentSetBytes() / (1024.0 * 1024.0);
+        char buf[512];
+        snprintf(buf, sizeof(buf), "%-20s %5dx%-5d build %8.1f ms  render %8.2f s  %7.2f Mrays/s  %7.2f Mpaths/s  rss %7.1f MB\n",
+            name, film.width, film.height, buildMs + lightMs, stats.seconds, mrays, mpaths, rssMb);
+        std::cerr << buf;
+
+        snprintf(buf, sizeof(buf),
+            "    {\"scene\": \"%s\", \"width\": %d, \"height\": %d, \"spp\": %d, "
+            "\"scene_build_ms\": %.3f, \"light_build_ms\": %.3f, \"render_s\": %.4f, "
+            "\"paths\": %lld, \"rays\": %lld, \"mpaths_per_s\": %.4f, \"mrays_per_s\": %.4f, "
+            "\"rays_per_path\": %.3f, \"peak_rss_mb\": %.1f}",
+            name, film.width, film.height, options.spp, buildMs, lightMs,
+            stats.seconds, (long long)stats.paths, (long long)stats.rays, mpaths, mrays,
+            stats.paths ? (double)stats.rays / stats.paths : 0.0, rssMb);
+        json << buf << (n + 1 < names.size() ? ",\n" : "\n");
+    }
+    json << "  ]\n}\n";
 
+    if (options.benchFile.empty()) {
+        std::cout << json.str();
+        return 0;
+    }
+    std::ofstream out(options.benchFile);
+    if (!out) {
+        std::cerr << "Cannot write '" << options.benchFile << "'\n";
+        return 1;
+    }
+    out << json.str();
+    return 0;
+}
+
+// Converts linear _pixels_ of a _width_ x _height_ film to an 8-bit BGR
+// image (gamma 2)
+cv::Mat ToImage(int width, int height, const std::vector<color>& pixels) {
+    cv::Mat image = cv::Mat::zeros(height, width, CV_8UC3);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            cv_write_color(image, x, y, pixels[size_t(y) * width + x], 1);
+    return image;
+}
+
+// Writes the radiance of _film_ to _filename_. With --denoise that image
+// is the denoised one and the raw render goes to <stem>_noisy<ext>; with
+// --aov the albedo, normal, depth and ID buffers go to <stem>_albedo<ext>
+// and so on.
+bool WriteImages(const Film& film, const std::string& filename, const Options& options) {
+    size_t dot = filename.find_last_of('.');
+    size_t slash = filename.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        dot = filename.size();
+    auto variant = [&](const char* tag) {
+        return filename.substr(0, dot) + "_" + tag + filename.substr(dot);
+    };
+    auto write = [&](const std::string& name, const std::vector<color>& pixels) {
+        if (cv::imwrite(name, ToImage(film.width, film.height, pixels)))
+            return true;
+        std::cerr << "Cannot write '" << name << "'\n";
+        return false;
+    };
+
+    if (!options.denoise) {
+        if (!write(filename, film.rgb))
+            return false;
+    }
+    else {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<color> denoised;
+        Denoise(film, DenoiseOptions(), &denoised);
+        if (!options.quiet)
+            std::cerr << "Denoised in " << std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count() << "s\n";
+        if (!write(filename, denoised) || !write(variant("noisy"), film.rgb))
+            return false;
+    }
+    if (!options.aovs)
+        return true;
+
+    // Normals map to [0,1]^3, depth to a gray ramp up to the farthest hit
+    // and IDs to arbitrary colors
+    size_t n = film.rgb.size();
+    std::vector<color> normal(n), depth(n), id(n);
+    Float maxDepth = 0;
+    for (size_t i = 0; i < n; ++i)
+        maxDepth = std::max(maxDepth, film.depth[i]);
+    for (size_t i = 0; i < n; ++i) {
+        const vec3& nn = film.normal[i];
+        if (nn.LengthSquared() > 0)
+            normal[i] = 0.5f * color(nn.x + 1, nn.y + 1, nn.z + 1);
+        Float d = maxDepth > 0 ? film.depth[i] / maxDepth : 0;
+        depth[i] = color(d, d, d);
+        uint32_t h = film.objectId[i];
+        id[i] = color(h & 0xff, (h >> 8) & 0xff, (h >> 16) & 0xff) / 255.f;
+    }
+    return write(variant("albedo"), film.albedo) && write(variant("normal"), normal) &&
+        write(variant("depth"), depth) && write(variant("id"), id);
+}
+
+// Merges the partial films _options.scenes_ into _options.partialFile_
+// if given (to merge in stages), else resolves them and writes the images
+// to _options.imageFile_ (default render.png).
+int MergeParts(const Options& options) {
+    if (options.scenes.empty()) {
+        std::cerr << "--merge: no partial films given\n";
+        return 1;
+    }
+    // Parts of sample ranges are merged in order of their first sample,
+    // whatever order they are given in
+    std::vector<PartialFilm> parts(options.scenes.size());
+    std::vector<size_t> order(parts.size());
+    std::string error;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        if (!parts[i].Read(options.scenes[i], &error)) {
+            std::cerr << options.scenes[i] << ": " << error << "\n";
+            return 1;
+        }
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return parts[a].FirstSample() < parts[b].FirstSample();
+    });
+    PartialFilm merged = std::move(parts[order[0]]);
+    for (size_t i = 1; i < order.size(); ++i)
+        if (!merged.Merge(parts[order[i]], &error)) {
+            std::cerr << options.scenes[order[i]] << ": " << error << "\n";
+            return 1;
+        }
+    if (!options.partialFile.empty()) {
+        if (merged.Write(options.partialFile, &error))
+            return 0;
+        std::cerr << error << "\n";
+        return 1;
+    }
+    Film film = merged.Resolve();
+    if (options.denoise && !film.HasAOVs()) {
+        std::cerr << "--denoise: the partial films have no AOVs\n";
+        return 1;
+    }
+    return WriteImages(film, options.imageFile.empty() ? "render.png" : options.imageFile,
+        options) ? 0 : 1;
+}
+
+// Renders the job of _args_ with _options.launch_ worker processes of
+// _program_ on this machine, each taking every n-th tile (--part) into a
+// partial film next to the output image, then merges them. This stands in
+// for a render farm's scheduler: the workers' command lines are what a
+// farm would run on its nodes, followed by PBRT --merge.
+int LaunchWorkers(const char* program, const std::vector<std::string>& args,
+    const Options& options) {
+    int n = options.launch;
+    if (options.scenes.size() > 1 || !options.batchFile.empty()) {
+        std::cerr << "--launch renders a single scene\n";
+        return 1;
+    }
+    // Double quotes group arguments for both sh and cmd
+    auto quote = [](const std::string& arg) { return "\"" + arg + "\""; };
+    std::string common = quote(program);
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--launch") {
+            ++i;
+            continue;
+        }
+        common += " " + quote(args[i]);
+    }
+    if (options.nThreads == 0) {
+        int hw = (int)std::thread::hardware_concurrency();
+        common += " --nthreads " + std::to_string(std::max(1, hw / n));
+    }
+
+    std::string image = options.imageFile.empty() ? "render.png" : options.imageFile;
+    size_t dot = image.find_last_of('.');
+    size_t slash = image.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        dot = image.size();
+    Options merge = options;
+    merge.merge = true;
+    merge.imageFile = image;
+    merge.scenes.clear();
+    std::vector<std::string> commands;
+    for (int k = 0; k < n; ++k) {
+        merge.scenes.push_back(image.substr(0, dot) + "_part" + std::to_string(k) + ".part");
+        commands.push_back(common + " --quiet --part " + std::to_string(k) + " " +
+            std::to_string(n) + " --partial " + quote(merge.scenes.back()));
+#ifdef _WIN32
+        // cmd /c drops the first and last quote of the line
+        commands.back() = "\"" + commands.back() + "\"";
+#endif
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<int> status(n);
+    std::vector<std::thread> workers;
+    for (int k = 0; k < n; ++k)
+        workers.emplace_back([&, k]() { status[k] = std::system(commands[k].c_str()); });
+    for (std::thread& worker : workers)
+        worker.join();
+    for (int k = 0; k < n; ++k)
+        if (status[k] != 0) {
+            std::cerr << "Worker " << k << " failed: " << commands[k] << "\n";
+            return 1;
+        }
+    if (!options.quiet)
+        std::cerr << n << " workers: " << std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count() << "s\n";
+
+    int result = MergeParts(merge);
+    if (result == 0)
+        for (const std::string& file : merge.scenes)
+            std::remove(file.c_str());
+    return result;
+}
+
+// Scenes the render server keeps built between jobs, with their BVHs,
+// material tables and light distributions, plus the decoded assets of
+// scene files. A scene is found by its name and the options it was built
+// with, and used again as long as the files it was read from hash the
+// same; otherwise it is rebuilt, reusing the unchanged assets. The least
+// recently used scenes beyond _maxScenes_ are dropped.
+class SceneCache {
+public:
+    // SceneCache Public Types
+    struct Entry {
+        std::string key;
+        uint64_t filesHash = 0;
+        std::unique_ptr<SceneConfig> sc;
+        std::unique_ptr<LightDistribution> lightDistrib;
+        int64_t lastUse = 0;
+    };
+
+    // SceneCache Public Methods
+    // The scene _name_ for a job with _options_; null if it cannot be built
+    const Entry* Get(const std::string& name, const Options& options);
+    // Whether the last Get() built the scene, and how long that took
+    bool LastBuilt() const { return lastBuilt; }
+    double LastBuildSeconds() const { return lastBuildSeconds; }
+    size_t Scenes() const { return entries.size(); }
+
+private:
+    // SceneCache Private Data
+    static const size_t maxScenes = 4;
+    std::vector<Entry> entries;
+    AssetCache assets;
+    int64_t uses = 0;
+    bool lastBuilt = false;
+    double lastBuildSeconds = 0;
+};
+
+const SceneCache::Entry* SceneCache::Get(const std::string& name, const Options& options) {
+    // Scene files and the asset directory by absolute path, as clients
+    // work in different directories; registered scenes also depend on the
+    // seed
+    bool file = IsSceneFile(name);
+    std::string key = file ? AbsolutePath(name) : name;
+    key += "\n" + AbsolutePath(options.assetDir) + "\n" + std::to_string(options.bakeResolution);
+    if (!file)
+        key += "\n" + std::to_string(options.seed);
+
+    Entry* entry = nullptr;
+    for (Entry& e : entries)
+        if (e.key == key)
+            entry = &e;
+    uint64_t filesHash;
+    if (entry && assets.HashFiles(entry->sc->files, &filesHash) &&
+        filesHash == entry->filesHash) {
+        entry->lastUse = ++uses;
+        lastBuilt = false;
+        return entry;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Entry built;
+    built.key = key;
+    built.sc.reset(new SceneConfig);
+    SeedRandom(options.seed);
+    if (!BuildScene(name, built.sc.get(), &assets))
+        return nullptr;
+    built.lightDistrib = PrepareLights(built.sc->world);
+    if (!assets.HashFiles(built.sc->files, &built.filesHash))
+        built.filesHash = 0;
+    built.lastUse = ++uses;
+    lastBuilt = true;
+    lastBuildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (entry)
+        *entry = std::move(built);
+    else {
+        if (entries.size() >= maxScenes)
+            entries.erase(std::min_element(entries.begin(), entries.end(),
+                [](const Entry& a, const Entry& b) { return a.lastUse < b.lastUse; }));
+        entries.push_back(std::move(built));
+        entry = &entries.back();
+    }
+    // Assets only replaced or evicted scenes used are let go
+    std::vector<std::string> inUse;
+    for (const Entry& e : entries)
+        inUse.insert(inUse.end(), e.sc->files.begin(), e.sc->files.end());
+    assets.Prune(inUse);
+    return entry;
+}
+
+// Renders one job: every scene in _options.scenes_ (the default scene if
+// none), each written to _options.imageFile_ (else the file the scene
+// names, else render.png) or, for several scenes, to <stem>_<scene><ext>.
+// With --partial the single scene's samples go to a partial film instead,
+// and with --merge the "scenes" are partial films to merge. Scenes come
+// from _cache_ if given, else are built for the job.
+int RunJob(const Options& options, SceneCache* cache = nullptr) {
+    // Jobs of a batch (or the render server) without --nthreads get all
+    // cores again, whatever an earlier job asked for
+    static const int defaultThreads = omp_get_max_threads();
+    PbrtOptions = options;
+    omp_set_num_threads(options.nThreads > 0 ? options.nThreads : defaultThreads);
+    if (options.bench)
+        return RunBenchmark(options);
+    if (options.merge)
+        return MergeParts(options);
+
+    std::vector<std::string> names = options.scenes;
+    if (names.empty())
+        names.push_back("cornell_mesh");
+    if (!options.partialFile.empty() && names.size() > 1) {
+        std::cerr << "--partial renders a single scene\n";
+        return 1;
+    }
+    for (const std::string& name : names) {
+        SceneConfig built;
+        std::unique_ptr<LightDistribution> builtLights;
+        const SceneConfig* scene = &built;
+        const LightDistribution* lightDistrib = nullptr;
+        if (cache) {
+            const SceneCache::Entry* entry = cache->Get(name, options);
+            if (!entry)
+                return 1;
+            scene = entry->sc.get();
+            lightDistrib = entry->lightDistrib.get();
+        }
+        else {
+            SeedRandom(options.seed);
+            if (!BuildScene(name, &built))
+                return 1;
+            builtLights = PrepareLights(built.world);
+            lightDistrib = builtLights.get();
+        }
+        const SceneConfig& sc = *scene;
+
+        Film film;
+        PartialFilm part;
+        bool partial = !options.partialFile.empty();
+        RenderStats stats = RenderScene(sc, *lightDistrib, options, film,
+            partial ? &part : nullptr);
+        if (!options.quiet)
+            std::cerr << name << ": " << stats.seconds << "s, "
+                << stats.rays / stats.seconds * 1e-6 << " Mrays/s. Done.\n";
+        if (partial) {
+            std::string error;
+            if (!part.Write(options.partialFile, &error)) {
+                std::cerr << error << "\n";
+                return 1;
+            }
+            continue;
+        }
+
+        // -o wins over the file a scene description names
+        std::string filename = !options.imageFile.empty() ? options.imageFile
+            : !sc.image_file.empty() ? sc.image_file : "render.png";
+        if (names.size() > 1) {
+            std::string tag = name.substr(name.find_last_of("/\\") + 1);
+            tag = tag.substr(0, tag.find('.'));
+            size_t dot = filename.find_last_of('.');
+            if (dot == std::string::npos)
+                dot = filename.size();
+            filename = filename.substr(0, dot) + "_" + tag + filename.substr(dot);
+        }
+        if (!WriteImages(film, filename, options))
+            return 1;
+    }
+    return 0;
+}
+
+// Render server: listens on _options.serveSocket_ and runs the jobs its
+// clients send one at a time, in the client's working directory, with the
+// job's options parsed on top of the server's. Scenes stay built in a
+// SceneCache between jobs, so a job against a resident scene only
+// renders. A client sends two lines, its working directory and the job's
+// arguments (quoted as in job lists), within a few seconds of connecting,
+// and gets back the job's messages as "log" lines followed by "ok" or
+// "error". Jobs without --nthreads use the server's thread count.
+int RunServer(const Options& options) {
+    LocalSocket server;
+    std::string error;
+    if (!server.Listen(options.serveSocket, &error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    std::cerr << "Serving on " << options.serveSocket << "\n";
+    std::string home = CurrentDirectory();
+    SceneCache cache;
+    for (int64_t nJobs = 1;; ++nJobs) {
+        LocalSocket client;
+        if (!server.Accept(&client, &error)) {
+            std::cerr << error << "\n";
+            continue;
+        }
+        // A client that connects and then stalls must not hold up the
+        // others for good
+        std::string dir, line;
+        client.SetTimeout(10);
+        if (!client.ReadLine(&dir) || !client.ReadLine(&line)) {
+            std::cerr << "Dropped a client that sent no job\n";
+            continue;
+        }
+
+        Options job = options;
+        job.serveSocket.clear();
+        auto start = std::chrono::steady_clock::now();
+        int result = 1;
+        // The job's messages go to the client as well as to the log
+        std::ostringstream log;
+        std::streambuf* stderrBuf = std::cerr.rdbuf(log.rdbuf());
+        if (!ParseOptions(SplitArguments(line), &job, &error))
+            std::cerr << error << "\n";
+        else if (job.launch > 0 || !job.batchFile.empty() || !job.serveSocket.empty() ||
+            !job.connectSocket.empty() || job.help || job.listScenes)
+            std::cerr << "--launch, --batch, --serve, --connect, --help and --list are not server jobs\n";
+        else if (job.bench && job.benchFile.empty())
+            std::cerr << "--bench on the server needs --bench-out\n";
+        else if (!ChangeDirectory(dir))
+            std::cerr << "cannot change to directory '" << dir << "'\n";
+        else {
+            result = RunJob(job, &cache);
+            if (result == 0 && !job.bench && !job.merge) {
+                double seconds = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+                std::cerr << "Job done in " << seconds << "s; scene "
+                    << (cache.LastBuilt() ? "built in " + std::to_string(cache.LastBuildSeconds()) + "s"
+                        : std::string("resident")) << " (" << cache.Scenes() << " resident)\n";
+            }
+        }
+        std::cerr.rdbuf(stderrBuf);
+        ChangeDirectory(home);
+
+        std::cerr << "Job " << nJobs << " (" << dir << "): " << line << "\n" << log.str();
+        std::istringstream lines(log.str());
+        std::string text;
+        bool connected = true;
+        while (connected && std::getline(lines, text))
+            connected = client.WriteLine("log " + text);
+        if (connected)
+            client.WriteLine(result == 0 ? "ok" : "error");
+    }
+}
+
+// Sends the job _args_ to the render server on _socketPath_ and relays its
+// messages; the result is the job's
+int SubmitJob(const std::string& socketPath, const std::vector<std::string>& args) {
+    LocalSocket server;
+    std::string error;
+    if (!server.Connect(socketPath, &error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    std::string line;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--connect") {
+            ++i;
+            continue;
+        }
+        line += (line.empty() ? "\"" : " \"") + args[i] + "\"";
+    }
+    if (!server.WriteLine(CurrentDirectory()) || !server.WriteLine(line)) {
+        std::cerr << "cannot send the job to '" << socketPath << "'\n";
+        return 1;
+    }
+    std::string reply;
+    while (server.ReadLine(&reply)) {
+        if (reply.compare(0, 4, "log ") == 0)
+            std::cerr << reply.substr(4) << "\n";
+        else
+            return reply == "ok" ? 0 : 1;
+    }
+    std::cerr << "the server closed the connection\n";
+    return 1;
+}
+
+int main(int argc, char* argv[]) {
+
+    Options options;
+    std::string error;
+    if (!ParseOptions(std::vector<std::string>(argv + 1, argv + argc), &options, &error)) {
+        std::cerr << argv[0] << ": " << error << "\n";
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if (options.help) {
+        PrintUsage(argv[0]);
+        return 0;
+    }
+    if (options.listScenes) {
+        for (const SceneEntry& entry : SceneRegistry())
+            std::cout << entry.name << "\n";
+        return 0;
+    }
+    // Clients leave the setup to the server
+    if (!options.connectSocket.empty())
+        return SubmitJob(options.connectSocket, std::vector<std::string>(argv + 1, argv + argc));
+    SampledSpectrum::Init();
+    if (!options.serveSocket.empty())
+        return RunServer(options);
+    if (options.launch > 0)
+        return LaunchWorkers(argv[0], std::vector<std::string>(argv + 1, argv + argc), options);
+    if (options.batchFile.empty())
+        return RunJob(options);
+
+    // Batch mode: each line of the job list is parsed on top of the
+    // command-line options and rendered in turn; failures are reported
+    // and counted but don't stop the remaining jobs.
+    std::ifstream jobs(options.batchFile);
+    if (!jobs) {
+        std::cerr << "Cannot open job list '" << options.batchFile << "'\n";
+        return 1;
+    }
+    int lineNo = 0, nJobs = 0, nFailed = 0;
+    std::string line;
+    while (std::getline(jobs, line)) {
+        ++lineNo;
+        std::vector<std::string> args = SplitArguments(line);
+        if (args.empty())
+            continue;
+        Options job = options;
+        job.batchFile.clear();
+        ++nJobs;
+        if (!ParseOptions(args, &job, &error)) {
+            std::cerr << options.batchFile << ":" << lineNo << ": " << error << "\n";
+            ++nFailed;
+            continue;
+        }
+        if (job.launch > 0) {
+            std::cerr << options.batchFile << ":" << lineNo << ": --launch in a job list\n";
+            ++nFailed;
+            continue;
+        }
+        if (!job.quiet)
+            std::cerr << "Job " << nJobs << " (line " << lineNo << ")\n";
+        if (RunJob(job) != 0)
+            ++nFailed;
+    }
+    std::cerr << nJobs - nFailed << "/" << nJobs << " jobs succeeded\n";
+    return nFailed == 0 ? 0 : 1;
+}
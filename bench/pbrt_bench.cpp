@@ -0,0 +1,835 @@
+// pbrt_bench: micro-benchmarks for the hot geometry, acceleration, noise,
+// volume, denoising, spectrum and threading kernels. Every input is synthetic (fixed
+// seed), so the target builds without OpenCV or Assimp and runs are
+// comparable across machines and commits. Results are written as JSON.
+//
+// Usage: pbrt_bench [--reps N] [--warmup N] [--prims N] [--rays N]
+//                   [--threads N] [--seed N] [--out file.json]
+
+#include "rtweekend.h"
+#include "vec3.h"
+#include "ray.h"
+#include "aabb.h"
+#include "transform.h"
+#include "shape.h"
+#include "sphere.h"
+#include "triangle.h"
+#include "primitive.h"
+#include "bvh.h"
+#include "hittable_list.h"
+#include "spectrum.h"
+#include "parallel.h"
+#include "perlin.h"
+#include "medium.h"
+#include "denoise.h"
+#include "raysort.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Benchmark Options
+struct BenchOptions {
+    int reps = 15;
+    int warmup = 3;
+    int nPrims = 100000;
+    int nRays = 100000;
+    int nThreads = 0;
+    unsigned int seed = 7;
+    std::string outFile;
+};
+
+// Benchmark Result
+struct BenchResult {
+    std::string name;
+    std::string unit;
+    int64_t opsPerRep;
+    std::vector<double> nsPerOp;
+    double counter = 0;  // kernel-specific check value (hits, sum, ...)
+};
+
+// Sink that keeps the optimizer from discarding benchmarked work.
+static volatile double benchSink = 0;
+
+template <typename Func>
+static BenchResult RunBench(const BenchOptions& opt, const std::string& name,
+    int64_t opsPerRep, Func&& body,
+    const std::string& unit = "ns/op") {
+    BenchResult result;
+    result.name = name;
+    result.unit = unit;
+    result.opsPerRep = opsPerRep;
+    for (int i = 0; i < opt.warmup; ++i) benchSink = benchSink + body();
+    for (int i = 0; i < opt.reps; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        double c = body();
+        auto end = std::chrono::steady_clock::now();
+        double ns =
+            std::chrono::duration<double, std::nano>(end - start).count();
+        result.nsPerOp.push_back(ns / double(opsPerRep));
+        result.counter = c;
+        benchSink = benchSink + c;
+    }
+    std::fprintf(stderr, "%-36s %12.3f %s\n", name.c_str(),
+        [&] {
+            std::vector<double> v = result.nsPerOp;
+            std::sort(v.begin(), v.end());
+            return v[v.size() / 2];
+        }(),
+        unit.c_str());
+    return result;
+}
+
+// Statistics
+struct BenchStats {
+    double median, mean, stddev, min, max, mad;
+};
+
+static BenchStats ComputeStats(std::vector<double> v) {
+    BenchStats s;
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    s.min = v.front();
+    s.max = v.back();
+    s.median = (n % 2) ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+    s.mean = std::accumulate(v.begin(), v.end(), 0.0) / n;
+    double var = 0;
+    for (double x : v) var += (x - s.mean) * (x - s.mean);
+    s.stddev = n > 1 ? std::sqrt(var / (n - 1)) : 0;
+    // Median absolute deviation is robust to the occasional preempted rep.
+    std::vector<double> dev(n);
+    for (size_t i = 0; i < n; ++i) dev[i] = std::abs(v[i] - s.median);
+    std::sort(dev.begin(), dev.end());
+    s.mad = (n % 2) ? dev[n / 2] : 0.5 * (dev[n / 2 - 1] + dev[n / 2]);
+    return s;
+}
+
+static std::string JsonEscape(const std::string& s) {
+    std::string r;
+    for (char c : s) {
+        if (c == '"' || c == '\\') r += '\\';
+        r += c;
+    }
+    return r;
+}
+
+static void WriteJson(std::ostream& os, const BenchOptions& opt,
+    const std::vector<BenchResult>& results) {
+    os << "{\n";
+    os << "  \"benchmark\": \"pbrt_bench\",\n";
+    os << "  \"config\": {\"reps\": " << opt.reps
+        << ", \"warmup\": " << opt.warmup << ", \"prims\": " << opt.nPrims
+        << ", \"rays\": " << opt.nRays << ", \"threads\": " << MaxThreadIndex()
+        << ", \"seed\": " << opt.seed
+        << ", \"float_bytes\": " << sizeof(Float) << "},\n";
+    os << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        BenchStats s = ComputeStats(r.nsPerOp);
+        char buf[512];
+        std::snprintf(buf, sizeof(buf),
+            "\"median\": %.6g, \"mean\": %.6g, \"stddev\": %.6g, "
+            "\"mad\": %.6g, \"min\": %.6g, \"max\": %.6g",
+            s.median, s.mean, s.stddev, s.mad, s.min, s.max);
+        os << "    {\"name\": \"" << JsonEscape(r.name) << "\", \"unit\": \""
+            << JsonEscape(r.unit) << "\", \"ops_per_rep\": " << r.opsPerRep
+            << ", \"reps\": " << r.nsPerOp.size() << ", " << buf
+            << ", \"median_rep_ms\": " << s.median * r.opsPerRep * 1e-6
+            << ", \"counter\": " << r.counter << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+}
+
+// Synthetic Scene Generation
+class BenchRNG {
+public:
+    explicit BenchRNG(unsigned int seed) : gen(seed), dist(0.f, 1.f) {}
+    Float Uniform() { return dist(gen); }
+    Float Uniform(Float a, Float b) { return a + (b - a) * Uniform(); }
+    Point3f InBox(Float extent) {
+        return Point3f(Uniform(-extent, extent), Uniform(-extent, extent),
+            Uniform(-extent, extent));
+    }
+    Vector3f Direction() {
+        Float z = 1 - 2 * Uniform();
+        Float r = std::sqrt(std::max((Float)0, 1 - z * z));
+        Float phi = 2 * Pi * Uniform();
+        return Vector3f(r * std::cos(phi), r * std::sin(phi), z);
+    }
+
+private:
+    std::mt19937 gen;
+    std::uniform_real_distribution<Float> dist;
+};
+
+// Triangle soup with _n_ small triangles scattered through [-1,1]^3.
+static std::vector<std::shared_ptr<Shape>> MakeTriangleSoup(int n, BenchRNG& rng) {
+    std::vector<Point3f> P(3 * n);
+    std::vector<int> indices(3 * n);
+    for (int i = 0; i < n; ++i) {
+        Point3f c = rng.InBox(1);
+        for (int j = 0; j < 3; ++j) {
+            P[3 * i + j] = c + 0.02f * rng.Direction();
+            indices[3 * i + j] = 3 * i + j;
+        }
+    }
+    auto identity = std::make_shared<Transform>();
+    return CreateTriangleMesh(identity, identity, false, n, indices.data(),
+        3 * n, P.data(), nullptr, nullptr, nullptr, nullptr);
+}
+
+// Rays starting outside each target's bounds and aimed at a jittered point
+// inside them, so that the kernels see a mix of hits and misses.
+template <typename BoundsFunc>
+static std::vector<Ray> MakeTargetedRays(int nRays, int nTargets,
+    BoundsFunc bounds, BenchRNG& rng) {
+    std::vector<Ray> rays;
+    rays.reserve(nRays);
+    for (int i = 0; i < nRays; ++i) {
+        Bounds3f b = bounds(i % nTargets);
+        Point3f c = 0.5f * b.pMin + 0.5f * b.pMax;
+        Vector3f diag = b.pMax - b.pMin;
+        Point3f target = c + Vector3f(diag.x * rng.Uniform(-1, 1),
+            diag.y * rng.Uniform(-1, 1),
+            diag.z * rng.Uniform(-1, 1));
+        Point3f o = c + 4 * rng.Direction();
+        rays.push_back(Ray(o, unit_vector(target - o), 0, 0, Infinity));
+    }
+    return rays;
+}
+
+static std::vector<Ray> MakeSceneRays(int nRays, BenchRNG& rng) {
+    std::vector<Ray> rays;
+    rays.reserve(nRays);
+    for (int i = 0; i < nRays; ++i)
+        rays.push_back(Ray(rng.InBox(1.2f), rng.Direction(), 0, 0, Infinity));
+    return rays;
+}
+
+// Kernel Benchmarks
+static void BenchBounds(const BenchOptions& opt, BenchRNG& rng,
+    std::vector<BenchResult>& results) {
+    const int nBoxes = 1024;
+    std::vector<aabb> boxes;
+    for (int i = 0; i < nBoxes; ++i) {
+        Point3f a = rng.InBox(1), b = a + 0.2f * rng.Direction();
+        boxes.push_back(Union(aabb(a), b));
+    }
+    std::vector<Ray> rays = MakeTargetedRays(
+        opt.nRays, nBoxes, [&](int i) { return boxes[i]; }, rng);
+    std::vector<Vector3f> invDir(rays.size());
+    std::vector<int> dirIsNeg(3 * rays.size());
+    for (size_t i = 0; i < rays.size(); ++i) {
+        const Vector3f& d = rays[i].d;
+        invDir[i] = Vector3f(1 / d.x, 1 / d.y, 1 / d.z);
+        for (int a = 0; a < 3; ++a) dirIsNeg[3 * i + a] = invDir[i][a] < 0;
+    }
+    int64_t n = rays.size();
+
+    results.push_back(RunBench(opt, "aabb::hit", n, [&] {
+        double hits = 0;
+        for (int64_t i = 0; i < n; ++i)
+            hits += boxes[i % nBoxes].hit(rays[i], 0, Infinity);
+        return hits;
+    }));
+    results.push_back(RunBench(opt, "aabb::IntersectP", n, [&] {
+        double hits = 0;
+        for (int64_t i = 0; i < n; ++i) {
+            Float t0, t1;
+            hits += boxes[i % nBoxes].IntersectP(rays[i], &t0, &t1);
+        }
+        return hits;
+    }));
+    results.push_back(RunBench(opt, "aabb::IntersectP(invDir)", n, [&] {
+        double hits = 0;
+        for (int64_t i = 0; i < n; ++i)
+            hits += boxes[i % nBoxes].IntersectP(rays[i], invDir[i], &dirIsNeg[3 * i]);
+        return hits;
+    }));
+}
+
+static void BenchTriangles(const BenchOptions& opt, BenchRNG& rng,
+    std::vector<BenchResult>& results) {
+    const int nTris = 4096;
+    std::vector<std::shared_ptr<Shape>> tris = MakeTriangleSoup(nTris, rng);
+    std::vector<Ray> rays = MakeTargetedRays(
+        opt.nRays, nTris, [&](int i) { return tris[i]->WorldBound(); }, rng);
+    int64_t n = rays.size();
+
+    results.push_back(RunBench(opt, "Triangle::Intersect", n, [&] {
+        double hits = 0;
+        for (int64_t i = 0; i < n; ++i) {
+            Ray r = rays[i];
+            Float tHit;
+            SurfaceInteraction isect;
+            hits += tris[i % nTris]->Intersect(r, &tHit, &isect, false);
+        }
+        return hits;
+    }));
+    results.push_back(RunBench(opt, "Triangle::IntersectP", n, [&] {
+        double hits = 0;
+        for (int64_t i = 0; i < n; ++i)
+            hits += tris[i % nTris]->IntersectP(rays[i], false);
+        return hits;
+    }));
+}
+
+static void BenchSpheres(const BenchOptions& opt, BenchRNG& rng,
+    std::vector<BenchResult>& results) {
+    const int nSpheres = 256;
+    std::vector<std::shared_ptr<Shape>> spheres;
+    for (int i = 0; i < nSpheres; ++i) {
+        auto o2w = std::make_shared<Transform>(Translate(Vector3f(rng.InBox(1))));
+        auto w2o = std::make_shared<Transform>(Inverse(*o2w));
+        spheres.push_back(
+            std::make_shared<Sphere>(o2w, w2o, rng.Uniform(0.05f, 0.2f)));
+    }
+    std::vector<Ray> rays = MakeTargetedRays(
+        opt.nRays, nSpheres, [&](int i) { return spheres[i]->WorldBound(); },
+        rng);
+    int64_t n = rays.size();
+
+    results.push_back(RunBench(opt, "Sphere::Intersect", n, [&] {
+        double hits = 0;
+        for (int64_t i = 0; i < n; ++i) {
+            Ray r = rays[i];
+            Float tHit;
+            SurfaceInteraction isect;
+            hits += spheres[i % nSpheres]->Intersect(r, &tHit, &isect, false);
+        }
+        return hits;
+    }));
+    results.push_back(RunBench(opt, "Sphere::IntersectP", n, [&] {
+        double hits = 0;
+        for (int64_t i = 0; i < n; ++i)
+            hits += spheres[i % nSpheres]->IntersectP(rays[i], false);
+        return hits;
+    }));
+}
+
+// Sphere quadratic solvers (see SphereQuadratic() in sphere.h), each run
+// on the same object-space rays. Timing uses rays aimed at the spheres;
+// robustness uses rays spawned from sampled points on spheres placed far
+// from the origin, where the error bounds decide the outcome. Counters:
+//   .self   rays leaving the surface outward that hit their own sphere
+//   .miss   rays leaving the surface inward that miss the far side
+//   .bound  roots whose interval excludes the long double root
+struct SphereSolver {
+    const char* name;
+    bool (*solve)(const Ray&, const Vector3f&, const Vector3f&, Float,
+        EFloat*, EFloat*);
+};
+
+struct SphereRay {
+    Ray ray;  // object space
+    Vector3f oErr, dErr;
+    Float radius;
+    bool inward;
+};
+
+// pbrt's OffsetRayOrigin(): move _p_ off the surface past its error box
+static Point3f OffsetOrigin(const Point3f& p, const Vector3f& pError,
+    const Normal3f& n, const Vector3f& w) {
+    Float d = Dot(Abs(Vector3f(n)), pError);
+    Vector3f offset = d * Vector3f(n);
+    if (Dot(w, Vector3f(n)) < 0) offset = -offset;
+    Point3f po = p + offset;
+    for (int i = 0; i < 3; ++i) {
+        if (offset[i] > 0) po[i] = NextFloatUp(po[i]);
+        else if (offset[i] < 0) po[i] = NextFloatDown(po[i]);
+    }
+    return po;
+}
+
+// The hit test of Sphere::Intersect() for an unclipped sphere
+static bool SphereHit(const EFloat& t0, const EFloat& t1, Float tMax) {
+    if (t0.UpperBound() > tMax || t1.LowerBound() <= 0) return false;
+    if (t0.LowerBound() <= 0 && t1.UpperBound() > tMax) return false;
+    return true;
+}
+
+static void BenchSphereSolvers(const BenchOptions& opt, BenchRNG& rng,
+    std::vector<BenchResult>& results) {
+    const SphereSolver solvers[] = {
+        { "efloat", SphereQuadraticEFloat },
+        { "float", SphereQuadraticFast<float> },
+        { "double", SphereQuadraticFast<double> },
+    };
+
+    // Timing: rays aimed at unit-scale spheres near the origin
+    const int nSpheres = 256;
+    std::vector<std::shared_ptr<Transform>> w2o;
+    std::vector<Float> radii;
+    for (int i = 0; i < nSpheres; ++i) {
+        w2o.push_back(std::make_shared<Transform>(
+            Translate(-Vector3f(rng.InBox(1)))));
+        radii.push_back(rng.Uniform(0.05f, 0.2f));
+    }
+    std::vector<Ray> worldRays = MakeTargetedRays(
+        opt.nRays, nSpheres,
+        [&](int i) {
+            Point3f c = Inverse(*w2o[i])(Point3f(0, 0, 0));
+            Vector3f r(radii[i], radii[i], radii[i]);
+            return Bounds3f(c - r, c + r);
+        },
+        rng);
+    std::vector<SphereRay> timed(worldRays.size());
+    for (size_t i = 0; i < worldRays.size(); ++i) {
+        SphereRay& sr = timed[i];
+        sr.ray = (*w2o[i % nSpheres])(worldRays[i], &sr.oErr, &sr.dErr);
+        sr.radius = radii[i % nSpheres];
+    }
+    int64_t n = timed.size();
+    for (const SphereSolver& s : solvers)
+        results.push_back(RunBench(opt, std::string("SphereQuadratic.") + s.name, n, [&] {
+            double hits = 0;
+            for (int64_t i = 0; i < n; ++i) {
+                const SphereRay& sr = timed[i];
+                EFloat t0, t1;
+                if (s.solve(sr.ray, sr.oErr, sr.dErr, sr.radius, &t0, &t1))
+                    hits += SphereHit(t0, t1, sr.ray.tMax);
+            }
+            return hits;
+        }));
+
+    // Robustness: spawned rays off spheres with radii over four orders of
+    // magnitude, up to 1000 units from the origin
+    std::vector<SphereRay> spawned;
+    spawned.reserve(opt.nRays);
+    std::vector<std::shared_ptr<Sphere>> shapes;
+    std::vector<std::shared_ptr<Transform>> toObject;
+    radii.clear();
+    for (int i = 0; i < nSpheres; ++i) {
+        Float radius = std::pow(10.f, rng.Uniform(-2, 2));
+        radii.push_back(radius);
+        auto o2w = std::make_shared<Transform>(
+            Translate(Vector3f(rng.InBox(1000))) *
+            Rotate(rng.Uniform(0, 360), rng.Direction()));
+        auto inv = std::make_shared<Transform>(Inverse(*o2w));
+        shapes.push_back(std::make_shared<Sphere>(o2w, inv, radius));
+        toObject.push_back(inv);
+    }
+    for (int i = 0; i < opt.nRays; ++i) {
+        int k = i % nSpheres;
+        Float pdf;
+        Interaction it = shapes[k]->Sample(
+            Point2f(rng.Uniform(), rng.Uniform()), &pdf);
+        Vector3f w = rng.Direction();
+        SphereRay sr;
+        sr.inward = Dot(w, Vector3f(it.n)) < 0;
+        Ray r(OffsetOrigin(it.p, it.pError, it.n, w), w, 0, 0, Infinity);
+        sr.ray = (*toObject[k])(r, &sr.oErr, &sr.dErr);
+        sr.radius = radii[k];
+        spawned.push_back(sr);
+    }
+    for (const SphereSolver& s : solvers) {
+        int64_t self = 0, miss = 0, bound = 0;
+        for (const SphereRay& sr : spawned) {
+            EFloat t0, t1;
+            bool hit = s.solve(sr.ray, sr.oErr, sr.dErr, sr.radius, &t0, &t1) &&
+                SphereHit(t0, t1, sr.ray.tMax);
+            if (hit && !sr.inward) ++self;
+            if (!hit && sr.inward) ++miss;
+
+            // Reference roots of the same object-space ray
+            typedef long double LD;
+            LD ox = sr.ray.o.x, oy = sr.ray.o.y, oz = sr.ray.o.z;
+            LD dx = sr.ray.d.x, dy = sr.ray.d.y, dz = sr.ray.d.z;
+            LD a = dx * dx + dy * dy + dz * dz;
+            LD bh = dx * ox + dy * oy + dz * oz;
+            LD c = ox * ox + oy * oy + oz * oz - (LD)sr.radius * sr.radius;
+            LD disc = bh * bh - a * c;
+            if (disc < 0 || !s.solve(sr.ray, sr.oErr, sr.dErr, sr.radius, &t0, &t1))
+                continue;
+            LD root = std::sqrt(disc);
+            LD r0 = (-bh - root) / a, r1 = (-bh + root) / a;
+            if (r0 < t0.LowerBound() || r0 > t0.UpperBound()) ++bound;
+            if (r1 < t1.LowerBound() || r1 > t1.UpperBound()) ++bound;
+        }
+        std::fprintf(stderr, "%-36s self %lld  miss %lld  bound %lld of %d\n",
+            (std::string("SphereRobustness.") + s.name).c_str(),
+            (long long)self, (long long)miss, (long long)bound, opt.nRays);
+        const char* kinds[] = { "self", "miss", "bound" };
+        int64_t counts[] = { self, miss, bound };
+        for (int j = 0; j < 3; ++j) {
+            BenchResult r;
+            r.name = std::string("SphereRobustness.") + s.name + "." + kinds[j];
+            r.unit = "count";
+            r.opsPerRep = opt.nRays;
+            r.nsPerOp.push_back(0);
+            r.counter = (double)counts[j];
+            results.push_back(r);
+        }
+    }
+}
+
+static void BenchBVH(const BenchOptions& opt, BenchRNG& rng,
+    std::vector<BenchResult>& results) {
+    std::vector<std::shared_ptr<Shape>> tris =
+        MakeTriangleSoup(opt.nPrims, rng);
+    std::vector<std::shared_ptr<Primitive>> prims;
+    prims.reserve(tris.size());
+    for (const auto& t : tris)
+        prims.push_back(std::make_shared<GeometricPrimitive>(t));
+    std::vector<Ray> rays = MakeSceneRays(opt.nRays, rng);
+    int64_t n = rays.size();
+
+    const struct {
+        const char* name;
+        BVHAccel::SplitMethod method;
+    } methods[] = {
+        { "SAH", BVHAccel::SplitMethod::SAH },
+        { "HLBVH", BVHAccel::SplitMethod::HLBVH },
+    };
+    for (const auto& m : methods) {
+        std::string tag = std::string("BVHAccel[") + m.name + "]";
+        results.push_back(RunBench(opt, tag + "::build", prims.size(), [&] {
+            BVHAccel bvh(prims, 4, m.method);
+            return double(bvh.WorldBound().SurfaceArea());
+        }, "ns/prim"));
+
+        BVHAccel bvh(prims, 4, m.method);
+        results.push_back(RunBench(opt, tag + "::Intersect", n, [&] {
+            double hits = 0;
+            for (int64_t i = 0; i < n; ++i) {
+                Ray r = rays[i];
+                SurfaceInteraction isect;
+                hits += bvh.Intersect(r, &isect);
+            }
+            return hits;
+        }));
+        results.push_back(RunBench(opt, tag + "::IntersectP", n, [&] {
+            double hits = 0;
+            for (int64_t i = 0; i < n; ++i) hits += bvh.IntersectP(rays[i]);
+            return hits;
+        }));
+    }
+}
+
+// The hittable-API BVH (bvh_node) over small spheres, as in the legacy
+// scenes' sphere clusters. The rays start anywhere and go anywhere, like
+// secondary rays; "sorted" traces them in SortRays() order.
+static void BenchHittableBVH(const BenchOptions& opt, BenchRNG& rng,
+    std::vector<BenchResult>& results) {
+    hittable_list spheres;
+    for (int i = 0; i < opt.nPrims; ++i)
+        spheres.add(std::make_shared<sphere>(rng.InBox(1), 0.01f, nullptr));
+    std::vector<Ray> rays = MakeSceneRays(opt.nRays, rng);
+    int64_t n = rays.size();
+
+    results.push_back(RunBench(opt, "bvh_node::build", spheres.objects.size(), [&] {
+        bvh_node bvh(spheres, 0, 1);
+        return double(bvh.NodeCount());
+    }, "ns/prim"));
+    bvh_node bvh(spheres, 0, 1);
+    results.push_back(RunBench(opt, "bvh_node::hit", n, [&] {
+        double hits = 0;
+        for (int64_t i = 0; i < n; ++i) {
+            hit_record rec;
+            hits += bvh.hit(rays[i], 0.001f, Infinity, rec);
+        }
+        return hits;
+    }));
+
+    std::vector<point3> origins(n);
+    std::vector<vec3> directions(n);
+    for (int64_t i = 0; i < n; ++i) {
+        origins[i] = rays[i].o;
+        directions[i] = rays[i].d;
+    }
+    aabb bounds;
+    bvh.bounding_box(0, 1, bounds);
+    std::vector<uint32_t> order;
+    results.push_back(RunBench(opt, "SortRays", n, [&] {
+        SortRays(origins.data(), directions.data(), n, bounds, &order);
+        return double(order[0]);
+    }, "ns/ray"));
+    results.push_back(RunBench(opt, "bvh_node::hit (sorted)", n, [&] {
+        double hits = 0;
+        for (int64_t i = 0; i < n; ++i) {
+            hit_record rec;
+            hits += bvh.hit(rays[order[i]], 0.001f, Infinity, rec);
+        }
+        return hits;
+    }));
+}
+
+static void BenchAnimatedTransform(const BenchOptions& opt, BenchRNG& rng,
+    std::vector<BenchResult>& results) {
+    // Instances that translate, rotate and (every other one) change scale
+    // over the shutter interval; one ray time per ray
+    const int nInstances = 64;
+    std::vector<Transform> ends(2 * nInstances);
+    std::vector<std::unique_ptr<AnimatedTransform>> instances;
+    for (int i = 0; i < nInstances; ++i) {
+        Transform base = Translate(Vector3f(rng.InBox(10))) *
+            Rotate(rng.Uniform(0, 360), rng.Direction());
+        ends[2 * i] = base;
+        ends[2 * i + 1] = Translate(Vector3f(rng.InBox(1))) * base *
+            Rotate(rng.Uniform(0, 90), rng.Direction()) *
+            (i % 2 ? Scale(1.5f, 1, 1) : Transform());
+        instances.push_back(std::unique_ptr<AnimatedTransform>(
+            new AnimatedTransform(&ends[2 * i], 0, &ends[2 * i + 1], 1)));
+    }
+    std::vector<Float> times(opt.nRays);
+    for (Float& t : times) t = rng.Uniform();
+    int64_t n = times.size();
+
+    results.push_back(RunBench(opt, "AnimatedTransform::Interpolate", n, [&] {
+        double sum = 0;
+        Transform t;
+        for (int64_t i = 0; i < n; ++i) {
+            instances[i % nInstances]->Interpolate(times[i], &t);
+            sum += t.GetMatrix().m[0][3];
+        }
+        return sum;
+    }));
+    // Packets of rays hitting the same instance, interpolated lane-wise
+    const int packetSize = 32;
+    std::vector<Float> m(12 * packetSize), mInv(12 * packetSize);
+    results.push_back(
+        RunBench(opt, "AnimatedTransform::Interpolate(packet)", n, [&] {
+            double sum = 0;
+            for (int64_t i = 0; i < n; i += packetSize) {
+                int count = (int)std::min<int64_t>(packetSize, n - i);
+                instances[(i / packetSize) % nInstances]->Interpolate(
+                    count, &times[i], m.data(), mInv.data());
+                for (int k = 0; k < count; ++k) sum += m[3 * count + k];
+            }
+            return sum;
+        }));
+}
+
+static void BenchPerlin(const BenchOptions& opt, BenchRNG& rng,
+    std::vector<BenchResult>& results) {
+    perlin noise;
+    std::vector<Point3f> points(opt.nRays);
+    for (Point3f& p : points) p = rng.InBox(50);
+    int64_t n = points.size();
+
+    results.push_back(RunBench(opt, "perlin::noise", n, [&] {
+        double sum = 0;
+        for (int64_t i = 0; i < n; ++i) sum += noise.noise(points[i]);
+        return sum;
+    }));
+    std::vector<Float> values(n);
+    results.push_back(RunBench(opt, "perlin::noise(batch)", n, [&] {
+        noise.noise((int)n, points.data(), values.data());
+        return std::accumulate(values.begin(), values.end(), 0.0);
+    }));
+    results.push_back(RunBench(opt, "perlin::turb", n, [&] {
+        double sum = 0;
+        for (int64_t i = 0; i < n; ++i) sum += noise.turb(points[i]);
+        return sum;
+    }));
+}
+
+// Smoke-like volume: soft puffs in a random eighth of the 32^3-sample
+// blocks of a 256^3 grid that is otherwise empty, traced with rays
+// crossing the whole volume
+static void BenchGridMedium(const BenchOptions& opt, BenchRNG& rng,
+    std::vector<BenchResult>& results) {
+    const int n = 256, block = 32, nBlocks = n / block;
+    std::vector<char> puff(nBlocks * nBlocks * nBlocks);
+    for (char& p : puff) p = rng.Uniform() < 0.125f;
+    auto density = [&](int x, int y, int z) {
+        int bx = x / block, by = y / block, bz = z / block;
+        if (!puff[(bz * nBlocks + by) * nBlocks + bx]) return (Float)0;
+        Float dx = x - (bx * block + block / 2), dy = y - (by * block + block / 2),
+            dz = z - (bz * block + block / 2);
+        Float r2 = (dx * dx + dy * dy + dz * dz) / (0.16f * block * block);
+        return std::max((Float)0, 1 - r2);
+    };
+    std::shared_ptr<const SparseGrid> grid;
+    results.push_back(RunBench(opt, "SparseGrid build (256^3)", 1, [&] {
+        grid = std::make_shared<const SparseGrid>(n, n, n, density);
+        return (double)grid->MemoryBytes();
+    }, "ns/grid"));
+
+    GridDensityMedium medium(4, Bounds3f(Point3f(-1, -1, -1), Point3f(1, 1, 1)), grid);
+    std::vector<Ray> rays = MakeSceneRays(opt.nRays, rng);
+    int64_t nRays = rays.size();
+    results.push_back(RunBench(opt, "GridDensityMedium::Tr", nRays, [&] {
+        double sum = 0;
+        for (const Ray& r : rays) sum += medium.Tr(r, 0, 4);
+        return sum;
+    }));
+    results.push_back(RunBench(opt, "GridDensityMedium::SampleDistance", nRays, [&] {
+        double hits = 0;
+        Float t;
+        for (const Ray& r : rays) hits += medium.SampleDistance(r, 0, 4, &t);
+        return hits;
+    }));
+}
+
+// 512x512 film of flat-shaded rectangles at 8 spp: radiance with
+// per-channel noise around each rectangle's color, and noise-free AOVs
+static void BenchDenoise(const BenchOptions& opt, BenchRNG& rng,
+    std::vector<BenchResult>& results) {
+    const int n = 512, nRects = 64, spp = 8;
+    Film film(n, n, true);
+    std::vector<color> rectColor(nRects);
+    for (color& c : rectColor) c = color(rng.Uniform(), rng.Uniform(), rng.Uniform());
+    for (int y = 0; y < n; ++y)
+        for (int x = 0; x < n; ++x) {
+            size_t i = film.Index(x, y);
+            int rect = (y / 64) * 8 + x / 64;
+            const color& c = rectColor[rect];
+            Float noise = 0.5f;
+            film.rgb[i] = color(c.x * (1 + noise * (rng.Uniform() - .5f)),
+                c.y * (1 + noise * (rng.Uniform() - .5f)),
+                c.z * (1 + noise * (rng.Uniform() - .5f)));
+            film.variance[i] = c * c * (noise * noise / 12 / spp);
+            film.albedo[i] = c;
+            film.normal[i] = vec3(0, 0, 1);
+            film.depth[i] = 1 + rect % 3;
+            film.objectId[i] = rect + 1;
+        }
+    std::vector<color> out;
+    results.push_back(RunBench(opt, "Denoise (512x512)", int64_t(n) * n, [&] {
+        Denoise(film, DenoiseOptions(), &out);
+        return (double)out[n * n / 2].x;
+    }, "ns/pixel"));
+}
+
+static void BenchSpectrum(const BenchOptions& opt, BenchRNG& rng,
+    std::vector<BenchResult>& results) {
+    const int nSpectra = 1024;
+    std::vector<Float> rgb(3 * nSpectra);
+    for (Float& v : rgb) v = rng.Uniform();
+    std::vector<SampledSpectrum> spectra;
+    for (int i = 0; i < nSpectra; ++i)
+        spectra.push_back(SampledSpectrum::FromRGB(&rgb[3 * i]));
+    const int64_t nOps = 1 << 16;
+
+    results.push_back(RunBench(opt, "CoefficientSpectrum::madd", nOps, [&] {
+        CoefficientSpectrum<nSpectralSamples> acc(0.f);
+        for (int64_t i = 0; i < nOps; ++i) {
+            const SampledSpectrum& a = spectra[i % nSpectra];
+            const SampledSpectrum& b = spectra[(i * 7 + 3) % nSpectra];
+            acc = 0.5f * acc + a * b;
+        }
+        return double(acc[0]);
+    }));
+    results.push_back(RunBench(opt, "CoefficientSpectrum::div", nOps, [&] {
+        CoefficientSpectrum<nSpectralSamples> acc(1.f);
+        for (int64_t i = 0; i < nOps; ++i) {
+            acc += spectra[i % nSpectra];
+            acc /= 2.f;
+        }
+        return double(acc[0]);
+    }));
+    results.push_back(RunBench(opt, "SampledSpectrum::FromRGB", nOps, [&] {
+        double sum = 0;
+        for (int64_t i = 0; i < nOps; ++i)
+            sum += SampledSpectrum::FromRGB(&rgb[3 * (i % nSpectra)])[0];
+        return sum;
+    }));
+    results.push_back(RunBench(opt, "SampledSpectrum::y", nOps, [&] {
+        double sum = 0;
+        for (int64_t i = 0; i < nOps; ++i) sum += spectra[i % nSpectra].y();
+        return sum;
+    }));
+}
+
+static void BenchParallelFor(const BenchOptions& opt,
+    std::vector<BenchResult>& results) {
+    const int64_t count = 1 << 16;
+    std::vector<Float> data(count, 1.f);
+
+    results.push_back(RunBench(opt, "serial loop", count, [&] {
+        for (int64_t i = 0; i < count; ++i) data[i] = data[i] * 0.5f + 0.5f;
+        return double(data[0]);
+    }));
+    for (int chunk : {1, 64, 4096}) {
+        std::string name = "ParallelFor[chunk=" + std::to_string(chunk) + "]";
+        results.push_back(RunBench(opt, name, count, [&] {
+            ParallelFor([&](int64_t i) { data[i] = data[i] * 0.5f + 0.5f; },
+                count, chunk);
+            return double(data[0]);
+        }));
+    }
+    // Cost of dispatching an empty loop, i.e. wakeup plus join.
+    results.push_back(RunBench(opt, "ParallelFor[dispatch]", 1, [&] {
+        ParallelFor([&](int64_t) {}, MaxThreadIndex(), 1);
+        return 0.0;
+    }, "ns/call"));
+}
+
+static void Usage(const char* msg = nullptr) {
+    if (msg) std::fprintf(stderr, "pbrt_bench: %s\n\n", msg);
+    std::fprintf(stderr,
+        "usage: pbrt_bench [--reps N] [--warmup N] [--prims N] "
+        "[--rays N] [--threads N] [--seed N] [--out file.json]\n");
+    std::exit(msg ? 1 : 0);
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions opt;
+    for (int i = 1; i < argc; ++i) {
+        auto next = [&]() -> const char* {
+            if (i + 1 == argc) Usage("missing value after option");
+            return argv[++i];
+        };
+        if (!std::strcmp(argv[i], "--reps"))
+            opt.reps = std::max(1, std::atoi(next()));
+        else if (!std::strcmp(argv[i], "--warmup"))
+            opt.warmup = std::max(0, std::atoi(next()));
+        else if (!std::strcmp(argv[i], "--prims"))
+            opt.nPrims = std::max(1, std::atoi(next()));
+        else if (!std::strcmp(argv[i], "--rays"))
+            opt.nRays = std::max(1, std::atoi(next()));
+        else if (!std::strcmp(argv[i], "--threads"))
+            opt.nThreads = std::max(0, std::atoi(next()));
+        else if (!std::strcmp(argv[i], "--seed"))
+            opt.seed = (unsigned int)std::atoi(next());
+        else if (!std::strcmp(argv[i], "--out"))
+            opt.outFile = next();
+        else if (!std::strcmp(argv[i], "--help") || !std::strcmp(argv[i], "-h"))
+            Usage();
+        else
+            Usage(("unknown option " + std::string(argv[i])).c_str());
+    }
+
+    SampledSpectrum::Init();
+    ParallelInit(opt.nThreads);
+
+    BenchRNG rng(opt.seed);
+    std::vector<BenchResult> results;
+    BenchBounds(opt, rng, results);
+    BenchTriangles(opt, rng, results);
+    BenchSpheres(opt, rng, results);
+    BenchSphereSolvers(opt, rng, results);
+    BenchBVH(opt, rng, results);
+    BenchHittableBVH(opt, rng, results);
+    BenchAnimatedTransform(opt, rng, results);
+    BenchPerlin(opt, rng, results);
+    BenchGridMedium(opt, rng, results);
+    BenchDenoise(opt, rng, results);
+    BenchSpectrum(opt, rng, results);
+    BenchParallelFor(opt, results);
+
+    ParallelCleanup();
+
+    if (opt.outFile.empty())
+        WriteJson(std::cout, opt, results);
+    else {
+        std::ofstream out(opt.outFile);
+        if (!out) {
+            std::fprintf(stderr, "pbrt_bench: cannot write %s\n", opt.outFile.c_str());
+            return 1;
+        }
+        WriteJson(out, opt, results);
+    }
+    return 0;
+}
@@ -6,9 +6,11 @@
 
 class aabb {
 public:
+    // Default bounds are empty (pMin > pMax) so that Union() with the
+    // first point or box yields exactly that point or box
     aabb() {
-        pMin = point3(-Infinity, -Infinity, -Infinity);
-        pMax = point3(Infinity, Infinity, Infinity);
+        pMin = point3(Infinity, Infinity, Infinity);
+        pMax = point3(-Infinity, -Infinity, -Infinity);
     }
     aabb(const point3& p):pMin(p),pMax(p){}
     aabb(const point3& p1, const point3& p2)  :pMin(std::min(p1.x, p2.x), std::min(p1.y, p2.y),std::min(p1.z, p2.z)),
@@ -96,9 +98,11 @@ public:
     /*Return relative position in box*/
     vec3 Offset(const point3& p) const
     {
-        return vec3((p.x - pMin.x) / (pMax.x - pMin.x),
-                    (p.y - pMin.y) / (pMax.y - pMin.y),
-                    (p.z - pMin.z) / (pMax.z - pMin.z));
+        vec3 o = p - pMin;
+        if (pMax.x > pMin.x) o.x /= pMax.x - pMin.x;
+        if (pMax.y > pMin.y) o.y /= pMax.y - pMin.y;
+        if (pMax.z > pMin.z) o.z /= pMax.z - pMin.z;
+        return o;
     }
     void BoundingSphere(point3& c, float& rad) const
     {
@@ -106,9 +110,9 @@ public:
         rad=Inside(c)?Distance(c,pMax):0.f;
     }
     /*Ƿray(0,tMax)Χ*/
-    bool aabb::IntersectP(const Ray& ray, Float* hitt0, Float* hitt1) const;
+    bool IntersectP(const Ray& ray, Float* hitt0, Float* hitt1) const;
     /*ͨԤǷrayΧ*/
-    bool aabb::IntersectP(const Ray& ray, const Vector3f& invDir, const int dirIsNeg[3]) const;
+    bool IntersectP(const Ray& ray, const Vector3f& invDir, const int dirIsNeg[3]) const;
 
 
     point3 pMin;
@@ -129,5 +133,63 @@ inline aabb Union(aabb box0, aabb box1) {
 
 
 using  Bounds3f = aabb;
+
+// DirectionCone bounds a set of directions by a central axis _w_ and the
+// cosine of the cone's spread; used for light normal bounds.
+struct DirectionCone {
+    DirectionCone() = default;
+    DirectionCone(const vec3& w, Float cosTheta)
+        : w(Normalize(w)), cosTheta(cosTheta) {}
+    explicit DirectionCone(const vec3& w) : DirectionCone(w, 1) {}
+
+    static DirectionCone EntireSphere() {
+        return DirectionCone(vec3(0, 0, 1), -1);
+    }
+    bool IsEmpty() const { return cosTheta == Infinity; }
+
+    vec3 w;
+    Float cosTheta = Infinity;
+};
+
+inline DirectionCone Union(const DirectionCone& a, const DirectionCone& b) {
+    // Handle the cases where one or both cones are empty
+    if (a.IsEmpty()) return b;
+    if (b.IsEmpty()) return a;
+
+    // Handle the cases where one cone is inside the other
+    Float theta_a = SafeACos(a.cosTheta), theta_b = SafeACos(b.cosTheta);
+    Float theta_d = SafeACos(Dot(a.w, b.w));
+    if (std::min(theta_d + theta_b, Pi) <= theta_a) return a;
+    if (std::min(theta_d + theta_a, Pi) <= theta_b) return b;
+
+    // Compute the spread angle of the merged cone, $\theta_o$
+    Float theta_o = (theta_a + theta_d + theta_b) / 2;
+    if (theta_o >= Pi) return DirectionCone::EntireSphere();
+
+    // Find the merged cone's axis by rotating _a.w_ towards _b.w_ by
+    // $\theta_o - \theta_a$ (Rodrigues' formula)
+    Float theta_r = theta_o - theta_a;
+    vec3 wr = Cross(a.w, b.w);
+    if (wr.LengthSquared() == 0) return DirectionCone::EntireSphere();
+    wr = Normalize(wr);
+    Float cosR = std::cos(theta_r), sinR = std::sin(theta_r);
+    vec3 w = a.w * cosR + Cross(wr, a.w) * sinR + wr * Dot(wr, a.w) * (1 - cosR);
+    return DirectionCone(w, std::cos(theta_o));
+}
+
+// Cone of directions from _p_ that can reach _b_
+inline DirectionCone BoundSubtendedDirections(const aabb& b, const point3& p) {
+    Float radius;
+    point3 pCenter;
+    b.BoundingSphere(pCenter, radius);
+    if (DistanceSquared(p, pCenter) < radius * radius)
+        return DirectionCone::EntireSphere();
+
+    // Compute and return _DirectionCone_ for bounding sphere
+    vec3 w = Normalize(pCenter - p);
+    Float sin2ThetaMax = radius * radius / DistanceSquared(pCenter, p);
+    Float cosThetaMax = SafeSqrt(1 - sin2ThetaMax);
+    return DirectionCone(w, cosThetaMax);
+}
 #endif
 
@@ -14,7 +14,12 @@ public:
         shared_ptr<material> mat)
         : x0(_x0), x1(_x1), y0(_y0), y1(_y1), k(_k), mp(mat) {};
 
-    virtual bool hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const override;
+    virtual bool intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const override;
+    virtual void fill_record(const ray& r, const hit_info& hit, hit_record& rec) const override;
+
+    virtual void compile_materials(MaterialTable& table) override {
+        material_id = table.AddMaterial(mp.get());
+    }
 
     virtual bool bounding_box(Float time0, Float time1, aabb& output_box) const override {
         // The bounding box must have non-zero width in each dimension, so pad the Z
@@ -22,13 +27,32 @@ public:
         output_box = aabb(point3(x0, y0, k - 0.0001), point3(x1, y1, k + 0.0001));
         return true;
     }
+    virtual Float pdf_value(const point3& origin, const vec3& v) const override {
+        hit_record rec;
+        if (!this->hit(ray(origin, v), 0.001, Infinity, rec))
+            return 0;
+
+        auto distance_squared = rec.time * rec.time * v.LengthSquared();
+        auto cosine = fabs(Dot(v, rec.normal) / v.Length());
+
+        return distance_squared / (cosine * area());
+    }
+
+    virtual vec3 random(const vec3& origin) const override {
+        auto random_point = vec3(RandomFloat(x0, x1), RandomFloat(y0, y1), k);
+        return random_point - origin;
+    }
+
+    virtual Float area() const override {
+        return (x1 - x0) * (y1 - y0);
+    }
 
 public:
     shared_ptr<material> mp;
     Float x0, x1, y0, y1, k;
 };
 
-bool xy_rect::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const {
+bool xy_rect::intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const {
     auto t = (k - r.origin().z) / r.direction().z;
     if (t < t_min || t > t_max)
         return false;
@@ -36,14 +60,25 @@ bool xy_rect::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const
     auto y = r.origin().y + t * r.direction().y;
     if (x < x0 || x > x1 || y < y0 || y > y1)
         return false;
-    rec.u = (x - x0) / (x1 - x0);
-    rec.v = (y - y0) / (y1 - y0);
+    hit.t = t;
+    hit.object = this;
+    hit.nInstances = 0;
+    hit.b0 = x;
+    hit.b1 = y;
+    return true;
+}
+
+void xy_rect::fill_record(const ray& r, const hit_info& hit, hit_record& rec) const {
+    auto t = hit.t;
+    rec.u = (hit.b0 - x0) / (x1 - x0);
+    rec.v = (hit.b1 - y0) / (y1 - y0);
     rec.time = t;
     auto outward_normal = vec3(0, 0, 1);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
+    rec.mat_ptr = mp.get();
+    rec.material_id = material_id;
+    rec.area_light = area_light;
     rec.p = r.at(t);
-    return true;
 }
 
 class xz_rect : public hittable {
@@ -54,7 +89,12 @@ public:
         shared_ptr<material> mat)
         : x0(_x0), x1(_x1), z0(_z0), z1(_z1), k(_k), mp(mat) {};
 
-    virtual bool hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const override;
+    virtual bool intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const override;
+    virtual void fill_record(const ray& r, const hit_info& hit, hit_record& rec) const override;
+
+    virtual void compile_materials(MaterialTable& table) override {
+        material_id = table.AddMaterial(mp.get());
+    }
 
     virtual bool bounding_box(Float time0, Float time1, aabb& output_box) const override {
         // The bounding box must have non-zero width in each dimension, so pad the Y
@@ -67,11 +107,10 @@ public:
         if (!this->hit(ray(origin, v), 0.001, Infinity, rec))
             return 0;
 
-        auto area = (x1 - x0) * (z1 - z0);
         auto distance_squared = rec.time * rec.time * v.LengthSquared();
         auto cosine = fabs(Dot(v, rec.normal) / v.Length());
 
-        return distance_squared / (cosine * area);
+        return distance_squared / (cosine * area());
     }
 
     virtual vec3 random(const vec3& origin) const override {
@@ -79,6 +118,10 @@ public:
         return random_point - origin;
     }
 
+    virtual Float area() const override {
+        return (x1 - x0) * (z1 - z0);
+    }
+
 public:
     shared_ptr<material> mp;
     Float x0, x1, z0, z1, k;
@@ -92,7 +135,12 @@ public:
         shared_ptr<material> mat)
         : y0(_y0), y1(_y1), z0(_z0), z1(_z1), k(_k), mp(mat) {};
 
-    virtual bool hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const override;
+    virtual bool intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const override;
+    virtual void fill_record(const ray& r, const hit_info& hit, hit_record& rec) const override;
+
+    virtual void compile_materials(MaterialTable& table) override {
+        material_id = table.AddMaterial(mp.get());
+    }
 
     virtual bool bounding_box(Float time0, Float time1, aabb& output_box) const override {
         // The bounding box must have non-zero width in each dimension, so pad the X
@@ -100,13 +148,32 @@ public:
         output_box = aabb(point3(k - 0.0001, y0, z0), point3(k + 0.0001, y1, z1));
         return true;
     }
+    virtual Float pdf_value(const point3& origin, const vec3& v) const override {
+        hit_record rec;
+        if (!this->hit(ray(origin, v), 0.001, Infinity, rec))
+            return 0;
+
+        auto distance_squared = rec.time * rec.time * v.LengthSquared();
+        auto cosine = fabs(Dot(v, rec.normal) / v.Length());
+
+        return distance_squared / (cosine * area());
+    }
+
+    virtual vec3 random(const vec3& origin) const override {
+        auto random_point = vec3(k, RandomFloat(y0, y1), RandomFloat(z0, z1));
+        return random_point - origin;
+    }
+
+    virtual Float area() const override {
+        return (y1 - y0) * (z1 - z0);
+    }
 
 public:
     shared_ptr<material> mp;
     Float y0, y1, z0, z1, k;
 };
 
-bool xz_rect::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const {
+bool xz_rect::intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const {
     auto t = (k - r.origin().y) / r.direction().y;
     if (t < t_min || t > t_max)
         return false;
@@ -114,17 +181,28 @@ bool xz_rect::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const
     auto z = r.origin().z + t * r.direction().z;
     if (x < x0 || x > x1 || z < z0 || z > z1)
         return false;
-    rec.u = (x - x0) / (x1 - x0);
-    rec.v = (z - z0) / (z1 - z0);
+    hit.t = t;
+    hit.object = this;
+    hit.nInstances = 0;
+    hit.b0 = x;
+    hit.b1 = z;
+    return true;
+}
+
+void xz_rect::fill_record(const ray& r, const hit_info& hit, hit_record& rec) const {
+    auto t = hit.t;
+    rec.u = (hit.b0 - x0) / (x1 - x0);
+    rec.v = (hit.b1 - z0) / (z1 - z0);
     rec.time = t;
     auto outward_normal = vec3(0, 1, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
+    rec.mat_ptr = mp.get();
+    rec.material_id = material_id;
+    rec.area_light = area_light;
     rec.p = r.at(t);
-    return true;
 }
 
-bool yz_rect::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const {
+bool yz_rect::intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const {
     auto t = (k - r.origin().x) / r.direction().x;
     if (t < t_min || t > t_max)
         return false;
@@ -132,14 +210,25 @@ bool yz_rect::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const
     auto z = r.origin().z + t * r.direction().z;
     if (y < y0 || y > y1 || z < z0 || z > z1)
         return false;
-    rec.u = (y - y0) / (y1 - y0);
-    rec.v = (z - z0) / (z1 - z0);
+    hit.t = t;
+    hit.object = this;
+    hit.nInstances = 0;
+    hit.b0 = y;
+    hit.b1 = z;
+    return true;
+}
+
+void yz_rect::fill_record(const ray& r, const hit_info& hit, hit_record& rec) const {
+    auto t = hit.t;
+    rec.u = (hit.b0 - y0) / (y1 - y0);
+    rec.v = (hit.b1 - z0) / (z1 - z0);
     rec.time = t;
     auto outward_normal = vec3(1, 0, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
+    rec.mat_ptr = mp.get();
+    rec.material_id = material_id;
+    rec.area_light = area_light;
     rec.p = r.at(t);
-    return true;
 }
 #endif
 
@@ -153,7 +242,11 @@ public:
     box() {}
     box(const point3& p0, const point3& p1, shared_ptr<material> ptr);
 
-    virtual bool hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const override;
+    virtual bool intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const override;
+
+    virtual void compile_materials(MaterialTable& table) override {
+        sides.compile_materials(table);
+    }
 
     virtual bool bounding_box(Float time0, Float time1, aabb& output_box) const override {
         output_box = aabb(box_min, box_max);
@@ -180,8 +273,8 @@ box::box(const point3& p0, const point3& p1, shared_ptr<material> ptr) {
     sides.add(make_shared<yz_rect>(p0.y, p1.y, p0.z, p1.z, p0.x, ptr));
 }
 
-bool box::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const {
-    return sides.hit(r, t_min, t_max, rec);
+bool box::intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const {
+    return sides.intersect(r, t_min, t_max, hit);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,122 @@
+#include "assetcache.h"
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include "texture.h"
+#include "loadobj.h"
+#include "localsocket.h"
+
+// AssetCache Method Definitions
+bool AssetCache::HashFile(const std::string& filename, uint64_t* hash) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+        return false;
+    int64_t mtime = (int64_t)st.st_mtime * 1000000000;
+#if defined(__linux__)
+    mtime += st.st_mtim.tv_nsec;
+#endif
+    std::string key = AbsolutePath(filename);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = stamps.find(key);
+        if (it != stamps.end() && it->second.size == (int64_t)st.st_size &&
+            it->second.mtime == mtime) {
+            *hash = it->second.hash;
+            return true;
+        }
+    }
+
+    // Eight bytes at a time through MixBits, the tail zero-padded
+    FILE* f = std::fopen(filename.c_str(), "rb");
+    if (!f)
+        return false;
+    std::vector<char> buffer(1 << 20);
+    uint64_t h = MixBits((uint64_t)st.st_size);
+    size_t n;
+    while ((n = std::fread(buffer.data(), 1, buffer.size(), f)) > 0) {
+        std::memset(buffer.data() + n, 0, (8 - n % 8) % 8);
+        for (size_t i = 0; i < n; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, buffer.data() + i, 8);
+            h = MixBits(h ^ word);
+        }
+    }
+    bool ok = !std::ferror(f);
+    std::fclose(f);
+    if (!ok)
+        return false;
+    *hash = h;
+    std::lock_guard<std::mutex> lock(mutex);
+    stamps[key] = FileStamp{ (int64_t)st.st_size, mtime, h };
+    return true;
+}
+
+bool AssetCache::HashFiles(const std::vector<std::string>& filenames, uint64_t* hash) {
+    uint64_t h = 0;
+    for (const std::string& filename : filenames) {
+        uint64_t fileHash;
+        if (!HashFile(filename, &fileHash))
+            return false;
+        h = MixBits(h ^ fileHash);
+    }
+    *hash = h;
+    return true;
+}
+
+bool AssetCache::LoadImage(const std::string& filename,
+    const shared_ptr<image_texture>& image) {
+    uint64_t hash;
+    if (!HashFile(filename, &hash))
+        return image->load(filename);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = images.find(hash);
+        if (it != images.end()) {
+            image->share(*it->second);
+            return true;
+        }
+    }
+    if (!image->load(filename))
+        return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    images.emplace(hash, image);
+    return true;
+}
+
+shared_ptr<Model> AssetCache::LoadModel(const std::string& filename) {
+    uint64_t hash = 0;
+    bool hashed = HashFile(filename, &hash);
+    if (hashed) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = models.find(hash);
+        if (it != models.end())
+            return it->second;
+    }
+    auto model = make_shared<Model>(filename);
+    if (model->meshes.empty())
+        return nullptr;
+    if (hashed) {
+        std::lock_guard<std::mutex> lock(mutex);
+        models.emplace(hash, model);
+    }
+    return model;
+}
+
+void AssetCache::Prune(const std::vector<std::string>& inUse) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unordered_set<uint64_t> keep;
+    for (const std::string& filename : inUse) {
+        auto it = stamps.find(AbsolutePath(filename));
+        if (it != stamps.end())
+            keep.insert(it->second.hash);
+    }
+    for (auto it = images.begin(); it != images.end();)
+        it = keep.count(it->first) ? std::next(it) : images.erase(it);
+    for (auto it = models.begin(); it != models.end();)
+        it = keep.count(it->first) ? std::next(it) : models.erase(it);
+}
+
+size_t AssetCache::Size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return images.size() + models.size();
+}
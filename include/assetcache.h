@@ -0,0 +1,56 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef ASSETCACHE_H
+#define ASSETCACHE_H
+
+#include "rtweekend.h"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class image_texture;
+class Model;
+
+// AssetCache Declarations
+// Decoded image textures and meshes kept between scene loads, keyed by a
+// hash of the file's contents, so that a long-running process (the render
+// server) reparsing an edited scene only decodes the assets that changed.
+// File hashes are themselves cached by absolute path, size and
+// modification time, so an unchanged file is read once. Safe to use from the parser's asset
+// loading threads.
+class AssetCache {
+public:
+    // AssetCache Public Methods
+    // Hash of the contents of _filename_; false if it cannot be read
+    bool HashFile(const std::string& filename, uint64_t* hash);
+    // Hash of the contents of all _filenames_, in order
+    bool HashFiles(const std::vector<std::string>& filenames, uint64_t* hash);
+    // Fills _image_ from _filename_, sharing the pixels of a cached image
+    // with the same contents if there is one
+    bool LoadImage(const std::string& filename, const shared_ptr<image_texture>& image);
+    // The mesh in _filename_ (read through Assimp), or null on failure
+    shared_ptr<Model> LoadModel(const std::string& filename);
+    // Drops the assets whose contents are not those of one of the files
+    // _inUse_ as last hashed
+    void Prune(const std::vector<std::string>& inUse);
+    size_t Size() const;
+
+private:
+    // AssetCache Private Data
+    struct FileStamp {
+        int64_t size, mtime;
+        uint64_t hash;
+    };
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, FileStamp> stamps;
+    std::unordered_map<uint64_t, shared_ptr<image_texture>> images;
+    std::unordered_map<uint64_t, shared_ptr<Model>> models;
+};
+
+#endif // ASSETCACHE_H
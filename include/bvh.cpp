@@ -1,4 +1,6 @@
 #include "bvh.h"
+#include "morton.h"
+#include "parallel.h"
 
 // BVHAccel Local Declarations
 struct BVHPrimitiveInfo {
@@ -63,82 +65,6 @@ struct BucketInfo {
     Bounds3f bounds;
 };
 
-// BVHAccel Utility Functions
-inline uint32_t LeftShift3(uint32_t x) {
-    CHECK_LE(x, (1 << 10));
-    if (x == (1 << 10)) --x;
-#ifdef PBRT_HAVE_BINARY_CONSTANTS
-    x = (x | (x << 16)) & 0b00000011000000000000000011111111;
-    // x = ---- --98 ---- ---- ---- ---- 7654 3210
-    x = (x | (x << 8)) & 0b00000011000000001111000000001111;
-    // x = ---- --98 ---- ---- 7654 ---- ---- 3210
-    x = (x | (x << 4)) & 0b00000011000011000011000011000011;
-    // x = ---- --98 ---- 76-- --54 ---- 32-- --10
-    x = (x | (x << 2)) & 0b00001001001001001001001001001001;
-    // x = ---- 9--8 --7- -6-- 5--4 --3- -2-- 1--0
-#else
-    x = (x | (x << 16)) & 0x30000ff;
-    // x = ---- --98 ---- ---- ---- ---- 7654 3210
-    x = (x | (x << 8)) & 0x300f00f;
-    // x = ---- --98 ---- ---- 7654 ---- ---- 3210
-    x = (x | (x << 4)) & 0x30c30c3;
-    // x = ---- --98 ---- 76-- --54 ---- 32-- --10
-    x = (x | (x << 2)) & 0x9249249;
-    // x = ---- 9--8 --7- -6-- 5--4 --3- -2-- 1--0
-#endif // PBRT_HAVE_BINARY_CONSTANTS
-    return x;
-}
-
-inline uint32_t EncodeMorton3(const Vector3f& v) {
-    CHECK_GE(v.x, 0);
-    CHECK_GE(v.y, 0);
-    CHECK_GE(v.z, 0);
-    return (LeftShift3(v.z) << 2) | (LeftShift3(v.y) << 1) | LeftShift3(v.x);
-}
-
-static void RadixSort(std::vector<MortonPrimitive>* v) {
-    std::vector<MortonPrimitive> tempVector(v->size());
-    constexpr int bitsPerPass = 6;
-    constexpr int nBits = 30;
-    static_assert((nBits % bitsPerPass) == 0,
-        "Radix sort bitsPerPass must evenly divide nBits");
-    constexpr int nPasses = nBits / bitsPerPass;
-
-    for (int pass = 0; pass < nPasses; ++pass) {
-        // Perform one pass of radix sort, sorting _bitsPerPass_ bits
-        int lowBit = pass * bitsPerPass;
-
-        // Set in and out vector pointers for radix sort pass
-        std::vector<MortonPrimitive>& in = (pass & 1) ? tempVector : *v;
-        std::vector<MortonPrimitive>& out = (pass & 1) ? *v : tempVector;
-
-        // Count number of zero bits in array for current radix sort bit
-        constexpr int nBuckets = 1 << bitsPerPass;
-        int bucketCount[nBuckets] = { 0 };
-        constexpr int bitMask = (1 << bitsPerPass) - 1;
-        for (const MortonPrimitive& mp : in) {
-            int bucket = (mp.mortonCode >> lowBit) & bitMask;
-            CHECK_GE(bucket, 0);
-            CHECK_LT(bucket, nBuckets);
-            ++bucketCount[bucket];
-        }
-
-        // Compute starting index in output array for each bucket
-        int outIndex[nBuckets];
-        outIndex[0] = 0;
-        for (int i = 1; i < nBuckets; ++i)
-            outIndex[i] = outIndex[i - 1] + bucketCount[i - 1];
-
-        // Store sorted values in output array
-        for (const MortonPrimitive& mp : in) {
-            int bucket = (mp.mortonCode >> lowBit) & bitMask;
-            out[outIndex[bucket]++] = mp;
-        }
-    }
-    // Copy final result from _tempVector_, if needed
-    if (nPasses & 1) std::swap(*v, tempVector);
-}
-
 
 BVHAccel::BVHAccel(std::vector<std::shared_ptr<Primitive>> p,
     int maxPrimsInNode, SplitMethod splitMethod)
@@ -154,16 +80,17 @@ BVHAccel::BVHAccel(std::vector<std::shared_ptr<Primitive>> p,
     for (size_t i = 0; i < primitives.size(); ++i)
         primitiveInfo[i] = { i, primitives[i]->WorldBound() };
 
-    // Build BVH tree for primitives using _primitiveInfo_
-    //MemoryArena arena(1024 * 1024);
+    // Build BVH tree for primitives using _primitiveInfo_; the build nodes
+    // live in _arena_ and are released once the tree has been flattened
+    MemoryArena arena(1024 * 1024);
     int totalNodes = 0;
     std::vector<std::shared_ptr<Primitive>> orderedPrims;
     orderedPrims.reserve(primitives.size());
     BVHBuildNode* root;
     if (splitMethod == SplitMethod::HLBVH)
-        root = HLBVHBuild(/*arena,*/ primitiveInfo, &totalNodes, orderedPrims);
+        root = HLBVHBuild(arena, primitiveInfo, &totalNodes, orderedPrims);
     else
-        root = recursiveBuild(/*arena,*/ primitiveInfo, 0, primitives.size(),
+        root = recursiveBuild(arena, primitiveInfo, 0, primitives.size(),
             &totalNodes, orderedPrims);
     primitives.swap(orderedPrims);
     primitiveInfo.resize(0);
@@ -178,24 +105,26 @@ BVHAccel::BVHAccel(std::vector<std::shared_ptr<Primitive>> p,
     // Compute representation of depth-first traversal of BVH tree
     //treeBytes += totalNodes * sizeof(LinearBVHNode) + sizeof(*this) +
     //    primitives.size() * sizeof(primitives[0]);
-    //nodes = AllocAligned<LinearBVHNode>(totalNodes);
-    nodes = new LinearBVHNode[totalNodes];
+    nodes = AllocLarge<LinearBVHNode>(totalNodes);
+    nNodes = totalNodes;
+    FirstTouch(nodes, nNodes);
     int offset = 0;
     flattenBVHTree(root, &offset);
     //CHECK_EQ(totalNodes, offset);
 }
 
+BVHAccel::~BVHAccel() { FreeLarge(nodes, nNodes * sizeof(LinearBVHNode)); }
+
 Bounds3f BVHAccel::WorldBound() const {
     return nodes ? nodes[0].bounds : Bounds3f();
 }
 
 BVHBuildNode* BVHAccel::recursiveBuild(
-    /*MemoryArena& arena,*/ std::vector<BVHPrimitiveInfo>& primitiveInfo, int start,
+    MemoryArena& arena, std::vector<BVHPrimitiveInfo>& primitiveInfo, int start,
     int end, int* totalNodes,
     std::vector<std::shared_ptr<Primitive>>& orderedPrims) {
     CHECK_NE(start, end);
-    //BVHBuildNode* node = arena.Alloc<BVHBuildNode>();
-    BVHBuildNode* node = new BVHBuildNode;
+    BVHBuildNode* node = arena.Alloc<BVHBuildNode>();
     (*totalNodes)++;
     // Compute bounds of all primitives in BVH node
     Bounds3f bounds;
@@ -353,9 +282,9 @@ BVHBuildNode* BVHAccel::recursiveBuild(
             }
             }
             node->InitInterior(dim,
-                recursiveBuild(/*arena,*/ primitiveInfo, start, mid,
+                recursiveBuild(arena, primitiveInfo, start, mid,
                     totalNodes, orderedPrims),
-                recursiveBuild(/*arena,*/ primitiveInfo, mid, end,
+                recursiveBuild(arena, primitiveInfo, mid, end,
                     totalNodes, orderedPrims));
         }
     }
@@ -448,7 +377,7 @@ bool BVHAccel::IntersectP(const Ray& ray) const {
 
 
 BVHBuildNode* BVHAccel::HLBVHBuild(
-    /*MemoryArena& arena,*/ const std::vector<BVHPrimitiveInfo>& primitiveInfo,
+    MemoryArena& arena, const std::vector<BVHPrimitiveInfo>& primitiveInfo,
     int* totalNodes,
     std::vector<std::shared_ptr<Primitive>>& orderedPrims) const {
     // Compute bounding box of all primitive centroids
@@ -468,7 +397,7 @@ BVHBuildNode* BVHAccel::HLBVHBuild(
         }, primitiveInfo.size(), 512);
 
     // Radix sort primitive Morton indices
-    RadixSort(&mortonPrims);
+    RadixSort(&mortonPrims, [](const MortonPrimitive& mp) { return mp.mortonCode; });
 
     // Create LBVH treelets at bottom of BVH
 
@@ -486,7 +415,7 @@ BVHBuildNode* BVHAccel::HLBVHBuild(
             // Add entry to _treeletsToBuild_ for this treelet
             int nPrimitives = end - start;
             int maxBVHNodes = 2 * nPrimitives;
-            BVHBuildNode* nodes = new BVHBuildNode[maxBVHNodes];//arena.Alloc<BVHBuildNode>(maxBVHNodes, false);
+            BVHBuildNode* nodes = arena.Alloc<BVHBuildNode>(maxBVHNodes, false);
             treeletsToBuild.push_back({ start, nPrimitives, nodes });
             start = end;
         }
@@ -513,10 +442,177 @@ BVHBuildNode* BVHAccel::HLBVHBuild(
     finishedTreelets.reserve(treeletsToBuild.size());
     for (LBVHTreelet& treelet : treeletsToBuild)
         finishedTreelets.push_back(treelet.buildNodes);
-    return buildUpperSAH(/*arena,*/ finishedTreelets, 0, finishedTreelets.size(),
+    return buildUpperSAH(arena, finishedTreelets, 0, finishedTreelets.size(),
         totalNodes);
 }
 
+BVHBuildNode* BVHAccel::emitLBVH(
+    BVHBuildNode*& buildNodes,
+    const std::vector<BVHPrimitiveInfo>& primitiveInfo,
+    MortonPrimitive* mortonPrims, int nPrimitives, int* totalNodes,
+    std::vector<std::shared_ptr<Primitive>>& orderedPrims,
+    std::atomic<int>* orderedPrimsOffset, int bitIndex) const {
+    CHECK_GT(nPrimitives, 0);
+    if (bitIndex == -1 || nPrimitives < maxPrimsInNode) {
+        // Create and return leaf node of LBVH treelet
+        (*totalNodes)++;
+        BVHBuildNode* node = buildNodes++;
+        Bounds3f bounds;
+        int firstPrimOffset = orderedPrimsOffset->fetch_add(nPrimitives);
+        for (int i = 0; i < nPrimitives; ++i) {
+            int primitiveIndex = mortonPrims[i].primitiveIndex;
+            orderedPrims[firstPrimOffset + i] = primitives[primitiveIndex];
+            bounds = Union(bounds, primitiveInfo[primitiveIndex].bounds);
+        }
+        node->InitLeaf(firstPrimOffset, nPrimitives, bounds);
+        return node;
+    }
+    else {
+        int mask = 1 << bitIndex;
+        // Advance to next subtree level if there's no LBVH split for this bit
+        if ((mortonPrims[0].mortonCode & mask) ==
+            (mortonPrims[nPrimitives - 1].mortonCode & mask))
+            return emitLBVH(buildNodes, primitiveInfo, mortonPrims, nPrimitives,
+                totalNodes, orderedPrims, orderedPrimsOffset,
+                bitIndex - 1);
+
+        // Find LBVH split point for this dimension
+        int searchStart = 0, searchEnd = nPrimitives - 1;
+        while (searchStart + 1 != searchEnd) {
+            CHECK_NE(searchStart, searchEnd);
+            int mid = (searchStart + searchEnd) / 2;
+            if ((mortonPrims[searchStart].mortonCode & mask) ==
+                (mortonPrims[mid].mortonCode & mask))
+                searchStart = mid;
+            else {
+                CHECK_EQ(mortonPrims[mid].mortonCode & mask,
+                    mortonPrims[searchEnd].mortonCode & mask);
+                searchEnd = mid;
+            }
+        }
+        int splitOffset = searchEnd;
+        CHECK_LE(splitOffset, nPrimitives - 1);
+
+        // Create and return interior LBVH node
+        (*totalNodes)++;
+        BVHBuildNode* node = buildNodes++;
+        BVHBuildNode* lbvh[2] = {
+            emitLBVH(buildNodes, primitiveInfo, mortonPrims, splitOffset,
+                     totalNodes, orderedPrims, orderedPrimsOffset,
+                     bitIndex - 1),
+            emitLBVH(buildNodes, primitiveInfo, &mortonPrims[splitOffset],
+                     nPrimitives - splitOffset, totalNodes, orderedPrims,
+                     orderedPrimsOffset, bitIndex - 1) };
+        int axis = bitIndex % 3;
+        node->InitInterior(axis, lbvh[0], lbvh[1]);
+        return node;
+    }
+}
+
+BVHBuildNode* BVHAccel::buildUpperSAH(MemoryArena& arena,
+    std::vector<BVHBuildNode*>& treeletRoots,
+    int start, int end,
+    int* totalNodes) const {
+    CHECK_LT(start, end);
+    int nNodes = end - start;
+    if (nNodes == 1) return treeletRoots[start];
+    (*totalNodes)++;
+    BVHBuildNode* node = arena.Alloc<BVHBuildNode>();
+
+    // Compute bounds of all nodes under this HLBVH node
+    Bounds3f bounds;
+    for (int i = start; i < end; ++i)
+        bounds = Union(bounds, treeletRoots[i]->bounds);
+
+    // Compute bound of HLBVH node centroids, choose split dimension _dim_
+    Bounds3f centroidBounds;
+    for (int i = start; i < end; ++i) {
+        Point3f centroid =
+            (treeletRoots[i]->bounds.pMin + treeletRoots[i]->bounds.pMax) *
+            0.5f;
+        centroidBounds = Union(centroidBounds, centroid);
+    }
+    int dim = centroidBounds.MaximumExtent();
+    if (centroidBounds.pMax[dim] == centroidBounds.pMin[dim]) {
+        // The treelet centroids coincide, so no bucket separates them and
+        // the bucket index below would divide by zero; split them in half
+        int mid = (start + end) / 2;
+        node->InitInterior(
+            dim, this->buildUpperSAH(arena, treeletRoots, start, mid, totalNodes),
+            this->buildUpperSAH(arena, treeletRoots, mid, end, totalNodes));
+        return node;
+    }
+
+    // Allocate _BucketInfo_ for SAH partition buckets
+    constexpr int nBuckets = 12;
+    BucketInfo buckets[nBuckets];
+
+    // Initialize _BucketInfo_ for HLBVH SAH partition buckets
+    for (int i = start; i < end; ++i) {
+        Float centroid = (treeletRoots[i]->bounds.pMin[dim] +
+            treeletRoots[i]->bounds.pMax[dim]) *
+            0.5f;
+        int b =
+            nBuckets * ((centroid - centroidBounds.pMin[dim]) /
+                (centroidBounds.pMax[dim] - centroidBounds.pMin[dim]));
+        if (b == nBuckets) b = nBuckets - 1;
+        CHECK_GE(b, 0);
+        CHECK_LT(b, nBuckets);
+        buckets[b].count++;
+        buckets[b].bounds = Union(buckets[b].bounds, treeletRoots[i]->bounds);
+    }
+
+    // Compute costs for splitting after each bucket
+    Float cost[nBuckets - 1];
+    for (int i = 0; i < nBuckets - 1; ++i) {
+        Bounds3f b0, b1;
+        int count0 = 0, count1 = 0;
+        for (int j = 0; j <= i; ++j) {
+            b0 = Union(b0, buckets[j].bounds);
+            count0 += buckets[j].count;
+        }
+        for (int j = i + 1; j < nBuckets; ++j) {
+            b1 = Union(b1, buckets[j].bounds);
+            count1 += buckets[j].count;
+        }
+        cost[i] = .125f +
+            (count0 * b0.SurfaceArea() + count1 * b1.SurfaceArea()) /
+            bounds.SurfaceArea();
+    }
+
+    // Find bucket to split at that minimizes SAH metric
+    Float minCost = cost[0];
+    int minCostSplitBucket = 0;
+    for (int i = 1; i < nBuckets - 1; ++i) {
+        if (cost[i] < minCost) {
+            minCost = cost[i];
+            minCostSplitBucket = i;
+        }
+    }
+
+    // Split nodes and create interior HLBVH SAH node
+    BVHBuildNode** pmid = std::partition(
+        &treeletRoots[start], &treeletRoots[end - 1] + 1,
+        [=](const BVHBuildNode* node) {
+            Float centroid =
+                (node->bounds.pMin[dim] + node->bounds.pMax[dim]) * 0.5f;
+            int b = nBuckets *
+                ((centroid - centroidBounds.pMin[dim]) /
+                    (centroidBounds.pMax[dim] - centroidBounds.pMin[dim]));
+            if (b == nBuckets) b = nBuckets - 1;
+            CHECK_GE(b, 0);
+            CHECK_LT(b, nBuckets);
+            return b <= minCostSplitBucket;
+        });
+    int mid = pmid - &treeletRoots[0];
+    CHECK_GT(mid, start);
+    CHECK_LT(mid, end);
+    node->InitInterior(
+        dim, this->buildUpperSAH(arena, treeletRoots, start, mid, totalNodes),
+        this->buildUpperSAH(arena, treeletRoots, mid, end, totalNodes));
+    return node;
+}
+
 
 int BVHAccel::flattenBVHTree(BVHBuildNode* node, int* offset) {
     LinearBVHNode* linearNode = &nodes[*offset];
@@ -8,6 +8,7 @@
 
 #include <vector>
 #include "primitive.h"
+#include "meomery.h"
 
 struct BVHBuildNode;
 
@@ -27,18 +28,18 @@ public:
         int maxPrimsInNode = 1,
         SplitMethod splitMethod = SplitMethod::SAH);
     Bounds3f WorldBound() const;
-    ~BVHAccel(){}
+    ~BVHAccel();
     bool Intersect(const Ray& ray, SurfaceInteraction* isect) const;
     bool IntersectP(const Ray& ray) const;
 
 private:
     // BVHAccel Private Methods
     BVHBuildNode* recursiveBuild(
-        /*MemoryArena& arena,*/ std::vector<BVHPrimitiveInfo>& primitiveInfo,
+        MemoryArena& arena, std::vector<BVHPrimitiveInfo>& primitiveInfo,
         int start, int end, int* totalNodes,
         std::vector<std::shared_ptr<Primitive>>& orderedPrims);
     BVHBuildNode* HLBVHBuild(
-        /* MemoryArena& arena,*/ const std::vector<BVHPrimitiveInfo>& primitiveInfo,
+        MemoryArena& arena, const std::vector<BVHPrimitiveInfo>& primitiveInfo,
         int* totalNodes,
         std::vector<std::shared_ptr<Primitive>>& orderedPrims) const;
     BVHBuildNode* emitLBVH(
@@ -47,7 +48,7 @@ private:
         MortonPrimitive* mortonPrims, int nPrimitives, int* totalNodes,
         std::vector<std::shared_ptr<Primitive>>& orderedPrims,
         std::atomic<int>* orderedPrimsOffset, int bitIndex) const;
-    BVHBuildNode* buildUpperSAH(/* MemoryArena& arena,*/
+    BVHBuildNode* buildUpperSAH(MemoryArena& arena,
         std::vector<BVHBuildNode*>& treeletRoots,
         int start, int end, int* totalNodes) const;
     int flattenBVHTree(BVHBuildNode* node, int* offset);
@@ -57,6 +58,7 @@ private:
     const SplitMethod splitMethod;
     std::vector<std::shared_ptr<Primitive>> primitives;
     LinearBVHNode* nodes = nullptr;
+    int nNodes = 0;
 };
 
 //std::shared_ptr<BVHAccel> CreateBVHAccelerator(
@@ -5,79 +5,110 @@
 
 #include "hittable.h"
 #include "material.h"
+#include "medium.h"
 #include "texture.h"
 
+// Volume filled with a participating medium, bounded by the closed surface
+// _boundary_. Rays scatter inside it at distances sampled from _medium_,
+// with _phase_function_ giving the color of the scattered light.
 class constant_medium : public hittable {
 public:
     constant_medium(shared_ptr<hittable> b, Float d, shared_ptr<texture> a)
-        : boundary(b),
-        neg_inv_density(-1 / d),
-        phase_function(make_shared<isotropic>(a))
+        : constant_medium(b, make_shared<HomogeneousMedium>(d),
+            make_shared<isotropic>(a))
     {}
 
     constant_medium(shared_ptr<hittable> b, Float d, color c)
-        : boundary(b),
-        neg_inv_density(-1 / d),
-        phase_function(make_shared<isotropic>(c))
+        : constant_medium(b, make_shared<HomogeneousMedium>(d),
+            make_shared<isotropic>(c))
     {}
 
-    virtual bool hit(
-        const ray& r, Float t_min, Float t_max, hit_record& rec) const override;
+    constant_medium(shared_ptr<hittable> b, shared_ptr<Medium> m, color albedo)
+        : constant_medium(b, m, make_shared<isotropic>(albedo))
+    {}
+
+    constant_medium(shared_ptr<hittable> b, shared_ptr<Medium> m,
+        shared_ptr<material> phase)
+        : boundary(b), medium(m), phase_function(phase) {
+        // Moving boundaries can't bound all time; they skip the precheck
+        hasBox = boundary->bounding_box(-Infinity, Infinity, box);
+        for (int c = 0; c < 3; ++c)
+            hasBox &= std::isfinite(box.pMin[c]) && std::isfinite(box.pMax[c]);
+    }
+
+    virtual bool intersect(
+        const ray& r, Float t_min, Float t_max, hit_info& hit) const override;
+    virtual void fill_record(
+        const ray& r, const hit_info& hit, hit_record& rec) const override;
+
+    virtual void compile_materials(MaterialTable& table) override {
+        material_id = table.AddMaterial(phase_function.get());
+    }
 
     virtual bool bounding_box(Float time0, Float time1, aabb& output_box) const override {
         return boundary->bounding_box(time0, time1, output_box);
     }
 
+    virtual Float Tr(const ray& r, Float t_min, Float t_max) const override {
+        Float t0, t1;
+        if (!Segment(r, t_min, t_max, &t0, &t1))
+            return 1;
+        return medium->Tr(r, t0, t1);
+    }
+
+private:
+    // Finds the part [*_t0_, *_t1_) of [_t_min_, _t_max_] that lies inside
+    // _boundary_; rays starting inside get the entry point behind them
+    bool Segment(const ray& r, Float t_min, Float t_max, Float* t0, Float* t1) const;
+
 public:
     shared_ptr<hittable> boundary;
+    shared_ptr<Medium> medium;
     shared_ptr<material> phase_function;
-    Float neg_inv_density;
+    aabb box;
+    bool hasBox = false;
 };
 
-bool constant_medium::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const {
-    // Print occasional samples when debugging. To enable, set enableDebug true.
-    const bool enableDebug = false;
-    const bool debugging = enableDebug && RandomFloat() < 0.00001;
-
-    hit_record rec1, rec2;
-
-    if (!boundary->hit(r, -Infinity, Infinity, rec1))
+inline bool constant_medium::Segment(const ray& r, Float t_min, Float t_max,
+    Float* t0, Float* t1) const {
+    // Rays missing the bounds can't reach the boundary at any _t_ in range
+    if (hasBox && !box.hit(r, t_min, t_max))
         return false;
 
-    if (!boundary->hit(r, rec1.time + 0.0001, Infinity, rec2))
+    // Only the first crossing before _t_max_ and the one after it matter,
+    // so neither query needs to look past _t_max_
+    hit_info hit1, hit2;
+    if (!boundary->intersect(r, -Infinity, t_max, hit1))
         return false;
 
-    if (debugging) std::cerr << "\nt_min=" << rec1.time << ", t_max=" << rec2.time << '\n';
-
-    if (rec1.time < t_min) rec1.time = t_min;
-    if (rec2.time > t_max) rec2.time = t_max;
+    *t0 = std::max(hit1.t, t_min);
+    *t1 = boundary->intersect(r, hit1.t + 0.0001, t_max, hit2) ? hit2.t : t_max;
+    return *t0 < *t1;
+}
 
-    if (rec1.time >= rec2.time)
+inline bool constant_medium::intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const {
+    Float t0, t1, t;
+    if (!Segment(r, t_min, t_max, &t0, &t1))
         return false;
 
-    if (rec1.time < 0)
-        rec1.time = 0;
-
-    const auto ray_length = r.direction().Length();
-    const auto distance_inside_boundary = (rec2.time - rec1.time) * ray_length;
-    const auto hit_distance = neg_inv_density * log(RandomFloat());
-
-    if (hit_distance > distance_inside_boundary)
+    if (!medium->SampleDistance(r, t0, t1, &t))
         return false;
+    hit.t = t;
+    hit.object = this;
+    hit.nInstances = 0;
+    return true;
+}
 
-    rec.time = rec1.time + hit_distance / ray_length;
+inline void constant_medium::fill_record(const ray& r, const hit_info& hit, hit_record& rec) const {
+    rec.time = hit.t;
     rec.p = r.at(rec.time);
 
-   /*if (debugging) {
-        std::cerr << "hit_distance = " << hit_distance << '\n'
-            << "rec.t = " << rec.t << '\n'
-            << "rec.p = " << rec.p << '\n';
-    }*/ 
-
-    rec.normal = vec3(1, 0, 0);  // arbitrary
-    rec.front_face = true;     // also arbitrary
-    rec.mat_ptr = phase_function;
-
-    return true;
+    // No surface: a zero normal keeps light sampling from weighting
+    // lights by a cosine
+    rec.normal = vec3(0, 0, 0);
+    rec.front_face = true;     // arbitrary
+    rec.mat_ptr = phase_function.get();
+    rec.material_id = material_id;
+    rec.area_light = nullptr;
 }
-#endif
\ No newline at end of file
+#endif
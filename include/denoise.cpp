@@ -0,0 +1,180 @@
+#include "denoise.h"
+#include <algorithm>
+#include <cmath>
+
+// Denoiser Local Definitions
+namespace {
+
+// Per-pixel features for the weights: scaled albedo and normal, and depth
+struct Feature {
+    Float f[6];
+    Float depth;
+};
+
+}  // namespace
+
+// Denoiser Method Definitions
+void Denoise(const Film& film, const DenoiseOptions& options,
+    std::vector<color>* out) {
+    const int w = film.width, h = film.height;
+    const size_t n = size_t(w) * h;
+    out->assign(n, color(0, 0, 0));
+    if (n == 0) return;
+    const bool aovs = film.HasAOVs();
+
+    // Demodulate radiance by albedo; channels with (nearly) black albedo
+    // are left as they are
+    std::vector<color> modulation(n, color(1, 1, 1)), u(n);
+    std::vector<Float> rawVariance(n);
+    for (size_t i = 0; i < n; ++i) {
+        if (aovs)
+            for (int c = 0; c < 3; ++c)
+                if (film.albedo[i][c] > 0.01f) modulation[i][c] = film.albedo[i][c];
+        const color& m = modulation[i];
+        u[i] = color(film.rgb[i].x / m.x, film.rgb[i].y / m.y, film.rgb[i].z / m.z);
+        const color& v = film.variance[i];
+        rawVariance[i] = (v.x / (m.x * m.x) + v.y / (m.y * m.y) + v.z / (m.z * m.z)) / 3;
+    }
+
+    // The per-pixel variance estimates are noisy themselves; a 3x3 box
+    // filter steadies them
+    std::vector<Float> variance(n);
+    for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w; ++x) {
+            Float sum = 0;
+            int count = 0;
+            for (int yy = std::max(0, y - 1); yy <= std::min(h - 1, y + 1); ++yy)
+                for (int xx = std::max(0, x - 1); xx <= std::min(w - 1, x + 1); ++xx) {
+                    sum += rawVariance[size_t(yy) * w + xx];
+                    ++count;
+                }
+            variance[size_t(y) * w + x] = sum / count;
+        }
+
+    const int r = options.radius, pr = options.patchRadius;
+    const Float k2 = options.k * options.k, eps = 1e-10f;
+    const Float invDepth2 = 1 / (options.sigmaDepth * options.sigmaDepth);
+
+    // Albedo and normal scaled by their bandwidths, so that their part of a
+    // weight's exponent is a squared distance
+    std::vector<Feature> features(aovs ? n : 0);
+    for (size_t i = 0; i < features.size(); ++i)
+        for (int c = 0; c < 3; ++c) {
+            features[i].f[c] = film.albedo[i][c] / options.sigmaAlbedo;
+            features[i].f[3 + c] = film.normal[i][c] / options.sigmaNormal;
+            features[i].depth = film.depth[i];
+        }
+    const int bandRows = 16;
+    const int nBands = (h + bandRows - 1) / bandRows;
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int band = 0; band < nBands; ++band) {
+        int y0 = band * bandRows, y1 = std::min(h, y0 + bandRows);
+        // Patch distances are also needed _pr_ rows above and below
+        int ey0 = std::max(0, y0 - pr), ey1 = std::min(h, y1 + pr);
+        int rows = ey1 - ey0;
+        std::vector<Float> dist(size_t(rows) * w), rowBox(size_t(rows) * w), colBox(w);
+        std::vector<color> sum(size_t(y1 - y0) * w, color(0, 0, 0));
+        std::vector<Float> weightSum(size_t(y1 - y0) * w, 0);
+
+        for (int dy = -r; dy <= r; ++dy)
+            for (int dx = -r; dx <= r; ++dx) {
+                // Pixels whose neighbor at (_dx_, _dy_) is inside the image
+                int xa = std::max(0, -dx), xb = std::min(w, w - dx);
+                if (xa >= xb) continue;
+                // Variance-normalized distance between each pixel and its
+                // neighbor; rows whose neighbors fall outside stay zero
+                for (int y = ey0; y < ey1; ++y) {
+                    Float* d = &dist[size_t(y - ey0) * w];
+                    int qy = y + dy;
+                    if (qy < 0 || qy >= h) {
+                        std::fill(d, d + w, (Float)0);
+                        continue;
+                    }
+                    const color* up = &u[size_t(y) * w];
+                    const color* uq = &u[size_t(qy) * w + dx];
+                    const Float* vp = &variance[size_t(y) * w];
+                    const Float* vq = &variance[size_t(qy) * w + dx];
+                    for (int x = xa; x < xb; ++x) {
+                        Float d0 = up[x].x - uq[x].x, d1 = up[x].y - uq[x].y,
+                            d2 = up[x].z - uq[x].z;
+                        Float num = (d0 * d0 + d1 * d1 + d2 * d2) * (1.f / 3) -
+                            (vp[x] + std::min(vp[x], vq[x]));
+                        d[x] = num / (eps + k2 * (vp[x] + vq[x]));
+                    }
+                }
+                // Average the distances over the patches, first along rows
+                for (int y = 0; y < rows; ++y) {
+                    const Float* d = &dist[size_t(y) * w];
+                    Float* b = &rowBox[size_t(y) * w];
+                    // Patches near the ends of the valid range are clipped
+                    auto clipped = [&](int x) {
+                        int lo = std::max(xa, x - pr), hi = std::min(xb - 1, x + pr);
+                        Float s = 0;
+                        for (int xx = lo; xx <= hi; ++xx) s += d[xx];
+                        b[x] = s / (hi - lo + 1);
+                    };
+                    int ia = std::min(xa + pr, xb), ib = std::max(xb - pr, ia);
+                    for (int x = xa; x < ia; ++x) clipped(x);
+                    const Float invWidth = (Float)1 / (2 * pr + 1);
+                    for (int x = ia; x < ib; ++x) {
+                        Float s = 0;
+                        for (int k = -pr; k <= pr; ++k) s += d[x + k];
+                        b[x] = s * invWidth;
+                    }
+                    for (int x = ib; x < xb; ++x) clipped(x);
+                }
+                // then down columns, and accumulate the weighted neighbors
+                for (int y = y0; y < y1; ++y) {
+                    int qy = y + dy;
+                    if (qy < 0 || qy >= h) continue;
+                    int ya = std::max({ ey0, y - pr, -dy }), yb = std::min({ ey1 - 1, y + pr, h - 1 - dy });
+                    Float invRows = (Float)1 / (yb - ya + 1);
+                    Float* weight = &colBox[0];
+                    std::fill(weight + xa, weight + xb, (Float)0);
+                    for (int yy = ya; yy <= yb; ++yy) {
+                        const Float* b = &rowBox[size_t(yy - ey0) * w];
+                        for (int x = xa; x < xb; ++x) weight[x] += b[x];
+                    }
+                    size_t p0 = size_t(y) * w, q0 = size_t(qy) * w + dx;
+                    if (aovs) {
+                        const Feature* fp = &features[p0];
+                        const Feature* fq = &features[q0];
+                        for (int x = xa; x < xb; ++x) {
+                            Float exponent = std::max((Float)0, weight[x] * invRows);
+                            Float e = 0;
+                            for (int c = 0; c < 6; ++c) {
+                                Float dc = fp[x].f[c] - fq[x].f[c];
+                                e += dc * dc;
+                            }
+                            Float zp = fp[x].depth, zq = fq[x].depth;
+                            Float dz = (zp - zq) / std::max({ zp, zq, (Float)1e-4 });
+                            exponent += e + dz * dz * invDepth2;
+                            weight[x] = exponent < 20 ? std::exp(-exponent) : 0;
+                        }
+                    }
+                    else
+                        for (int x = xa; x < xb; ++x) {
+                            Float exponent = std::max((Float)0, weight[x] * invRows);
+                            weight[x] = exponent < 20 ? std::exp(-exponent) : 0;
+                        }
+                    color* sumRow = &sum[size_t(y - y0) * w];
+                    Float* weightRow = &weightSum[size_t(y - y0) * w];
+                    const color* uq = &u[q0];
+                    for (int x = xa; x < xb; ++x) {
+                        sumRow[x] += weight[x] * uq[x];
+                        weightRow[x] += weight[x];
+                    }
+                }
+            }
+
+        // Remodulate
+        for (int y = y0; y < y1; ++y)
+            for (int x = 0; x < w; ++x) {
+                size_t o = size_t(y - y0) * w + x, p = size_t(y) * w + x;
+                color c = weightSum[o] > 0 ? sum[o] / weightSum[o] : u[p];
+                const color& m = modulation[p];
+                (*out)[p] = color(c.x * m.x, c.y * m.y, c.z * m.z);
+            }
+    }
+}
@@ -0,0 +1,35 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include "film.h"
+
+// Denoiser Declarations
+struct DenoiseOptions {
+    // Half widths of the search window and of the compared patches
+    int radius = 7, patchRadius = 1;
+    // Color sensitivity relative to the pixels' variance; larger values
+    // smooth more
+    Float k = 0.7f;
+    // Feature bandwidths: albedo difference, normal difference and depth
+    // difference relative to depth
+    Float sigmaAlbedo = 0.1f, sigmaNormal = 0.35f, sigmaDepth = 0.05f;
+};
+
+// Feature-guided non-local means filter on _film_'s radiance. Each pixel
+// becomes a weighted mean of the pixels in its search window. The weights
+// compare the patches around the two pixels, taking the difference in
+// units of the pixels' estimated variance so that only differences beyond
+// the noise count. When the film has AOVs, the weights are also multiplied
+// by the similarity of albedo, normal and depth. Radiance is divided by
+// albedo before filtering and multiplied back afterwards, so textures stay
+// sharp. Rows are filtered in parallel bands. *_out_ receives the result,
+// one color per film pixel.
+void Denoise(const Film& film, const DenoiseOptions& options,
+    std::vector<color>* out);
+
+#endif // DENOISE_H
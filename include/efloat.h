@@ -37,6 +37,19 @@ public:
         Check();
     }
 #endif  // DEBUG
+    // Returns _v_ with the interval [_low_, _high_], for callers that know
+    // tighter bounds than a symmetric error gives
+    static EFloat FromBounds(float v, float low, float high) {
+        EFloat r;
+        r.v = v;
+        r.low = low;
+        r.high = high;
+#ifndef NDEBUG
+        r.vPrecise = v;
+#endif
+        r.Check();
+        return r;
+    }
     EFloat operator+(EFloat ef) const {
         EFloat r;
         r.v = v + ef.v;
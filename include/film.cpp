@@ -0,0 +1,195 @@
+#include "film.h"
+#include <cstdio>
+#include <cstring>
+
+// PartialFilm Local Definitions
+namespace {
+
+const char partialFilmMagic[8] = { 'P', 'B', 'R', 'T', 'P', 'A', 'R', 'T' };
+const uint32_t partialFilmVersion = 1;
+
+struct PartialFilmHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t floatSize;     // sizeof(Float) of the writer
+    int32_t width, height;
+    uint32_t aovs;
+};
+
+template <typename T>
+bool WriteBuffer(FILE* f, const std::vector<T>& v) {
+    return std::fwrite(v.data(), sizeof(T), v.size(), f) == v.size();
+}
+
+template <typename T>
+bool ReadBuffer(FILE* f, std::vector<T>& v) {
+    return std::fread(v.data(), sizeof(T), v.size(), f) == v.size();
+}
+
+}  // namespace
+
+// PartialFilm Method Definitions
+PartialFilm::PartialFilm(int width, int height, bool aovs)
+    : width(width), height(height), firstSample(size_t(width) * height),
+    samples(firstSample.size()), sum(firstSample.size()), sumSquares(firstSample.size()) {
+    if (aovs) {
+        albedo.resize(samples.size());
+        normal.resize(samples.size());
+        depth.resize(samples.size());
+        objectId.resize(samples.size());
+    }
+}
+
+void PartialFilm::CopyAOVs(const Film& film) {
+    if (!HasAOVs() || !film.HasAOVs())
+        return;
+    for (size_t i = 0; i < samples.size(); ++i)
+        if (samples[i] > 0) {
+            albedo[i] = film.albedo[i];
+            normal[i] = film.normal[i];
+            depth[i] = film.depth[i];
+            objectId[i] = film.objectId[i];
+        }
+}
+
+bool PartialFilm::Merge(const PartialFilm& part, std::string* error) {
+    if (part.width != width || part.height != height) {
+        *error = "film resolutions differ (" + std::to_string(part.width) + "x" +
+            std::to_string(part.height) + " and " + std::to_string(width) + "x" +
+            std::to_string(height) + ")";
+        return false;
+    }
+    bool aovs = HasAOVs() && part.HasAOVs();
+    for (size_t i = 0; i < samples.size(); ++i) {
+        uint32_t n = part.samples[i];
+        if (n == 0)
+            continue;
+        uint32_t first = part.firstSample[i];
+        if (samples[i] == 0) {
+            // The pixel's first samples: copy them, so that it resolves
+            // exactly as in the part
+            firstSample[i] = first;
+            samples[i] = n;
+            sum[i] = part.sum[i];
+            sumSquares[i] = part.sumSquares[i];
+            if (aovs) {
+                albedo[i] = part.albedo[i];
+                normal[i] = part.normal[i];
+                depth[i] = part.depth[i];
+                objectId[i] = part.objectId[i];
+            }
+            continue;
+        }
+        // The pixel's samples stay one contiguous range: the part's must
+        // start where they end or end where they start
+        uint32_t end = firstSample[i] + samples[i];
+        if (first != end && first + n != firstSample[i]) {
+            std::string where = " of pixel (" + std::to_string(i % width) + ", " +
+                std::to_string(i / width) + ")";
+            if (first < end && firstSample[i] < first + n)
+                *error = "parts overlap: both have sample " +
+                    std::to_string(std::max(first, firstSample[i])) + where;
+            else
+                *error = "samples " + std::to_string(std::min(end, first + n)) + " to " +
+                    std::to_string(std::max(first, firstSample[i]) - 1) + where +
+                    " are missing between the parts merged so far and the next";
+            return false;
+        }
+        if (aovs) {
+            Float w = Float(n) / (samples[i] + n);
+            albedo[i] += w * (part.albedo[i] - albedo[i]);
+            normal[i] += w * (part.normal[i] - normal[i]);
+            depth[i] += w * (part.depth[i] - depth[i]);
+            if (first < firstSample[i])
+                objectId[i] = part.objectId[i];
+        }
+        firstSample[i] = std::min(firstSample[i], first);
+        samples[i] += n;
+        sum[i] += part.sum[i];
+        sumSquares[i] += part.sumSquares[i];
+    }
+    // AOVs are only kept when every part has them
+    if (!part.HasAOVs()) {
+        albedo.clear();
+        normal.clear();
+        depth.clear();
+        objectId.clear();
+    }
+    return true;
+}
+
+uint32_t PartialFilm::FirstSample() const {
+    uint32_t first = UINT32_MAX;
+    for (size_t i = 0; i < samples.size(); ++i)
+        if (samples[i] > 0)
+            first = std::min(first, firstSample[i]);
+    return first;
+}
+
+Film PartialFilm::Resolve() const {
+    Film film(width, height, HasAOVs());
+    for (size_t i = 0; i < samples.size(); ++i) {
+        if (samples[i] == 0)
+            continue;
+        film.SetPixel(i, sum[i], sumSquares[i], (int)samples[i]);
+        if (HasAOVs()) {
+            film.albedo[i] = albedo[i];
+            film.normal[i] = normal[i];
+            film.depth[i] = depth[i];
+            film.objectId[i] = objectId[i];
+        }
+    }
+    return film;
+}
+
+bool PartialFilm::Write(const std::string& filename, std::string* error) const {
+    FILE* f = std::fopen(filename.c_str(), "wb");
+    if (!f) {
+        *error = "cannot write '" + filename + "'";
+        return false;
+    }
+    PartialFilmHeader header;
+    std::memcpy(header.magic, partialFilmMagic, sizeof(header.magic));
+    header.version = partialFilmVersion;
+    header.floatSize = sizeof(Float);
+    header.width = width;
+    header.height = height;
+    header.aovs = HasAOVs();
+    bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1 &&
+        WriteBuffer(f, firstSample) && WriteBuffer(f, samples) &&
+        WriteBuffer(f, sum) && WriteBuffer(f, sumSquares);
+    if (ok && HasAOVs())
+        ok = WriteBuffer(f, albedo) && WriteBuffer(f, normal) &&
+            WriteBuffer(f, depth) && WriteBuffer(f, objectId);
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok)
+        *error = "error writing '" + filename + "'";
+    return ok;
+}
+
+bool PartialFilm::Read(const std::string& filename, std::string* error) {
+    FILE* f = std::fopen(filename.c_str(), "rb");
+    if (!f) {
+        *error = "cannot open '" + filename + "'";
+        return false;
+    }
+    PartialFilmHeader header;
+    if (std::fread(&header, sizeof(header), 1, f) != 1 ||
+        std::memcmp(header.magic, partialFilmMagic, sizeof(header.magic)) != 0 ||
+        header.version != partialFilmVersion || header.floatSize != sizeof(Float) ||
+        header.width < 0 || header.height < 0) {
+        std::fclose(f);
+        *error = "'" + filename + "' is not a partial film of this build";
+        return false;
+    }
+    *this = PartialFilm(header.width, header.height, header.aovs != 0);
+    bool ok = ReadBuffer(f, firstSample) && ReadBuffer(f, samples) &&
+        ReadBuffer(f, sum) && ReadBuffer(f, sumSquares);
+    if (ok && HasAOVs())
+        ok = ReadBuffer(f, albedo) && ReadBuffer(f, normal) &&
+            ReadBuffer(f, depth) && ReadBuffer(f, objectId);
+    std::fclose(f);
+    if (!ok)
+        *error = "'" + filename + "' is truncated";
+    return ok;
+}
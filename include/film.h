@@ -0,0 +1,111 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef FILM_H
+#define FILM_H
+
+#include "rtweekend.h"
+#include "vec3.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Film Declarations
+// Float framebuffer for the pixels of a crop window, (0, 0) at the top
+// left. Holds each pixel's mean radiance (linear RGB) and the per-channel
+// variance of that mean, and, when enabled, the auxiliary buffers (AOVs) describing
+// what the camera rays hit first: albedo, shading normal facing the
+// camera, distance and an object ID. Albedo, normal and depth are averaged
+// over the pixel's samples; the ID is that of the first sample, 0 for a
+// miss.
+class Film {
+public:
+    // Film Public Methods
+    Film() {}
+    Film(int width, int height, bool aovs)
+        : width(width), height(height), rgb(size_t(width) * height),
+        variance(size_t(width) * height) {
+        if (aovs) {
+            albedo.resize(rgb.size());
+            normal.resize(rgb.size());
+            depth.resize(rgb.size());
+            objectId.resize(rgb.size());
+        }
+    }
+    bool HasAOVs() const { return !albedo.empty(); }
+    size_t Index(int x, int y) const { return size_t(y) * width + x; }
+    // Sets _pixel_ to the mean of _n_ samples, given their sum and sum of
+    // squares, and its variance to that of the mean (sample variance / n)
+    void SetPixel(size_t pixel, const color& sum, const color& sumSquares, int n) {
+        color mean = sum / n;
+        rgb[pixel] = mean;
+        if (n > 1) {
+            color var = (sumSquares - n * mean * mean) / (n - 1);
+            variance[pixel] = color(std::max(var.x, (Float)0), std::max(var.y, (Float)0),
+                std::max(var.z, (Float)0)) / n;
+        }
+    }
+
+    // Film Public Data
+    int width = 0, height = 0;
+    std::vector<color> rgb;
+    std::vector<color> variance;
+    std::vector<color> albedo;
+    std::vector<vec3> normal;
+    std::vector<Float> depth;
+    std::vector<uint32_t> objectId;
+};
+
+// PartialFilm Declarations
+// The samples one process took of a frame that several processes render
+// together, each taking some of the tiles or some of every pixel's
+// samples. Per pixel it keeps how many samples were taken, starting at
+// which sample index, and the sums of their radiance and squared
+// radiance, so that merging parts adds the sums up and resolves to the
+// film of all their samples. The AOVs are kept as averages over a part's
+// samples and merged weighted by the counts; the ID is that of the lowest
+// sample. A pixel rendered by only one part resolves exactly as if that
+// process had rendered the whole frame. A pixel's samples must form one
+// range, so parts with sample ranges are merged in order of their first
+// sample and must not leave gaps.
+class PartialFilm {
+public:
+    // PartialFilm Public Methods
+    PartialFilm() {}
+    PartialFilm(int width, int height, bool aovs);
+    bool HasAOVs() const { return !albedo.empty(); }
+    // Records _n_ samples of _pixel_ starting at sample _first_
+    void SetPixel(size_t pixel, int first, int n, const color& sum, const color& sumSquares) {
+        firstSample[pixel] = first;
+        samples[pixel] = n;
+        this->sum[pixel] = sum;
+        this->sumSquares[pixel] = sumSquares;
+    }
+    // Takes the AOVs of the pixels with samples from _film_
+    void CopyAOVs(const Film& film);
+    // Adds the samples of _part_, which must be of the same frame and,
+    // for each pixel both have samples of, continue this one's range of
+    // samples (or end where it starts)
+    bool Merge(const PartialFilm& part, std::string* error);
+    // The lowest first sample of any pixel (UINT32_MAX if none has any)
+    uint32_t FirstSample() const;
+    // The film of the samples taken; pixels without samples are black
+    Film Resolve() const;
+    // Files hold the buffers in native byte order behind a short header
+    bool Write(const std::string& filename, std::string* error) const;
+    bool Read(const std::string& filename, std::string* error);
+
+    // PartialFilm Public Data
+    int width = 0, height = 0;
+    std::vector<uint32_t> firstSample, samples;
+    std::vector<color> sum, sumSquares;
+    std::vector<color> albedo;
+    std::vector<vec3> normal;
+    std::vector<Float> depth;
+    std::vector<uint32_t> objectId;
+};
+
+#endif // FILM_H
@@ -1,16 +1,22 @@
 #include "hittable.h"
 #include "shape.h"
 #include "spectrum.h"
+#include "triangle.h"
 
-bool translate::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const {
+bool translate::intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const {
     ray moved_r(r.origin() - offset, r.direction(), r.Time());
-    if (!ptr->hit(moved_r, t_min, t_max, rec))
+    if (!ptr->intersect(moved_r, t_min, t_max, hit))
         return false;
+    add_instance(hit);
+    return true;
+}
+
+void translate::fill_record(const ray& r, const hit_info& hit, hit_record& rec) const {
+    ray moved_r(r.origin() - offset, r.direction(), r.Time());
+    inner(hit)->fill_record(moved_r, hit, rec);
 
     rec.p += offset;
     rec.set_face_normal(moved_r, rec.normal);
-
-    return true;
 }
 
 bool translate::bounding_box(Float time0, Float time1, aabb& output_box) const {
@@ -61,7 +67,7 @@ rotate_y::rotate_y(shared_ptr<hittable> p, Float angle) : ptr(p) {
     bbox = aabb(min, max);
 }
 
-bool rotate_y::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const {
+ray rotate_y::rotated(const ray& r) const {
     auto origin = r.origin();
     auto direction = r.direction();
 
@@ -71,10 +77,19 @@ bool rotate_y::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) cons
     direction[0] = cos_theta * r.direction()[0] - sin_theta * r.direction()[2];
     direction[2] = sin_theta * r.direction()[0] + cos_theta * r.direction()[2];
 
-    ray rotated_r(origin, direction, r.Time());
+    return ray(origin, direction, r.Time());
+}
 
-    if (!ptr->hit(rotated_r, t_min, t_max, rec))
+bool rotate_y::intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const {
+    if (!ptr->intersect(rotated(r), t_min, t_max, hit))
         return false;
+    add_instance(hit);
+    return true;
+}
+
+void rotate_y::fill_record(const ray& r, const hit_info& hit, hit_record& rec) const {
+    ray rotated_r = rotated(r);
+    inner(hit)->fill_record(rotated_r, hit, rec);
 
     auto p = rec.p;
     auto normal = rec.normal;
@@ -87,8 +102,6 @@ bool rotate_y::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) cons
 
     rec.p = p;
     rec.set_face_normal(rotated_r, normal);
-
-    return true;
 }
 
 
@@ -141,3 +154,92 @@ bool rotate_y::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) cons
      //return area ? area->L(*this, w) : RGBSpectrum(0.f);
      return RGBSpectrum(0.f);
  }
+
+shape_hittable::shape_hittable(shared_ptr<Shape> shape, shared_ptr<material> m)
+    : shape(shape), mat_ptr(m), triangle(dynamic_cast<const Triangle*>(shape.get())) {}
+
+bool shape_hittable::intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const {
+    Ray sr(r.o, r.d, r.time, 0, t_max);
+    Float tHit, b[3] = { 0, 0, 0 };
+    if (triangle) {
+        if (!triangle->IntersectBarycentric(sr, &tHit, b) || tHit < t_min)
+            return false;
+    }
+    else {
+        SurfaceInteraction isect;
+        if (!shape->Intersect(sr, &tHit, &isect, false) || tHit < t_min)
+            return false;
+    }
+    hit.t = tHit;
+    hit.object = this;
+    hit.nInstances = 0;
+    hit.b0 = b[0];
+    hit.b1 = b[1];
+    return true;
+}
+
+void shape_hittable::fill_record(const ray& r, const hit_info& hit, hit_record& rec) const {
+    // Shapes find their closest hit within the ray's extent, so limiting
+    // it to the hit's distance finds the same hit again
+    Ray sr(r.o, r.d, r.time, 0, hit.t);
+    Float tHit = hit.t;
+    SurfaceInteraction isect;
+    bool found;
+    if (triangle) {
+        Float b[3] = { hit.b0, hit.b1, 1 - hit.b0 - hit.b1 };
+        found = triangle->InteractionAt(sr, b, &isect);
+    }
+    else
+        found = shape->Intersect(sr, &tHit, &isect, false);
+    if (!found) {
+        // Degenerate triangles have no surface frame
+        isect.p = r.at(hit.t);
+        isect.shading.n = Normal(-r.d);
+    }
+
+    rec.time = tHit;
+    rec.p = isect.p;
+    rec.pError = isect.pError;
+    rec.wo = isect.wo;
+    rec.n = isect.n;
+    rec.u = isect.uv.x;
+    rec.v = isect.uv.y;
+    rec.set_face_normal(r, unit_vector(vec3(isect.shading.n)));
+    rec.mat_ptr = mat_ptr.get();
+    rec.material_id = material_id;
+    rec.area_light = area_light;
+}
+
+bool shape_hittable::bounding_box(Float time0, Float time1, aabb& output_box) const {
+    output_box = shape->WorldBound();
+    // Axis-aligned triangles have flat bounds, which aabb::hit() rejects;
+    // pad them the way aarect does
+    for (int a = 0; a < 3; ++a)
+        if (output_box.pMax[a] - output_box.pMin[a] < 0.0002) {
+            output_box.pMin[a] -= 0.0001;
+            output_box.pMax[a] += 0.0001;
+        }
+    return true;
+}
+
+Float shape_hittable::pdf_value(const point3& o, const vec3& v) const {
+    Interaction ref;
+    ref.p = o;
+    return shape->Pdf(ref, unit_vector(v));
+}
+
+vec3 shape_hittable::random(const vec3& o) const {
+    Interaction ref;
+    ref.p = point3(o);
+    Float pdf;
+    Interaction it = shape->Sample(ref, Point2f(RandomFloat(), RandomFloat()), &pdf);
+    return it.p - ref.p;
+}
+
+Float shape_hittable::area() const {
+    return shape->Area();
+}
+
+void shape_hittable::compile_materials(MaterialTable& table) {
+    material_id = table.AddMaterial(mat_ptr.get());
+}
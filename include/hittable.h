@@ -3,11 +3,16 @@
 
 #include "rtweekend.h"
 #include "aabb.h"
+#include "medium.h"
+#include "materialtable.h"
 class material;
 class Shape;
+class Triangle;
 class aabb;
 class RGBSpectrum;
 class Primitive;
+class AreaLight;
+class hittable;
 
 struct hit_record {
     point3 p;
@@ -15,11 +20,14 @@ struct hit_record {
     Float time;
     Float u;
     Float v;
-    bool front_face;
+    bool front_face = false;
     vec3 pError;
     Normal n;
     vec3 wo;
-    shared_ptr<material> mat_ptr;
+    // The surface's material, and its record in the scene's MaterialTable
+    const material* mat_ptr = nullptr;
+    uint32_t material_id = 0;
+    const AreaLight* area_light = nullptr;
     hit_record():time(0){}
     hit_record(const point3& p, const Normal& n, const vec3& pError,
         const vec3& wo, Float time)
@@ -63,6 +71,7 @@ public:
     Normal dndu, dndv;
     const Shape* shape = nullptr;
     const Primitive* primitive = nullptr;
+    MediumInterface mediumInterface;
     //BSDF* bsdf = nullptr;
     //BSSRDF* bssrdf = nullptr;
 
@@ -72,18 +81,95 @@ public:
 };
 
 
+// Closest hit found so far by hittable::intersect(): only what is needed
+// to compute the full hit_record later, once the closest hit is known
+struct hit_info {
+    Float t = Infinity;
+    // The surface hit, and the instancing wrappers (translate, rotate_y)
+    // the ray went through to reach it, innermost first
+    const hittable* object = nullptr;
+    static const int maxInstances = 8;
+    const hittable* instances[maxInstances];
+    int nInstances = 0;
+    // Surface-specific coordinates of the hit: barycentrics for triangles,
+    // the in-plane coordinates for axis-aligned rectangles
+    Float b0 = 0, b1 = 0;
+};
+
 class hittable {
 public:
-    virtual bool hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const = 0;
+    // Ray traversal records hits in a hit_info and only the closest one
+    // is turned into a hit_record. intersect() updates _hit_ and returns
+    // true when it finds a hit in [_t_min_, _t_max_]; containers pass
+    // the shrinking interval on to their children. fill_record() computes
+    // the hit_record of a hit found along _r_; surfaces and instancing
+    // wrappers implement it, containers never see it.
+    virtual bool intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const = 0;
+    virtual void fill_record(const ray& r, const hit_info& hit, hit_record& rec) const {}
+
+    // Closest hit along _r_ with its full hit_record
+    bool hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const {
+        hit_info h;
+        if (!intersect(r, t_min, t_max, h))
+            return false;
+        record_hit(r, h, rec);
+        return true;
+    }
+    // The hit_record of _hit_, found by intersect() along _r_
+    static void record_hit(const ray& r, const hit_info& hit, hit_record& rec) {
+        const hittable* outer = hit.nInstances > 0 ? hit.instances[hit.nInstances - 1] : hit.object;
+        outer->fill_record(r, hit, rec);
+    }
 
     virtual bool bounding_box(Float time0, Float time1, aabb& output_box) const = 0;
     virtual Float pdf_value(const point3& o, const vec3& v) const {
         return 0.0;
     }
 
+    // Fraction of light passing along _r_ between _t_min_ and _t_max_, for
+    // shadow rays: 0 if a surface blocks it, else the transmittance of
+    // the media it crosses. Media and containers override it.
+    virtual Float Tr(const ray& r, Float t_min, Float t_max) const {
+        hit_info hit;
+        return intersect(r, t_min, t_max, hit) ? 0 : 1;
+    }
+
     virtual vec3 random(const vec3& o) const {
         return vec3(1, 0, 0);
     }
+
+    // Surface area, used to estimate the power of emitters built on this
+    // shape; 0 for shapes that cannot be area lights
+    virtual Float area() const {
+        return 0.0;
+    }
+
+    // Adds the materials of the surfaces in this object to _table_ and
+    // sets their _material_id_; containers and wrappers pass it on
+    virtual void compile_materials(MaterialTable& table) {}
+
+public:
+    // Set by hittable_list::add_area_light() and copied into every hit_record
+    const AreaLight* area_light = nullptr;
+    // Set by compile_materials() and copied into every hit_record
+    uint32_t material_id = 0;
+
+protected:
+    // For instancing wrappers: records this wrapper in _hit_ after the
+    // wrapped object was hit
+    void add_instance(hit_info& hit) const {
+        CHECK_LT(hit.nInstances, hit_info::maxInstances);
+        if (hit.nInstances < hit_info::maxInstances)
+            hit.instances[hit.nInstances++] = this;
+    }
+    // For instancing wrappers: the next wrapper inside this one on the
+    // way to the surface in _hit_, or the surface itself
+    const hittable* inner(const hit_info& hit) const {
+        for (int i = hit.nInstances - 1; i > 0; --i)
+            if (hit.instances[i] == this)
+                return hit.instances[i - 1];
+        return hit.object;
+    }
 };
 
 class translate : public hittable {
@@ -91,11 +177,21 @@ public:
     translate(shared_ptr<hittable> p, const vec3& displacement)
         : ptr(p), offset(displacement) {}
 
-    virtual bool hit(
-        const ray& r, Float t_min, Float t_max, hit_record& rec) const override;
+    virtual bool intersect(
+        const ray& r, Float t_min, Float t_max, hit_info& hit) const override;
+    virtual void fill_record(
+        const ray& r, const hit_info& hit, hit_record& rec) const override;
 
     virtual bool bounding_box(Float time0, Float time1, aabb& output_box) const override;
 
+    virtual Float Tr(const ray& r, Float t_min, Float t_max) const override {
+        return ptr->Tr(ray(r.origin() - offset, r.direction(), r.Time()), t_min, t_max);
+    }
+
+    virtual void compile_materials(MaterialTable& table) override {
+        ptr->compile_materials(table);
+    }
+
 public:
     shared_ptr<hittable> ptr;
     vec3 offset;
@@ -105,11 +201,24 @@ class rotate_y : public hittable {
 public:
     rotate_y(shared_ptr<hittable> p, Float angle);
 
-    virtual bool hit(
-        const ray& r, Float t_min, Float t_max, hit_record& rec) const override;
+    virtual bool intersect(
+        const ray& r, Float t_min, Float t_max, hit_info& hit) const override;
+    virtual void fill_record(
+        const ray& r, const hit_info& hit, hit_record& rec) const override;
 
     virtual bool bounding_box(Float time0, Float time1, aabb& output_box) const override;
 
+    virtual Float Tr(const ray& r, Float t_min, Float t_max) const override {
+        return ptr->Tr(rotated(r), t_min, t_max);
+    }
+
+    virtual void compile_materials(MaterialTable& table) override {
+        ptr->compile_materials(table);
+    }
+
+    // _r_ in the object's unrotated frame
+    ray rotated(const ray& r) const;
+
 public:
     shared_ptr<hittable> ptr;
     Float sin_theta;
@@ -120,4 +229,31 @@ public:
 
 
 
+// Adapts a pbrt Shape (e.g. a mesh triangle) to the hittable interface,
+// so shapes loaded from scene files can carry one of the materials above
+// and be sampled as area lights. Triangles are tested for their hit
+// distance and barycentrics alone; other shapes are intersected again
+// to fill in the record.
+class shape_hittable : public hittable {
+public:
+    shape_hittable(shared_ptr<Shape> shape, shared_ptr<material> m);
+
+    virtual bool intersect(
+        const ray& r, Float t_min, Float t_max, hit_info& hit) const override;
+    virtual void fill_record(
+        const ray& r, const hit_info& hit, hit_record& rec) const override;
+
+    virtual bool bounding_box(Float time0, Float time1, aabb& output_box) const override;
+    virtual Float pdf_value(const point3& o, const vec3& v) const override;
+    virtual vec3 random(const vec3& o) const override;
+    virtual Float area() const override;
+    virtual void compile_materials(MaterialTable& table) override;
+
+public:
+    shared_ptr<Shape> shape;
+    shared_ptr<material> mat_ptr;
+    // _shape_ when it is a Triangle
+    const Triangle* triangle = nullptr;
+};
+
 #endif
\ No newline at end of file
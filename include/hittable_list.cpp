@@ -0,0 +1,277 @@
+#include "hittable_list.h"
+
+// bvh_node Local Declarations
+struct bvh_node::BuildObject {
+    size_t index;
+    aabb bounds;
+    point3 centroid;
+};
+
+// bvh_node Method Definitions
+bvh_node::bvh_node(
+    const std::vector<shared_ptr<hittable>>& src_objects,
+    size_t start, size_t end, Float time0, Float time1)
+    : time0(time0), time1(time1) {
+    std::vector<BuildObject> info;
+    info.reserve(end - start);
+    for (size_t i = start; i < end; ++i) {
+        BuildObject o;
+        o.index = i;
+        if (!src_objects[i]->bounding_box(time0, time1, o.bounds))
+            std::cerr << "No bounding box in bvh_node constructor.\n";
+        o.centroid = .5f * o.bounds.pMin + .5f * o.bounds.pMax;
+        info.push_back(o);
+    }
+    if (info.empty())
+        return;
+    nodes.reserve(2 * info.size());
+    objects.reserve(info.size());
+    Build(info, 0, (int)info.size(), src_objects);
+    if (time1 > time0)
+        ComputeMotionBounds();
+}
+
+int bvh_node::Build(std::vector<BuildObject>& info, int start, int end,
+    const std::vector<shared_ptr<hittable>>& src_objects) {
+    int nodeIndex = (int)nodes.size();
+    nodes.push_back(LinearNode());
+    aabb bounds, centroidBounds;
+    for (int i = start; i < end; ++i) {
+        bounds = Union(bounds, info[i].bounds);
+        centroidBounds = Union(centroidBounds, aabb(info[i].centroid));
+    }
+    int n = end - start;
+    auto makeLeaf = [&]() {
+        LinearNode& node = nodes[nodeIndex];
+        node.bounds = bounds;
+        node.objectsOffset = (int)objects.size();
+        node.nObjects = (uint16_t)n;
+        node.axis = 0;
+        node.moving = 0;
+        for (int i = start; i < end; ++i)
+            objects.push_back(src_objects[info[i].index]);
+        return nodeIndex;
+    };
+    if (n == 1)
+        return makeLeaf();
+
+    // Split along the axis of largest centroid extent
+    int dim = centroidBounds.MaximumExtent();
+    int mid = (start + end) / 2;
+    auto byCentroid = [dim](const BuildObject& a, const BuildObject& b) {
+        return a.centroid[dim] < b.centroid[dim];
+    };
+    if (centroidBounds.pMax[dim] == centroidBounds.pMin[dim]) {
+        // Coincident centroids can't be told apart; halve big sets anyway
+        // so that leaves stay small
+        if (n <= maxObjectsInNode)
+            return makeLeaf();
+    }
+    else if (n <= 2)
+        std::nth_element(&info[start], &info[mid], &info[end - 1] + 1, byCentroid);
+    else {
+        // Bin the centroids and sweep the split candidates from both ends
+        constexpr int nBuckets = 12;
+        struct Bucket {
+            int count = 0;
+            aabb bounds;
+        } buckets[nBuckets];
+        auto bucketOf = [&](const BuildObject& o) {
+            int b = int(nBuckets * centroidBounds.Offset(o.centroid)[dim]);
+            return std::min(std::max(b, 0), nBuckets - 1);
+        };
+        for (int i = start; i < end; ++i) {
+            Bucket& b = buckets[bucketOf(info[i])];
+            ++b.count;
+            b.bounds = Union(b.bounds, info[i].bounds);
+        }
+        Float areaBelow[nBuckets - 1];
+        int countBelow[nBuckets - 1];
+        aabb below;
+        int count = 0;
+        for (int i = 0; i < nBuckets - 1; ++i) {
+            below = Union(below, buckets[i].bounds);
+            count += buckets[i].count;
+            areaBelow[i] = count ? below.SurfaceArea() : 0;
+            countBelow[i] = count;
+        }
+        aabb above;
+        Float minCost = Infinity;
+        int minCostSplitBucket = 0;
+        for (int i = nBuckets - 2; i >= 0; --i) {
+            above = Union(above, buckets[i + 1].bounds);
+            int countAbove = n - countBelow[i];
+            if (countBelow[i] == 0 || countAbove == 0)
+                continue;
+            Float cost = 1 + (countBelow[i] * areaBelow[i] +
+                countAbove * above.SurfaceArea()) / bounds.SurfaceArea();
+            if (cost < minCost) {
+                minCost = cost;
+                minCostSplitBucket = i;
+            }
+        }
+
+        // Either create a leaf or split at the cheapest bucket boundary
+        Float leafCost = n;
+        if (n <= maxObjectsInNode && !(minCost < leafCost))
+            return makeLeaf();
+        if (minCost < Infinity) {
+            BuildObject* pmid = std::partition(&info[start], &info[end - 1] + 1,
+                [&](const BuildObject& o) { return bucketOf(o) <= minCostSplitBucket; });
+            mid = int(pmid - &info[0]);
+        }
+        else
+            std::nth_element(&info[start], &info[mid], &info[end - 1] + 1, byCentroid);
+    }
+
+    Build(info, start, mid, src_objects);
+    int second = Build(info, mid, end, src_objects);
+    LinearNode& node = nodes[nodeIndex];
+    node.bounds = bounds;
+    node.secondChild = second;
+    node.nObjects = 0;
+    node.axis = (uint8_t)dim;
+    node.moving = 0;
+    return nodeIndex;
+}
+
+void bvh_node::ComputeMotionBounds() {
+    // Moving nodes keep their bounds at both ends of the shutter interval
+    // and test rays against the two interpolated at the ray's time, which
+    // is much tighter than the bounds swept over the whole interval. For
+    // objects moving linearly (moving_sphere) the interpolated bounds
+    // always contain the node: each face of the union is a min or max of
+    // linear functions, so it bulges away from the node's interior. Other
+    // motion is checked at a few times in between and falls back to the
+    // swept bounds. Children follow their parents in _nodes_, so walking
+    // it backwards sees every child before its parent.
+    motion.assign(2 * nodes.size(), aabb());
+    // Bounds of node _i_'s contents at _time_, from its children's
+    // (possibly interpolated) bounds or from its objects
+    auto instant = [&](int i, Float t, aabb* b) {
+        const LinearNode& node = nodes[i];
+        *b = aabb();
+        if (node.nObjects == 0) {
+            *b = Union(BoundsAt(i + 1, t), BoundsAt(node.secondChild, t));
+            return true;
+        }
+        for (int j = 0; j < node.nObjects; ++j) {
+            aabb ob;
+            if (!objects[node.objectsOffset + j]->bounding_box(t, t, ob))
+                return false;
+            *b = Union(*b, ob);
+        }
+        return true;
+    };
+    bool anyMoving = false;
+    for (int i = (int)nodes.size() - 1; i >= 0; --i) {
+        LinearNode& node = nodes[i];
+        aabb& box0 = motion[2 * i];
+        aabb& box1 = motion[2 * i + 1];
+        if (!instant(i, time0, &box0) || !instant(i, time1, &box1))
+            continue;
+        bool moving = false;
+        for (int c = 0; c < 3; ++c)
+            moving |= box0.pMin[c] != box1.pMin[c] || box0.pMax[c] != box1.pMax[c];
+        node.moving = moving;
+        const int nChecks = 7;
+        Float eps = 1e-4f * (1 + MaxComponent(Abs(node.bounds.pMax - node.bounds.pMin)));
+        for (int k = 1; k <= nChecks && node.moving; ++k) {
+            Float t = Lerp(Float(k) / (nChecks + 1), time0, time1);
+            aabb b, bi = BoundsAt(i, t);
+            if (!instant(i, t, &b))
+                node.moving = false;
+            for (int c = 0; c < 3; ++c)
+                if (b.pMin[c] < bi.pMin[c] - eps || b.pMax[c] > bi.pMax[c] + eps)
+                    node.moving = false;
+        }
+        anyMoving |= node.moving != 0;
+    }
+    if (!anyMoving)
+        motion.clear();
+}
+
+bool bvh_node::bounding_box(Float t0, Float t1, aabb& output_box) const {
+    if (nodes.empty())
+        return false;
+    // The interpolated bounds are linear in time, so the ends of [t0, t1]
+    // bound everything in between
+    if (!nodes[0].moving || t0 < time0 || t1 > time1 || t0 > t1)
+        output_box = nodes[0].bounds;
+    else
+        output_box = Union(BoundsAt(0, t0), BoundsAt(0, t1));
+    return true;
+}
+
+bool bvh_node::intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const {
+    if (nodes.empty())
+        return false;
+    bool hit_anything = false;
+    vec3 invDir(1 / r.d.x, 1 / r.d.y, 1 / r.d.z);
+    int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+    Float time = r.Time();
+    // Follow the ray through the nodes, near child first
+    int toVisitOffset = 0, currentNodeIndex = 0;
+    int nodesToVisit[64];
+    while (true) {
+        const LinearNode& node = nodes[currentNodeIndex];
+        if (HitBounds(BoundsAt(currentNodeIndex, time), r, invDir, dirIsNeg, t_min, t_max)) {
+            if (node.nObjects > 0) {
+                // Each hit shortens the interval left to search
+                for (int i = 0; i < node.nObjects; ++i)
+                    if (objects[node.objectsOffset + i]->intersect(r, t_min, t_max, hit)) {
+                        hit_anything = true;
+                        t_max = hit.t;
+                    }
+                if (toVisitOffset == 0) break;
+                currentNodeIndex = nodesToVisit[--toVisitOffset];
+            }
+            else if (dirIsNeg[node.axis]) {
+                nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+                currentNodeIndex = node.secondChild;
+            }
+            else {
+                nodesToVisit[toVisitOffset++] = node.secondChild;
+                currentNodeIndex = currentNodeIndex + 1;
+            }
+        }
+        else {
+            if (toVisitOffset == 0) break;
+            currentNodeIndex = nodesToVisit[--toVisitOffset];
+        }
+    }
+    return hit_anything;
+}
+
+Float bvh_node::Tr(const ray& r, Float t_min, Float t_max) const {
+    if (nodes.empty())
+        return 1;
+    Float tr = 1;
+    vec3 invDir(1 / r.d.x, 1 / r.d.y, 1 / r.d.z);
+    int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+    Float time = r.Time();
+    int toVisitOffset = 0, currentNodeIndex = 0;
+    int nodesToVisit[64];
+    while (true) {
+        const LinearNode& node = nodes[currentNodeIndex];
+        if (HitBounds(BoundsAt(currentNodeIndex, time), r, invDir, dirIsNeg, t_min, t_max)) {
+            if (node.nObjects > 0) {
+                for (int i = 0; i < node.nObjects; ++i) {
+                    tr *= objects[node.objectsOffset + i]->Tr(r, t_min, t_max);
+                    if (tr == 0) return 0;
+                }
+                if (toVisitOffset == 0) break;
+                currentNodeIndex = nodesToVisit[--toVisitOffset];
+            }
+            else {
+                nodesToVisit[toVisitOffset++] = node.secondChild;
+                currentNodeIndex = currentNodeIndex + 1;
+            }
+        }
+        else {
+            if (toVisitOffset == 0) break;
+            currentNodeIndex = nodesToVisit[--toVisitOffset];
+        }
+    }
+    return tr;
+}
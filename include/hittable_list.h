@@ -4,6 +4,7 @@
 #include "hittable.h"
 #include "rtweekend.h"
 #include "primitive.h"
+#include "light.h"
 
 #include <memory>
 #include <vector>
@@ -17,37 +18,66 @@ public:
     hittable_list() {}
     hittable_list(shared_ptr<hittable> object) { add(object); }
 
-    void clear() { objects.clear(); }
+    void clear() { objects.clear(); lights.clear(); infinite_lights.clear(); }
     void add(shared_ptr<hittable> object) { objects.push_back(object); }
+    // Registers _object_ (already added to the list) as an emitter with
+    // radiance _Lemit_, so it can be picked for next-event estimation
+    void add_area_light(shared_ptr<hittable> object, const Color& Lemit) {
+        auto light = make_shared<HittableAreaLight>(object, Lemit);
+        object->area_light = light.get();
+        lights.push_back(light);
+    }
+    // Adds a light without geometry (point, spot, distant, environment)
+    void add_light(shared_ptr<Light> light) {
+        if (light->flags & (int)LightFlags::Infinite)
+            infinite_lights.push_back(light);
+        lights.push_back(light);
+    }
     void setTime(Float t0, Float t1) { _time0 = t0; _time1 = t1; };
 
-    virtual bool hit(
-        const ray& r, Float t_min, Float t_max ,hit_record& rec) const override;
+    virtual bool intersect(
+        const ray& r, Float t_min, Float t_max, hit_info& hit) const override;
 
     virtual bool bounding_box(
         Float time0, Float time1, aabb& output_box) const override;
+
+    virtual Float Tr(const ray& r, Float t_min, Float t_max) const override;
+
+    virtual void compile_materials(MaterialTable& table) override {
+        for (const auto& object : objects)
+            object->compile_materials(table);
+    }
 public:
     std::vector<shared_ptr<hittable>> objects;
+    std::vector<shared_ptr<Light>> lights;
+    std::vector<shared_ptr<Light>> infinite_lights;
     Float _time0, _time1;
 };
 
-bool hittable_list::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const {
-    hit_record temp_rec;
+inline bool hittable_list::intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const {
     bool hit_anything = false;
     auto closest_so_far = t_max;
 
     for (const auto& object : objects) {
-        if (object->hit(r, t_min, closest_so_far, temp_rec)) {
+        if (object->intersect(r, t_min, closest_so_far, hit)) {
             hit_anything = true;
-            closest_so_far = temp_rec.time;
-            rec = temp_rec;
+            closest_so_far = hit.t;
         }
     }
     return hit_anything;
 }
 
+inline Float hittable_list::Tr(const ray& r, Float t_min, Float t_max) const {
+    Float tr = 1;
+    for (const auto& object : objects) {
+        tr *= object->Tr(r, t_min, t_max);
+        if (tr == 0) break;
+    }
+    return tr;
+}
+
 //listԪصbounding boxԪbounding box false
-bool hittable_list::bounding_box(Float time0, Float time1, aabb& output_box) const {
+inline bool hittable_list::bounding_box(Float time0, Float time1, aabb& output_box) const {
     if (objects.empty()) return false;
 
     aabb temp_box;
@@ -63,116 +93,99 @@ bool hittable_list::bounding_box(Float time0, Float time1, aabb& output_box) con
 }
 #endif
 
-#ifndef BVH_H
-#define BVH_H
+#ifndef BVH_NODE_H
+#define BVH_NODE_H
 
+// Bounding volume hierarchy over hittables. The tree is built with the
+// binned surface area heuristic and stored as a flat array in depth-first
+// order: an interior node's first child follows it and it records where
+// the second one starts, as in BVHAccel. Rays are traversed with a stack,
+// near child first, testing nodes with the ray's precomputed reciprocal
+// direction.
 class bvh_node : public hittable {
 public:
-    bvh_node();
+    bvh_node() {}
 
     bvh_node(const hittable_list& list, Float time0, Float time1)
         : bvh_node(list.objects, 0, list.objects.size(), time0, time1)
     {}
 
+    // Builds over _src_objects_[_start_, _end_), which must have bounds
+    // over [_time0_, _time1_]
     bvh_node(
         const std::vector<shared_ptr<hittable>>& src_objects,
         size_t start, size_t end, Float time0, Float time1);
 
-    virtual bool hit(
-        const ray& r, Float t_min, Float t_max, hit_record& rec) const override;
+    virtual bool intersect(
+        const ray& r, Float t_min, Float t_max, hit_info& hit) const override;
 
     virtual bool bounding_box(Float time0, Float time1, aabb& output_box) const override;
 
-public:
-    shared_ptr<hittable> left;
-    shared_ptr<hittable> right;
-    aabb box;
-};
-
-inline bool box_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b, int axis) {
-    aabb box_a;
-    aabb box_b;
+    virtual Float Tr(const ray& r, Float t_min, Float t_max) const override;
 
-    if (!a->bounding_box(0, 0, box_a) || !b->bounding_box(0, 0, box_b))
-        std::cerr << "No bounding box in bvh_node constructor.\n";
-
-    return box_a.min()[axis] < box_b.min()[axis];
-}
-
-
-bool box_x_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
-    return box_compare(a, b, 0);
-}
-
-bool box_y_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
-    return box_compare(a, b, 1);
-}
-
-bool box_z_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
-    return box_compare(a, b, 2);
-}
-
-
-
-bvh_node::bvh_node(
-    const std::vector<shared_ptr<hittable>>& src_objects,
-    size_t start, size_t end, Float time0, Float time1
-) {
-    auto objects = src_objects; // Create a modifiable array of the source scene objects
+    virtual void compile_materials(MaterialTable& table) override {
+        for (const auto& object : objects)
+            object->compile_materials(table);
+    }
 
-    int axis = RandomInt(0, 2);
-    auto comparator = (axis == 0) ? box_x_compare
-        : (axis == 1) ? box_y_compare
-        : box_z_compare;
+    size_t NodeCount() const { return nodes.size(); }
 
-    size_t object_span = end - start;
+    static const int maxObjectsInNode = 4;
 
-    if (object_span == 1) {
-        left = right = objects[start];
-    }
-    else if (object_span == 2) {
-        if (comparator(objects[start], objects[start + 1])) {
-            left = objects[start];
-            right = objects[start + 1];
-        }
-        else {
-            left = objects[start + 1];
-            right = objects[start];
-        }
+private:
+    // bvh_node Private Types
+    struct BuildObject;
+    struct LinearNode {
+        aabb bounds;            // over [time0, time1]
+        union {
+            int objectsOffset;  // leaf
+            int secondChild;    // interior
+        };
+        uint16_t nObjects;      // 0 -> interior node
+        uint8_t axis;           // interior node: split axis
+        uint8_t moving;         // bounds at the ray's time are in _motion_
+    };
+
+    // bvh_node Private Methods
+    int Build(std::vector<BuildObject>& info, int start, int end,
+        const std::vector<shared_ptr<hittable>>& src_objects);
+    // Slab test of _b_ against [_t_min_, _t_max_] with the ray's reciprocal
+    // direction and its signs precomputed
+    static bool HitBounds(const aabb& b, const ray& r, const vec3& invDir,
+        const int dirIsNeg[3], Float t_min, Float t_max) {
+        Float tx0 = (b[dirIsNeg[0]].x - r.o.x) * invDir.x;
+        Float tx1 = (b[1 - dirIsNeg[0]].x - r.o.x) * invDir.x;
+        Float ty0 = (b[dirIsNeg[1]].y - r.o.y) * invDir.y;
+        Float ty1 = (b[1 - dirIsNeg[1]].y - r.o.y) * invDir.y;
+        Float tz0 = (b[dirIsNeg[2]].z - r.o.z) * invDir.z;
+        Float tz1 = (b[1 - dirIsNeg[2]].z - r.o.z) * invDir.z;
+        t_min = std::max(t_min, std::max(tx0, std::max(ty0, tz0)));
+        t_max = std::min(t_max, std::min(tx1, std::min(ty1, tz1)) * (1 + 2 * gamma(3)));
+        return t_min <= t_max;
     }
-    else {
-        std::sort(objects.begin() + start, objects.begin() + end, comparator);
-
-        auto mid = start + object_span / 2;
-        left = make_shared<bvh_node>(objects, start, mid, time0, time1);
-        right = make_shared<bvh_node>(objects, mid, end, time0, time1);
+    void ComputeMotionBounds();
+    // Bounds of node _i_ at _time_: the node's bounds at _time0_ and
+    // _time1_ interpolated for moving nodes, its bounds over the whole
+    // interval otherwise and for times outside [time0, time1]
+    aabb BoundsAt(int i, Float time) const {
+        const LinearNode& node = nodes[i];
+        if (!node.moving || !(time >= time0 && time <= time1))
+            return node.bounds;
+        Float u = (time - time0) / (time1 - time0);
+        const aabb* m = &motion[2 * i];
+        aabb b;
+        b.pMin = (1 - u) * m[0].pMin + u * m[1].pMin;
+        b.pMax = (1 - u) * m[0].pMax + u * m[1].pMax;
+        return b;
     }
 
-    aabb box_left, box_right;
-
-    if (!left->bounding_box(time0, time1, box_left)
-        || !right->bounding_box(time0, time1, box_right)
-        )
-        std::cerr << "No bounding box in bvh_node constructor.\n";
-
-    box = Union(box_left, box_right);
-}
-
-bool bvh_node::bounding_box(Float time0, Float time1, aabb& output_box) const {
-    output_box = box;
-    return true;
-}
-
-bool bvh_node::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const {
-    if (!box.hit(r, t_min, t_max))
-        return false;
-
-    bool hit_left = left->hit(r, t_min, t_max, rec);
-    bool hit_right = right->hit(r, t_min, hit_left ? rec.time : t_max, rec);
-
-    return hit_left || hit_right;
-}
-
+    // bvh_node Private Data
+    std::vector<LinearNode> nodes;
+    std::vector<shared_ptr<hittable>> objects;
+    // Bounds at _time0_ and _time1_ for every node, when any node moves
+    std::vector<aabb> motion;
+    Float time0 = 0, time1 = 0;
+};
 
 inline bool box_compare(const shared_ptr<Primitive> a, const shared_ptr<Primitive> b, int axis) {
     aabb box_a;
@@ -206,14 +219,14 @@ private:
 
     virtual const Material* GetMaterial() const override;
 
-    virtual void ComputeScatteringFunctions(SurfaceInteraction* isect, TransportMode mode, bool allowMultipleLobes) const override;
+    virtual void ComputeScatteringFunctions(SurfaceInteraction* isect, MemoryArena& arena, TransportMode mode, bool allowMultipleLobes) const override;
 
     shared_ptr<Primitive> left;
     shared_ptr<Primitive> right;
     aabb box;
 };
 
-pbrt_bvh_node::pbrt_bvh_node(const std::vector<shared_ptr<Primitive>>& src_objects, int start, int end)
+inline pbrt_bvh_node::pbrt_bvh_node(const std::vector<shared_ptr<Primitive>>& src_objects, int start, int end)
 {
     auto objects = src_objects; // Create a modifiable array of the source scene objects
     aabb world_box = objects[start]->WorldBound();
@@ -262,16 +275,16 @@ pbrt_bvh_node::pbrt_bvh_node(const std::vector<shared_ptr<Primitive>>& src_objec
 
 }
 
-pbrt_bvh_node::~pbrt_bvh_node()
+inline pbrt_bvh_node::~pbrt_bvh_node()
 {
 }
 
-aabb pbrt_bvh_node::WorldBound() const
+inline aabb pbrt_bvh_node::WorldBound() const
 {
     return box;
 }
 
-bool pbrt_bvh_node::Intersect(const Ray& r, SurfaceInteraction* isect) const
+inline bool pbrt_bvh_node::Intersect(const Ray& r, SurfaceInteraction* isect) const
 {
 
     if (!box.hit(r, r.tMin, r.tMax))
@@ -283,7 +296,7 @@ bool pbrt_bvh_node::Intersect(const Ray& r, SurfaceInteraction* isect) const
     return hit_left || hit_right;
 }
 
-bool pbrt_bvh_node::IntersectP(const Ray& r) const
+inline bool pbrt_bvh_node::IntersectP(const Ray& r) const
 {
     if (!box.hit(r, r.tMin, r.tMax))
         return false;
@@ -294,12 +307,12 @@ bool pbrt_bvh_node::IntersectP(const Ray& r) const
     return hit_left || hit_right;
 }
 
-const Material* pbrt_bvh_node::GetMaterial() const
+inline const Material* pbrt_bvh_node::GetMaterial() const
 {
     return nullptr;
 }
 
-void pbrt_bvh_node::ComputeScatteringFunctions(SurfaceInteraction* isect, TransportMode mode, bool allowMultipleLobes) const
+inline void pbrt_bvh_node::ComputeScatteringFunctions(SurfaceInteraction* isect, MemoryArena& arena, TransportMode mode, bool allowMultipleLobes) const
 {
 }
 
@@ -0,0 +1,386 @@
+#include "light.h"
+#include "shape.h"
+#include "material.h"
+#include "texture.h"
+#include "sampling.h"
+
+// LightBounds Method Definitions
+LightBounds::LightBounds(const Bounds3f& b, const Vector3f& w, Float phi,
+    Float cosTheta_o, Float cosTheta_e, bool twoSided)
+    : bounds(b),
+    phi(phi),
+    w(Normalize(w)),
+    cosTheta_o(cosTheta_o),
+    cosTheta_e(cosTheta_e),
+    twoSided(twoSided) {}
+
+Float LightBounds::Importance(const Point3f& p, const Normal3f& n) const {
+    // Return importance for light bounds at reference point
+    // Compute clamped squared distance to reference point
+    Point3f pc = Centroid();
+    Float d2 = DistanceSquared(p, pc);
+    d2 = std::max(d2, (bounds.pMax - bounds.pMin).Length() / 2);
+
+    // Define cosine and sine clamped subtraction lambdas
+    auto cosSubClamped = [](Float sinTheta_a, Float cosTheta_a,
+        Float sinTheta_b, Float cosTheta_b) -> Float {
+        if (cosTheta_a > cosTheta_b) return 1;
+        return cosTheta_a * cosTheta_b + sinTheta_a * sinTheta_b;
+    };
+    auto sinSubClamped = [](Float sinTheta_a, Float cosTheta_a,
+        Float sinTheta_b, Float cosTheta_b) -> Float {
+        if (cosTheta_a > cosTheta_b) return 0;
+        return sinTheta_a * cosTheta_b - cosTheta_a * sinTheta_b;
+    };
+
+    // Compute sine and cosine of angle to vector _w_, $\theta_\roman{w}$
+    Vector3f wi = Normalize(p - pc);
+    Float cosTheta_w = Dot(w, wi);
+    if (twoSided) cosTheta_w = std::abs(cosTheta_w);
+    Float sinTheta_w = SafeSqrt(1 - cosTheta_w * cosTheta_w);
+
+    // Compute $\cos\,\theta_\roman{\+b}$ for reference point
+    Float cosTheta_b = BoundSubtendedDirections(bounds, p).cosTheta;
+    Float sinTheta_b = SafeSqrt(1 - cosTheta_b * cosTheta_b);
+
+    // Compute $\cos\,\theta'$ and test against $\cos\,\theta_\roman{e}$
+    Float sinTheta_o = SafeSqrt(1 - cosTheta_o * cosTheta_o);
+    Float cosTheta_x =
+        cosSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+    Float sinTheta_x =
+        sinSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+    Float cosThetap = cosSubClamped(sinTheta_x, cosTheta_x, sinTheta_b, cosTheta_b);
+    if (cosThetap <= cosTheta_e) return 0;
+
+    // Return final importance at reference point
+    Float importance = phi * cosThetap / d2;
+    // Account for $\cos\theta_\roman{i}$ in importance at surfaces
+    if (n != Normal3f()) {
+        Float cosTheta_i = AbsDot(n, wi);
+        Float sinTheta_i = SafeSqrt(1 - cosTheta_i * cosTheta_i);
+        Float cosThetap_i =
+            cosSubClamped(sinTheta_i, cosTheta_i, sinTheta_b, cosTheta_b);
+        importance *= cosThetap_i;
+    }
+    return std::max<Float>(importance, 0);
+}
+
+LightBounds Union(const LightBounds& a, const LightBounds& b) {
+    // If one _LightBounds_ has zero power, return the other
+    if (a.phi == 0) return b;
+    if (b.phi == 0) return a;
+
+    // Find average direction and updated angles for _LightBounds_
+    DirectionCone cone =
+        Union(DirectionCone(a.w, a.cosTheta_o), DirectionCone(b.w, b.cosTheta_o));
+    Float cosTheta_o = cone.cosTheta;
+    Float cosTheta_e = std::min(a.cosTheta_e, b.cosTheta_e);
+
+    // Return final _LightBounds_ union
+    return LightBounds(Union(a.bounds, b.bounds), cone.w, a.phi + b.phi,
+        cosTheta_o, cosTheta_e, a.twoSided || b.twoSided);
+}
+
+// VisibilityTester Method Definitions
+Ray VisibilityTester::ShadowRay() const {
+    Vector3f d = p1 - p0;
+    Float dist = d.Length();
+    return Ray(p0, d / dist, 0.f, 0.001, dist - 0.001);
+}
+
+bool VisibilityTester::Unoccluded(const hittable& world) const {
+    Ray r = ShadowRay();
+    hit_info hit;
+    return !world.intersect(r, r.tMin, r.tMax, hit);
+}
+
+Float VisibilityTester::Tr(const hittable& world) const {
+    Ray r = ShadowRay();
+    return world.Tr(r, r.tMin, r.tMax);
+}
+
+// Light Method Definitions
+Light::Light(int flags, const Transform& LightToWorld, int nSamples)
+    : flags(flags),
+    nSamples(std::max(1, nSamples)),
+    LightToWorld(LightToWorld),
+    WorldToLight(Inverse(LightToWorld)) {}
+
+Light::~Light() {}
+
+Color Light::Le(const Ray& ray) const { return Color(0.f); }
+
+AreaLight::AreaLight(const Transform& LightToWorld, int nSamples)
+    : Light((int)LightFlags::Area, LightToWorld, nSamples) {}
+
+// PointLight Method Definitions
+Color PointLight::Sample_Li(const Interaction& ref, const Point2f& u,
+    Vector3f* wi, Float* pdf,
+    VisibilityTester* vis) const {
+    *wi = Normalize(pLight - ref.p);
+    *pdf = 1.f;
+    *vis = VisibilityTester(ref.p, pLight);
+    return I / DistanceSquared(pLight, ref.p);
+}
+
+Color PointLight::Power() const { return 4 * Pi * I; }
+
+Float PointLight::Pdf_Li(const Interaction&, const Vector3f&) const {
+    return 0;
+}
+
+bool PointLight::Bounds(LightBounds* lb) const {
+    Float phi = 4 * Pi * I.MaxComponentValue();
+    *lb = LightBounds(Bounds3f(pLight, pLight), Vector3f(0, 0, 1), phi,
+        std::cos(Pi), std::cos(Pi / 2), false);
+    return true;
+}
+
+// SpotLight Method Definitions
+SpotLight::SpotLight(const Transform& LightToWorld, const Color& I,
+    Float totalWidth, Float falloffStart)
+    : Light((int)LightFlags::DeltaPosition, LightToWorld),
+    pLight(LightToWorld(Point3f(0, 0, 0))),
+    I(I),
+    cosTotalWidth(std::cos(Radians(totalWidth))),
+    cosFalloffStart(std::cos(Radians(falloffStart))) {}
+
+Color SpotLight::Sample_Li(const Interaction& ref, const Point2f& u,
+    Vector3f* wi, Float* pdf,
+    VisibilityTester* vis) const {
+    *wi = Normalize(pLight - ref.p);
+    *pdf = 1.f;
+    *vis = VisibilityTester(ref.p, pLight);
+    return I * Falloff(-*wi) / DistanceSquared(pLight, ref.p);
+}
+
+Float SpotLight::Falloff(const Vector3f& w) const {
+    Vector3f wl = Normalize(WorldToLight(w));
+    Float cosTheta = wl.z;
+    if (cosTheta < cosTotalWidth) return 0;
+    if (cosTheta >= cosFalloffStart) return 1;
+    // Compute falloff inside spotlight cone
+    Float delta =
+        (cosTheta - cosTotalWidth) / (cosFalloffStart - cosTotalWidth);
+    return (delta * delta) * (delta * delta);
+}
+
+Color SpotLight::Power() const {
+    return I * 2 * Pi * (1 - .5f * (cosFalloffStart + cosTotalWidth));
+}
+
+Float SpotLight::Pdf_Li(const Interaction&, const Vector3f&) const {
+    return 0.f;
+}
+
+bool SpotLight::Bounds(LightBounds* lb) const {
+    Vector3f w = Normalize(LightToWorld(Vector3f(0, 0, 1)));
+    Float phi = 4 * Pi * I.MaxComponentValue();
+    Float cosTheta_e = std::cos(std::acos(cosTotalWidth) - std::acos(cosFalloffStart));
+    *lb = LightBounds(Bounds3f(pLight, pLight), w, phi, cosFalloffStart,
+        cosTheta_e, false);
+    return true;
+}
+
+// DistantLight Method Definitions
+DistantLight::DistantLight(const Transform& LightToWorld, const Color& L,
+    const Vector3f& wLight)
+    : Light((int)LightFlags::DeltaDirection, LightToWorld),
+    L(L),
+    wLight(Normalize(LightToWorld(wLight))) {}
+
+Color DistantLight::Sample_Li(const Interaction& ref, const Point2f& u,
+    Vector3f* wi, Float* pdf,
+    VisibilityTester* vis) const {
+    *wi = wLight;
+    *pdf = 1;
+    Point3f pOutside = ref.p + wLight * (2 * worldRadius);
+    *vis = VisibilityTester(ref.p, pOutside);
+    return L;
+}
+
+Color DistantLight::Power() const {
+    return L * Pi * worldRadius * worldRadius;
+}
+
+Float DistantLight::Pdf_Li(const Interaction&, const Vector3f&) const {
+    return 0.f;
+}
+
+// DiffuseAreaLight Method Definitions
+DiffuseAreaLight::DiffuseAreaLight(const Transform& LightToWorld,
+    const Color& Lemit, int nSamples,
+    const std::shared_ptr<Shape>& shape,
+    bool twoSided)
+    : AreaLight(LightToWorld, nSamples),
+    Lemit(Lemit),
+    shape(shape),
+    twoSided(twoSided),
+    area(shape->Area()) {}
+
+Color DiffuseAreaLight::Power() const {
+    return (twoSided ? 2 : 1) * Lemit * area * Pi;
+}
+
+Color DiffuseAreaLight::Sample_Li(const Interaction& ref, const Point2f& u,
+    Vector3f* wi, Float* pdf,
+    VisibilityTester* vis) const {
+    Interaction pShape = shape->Sample(ref, u, pdf);
+    if (*pdf == 0 || (pShape.p - ref.p).LengthSquared() == 0) {
+        *pdf = 0;
+        return Color(0.f);
+    }
+    *wi = Normalize(pShape.p - ref.p);
+    *vis = VisibilityTester(ref.p, pShape.p);
+    return L(pShape, -*wi);
+}
+
+Float DiffuseAreaLight::Pdf_Li(const Interaction& ref,
+    const Vector3f& wi) const {
+    return shape->Pdf(ref, wi);
+}
+
+bool DiffuseAreaLight::Bounds(LightBounds* lb) const {
+    Float phi = Lemit.MaxComponentValue() * (twoSided ? 2 : 1) * area;
+    DirectionCone nb = shape->NormalBounds();
+    *lb = LightBounds(shape->WorldBound(), nb.w, phi, nb.cosTheta,
+        std::cos(Pi / 2), twoSided);
+    return true;
+}
+
+// HittableAreaLight Method Definitions
+Color HittableAreaLight::L(const Interaction& intr, const Vector3f& w) const {
+    if (!intr.mat_ptr) return Lemit;
+    return intr.mat_ptr->emitted(Ray(intr.p, -w), intr, intr.u, intr.v, intr.p);
+}
+
+Color HittableAreaLight::Power() const {
+    // diffuse_light emits from both faces
+    return 2 * Lemit * shape->area() * Pi;
+}
+
+Color HittableAreaLight::Sample_Li(const Interaction& ref, const Point2f& u,
+    Vector3f* wi, Float* pdf,
+    VisibilityTester* vis) const {
+    // hittable::random() draws its own random numbers, so _u_ is unused
+    Vector3f d = shape->random(vec3(ref.p));
+    hit_record rec;
+    if (!shape->hit(Ray(ref.p, d), 0.001, Infinity, rec)) {
+        *pdf = 0;
+        return Color(0.f);
+    }
+    *pdf = shape->pdf_value(ref.p, d);
+    *wi = Normalize(d);
+    *vis = VisibilityTester(ref.p, rec.p);
+    return L(rec, -*wi);
+}
+
+Float HittableAreaLight::Pdf_Li(const Interaction& ref,
+    const Vector3f& wi) const {
+    return shape->pdf_value(ref.p, wi);
+}
+
+bool HittableAreaLight::Bounds(LightBounds* lb) const {
+    aabb box;
+    if (!shape->bounding_box(0, 1, box)) return false;
+    Float phi = 2 * Lemit.MaxComponentValue() * shape->area();
+    // The rects pad their flat axis by 1e-4; treat such bounds as a planar
+    // emitter facing along that axis, anything else as emitting everywhere
+    vec3 extent = box.pMax - box.pMin;
+    int flat = extent.x < 1e-3f ? 0 : (extent.y < 1e-3f ? 1 : (extent.z < 1e-3f ? 2 : -1));
+    if (flat >= 0) {
+        Vector3f w(0, 0, 0);
+        w[flat] = 1;
+        *lb = LightBounds(box, w, phi, 1, std::cos(Pi / 2), true);
+    }
+    else
+        *lb = LightBounds(box, Vector3f(0, 0, 1), phi, std::cos(Pi),
+            std::cos(Pi / 2), true);
+    return true;
+}
+
+// InfiniteAreaLight Method Definitions
+InfiniteAreaLight::InfiniteAreaLight(const Transform& LightToWorld,
+    const Color& L, int nSamples,
+    const std::string& texmap)
+    : Light((int)LightFlags::Infinite, LightToWorld, nSamples), Lscale(L) {
+    // Read texel data from _texmap_ and initialize _Lmap_
+    if (!texmap.empty())
+        Lmap.reset(new hdr_image(texmap));
+    if (!Lmap || Lmap->width == 0)
+        Lmap.reset(new hdr_image(color(1, 1, 1)));
+
+    // Initialize sampling PDFs for infinite area light
+
+    // Compute scalar-valued image _img_ from environment map; the $\sin\theta$
+    // factor accounts for the lat-long mapping's distortion near the poles
+    int width = Lmap->width, height = Lmap->height;
+    std::unique_ptr<Float[]> img(new Float[width * height]);
+    for (int v = 0; v < height; ++v) {
+        Float vp = (v + .5f) / (Float)height;
+        Float sinTheta = std::sin(Pi * vp);
+        for (int u = 0; u < width; ++u) {
+            const color& c = Lmap->texel(u, v);
+            img[u + v * width] =
+                (0.212671f * c.x + 0.715160f * c.y + 0.072169f * c.z) * sinTheta;
+        }
+    }
+
+    // Compute sampling distributions for rows and columns of image
+    distribution.reset(new Distribution2D(img.get(), width, height));
+}
+
+InfiniteAreaLight::~InfiniteAreaLight() {}
+
+Color InfiniteAreaLight::Lookup(const Point2f& st) const {
+    return Color::FromRGB(Lmap->lookup(st.x, st.y), SpectrumType::Illuminant) * Lscale;
+}
+
+Color InfiniteAreaLight::Power() const {
+    color sum(0, 0, 0);
+    for (const color& c : Lmap->texels) sum += c;
+    sum = sum / (Float)Lmap->texels.size();
+    return Pi * worldRadius * worldRadius *
+        Color::FromRGB(sum, SpectrumType::Illuminant) * Lscale;
+}
+
+Color InfiniteAreaLight::Le(const Ray& ray) const {
+    Vector3f wi = Normalize(WorldToLight(ray.d));
+    Point2f st(SphericalPhi(wi) * Inv2Pi, SphericalTheta(wi) * InvPi);
+    return Lookup(st);
+}
+
+Color InfiniteAreaLight::Sample_Li(const Interaction& ref, const Point2f& u,
+    Vector3f* wi, Float* pdf,
+    VisibilityTester* vis) const {
+    // Find $(u,v)$ sample coordinates in infinite light texture
+    Float mapPdf;
+    Point2f uv = distribution->SampleContinuous(u, &mapPdf);
+    if (mapPdf == 0) {
+        *pdf = 0;
+        return Color(0.f);
+    }
+
+    // Convert infinite light sample point to direction
+    Float theta = uv.y * Pi, phi = uv.x * 2 * Pi;
+    Float cosTheta = std::cos(theta), sinTheta = std::sin(theta);
+    Float sinPhi = std::sin(phi), cosPhi = std::cos(phi);
+    *wi = Normalize(LightToWorld(Vector3f(sinTheta * cosPhi, sinTheta * sinPhi, cosTheta)));
+
+    // Compute PDF for sampled infinite light direction
+    *pdf = mapPdf / (2 * Pi * Pi * sinTheta);
+    if (sinTheta == 0) *pdf = 0;
+
+    // Return radiance value for infinite light direction
+    *vis = VisibilityTester(ref.p, ref.p + *wi * (2 * worldRadius));
+    return Lookup(uv);
+}
+
+Float InfiniteAreaLight::Pdf_Li(const Interaction&, const Vector3f& w) const {
+    Vector3f wi = Normalize(WorldToLight(w));
+    Float theta = SphericalTheta(wi), phi = SphericalPhi(wi);
+    Float sinTheta = std::sin(theta);
+    if (sinTheta == 0) return 0;
+    return distribution->Pdf(Point2f(phi * Inv2Pi, theta * InvPi)) /
+        (2 * Pi * Pi * sinTheta);
+}
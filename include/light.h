@@ -0,0 +1,251 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include "rtweekend.h"
+#include "hittable.h"
+#include "transform.h"
+#include "spectrum.h"
+
+#include <memory>
+#include <string>
+
+class Shape;
+class hdr_image;
+class Distribution2D;
+
+// LightFlags Declarations
+enum class LightFlags : int {
+    DeltaPosition = 1,
+    DeltaDirection = 2,
+    Area = 4,
+    Infinite = 8
+};
+
+inline bool IsDeltaLight(int flags) {
+    return flags & (int)LightFlags::DeltaPosition ||
+        flags & (int)LightFlags::DeltaDirection;
+}
+
+// LightBounds Declarations
+// Spatial and directional bounds of one light or a cluster of lights:
+// emitted power _phi_, normals within the cone (_w_, _cosTheta_o_) and
+// emission within a further _cosTheta_e_ of those normals.
+struct LightBounds {
+    // LightBounds Public Methods
+    LightBounds() = default;
+    LightBounds(const Bounds3f& b, const Vector3f& w, Float phi,
+        Float cosTheta_o, Float cosTheta_e, bool twoSided);
+    Point3f Centroid() const { return .5f * bounds.pMin + .5f * bounds.pMax; }
+    // Conservative estimate of the light reaching _p_ with surface normal
+    // _n_ (zero for points not on a surface)
+    Float Importance(const Point3f& p, const Normal3f& n) const;
+
+    // LightBounds Public Data
+    Bounds3f bounds;
+    Float phi = 0;
+    Vector3f w;
+    Float cosTheta_o, cosTheta_e;
+    bool twoSided;
+};
+
+LightBounds Union(const LightBounds& a, const LightBounds& b);
+
+// VisibilityTester Declarations
+class VisibilityTester {
+public:
+    // VisibilityTester Public Methods
+    VisibilityTester() {}
+    VisibilityTester(const Point3f& p0, const Point3f& p1) : p0(p0), p1(p1) {}
+    const Point3f& P0() const { return p0; }
+    const Point3f& P1() const { return p1; }
+    // Segment from _p0_ to _p1_, shortened at both ends by the same 0.001
+    // the hittable code uses to avoid self-intersection
+    Ray ShadowRay() const;
+    bool Unoccluded(const hittable& world) const;
+    // Fraction of light getting through _world_ along the segment: 0 if a
+    // surface is in the way, the media's transmittance otherwise
+    Float Tr(const hittable& world) const;
+
+private:
+    Point3f p0, p1;
+};
+
+// Light Declarations
+class Light {
+public:
+    // Light Interface
+    virtual ~Light();
+    Light(int flags, const Transform& LightToWorld, int nSamples = 1);
+    virtual Color Sample_Li(const Interaction& ref, const Point2f& u,
+        Vector3f* wi, Float* pdf,
+        VisibilityTester* vis) const = 0;
+    virtual Color Power() const = 0;
+    virtual void Preprocess(const Bounds3f& sceneBounds) {}
+    virtual Color Le(const Ray& r) const;
+    virtual Float Pdf_Li(const Interaction& ref, const Vector3f& wi) const = 0;
+    // Lights without finite bounds (distant, infinite) return false and
+    // are sampled outside of the light BVH
+    virtual bool Bounds(LightBounds* lb) const { return false; }
+
+    // Light Public Data
+    const int flags;
+    const int nSamples;
+
+protected:
+    // Light Protected Data
+    const Transform LightToWorld, WorldToLight;
+};
+
+class AreaLight : public Light {
+public:
+    // AreaLight Interface
+    AreaLight(const Transform& LightToWorld, int nSamples);
+    virtual Color L(const Interaction& intr, const Vector3f& w) const = 0;
+};
+
+// PointLight Declarations
+class PointLight : public Light {
+public:
+    // PointLight Public Methods
+    PointLight(const Transform& LightToWorld, const Color& I)
+        : Light((int)LightFlags::DeltaPosition, LightToWorld),
+        pLight(LightToWorld(Point3f(0, 0, 0))),
+        I(I) {}
+    Color Sample_Li(const Interaction& ref, const Point2f& u, Vector3f* wi,
+        Float* pdf, VisibilityTester* vis) const;
+    Color Power() const;
+    Float Pdf_Li(const Interaction&, const Vector3f&) const;
+    bool Bounds(LightBounds* lb) const;
+
+private:
+    // PointLight Private Data
+    const Point3f pLight;
+    const Color I;
+};
+
+// SpotLight Declarations
+class SpotLight : public Light {
+public:
+    // SpotLight Public Methods
+    SpotLight(const Transform& LightToWorld, const Color& I,
+        Float totalWidth, Float falloffStart);
+    Color Sample_Li(const Interaction& ref, const Point2f& u, Vector3f* wi,
+        Float* pdf, VisibilityTester* vis) const;
+    Float Falloff(const Vector3f& w) const;
+    Color Power() const;
+    Float Pdf_Li(const Interaction&, const Vector3f&) const;
+    bool Bounds(LightBounds* lb) const;
+
+private:
+    // SpotLight Private Data
+    const Point3f pLight;
+    const Color I;
+    const Float cosTotalWidth, cosFalloffStart;
+};
+
+// DistantLight Declarations
+class DistantLight : public Light {
+public:
+    // DistantLight Public Methods
+    DistantLight(const Transform& LightToWorld, const Color& L,
+        const Vector3f& w);
+    void Preprocess(const Bounds3f& sceneBounds) {
+        sceneBounds.BoundingSphere(worldCenter, worldRadius);
+    }
+    Color Sample_Li(const Interaction& ref, const Point2f& u, Vector3f* wi,
+        Float* pdf, VisibilityTester* vis) const;
+    Color Power() const;
+    Float Pdf_Li(const Interaction&, const Vector3f&) const;
+
+private:
+    // DistantLight Private Data
+    const Color L;
+    const Vector3f wLight;
+    Point3f worldCenter;
+    float worldRadius;
+};
+
+// DiffuseAreaLight Declarations
+class DiffuseAreaLight : public AreaLight {
+public:
+    // DiffuseAreaLight Public Methods
+    DiffuseAreaLight(const Transform& LightToWorld, const Color& Le,
+        int nSamples, const std::shared_ptr<Shape>& shape,
+        bool twoSided = false);
+    Color L(const Interaction& intr, const Vector3f& w) const {
+        return (twoSided || Dot(vec3(intr.n), w) > 0) ? Lemit : Color(0.f);
+    }
+    Color Power() const;
+    Color Sample_Li(const Interaction& ref, const Point2f& u, Vector3f* wo,
+        Float* pdf, VisibilityTester* vis) const;
+    Float Pdf_Li(const Interaction&, const Vector3f&) const;
+    bool Bounds(LightBounds* lb) const;
+
+protected:
+    // DiffuseAreaLight Protected Data
+    const Color Lemit;
+    std::shared_ptr<Shape> shape;
+    const bool twoSided;
+    const Float area;
+};
+
+// HittableAreaLight Declarations
+// Area light over one of the legacy hittables (rects, spheres). Sampling
+// goes through hittable::random()/pdf_value() and the emitted radiance is
+// whatever the surface's material reports, so light samples agree with
+// the emission found by rays that hit the shape directly.
+class HittableAreaLight : public AreaLight {
+public:
+    // HittableAreaLight Public Methods
+    HittableAreaLight(const std::shared_ptr<hittable>& shape, const Color& Lemit)
+        : AreaLight(Transform(), 1), shape(shape), Lemit(Lemit) {}
+    Color L(const Interaction& intr, const Vector3f& w) const;
+    Color Power() const;
+    Color Sample_Li(const Interaction& ref, const Point2f& u, Vector3f* wi,
+        Float* pdf, VisibilityTester* vis) const;
+    Float Pdf_Li(const Interaction& ref, const Vector3f& wi) const;
+    bool Bounds(LightBounds* lb) const;
+
+private:
+    // HittableAreaLight Private Data
+    std::shared_ptr<hittable> shape;
+    const Color Lemit;
+};
+
+// InfiniteAreaLight Declarations
+// Environment light from a lat-long image: _t_ (rows) maps to $\theta$
+// measured from the light-space +z axis and _s_ to $\phi$. Directions are
+// importance sampled from a Distribution2D over the image luminance.
+class InfiniteAreaLight : public Light {
+public:
+    // InfiniteAreaLight Public Methods
+    InfiniteAreaLight(const Transform& LightToWorld, const Color& L,
+        int nSamples, const std::string& texmap);
+    ~InfiniteAreaLight();
+    void Preprocess(const Bounds3f& sceneBounds) {
+        sceneBounds.BoundingSphere(worldCenter, worldRadius);
+    }
+    Color Power() const;
+    Color Le(const Ray& ray) const;
+    Color Sample_Li(const Interaction& ref, const Point2f& u, Vector3f* wi,
+        Float* pdf, VisibilityTester* vis) const;
+    Float Pdf_Li(const Interaction&, const Vector3f&) const;
+
+private:
+    // InfiniteAreaLight Private Methods
+    Color Lookup(const Point2f& st) const;
+
+    // InfiniteAreaLight Private Data
+    const Color Lscale;
+    std::unique_ptr<hdr_image> Lmap;
+    Point3f worldCenter;
+    float worldRadius;
+    std::unique_ptr<Distribution2D> distribution;
+};
+
+#endif // !LIGHT_H
@@ -0,0 +1,298 @@
+#include "lightdistrib.h"
+#include <algorithm>
+
+LightDistribution::~LightDistribution() {}
+
+std::unique_ptr<LightDistribution> CreateLightSampleDistribution(
+    const std::string& name, const std::vector<std::shared_ptr<Light>>& lights) {
+    if (name == "uniform" || lights.size() == 1)
+        return std::unique_ptr<LightDistribution>{
+            new UniformLightDistribution(lights) };
+    else if (name == "power")
+        return std::unique_ptr<LightDistribution>{
+            new PowerLightDistribution(lights) };
+    else if (name == "bvh")
+        return std::unique_ptr<LightDistribution>{
+            new BVHLightDistribution(lights) };
+    else {
+        std::cerr << "Light sample distribution type \"" << name
+            << "\" unknown. Using \"bvh\"." << std::endl;
+        return std::unique_ptr<LightDistribution>{
+            new BVHLightDistribution(lights) };
+    }
+}
+
+// UniformLightDistribution Method Definitions
+UniformLightDistribution::UniformLightDistribution(
+    const std::vector<std::shared_ptr<Light>>& lights) {
+    for (const auto& light : lights) this->lights.push_back(light.get());
+}
+
+const Light* UniformLightDistribution::Sample(const Interaction& ref, Float u,
+    Float* pmf) const {
+    if (lights.empty()) {
+        *pmf = 0;
+        return nullptr;
+    }
+    int lightNum = std::min((int)(u * lights.size()), (int)lights.size() - 1);
+    *pmf = Float(1) / lights.size();
+    return lights[lightNum];
+}
+
+Float UniformLightDistribution::PMF(const Interaction& ref,
+    const Light* light) const {
+    return lights.empty() ? 0 : Float(1) / lights.size();
+}
+
+// PowerLightDistribution Method Definitions
+PowerLightDistribution::PowerLightDistribution(
+    const std::vector<std::shared_ptr<Light>>& lights) {
+    std::vector<Float> lightPower;
+    for (const auto& light : lights) {
+        lightToIndex[light.get()] = (int)this->lights.size();
+        this->lights.push_back(light.get());
+        lightPower.push_back(light->Power().y());
+    }
+    if (!lightPower.empty()) aliasTable = AliasTable(lightPower);
+}
+
+const Light* PowerLightDistribution::Sample(const Interaction& ref, Float u,
+    Float* pmf) const {
+    if (lights.empty()) {
+        *pmf = 0;
+        return nullptr;
+    }
+    return lights[aliasTable.Sample(u, pmf)];
+}
+
+Float PowerLightDistribution::PMF(const Interaction& ref,
+    const Light* light) const {
+    auto iter = lightToIndex.find(light);
+    if (iter == lightToIndex.end()) return 0;
+    return aliasTable.PMF(iter->second);
+}
+
+// BVHLightDistribution Method Definitions
+static Normal3f ShadingNormal(const Interaction& ref) {
+    // Legacy hittables fill _normal_, Shape intersections fill _n_
+    return ref.n != Normal3f() ? ref.n : Normal3f(ref.normal);
+}
+
+BVHLightDistribution::BVHLightDistribution(
+    const std::vector<std::shared_ptr<Light>>& lights) {
+    // Initialize _infiniteLights_ and collect bounds of the others
+    std::vector<std::pair<int, LightBounds>> bvhLights;
+    for (const auto& light : lights) {
+        LightBounds lb;
+        if (!light->Bounds(&lb))
+            infiniteLights.push_back(light.get());
+        else if (lb.phi > 0) {
+            bvhLights.push_back(std::make_pair((int)this->lights.size(), lb));
+            this->lights.push_back(light.get());
+        }
+    }
+    if (!bvhLights.empty())
+        buildBVH(bvhLights, 0, bvhLights.size(), 0, 0);
+}
+
+std::pair<int, LightBounds> BVHLightDistribution::buildBVH(
+    std::vector<std::pair<int, LightBounds>>& bvhLights, int start, int end,
+    uint64_t bitTrail, int depth) {
+    CHECK_LT(start, end);
+    // Initialize leaf node if only a single light remains
+    if (end - start == 1) {
+        int nodeIndex = nodes.size();
+        const LightBounds& lb = bvhLights[start].second;
+        nodes.push_back(LightBVHNode{ lb, bvhLights[start].first, true });
+        lightToBitTrail[lights[bvhLights[start].first]] = bitTrail;
+        return std::make_pair(nodeIndex, lb);
+    }
+
+    // Choose split dimension and position using modified SAH
+    // Compute bounds and centroid bounds for lights
+    Bounds3f bounds = bvhLights[start].second.bounds;
+    Point3f c = bvhLights[start].second.Centroid();
+    Bounds3f centroidBounds(c, c);
+    for (int i = start + 1; i < end; ++i) {
+        const LightBounds& lb = bvhLights[i].second;
+        bounds = Union(bounds, lb.bounds);
+        centroidBounds = Union(centroidBounds, aabb(lb.Centroid()));
+    }
+
+    Float minCost = Infinity;
+    int minCostSplitBucket = -1, minCostSplitDim = -1;
+    constexpr int nBuckets = 12;
+    for (int dim = 0; dim < 3; ++dim) {
+        // Compute minimum cost bucket for splitting along dimension _dim_
+        if (centroidBounds.pMax[dim] == centroidBounds.pMin[dim]) continue;
+        // Compute _LightBounds_ for each bucket
+        LightBounds bucketLightBounds[nBuckets];
+        for (int i = start; i < end; ++i) {
+            Point3f pc = bvhLights[i].second.Centroid();
+            int b = nBuckets * centroidBounds.Offset(pc)[dim];
+            if (b == nBuckets) b = nBuckets - 1;
+            bucketLightBounds[b] = Union(bucketLightBounds[b], bvhLights[i].second);
+        }
+
+        // Compute costs for splitting lights after each bucket
+        Float cost[nBuckets - 1];
+        for (int i = 0; i < nBuckets - 1; ++i) {
+            // Find _LightBounds_ for lights below and above bucket split
+            LightBounds b0, b1;
+            for (int j = 0; j <= i; ++j) b0 = Union(b0, bucketLightBounds[j]);
+            for (int j = i + 1; j < nBuckets; ++j)
+                b1 = Union(b1, bucketLightBounds[j]);
+
+            // Compute final light split cost for bucket
+            cost[i] = EvaluateCost(b0, bounds, dim) + EvaluateCost(b1, bounds, dim);
+        }
+
+        // Find light split that minimizes SAH metric
+        for (int i = 1; i < nBuckets - 1; ++i) {
+            if (cost[i] > 0 && cost[i] < minCost) {
+                minCost = cost[i];
+                minCostSplitBucket = i;
+                minCostSplitDim = dim;
+            }
+        }
+    }
+
+    // Partition lights according to chosen split
+    int mid;
+    if (minCostSplitDim == -1)
+        mid = (start + end) / 2;
+    else {
+        const auto* pmid = std::partition(
+            &bvhLights[start], &bvhLights[end - 1] + 1,
+            [=](const std::pair<int, LightBounds>& l) {
+                int b = nBuckets *
+                    centroidBounds.Offset(l.second.Centroid())[minCostSplitDim];
+                if (b == nBuckets) b = nBuckets - 1;
+                return b <= minCostSplitBucket;
+            });
+        mid = pmid - &bvhLights[0];
+        if (mid == start || mid == end) mid = (start + end) / 2;
+    }
+
+    // Allocate interior _LightBVHNode_ and recursively initialize children
+    int nodeIndex = nodes.size();
+    nodes.push_back(LightBVHNode{ LightBounds(), 0, false });
+    CHECK_LT(depth, 64);
+    std::pair<int, LightBounds> child0 =
+        buildBVH(bvhLights, start, mid, bitTrail, depth + 1);
+    std::pair<int, LightBounds> child1 =
+        buildBVH(bvhLights, mid, end, bitTrail | (uint64_t(1) << depth), depth + 1);
+
+    // Initialize interior node and return node index and bounds
+    LightBounds lb = Union(child0.second, child1.second);
+    nodes[nodeIndex].lightBounds = lb;
+    nodes[nodeIndex].childOrLightIndex = child1.first;
+    return std::make_pair(nodeIndex, lb);
+}
+
+Float BVHLightDistribution::EvaluateCost(const LightBounds& b,
+    const Bounds3f& bounds, int dim) const {
+    if (b.phi == 0) return 0;
+    // Evaluate direction bounds measure for _LightBounds_
+    Float theta_o = std::acos(b.cosTheta_o), theta_e = std::acos(b.cosTheta_e);
+    Float theta_w = std::min(theta_o + theta_e, Pi);
+    Float sinTheta_o = SafeSqrt(1 - b.cosTheta_o * b.cosTheta_o);
+    Float M_omega = 2 * Pi * (1 - b.cosTheta_o) +
+        Pi / 2 * (2 * theta_w * sinTheta_o - std::cos(theta_o - 2 * theta_w) -
+            2 * theta_o * sinTheta_o + b.cosTheta_o);
+
+    // Return complete cost estimate for _LightBounds_
+    vec3 d = bounds.pMax - bounds.pMin;
+    Float Kr = d[dim] > 0 ? MaxComponent(d) / d[dim] : 1;
+    return b.phi * M_omega * Kr * b.bounds.SurfaceArea();
+}
+
+const Light* BVHLightDistribution::Sample(const Interaction& ref, Float u,
+    Float* pmf) const {
+    *pmf = 0;
+    // Compute infinite light sampling probability _pInfinite_
+    Float pInfinite = Float(infiniteLights.size()) /
+        Float(infiniteLights.size() + (nodes.empty() ? 0 : 1));
+
+    if (u < pInfinite) {
+        // Sample infinite lights with uniform probability
+        u /= pInfinite;
+        int index = std::min<int>(u * infiniteLights.size(),
+            infiniteLights.size() - 1);
+        *pmf = pInfinite / infiniteLights.size();
+        return infiniteLights[index];
+    }
+    if (nodes.empty()) return nullptr;
+
+    // Traverse light BVH to sample light
+    Point3f p = ref.p;
+    Normal3f n = ShadingNormal(ref);
+    u = std::min<Float>((u - pInfinite) / (1 - pInfinite), OneMinusEpsilon);
+    int nodeIndex = 0;
+    Float pmfAcc = 1 - pInfinite;
+    while (true) {
+        const LightBVHNode& node = nodes[nodeIndex];
+        if (!node.isLeaf) {
+            // Compute light BVH child node importances
+            Float ci[2] = { nodes[nodeIndex + 1].lightBounds.Importance(p, n),
+                            nodes[node.childOrLightIndex].lightBounds.Importance(p, n) };
+            if (ci[0] == 0 && ci[1] == 0) return nullptr;
+
+            // Randomly sample light BVH child node, reusing _u_
+            Float p0 = ci[0] / (ci[0] + ci[1]);
+            if (u < p0) {
+                u = std::min<Float>(u / p0, OneMinusEpsilon);
+                pmfAcc *= p0;
+                nodeIndex = nodeIndex + 1;
+            }
+            else {
+                u = std::min<Float>((u - p0) / (1 - p0), OneMinusEpsilon);
+                pmfAcc *= 1 - p0;
+                nodeIndex = node.childOrLightIndex;
+            }
+        }
+        else {
+            // Confirm light has nonzero importance before returning light sample
+            if (nodeIndex > 0 || node.lightBounds.Importance(p, n) > 0) {
+                *pmf = pmfAcc;
+                return lights[node.childOrLightIndex];
+            }
+            return nullptr;
+        }
+    }
+}
+
+Float BVHLightDistribution::PMF(const Interaction& ref,
+    const Light* light) const {
+    // Handle infinite _light_ PMF computation
+    auto iter = lightToBitTrail.find(light);
+    if (iter == lightToBitTrail.end()) {
+        if (std::find(infiniteLights.begin(), infiniteLights.end(), light) ==
+            infiniteLights.end())
+            return 0;
+        return 1.f / (infiniteLights.size() + (nodes.empty() ? 0 : 1));
+    }
+
+    // Initialize local variables for BVH traversal for PMF computation
+    uint64_t bitTrail = iter->second;
+    Point3f p = ref.p;
+    Normal3f n = ShadingNormal(ref);
+    // Compute infinite light sampling probability _pInfinite_
+    Float pInfinite = Float(infiniteLights.size()) /
+        Float(infiniteLights.size() + (nodes.empty() ? 0 : 1));
+    Float pmf = 1 - pInfinite;
+    int nodeIndex = 0;
+
+    // Compute light's PMF by walking down tree nodes to the light
+    while (true) {
+        const LightBVHNode& node = nodes[nodeIndex];
+        if (node.isLeaf) return pmf;
+        // Compute child importances and update PMF for current node
+        Float ci[2] = { nodes[nodeIndex + 1].lightBounds.Importance(p, n),
+                        nodes[node.childOrLightIndex].lightBounds.Importance(p, n) };
+        if (ci[0] == 0 && ci[1] == 0) return 0;
+        pmf *= ci[bitTrail & 1] / (ci[0] + ci[1]);
+        nodeIndex = (bitTrail & 1) ? node.childOrLightIndex : (nodeIndex + 1);
+        bitTrail >>= 1;
+    }
+}
@@ -0,0 +1,93 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef LIGHTDISTRIB_H
+#define LIGHTDISTRIB_H
+
+#include "light.h"
+#include "sampling.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// LightDistribution defines a general interface for classes that choose
+// one light to sample at a given shading point. PMF() must return the
+// probability Sample() would have picked _light_ at _ref_, so that
+// directions found by BSDF sampling can be MIS-weighted against it.
+class LightDistribution {
+public:
+    virtual ~LightDistribution();
+    virtual const Light* Sample(const Interaction& ref, Float u,
+        Float* pmf) const = 0;
+    virtual Float PMF(const Interaction& ref, const Light* light) const = 0;
+};
+
+std::unique_ptr<LightDistribution> CreateLightSampleDistribution(
+    const std::string& name, const std::vector<std::shared_ptr<Light>>& lights);
+
+// The simplest possible implementation of LightDistribution: this
+// returns a uniform distribution over all light sources, ignoring the
+// provided point.
+class UniformLightDistribution : public LightDistribution {
+public:
+    UniformLightDistribution(const std::vector<std::shared_ptr<Light>>& lights);
+    const Light* Sample(const Interaction& ref, Float u, Float* pmf) const;
+    Float PMF(const Interaction& ref, const Light* light) const;
+
+private:
+    std::vector<const Light*> lights;
+};
+
+// PowerLightDistribution returns a distribution with sampling probability
+// proportional to the total emitted power for each light, sampled in
+// constant time through an alias table.
+class PowerLightDistribution : public LightDistribution {
+public:
+    PowerLightDistribution(const std::vector<std::shared_ptr<Light>>& lights);
+    const Light* Sample(const Interaction& ref, Float u, Float* pmf) const;
+    Float PMF(const Interaction& ref, const Light* light) const;
+
+private:
+    std::vector<const Light*> lights;
+    std::unordered_map<const Light*, int> lightToIndex;
+    AliasTable aliasTable;
+};
+
+// BVHLightDistribution importance-samples lights relative to the shading
+// point: a bounding volume hierarchy over the lights' LightBounds is
+// descended in O(log N), choosing each child in proportion to its
+// LightBounds::Importance(). Lights without bounds (distant lights) are
+// chosen uniformly alongside the BVH as a whole.
+struct LightBVHNode {
+    LightBounds lightBounds;
+    int childOrLightIndex;  // leaf: light index, interior: second child
+    bool isLeaf;
+};
+
+class BVHLightDistribution : public LightDistribution {
+public:
+    BVHLightDistribution(const std::vector<std::shared_ptr<Light>>& lights);
+    const Light* Sample(const Interaction& ref, Float u, Float* pmf) const;
+    Float PMF(const Interaction& ref, const Light* light) const;
+
+private:
+    // BVHLightDistribution Private Methods
+    std::pair<int, LightBounds> buildBVH(
+        std::vector<std::pair<int, LightBounds>>& bvhLights, int start,
+        int end, uint64_t bitTrail, int depth);
+    Float EvaluateCost(const LightBounds& b, const Bounds3f& bounds,
+        int dim) const;
+
+    // BVHLightDistribution Private Data
+    std::vector<const Light*> lights;
+    std::vector<const Light*> infiniteLights;
+    std::vector<LightBVHNode> nodes;
+    // Path from the root to each light's leaf, one bit per level (1 means
+    // the second child), so PMF() can retrace Sample()'s decisions
+    std::unordered_map<const Light*, uint64_t> lightToBitTrail;
+};
+
+#endif // !LIGHTDISTRIB_H
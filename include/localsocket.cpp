@@ -0,0 +1,194 @@
+#include "localsocket.h"
+#include <cstring>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+// LocalSocket Method Definitions
+bool LocalSocket::Listen(const std::string&, std::string* error) {
+    *error = "local sockets are not supported on this platform";
+    return false;
+}
+
+bool LocalSocket::Accept(LocalSocket*, std::string* error) {
+    *error = "local sockets are not supported on this platform";
+    return false;
+}
+
+bool LocalSocket::Connect(const std::string&, std::string* error) {
+    *error = "local sockets are not supported on this platform";
+    return false;
+}
+
+bool LocalSocket::SetTimeout(int) { return false; }
+bool LocalSocket::ReadLine(std::string*) { return false; }
+bool LocalSocket::WriteLine(const std::string&) { return false; }
+void LocalSocket::Close() {}
+
+std::string CurrentDirectory() {
+    char buf[4096];
+    return _getcwd(buf, sizeof(buf)) ? buf : "";
+}
+
+bool ChangeDirectory(const std::string& dir) { return _chdir(dir.c_str()) == 0; }
+
+#else
+// LocalSocket Local Definitions
+namespace {
+
+bool SocketAddress(const std::string& path, sockaddr_un* addr, std::string* error) {
+    std::memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr->sun_path)) {
+        *error = "bad socket path '" + path + "'";
+        return false;
+    }
+    std::memcpy(addr->sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+std::string SystemError(const std::string& what) {
+    return what + ": " + std::strerror(errno);
+}
+
+}  // namespace
+
+// LocalSocket Method Definitions
+bool LocalSocket::Listen(const std::string& socketPath, std::string* error) {
+    Close();
+    sockaddr_un addr;
+    if (!SocketAddress(socketPath, &addr, error))
+        return false;
+    {
+        LocalSocket probe;
+        std::string ignored;
+        if (probe.Connect(socketPath, &ignored)) {
+            *error = "a server is already listening on '" + socketPath + "'";
+            return false;
+        }
+    }
+    unlink(socketPath.c_str());
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        *error = SystemError("socket");
+        return false;
+    }
+    // Jobs make the server write files anywhere it may, so other users
+    // must not be able to connect
+    mode_t mask = umask(077);
+    bool bound = bind(fd, (const sockaddr*)&addr, sizeof(addr)) == 0;
+    umask(mask);
+    if (bound)
+        path = socketPath;
+    if (!bound || chmod(socketPath.c_str(), 0600) != 0 || listen(fd, 16) != 0) {
+        *error = SystemError("cannot listen on '" + socketPath + "'");
+        Close();
+        return false;
+    }
+    // A client that disconnects early must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    return true;
+}
+
+bool LocalSocket::Accept(LocalSocket* client, std::string* error) {
+    client->Close();
+    int c;
+    do
+        c = accept(fd, nullptr, nullptr);
+    while (c < 0 && errno == EINTR);
+    if (c < 0) {
+        *error = SystemError("accept");
+        return false;
+    }
+    client->fd = c;
+    return true;
+}
+
+bool LocalSocket::Connect(const std::string& socketPath, std::string* error) {
+    Close();
+    sockaddr_un addr;
+    if (!SocketAddress(socketPath, &addr, error))
+        return false;
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+        *error = SystemError("cannot connect to '" + socketPath + "'");
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool LocalSocket::SetTimeout(int seconds) {
+    timeval tv;
+    tv.tv_sec = seconds;
+    tv.tv_usec = 0;
+    return setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0 &&
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == 0;
+}
+
+bool LocalSocket::ReadLine(std::string* line) {
+    while (true) {
+        size_t newline = buffer.find('\n');
+        if (newline != std::string::npos) {
+            *line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            return true;
+        }
+        char chunk[4096];
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buffer.append(chunk, n);
+    }
+}
+
+bool LocalSocket::WriteLine(const std::string& line) {
+    std::string data = line + "\n";
+    for (size_t done = 0; done < data.size();) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+void LocalSocket::Close() {
+    if (fd >= 0)
+        close(fd);
+    if (!path.empty())
+        unlink(path.c_str());
+    fd = -1;
+    path.clear();
+    buffer.clear();
+}
+
+std::string CurrentDirectory() {
+    char buf[4096];
+    return getcwd(buf, sizeof(buf)) ? buf : "";
+}
+
+bool ChangeDirectory(const std::string& dir) { return chdir(dir.c_str()) == 0; }
+
+#endif
+
+std::string AbsolutePath(const std::string& name) {
+    if (name.empty() || name[0] == '/' || name[0] == '\\' ||
+        (name.size() > 1 && name[1] == ':'))
+        return name;
+    std::string dir = CurrentDirectory();
+    return dir.empty() ? name : dir + "/" + name;
+}
@@ -0,0 +1,53 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef LOCALSOCKET_H
+#define LOCALSOCKET_H
+
+#include <string>
+
+// LocalSocket Declarations
+// Stream socket on a filesystem path (a Unix domain socket), carrying the
+// lines of text the render server (PBRT --serve) and its clients exchange.
+// Unix domain sockets are only implemented for POSIX systems; elsewhere
+// every call fails with an error saying so.
+class LocalSocket {
+public:
+    // LocalSocket Public Methods
+    LocalSocket() {}
+    ~LocalSocket() { Close(); }
+    LocalSocket(const LocalSocket&) = delete;
+    LocalSocket& operator=(const LocalSocket&) = delete;
+
+    // Creates the socket file _path_, accessible to this user only, and
+    // listens on it. Fails if another process is listening there; a stale
+    // file left by one that died is replaced.
+    bool Listen(const std::string& path, std::string* error);
+    // Waits for the next client of a listening socket
+    bool Accept(LocalSocket* client, std::string* error);
+    bool Connect(const std::string& path, std::string* error);
+    // Makes reads and writes give up after _seconds_ without progress
+    bool SetTimeout(int seconds);
+    // Reads up to the next newline, which is dropped; false at the end of
+    // the stream
+    bool ReadLine(std::string* line);
+    bool WriteLine(const std::string& line);
+    // Closes the connection; a listening socket also removes its file
+    void Close();
+
+private:
+    // LocalSocket Private Data
+    int fd = -1;
+    std::string path, buffer;
+};
+
+// The server runs each job in its client's working directory
+std::string CurrentDirectory();
+bool ChangeDirectory(const std::string& dir);
+// _name_ made absolute against the current directory, so that it still
+// names the same file once a later job has changed directory
+std::string AbsolutePath(const std::string& name);
+
+#endif // LOCALSOCKET_H
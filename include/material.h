@@ -7,8 +7,8 @@
 #include "onb.h"
 #include "pdf.h"
 #include "spectrum.h"
-
-enum class TransportMode { Radiance, Importance };
+#include "meomery.h"
+#include "primitive.h"
 
 struct hit_record;
 
@@ -16,19 +16,7 @@ struct scatter_record {
     ray specular_ray;
     bool is_specular;
     Color attenuation;
-    shared_ptr<pdf> pdf_ptr;
-};
-
-class Material {
-public:
-    // Material Interface
-    virtual void ComputeScatteringFunctions(SurfaceInteraction* si,
-        //MemoryArena& arena,
-        TransportMode mode,
-        bool allowMultipleLobes) const = 0;
-    virtual ~Material();
-    //static void Bump(const std::shared_ptr<Texture<Float>>& d,
-    //    SurfaceInteraction* si);
+    pdf* pdf_ptr = nullptr;
 };
 
 class material {
@@ -43,7 +31,8 @@ public:
         return false;
     }
     virtual bool scatter(
-        const ray& r_in, const hit_record& rec, scatter_record& srec
+        const ray& r_in, const hit_record& rec, scatter_record& srec,
+        MemoryArena& arena
     ) const {
         return false;
     }
@@ -53,6 +42,11 @@ public:
     ) const {
         return 0;
     }
+
+    // Reflectance at _rec_ for the albedo AOV
+    virtual color surface_albedo(const hit_record& rec) const {
+        return color(1, 1, 1);
+    }
 };
 
 class lambertian : public material {
@@ -62,17 +56,32 @@ public:
 
 
     virtual bool scatter(
-        const ray& r_in, const hit_record& rec, scatter_record& srec
+        const ray& r_in, const hit_record& rec, scatter_record& srec,
+        MemoryArena& arena
     ) const override {
-        srec.is_specular = false;
-        srec.attenuation = Color::FromRGB(albedo->value(rec.u, rec.v, rec.p));
-        srec.pdf_ptr = make_shared<cosine_pdf>(rec.normal);
+        scatter_with(albedo->value(rec.u, rec.v, rec.p), rec, srec, arena);
         return true;
     }
 
     Float scattering_pdf(
         const ray& r_in, const hit_record& rec, const ray& scattered
     ) const {
+        return pdf(rec, scattered);
+    }
+
+    virtual color surface_albedo(const hit_record& rec) const override {
+        return albedo->value(rec.u, rec.v, rec.p);
+    }
+
+    // The scattering of a lambertian surface with albedo _a_ at _rec_,
+    // shared with MaterialTable
+    static void scatter_with(const color& a, const hit_record& rec,
+        scatter_record& srec, MemoryArena& arena) {
+        srec.is_specular = false;
+        srec.attenuation = Color::FromRGB(a);
+        srec.pdf_ptr = ARENA_ALLOC(arena, cosine_pdf)(rec.normal);
+    }
+    static Float pdf(const hit_record& rec, const ray& scattered) {
         auto cosine = Dot(rec.normal, unit_vector(scattered.direction()));
         return cosine < 0 ? 0 : cosine / Pi;
     }
@@ -87,14 +96,24 @@ public:
     metal(const color& a, Float f) : albedo(Color::FromRGB(a)), fuzz(f < 1 ? f : 1) {}
 
     virtual bool scatter(
-        const ray& r_in, const hit_record& rec, scatter_record& srec
+        const ray& r_in, const hit_record& rec, scatter_record& srec,
+        MemoryArena& arena
     ) const override {
+        scatter_with(albedo, fuzz, r_in, rec, srec);
+        return true;
+    }
+
+    virtual color surface_albedo(const hit_record& rec) const override {
+        return albedo.ToColor();
+    }
+
+    static void scatter_with(const Color& albedo, Float fuzz, const ray& r_in,
+        const hit_record& rec, scatter_record& srec) {
         vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
         srec.specular_ray = ray(rec.p, reflected + fuzz * random_in_unit_sphere());
         srec.attenuation = albedo;
         srec.is_specular = true;
         srec.pdf_ptr = 0;
-        return true;
     }
 
 public:
@@ -107,8 +126,15 @@ public:
     dielectric(Float index_of_refraction) : ir(index_of_refraction) {}
 
     virtual bool scatter(
-        const ray& r_in, const hit_record& rec, scatter_record& srec
+        const ray& r_in, const hit_record& rec, scatter_record& srec,
+        MemoryArena& arena
     ) const override {
+        scatter_with(ir, r_in, rec, srec);
+        return true;
+    }
+
+    static void scatter_with(Float ir, const ray& r_in, const hit_record& rec,
+        scatter_record& srec) {
         srec.is_specular = true;
         srec.pdf_ptr = nullptr;
         srec.attenuation = Color(1.0);
@@ -127,7 +153,6 @@ public:
             direction = refract(unit_direction, rec.normal, refraction_ratio);
 
         srec.specular_ray = ray(rec.p, direction, r_in.Time());
-        return true;
     }
 
 public:
@@ -157,6 +182,15 @@ public:
         return Color::FromRGB(emit->value(u, v, p),SpectrumType::Illuminant);
     }
 
+    // Emitters count as their (clamped) emission
+    virtual color surface_albedo(const hit_record& rec) const override {
+        return albedo_of(emit->value(rec.u, rec.v, rec.p));
+    }
+
+    static color albedo_of(const color& c) {
+        return color(std::min(c.x, (Float)1), std::min(c.y, (Float)1), std::min(c.z, (Float)1));
+    }
+
 public:
     shared_ptr<texture> emit;
 };
@@ -174,6 +208,33 @@ public:
         return true;
     }
 
+    virtual bool scatter(
+        const ray& r_in, const hit_record& rec, scatter_record& srec,
+        MemoryArena& arena
+    ) const override {
+        scatter_with(albedo->value(rec.u, rec.v, rec.p), srec, arena);
+        return true;
+    }
+
+    Float scattering_pdf(
+        const ray& r_in, const hit_record& rec, const ray& scattered
+    ) const {
+        return pdf();
+    }
+
+    static void scatter_with(const color& a, scatter_record& srec, MemoryArena& arena) {
+        srec.is_specular = false;
+        srec.attenuation = Color::FromRGB(a);
+        srec.pdf_ptr = ARENA_ALLOC(arena, sphere_pdf)();
+    }
+    static Float pdf() {
+        return 1 / (4 * Pi);
+    }
+
+    virtual color surface_albedo(const hit_record& rec) const override {
+        return albedo->value(rec.u, rec.v, rec.p);
+    }
+
 public:
     shared_ptr<texture> albedo;
 };
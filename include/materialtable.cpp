@@ -0,0 +1,147 @@
+#include "materialtable.h"
+#include "material.h"
+
+// MaterialTable Method Definitions
+void MaterialTable::Build() {
+    materials.assign(sources.size(), MaterialRecord());
+    textures.clear();
+    textureIndex.clear();
+    for (size_t i = 1; i < sources.size(); ++i) {
+        const material* m = sources[i];
+        MaterialRecord& r = materials[i];
+        if (auto l = dynamic_cast<const lambertian*>(m)) {
+            r.type = MaterialType::Lambertian;
+            r.texture = AddTexture(l->albedo.get());
+        }
+        else if (auto mt = dynamic_cast<const metal*>(m)) {
+            r.type = MaterialType::Metal;
+            r.albedo = mt->albedo;
+            r.param = mt->fuzz;
+        }
+        else if (auto d = dynamic_cast<const dielectric*>(m)) {
+            r.type = MaterialType::Dielectric;
+            r.param = d->ir;
+        }
+        else if (auto e = dynamic_cast<const diffuse_light*>(m)) {
+            r.type = MaterialType::DiffuseLight;
+            r.texture = AddTexture(e->emit.get());
+        }
+        else if (auto iso = dynamic_cast<const isotropic*>(m)) {
+            r.type = MaterialType::Isotropic;
+            r.texture = AddTexture(iso->albedo.get());
+        }
+    }
+}
+
+uint32_t MaterialTable::AddTexture(const texture* t) {
+    auto it = textureIndex.find(t);
+    if (it != textureIndex.end())
+        return it->second;
+
+    // Children are added first, so the record's index is taken afterwards
+    TextureRecord r;
+    r.tex = t;
+    if (auto s = dynamic_cast<const solid_color*>(t)) {
+        r.type = TextureType::Solid;
+        r.value = s->value(0, 0, point3());
+    }
+    else if (auto c = dynamic_cast<const checker_texture*>(t)) {
+        r.type = TextureType::Checker;
+        r.even = AddTexture(c->even.get());
+        r.odd = AddTexture(c->odd.get());
+    }
+    else if (auto n = dynamic_cast<const noise_texture*>(t)) {
+        r.type = TextureType::Noise;
+        r.noise = &n->noise;
+        r.scale = n->scale;
+    }
+    textures.push_back(r);
+    return textureIndex[t] = uint32_t(textures.size() - 1);
+}
+
+color MaterialTable::EvaluateTexture(uint32_t id, Float u, Float v, const point3& p) const {
+    while (true) {
+        const TextureRecord& t = textures[id];
+        switch (t.type) {
+        case TextureType::Solid:
+            return t.value;
+        case TextureType::Checker:
+            id = checker_texture::is_odd(p) ? t.odd : t.even;
+            break;
+        case TextureType::Noise:
+            return noise_texture::evaluate(*t.noise, t.scale, p);
+        default:
+            return t.tex->value(u, v, p);
+        }
+    }
+}
+
+Color MaterialTable::Emitted(const ray& r_in, const hit_record& rec) const {
+    const MaterialRecord& m = materials[rec.material_id];
+    switch (m.type) {
+    case MaterialType::Other:
+        return rec.mat_ptr->emitted(r_in, rec, rec.u, rec.v, rec.p);
+    case MaterialType::DiffuseLight:
+        return Color::FromRGB(EvaluateTexture(m.texture, rec.u, rec.v, rec.p),
+            SpectrumType::Illuminant);
+    default:
+        return Color(0.f);
+    }
+}
+
+bool MaterialTable::Scatter(const ray& r_in, const hit_record& rec,
+    scatter_record& srec, MemoryArena& arena) const {
+    const MaterialRecord& m = materials[rec.material_id];
+    switch (m.type) {
+    case MaterialType::Lambertian:
+        lambertian::scatter_with(EvaluateTexture(m.texture, rec.u, rec.v, rec.p),
+            rec, srec, arena);
+        return true;
+    case MaterialType::Metal:
+        metal::scatter_with(m.albedo, m.param, r_in, rec, srec);
+        return true;
+    case MaterialType::Dielectric:
+        dielectric::scatter_with(m.param, r_in, rec, srec);
+        return true;
+    case MaterialType::DiffuseLight:
+        return false;
+    case MaterialType::Isotropic:
+        isotropic::scatter_with(EvaluateTexture(m.texture, rec.u, rec.v, rec.p),
+            srec, arena);
+        return true;
+    default:
+        return rec.mat_ptr->scatter(r_in, rec, srec, arena);
+    }
+}
+
+Float MaterialTable::ScatteringPdf(const ray& r_in, const hit_record& rec,
+    const ray& scattered) const {
+    const MaterialRecord& m = materials[rec.material_id];
+    switch (m.type) {
+    case MaterialType::Lambertian:
+        return lambertian::pdf(rec, scattered);
+    case MaterialType::Isotropic:
+        return isotropic::pdf();
+    case MaterialType::Other:
+        return rec.mat_ptr->scattering_pdf(r_in, rec, scattered);
+    default:
+        return 0;
+    }
+}
+
+color MaterialTable::SurfaceAlbedo(const hit_record& rec) const {
+    const MaterialRecord& m = materials[rec.material_id];
+    switch (m.type) {
+    case MaterialType::Lambertian:
+    case MaterialType::Isotropic:
+        return EvaluateTexture(m.texture, rec.u, rec.v, rec.p);
+    case MaterialType::Metal:
+        return m.albedo.ToColor();
+    case MaterialType::DiffuseLight:
+        return diffuse_light::albedo_of(EvaluateTexture(m.texture, rec.u, rec.v, rec.p));
+    case MaterialType::Other:
+        return rec.mat_ptr->surface_albedo(rec);
+    default:
+        return color(1, 1, 1);
+    }
+}
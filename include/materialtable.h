@@ -0,0 +1,101 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef MATERIALTABLE_H
+#define MATERIALTABLE_H
+
+#include "rtweekend.h"
+#include "ray.h"
+#include "spectrum.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class material;
+class texture;
+class perlin;
+class MemoryArena;
+struct hit_record;
+struct scatter_record;
+
+// MaterialTable Declarations
+// The scene's materials and textures flattened into arrays of plain
+// records. hittable::compile_materials() registers the surfaces'
+// materials after the scene is assembled, and Build() then creates the
+// records. Surfaces refer to their material by index, which hits carry in
+// hit_record::material_id, and materials refer to textures the same way,
+// so shading follows no shared_ptr and dispatches with a switch on the
+// record's type. Materials and textures of other types get an Other
+// record and fall back to their virtual methods; material 0 is always
+// such a record, so surfaces that were never compiled shade through
+// hit_record::mat_ptr as before.
+class MaterialTable {
+public:
+    // MaterialTable Public Types
+    enum class MaterialType : uint8_t {
+        Other, Lambertian, Metal, Dielectric, DiffuseLight, Isotropic
+    };
+    enum class TextureType : uint8_t { Other, Solid, Checker, Noise };
+
+    struct MaterialRecord {
+        MaterialType type = MaterialType::Other;
+        uint32_t texture = 0;   // albedo or emission
+        Color albedo;           // metal
+        Float param = 0;        // metal fuzz, dielectric index of refraction
+    };
+    struct TextureRecord {
+        TextureType type = TextureType::Other;
+        uint32_t even = 0, odd = 0;         // checker
+        color value;                        // solid
+        Float scale = 0;                    // noise
+        const perlin* noise = nullptr;      // noise
+        const texture* tex = nullptr;       // other
+    };
+
+    // MaterialTable Public Methods
+    MaterialTable() : sources(1, nullptr) {}
+    // Index of _m_'s record, registering it the first time
+    uint32_t AddMaterial(const material* m) {
+        if (!m)
+            return 0;
+        auto it = materialIndex.find(m);
+        if (it != materialIndex.end())
+            return it->second;
+        sources.push_back(m);
+        return materialIndex[m] = uint32_t(sources.size() - 1);
+    }
+    // Creates the records of the registered materials and their textures
+    void Build();
+
+    MaterialType Type(uint32_t id) const {
+        return id < materials.size() ? materials[id].type : MaterialType::Other;
+    }
+
+    // The material methods for the hit's material
+    Color Emitted(const ray& r_in, const hit_record& rec) const;
+    bool Scatter(const ray& r_in, const hit_record& rec, scatter_record& srec,
+        MemoryArena& arena) const;
+    Float ScatteringPdf(const ray& r_in, const hit_record& rec,
+        const ray& scattered) const;
+    color SurfaceAlbedo(const hit_record& rec) const;
+
+    color EvaluateTexture(uint32_t id, Float u, Float v, const point3& p) const;
+
+    size_t MaterialCount() const { return materials.size(); }
+    size_t TextureCount() const { return textures.size(); }
+
+private:
+    // MaterialTable Private Methods
+    uint32_t AddTexture(const texture* t);
+
+    // MaterialTable Private Data
+    std::vector<const material*> sources;
+    std::vector<MaterialRecord> materials;
+    std::vector<TextureRecord> textures;
+    std::unordered_map<const material*, uint32_t> materialIndex;
+    std::unordered_map<const texture*, uint32_t> textureIndex;
+};
+
+#endif // MATERIALTABLE_H
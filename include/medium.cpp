@@ -0,0 +1,99 @@
+#include "medium.h"
+#include <algorithm>
+#include <cmath>
+
+// HomogeneousMedium Method Definitions
+Float HomogeneousMedium::Tr(const ray& r, Float tMin, Float tMax) const {
+    return std::exp(-sigma_t * (tMax - tMin) * r.direction().Length());
+}
+
+bool HomogeneousMedium::SampleDistance(const ray& r, Float tMin, Float tMax,
+    Float* t) const {
+    Float dist = -std::log(1 - RandomFloat()) / sigma_t;
+    *t = tMin + dist / r.direction().Length();
+    return *t < tMax;
+}
+
+// GridDensityMedium Method Definitions
+GridDensityMedium::GridDensityMedium(Float sigma_t, const aabb& bounds,
+    std::shared_ptr<const SparseGrid> grid)
+    : sigma_t(sigma_t), bounds(bounds), grid(std::move(grid)) {
+    for (int a = 0; a < 3; ++a)
+        scale[a] = this->grid->Resolution(a) / (bounds.pMax[a] - bounds.pMin[a]);
+}
+
+GridDensityMedium::GridDensityMedium(Float sigma_t, const aabb& bounds,
+    int nx, int ny, int nz, const Float* d)
+    : GridDensityMedium(sigma_t, bounds,
+        std::make_shared<const SparseGrid>(nx, ny, nz, d))
+{}
+
+Float GridDensityMedium::Density(const point3& p) const {
+    if (!bounds.Inside(p)) return 0;
+    return grid->Interpolate((p.x - bounds.pMin.x) * scale[0],
+        (p.y - bounds.pMin.y) * scale[1], (p.z - bounds.pMin.z) * scale[2]);
+}
+
+template <typename Func>
+void GridDensityMedium::TraverseMajorants(const ray& r, Float tMin,
+    Float tMax, Func f) const {
+    // Express _r_ in the grid's sample space
+    Float o[3], d[3];
+    for (int a = 0; a < 3; ++a) {
+        o[a] = (r.origin()[a] - bounds.pMin[a]) * scale[a];
+        d[a] = r.direction()[a] * scale[a];
+    }
+    Float sigmaScale = sigma_t * r.direction().Length();
+    grid->Traverse(o, d, tMin, tMax, [&](Float t0, Float t1, Float maxDensity) {
+        return f(t0, t1, maxDensity, sigmaScale * maxDensity);
+    });
+}
+
+bool GridDensityMedium::SampleDistance(const ray& r, Float tMin, Float tMax,
+    Float* tHit) const {
+    // Delta tracking: tentative collisions at the majorant rate, accepted
+    // as real with probability density / majorant
+    bool scattered = false;
+    TraverseMajorants(r, tMin, tMax,
+        [&](Float t0, Float t1, Float maxDensity, Float sigmaMaj) {
+            if (sigmaMaj == 0) return true;
+            Float t = t0;
+            while (true) {
+                t -= std::log(1 - RandomFloat()) / sigmaMaj;
+                if (t >= t1) return true;
+                if (RandomFloat() * maxDensity < Density(r.at(t))) {
+                    *tHit = t;
+                    scattered = true;
+                    return false;
+                }
+            }
+        });
+    return scattered;
+}
+
+Float GridDensityMedium::Tr(const ray& r, Float tMin, Float tMax) const {
+    // Ratio tracking: the same tentative collisions, each scaling the
+    // estimate by the probability of it being a null collision
+    Float tr = 1;
+    TraverseMajorants(r, tMin, tMax,
+        [&](Float t0, Float t1, Float maxDensity, Float sigmaMaj) {
+            if (sigmaMaj == 0) return true;
+            Float t = t0;
+            while (true) {
+                t -= std::log(1 - RandomFloat()) / sigmaMaj;
+                if (t >= t1) return true;
+                tr *= 1 - Density(r.at(t)) / maxDensity;
+                // Russian roulette once the estimate gets small
+                const Float rrThreshold = .1;
+                if (tr < rrThreshold) {
+                    Float q = std::max((Float).05, 1 - tr);
+                    if (RandomFloat() < q) {
+                        tr = 0;
+                        return false;
+                    }
+                    tr /= 1 - q;
+                }
+            }
+        });
+    return tr;
+}
@@ -1,28 +1,95 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
 #pragma once
+#endif
+
 #ifndef MEDIUM_H
 #define MEDIUM_H
 
-#include "spectrum.h"
+#include "rtweekend.h"
+#include "vec3.h"
+#include "ray.h"
+#include "aabb.h"
+#include "sparsegrid.h"
+#include <memory>
 
 // Medium Declarations
+// Participating media with a gray extinction coefficient; the color of the
+// scattered light comes from the phase function material of the volume
+// holding the medium (see constant_medium). Ray parameters are in units of
+// the ray's _t_, so directions need not be normalized.
 class Medium {
 public:
     // Medium Interface
     virtual ~Medium() {}
-    virtual Color Tr(const ray& ray, Sampler& sampler) const = 0;
-    virtual Color Sample(const ray& ray, Sampler& sampler,
-        MemoryArena& arena,
-        MediumInteraction* mi) const = 0;
+    // Transmittance along _r_ between _tMin_ and _tMax_
+    virtual Float Tr(const ray& r, Float tMin, Float tMax) const = 0;
+    // Samples the first scattering event along _r_ in [_tMin_, _tMax_);
+    // returns false if the ray passes through, which happens with
+    // probability Tr(r, tMin, tMax)
+    virtual bool SampleDistance(const ray& r, Float tMin, Float tMax,
+        Float* t) const = 0;
 };
 
-// Medium Declarations
-class Medium {
+// Media on the two sides of a surface; a surface that separates no media
+// has both set to the same medium (or null)
+class MediumInterface {
 public:
-    // Medium Interface
-    virtual ~Medium() {}
-    virtual Color Tr(const ray& ray, Sampler& sampler) const = 0;
-    virtual Color Sample(const ray& ray, Sampler& sampler,
-        MemoryArena& arena,
-        MediumInteraction* mi) const = 0;
+    MediumInterface() : inside(nullptr), outside(nullptr) {}
+    MediumInterface(const Medium* medium) : inside(medium), outside(medium) {}
+    MediumInterface(const Medium* inside, const Medium* outside)
+        : inside(inside), outside(outside) {}
+    bool IsMediumTransition() const { return inside != outside; }
+
+    const Medium* inside, * outside;
+};
+
+// HomogeneousMedium Declarations
+class HomogeneousMedium : public Medium {
+public:
+    HomogeneousMedium(Float sigma_t) : sigma_t(sigma_t) {}
+    Float Tr(const ray& r, Float tMin, Float tMax) const override;
+    bool SampleDistance(const ray& r, Float tMin, Float tMax,
+        Float* t) const override;
+
+private:
+    const Float sigma_t;
+};
+
+// GridDensityMedium Declarations
+// Extinction _sigma_t_ scaled by a density grid spread over _bounds_ and
+// interpolated trilinearly, zero outside. The grid is a SparseGrid, so
+// empty space costs neither memory nor tracking steps. Distances are
+// sampled by delta tracking and transmittance estimated by ratio tracking,
+// both against the majorant of each 8^3 brick rather than of the whole
+// volume, so that sparse data (smoke, clouds) costs about as many steps as
+// it has optical depth.
+class GridDensityMedium : public Medium {
+public:
+    GridDensityMedium(Float sigma_t, const aabb& bounds,
+        std::shared_ptr<const SparseGrid> grid);
+    // Medium over a dense array of _nx_ x _ny_ x _nz_ samples, x fastest
+    GridDensityMedium(Float sigma_t, const aabb& bounds, int nx, int ny,
+        int nz, const Float* density);
+    Float Density(const point3& p) const;
+    Float Tr(const ray& r, Float tMin, Float tMax) const override;
+    bool SampleDistance(const ray& r, Float tMin, Float tMax,
+        Float* t) const override;
+
+private:
+    // GridDensityMedium Private Methods
+    // Calls _f_(t0, t1, maxDensity, sigmaMaj) for each brick that _r_
+    // crosses between _tMin_ and _tMax_, front to back, until _f_ returns
+    // false; _sigmaMaj_ is the majorant per unit of _t_
+    template <typename Func>
+    void TraverseMajorants(const ray& r, Float tMin, Float tMax, Func f) const;
+
+    // GridDensityMedium Private Data
+    const Float sigma_t;
+    const aabb bounds;
+    std::shared_ptr<const SparseGrid> grid;
+    // Scale from world to sample space
+    Float scale[3];
 };
-#endif // !MEDIUM_H
+
+#endif // MEDIUM_H
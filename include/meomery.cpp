@@ -1,4 +1,18 @@
 #include "meomery.h"
+#include <cstdlib>
+#if defined(PBRT_IS_WINDOWS)
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#elif defined(__linux__)
+#include <sys/mman.h>
+#include <sys/resource.h>
+#else
+#include <malloc.h>
+#include <sys/resource.h>
+#endif
 
 // Memory Allocation Functions
 void* AllocAligned(size_t size) {
@@ -21,3 +35,73 @@ void FreeAligned(void* ptr) {
     free(ptr);
 #endif
 }
+
+void* AllocLarge(size_t size) {
+    if (size == 0) return nullptr;
+    // Small arrays (one per mesh, say) would each cost a mapping and a
+    // partly used page; they share the heap instead
+    if (size < PBRT_HUGE_PAGE_SIZE) {
+        void* ptr = AllocAligned(size);
+        if (!ptr) throw std::bad_alloc();
+        return ptr;
+    }
+#if defined(PBRT_IS_WINDOWS)
+    // Large pages need SeLockMemoryPrivilege; fall back to normal pages
+    // when the request is too small or the privilege isn't held
+    size_t largePage = GetLargePageMinimum();
+    if (largePage > 0 && size >= largePage) {
+        size_t rounded = (size + largePage - 1) & ~(largePage - 1);
+        void* ptr = VirtualAlloc(nullptr, rounded,
+            MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (ptr) return ptr;
+    }
+    void* ptr = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+#elif defined(__linux__)
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+    // Transparent huge pages are only a hint; the mapping stays valid if
+    // the kernel declines
+    madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    return ptr;
+#else
+    void* ptr = AllocAligned(size);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+#endif
+}
+
+void FreeLarge(void* ptr, size_t size) {
+    if (!ptr) return;
+    if (size < PBRT_HUGE_PAGE_SIZE) {
+        FreeAligned(ptr);
+        return;
+    }
+#if defined(PBRT_IS_WINDOWS)
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#elif defined(__linux__)
+    munmap(ptr, size);
+#else
+    FreeAligned(ptr);
+#endif
+}
+
+size_t PeakResidentSetBytes() {
+#if defined(PBRT_IS_WINDOWS)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+    return pmc.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(__APPLE__)
+    return (size_t)usage.ru_maxrss;  // bytes on macOS
+#else
+    return (size_t)usage.ru_maxrss * 1024;  // kilobytes on Linux
+#endif
+#endif
+}
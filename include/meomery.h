@@ -16,9 +16,22 @@
 
 #define ALLOCA(TYPE, COUNT) (TYPE *) alloca((COUNT) * sizeof(TYPE))
 
+#ifndef PBRT_HUGE_PAGE_SIZE
+#define PBRT_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#endif
+
+#if defined(_MSC_VER)
 #define PBRT_HAVE__ALIGNED_MALLOC
+#else
+#define PBRT_HAVE_POSIX_MEMALIGN
+#endif
+#include "rtweekend.h"
 #include <list>
+#include <memory>
+#include <new>
 #include <cstddef>
+#include <cstdint>
+#include <algorithm>
 
 // Memory Declarations
 #define ARENA_ALLOC(arena, Type) new ((arena).Alloc(sizeof(Type))) Type
@@ -29,6 +42,49 @@ T* AllocAligned(size_t count) {
 }
 
 void FreeAligned(void*);
+
+// Large scene arrays (BVH nodes, vertex buffers, texture tiles) of at least
+// PBRT_HUGE_PAGE_SIZE come straight from the OS: page aligned, and backed by
+// huge pages when the OS grants them. Smaller ones come from AllocAligned().
+// The pages are left untouched so that FirstTouch() decides which NUMA node
+// each one lands on. Throws std::bad_alloc when out of memory; FreeLarge()
+// must be given the size that was allocated.
+void* AllocLarge(size_t size);
+void FreeLarge(void* ptr, size_t size);
+// Peak resident set size of the process so far, in bytes (0 if unknown).
+size_t PeakResidentSetBytes();
+template <typename T>
+T* AllocLarge(size_t count) {
+    return (T*)AllocLarge(count * sizeof(T));
+}
+
+// Default-constructs _count_ elements with a static OpenMP schedule, so the
+// pages are first touched by all the workers and spread across their NUMA
+// nodes, instead of all landing on the main thread's.
+template <typename T>
+void FirstTouch(T* ptr, size_t count) {
+#pragma omp parallel for schedule(static)
+    for (int64_t i = 0; i < (int64_t)count; ++i) new (&ptr[i]) T();
+}
+
+template <typename T>
+struct LargeArrayDeleter {
+    size_t count = 0;
+    void operator()(T* ptr) const {
+        for (size_t i = 0; i < count; ++i) ptr[i].~T();
+        FreeLarge(ptr, count * sizeof(T));
+    }
+};
+template <typename T>
+using LargeArray = std::unique_ptr<T[], LargeArrayDeleter<T>>;
+
+template <typename T>
+LargeArray<T> MakeLargeArray(size_t count) {
+    T* ptr = AllocLarge<T>(count);
+    FirstTouch(ptr, count);
+    return LargeArray<T>(ptr, LargeArrayDeleter<T>{count});
+}
+
 class
 #ifdef PBRT_HAVE_ALIGNAS
     alignas(PBRT_L1_CACHE_LINE_SIZE)
@@ -121,9 +177,9 @@ public:
     // BlockedArray Public Methods
     BlockedArray(int uRes, int vRes, const T* d = nullptr)
         : uRes(uRes), vRes(vRes), uBlocks(RoundUp(uRes) >> logBlockSize) {
-        int nAlloc = RoundUp(uRes) * RoundUp(vRes);
-        data = AllocAligned<T>(nAlloc);
-        for (int i = 0; i < nAlloc; ++i) new (&data[i]) T();
+        nAlloc = RoundUp(uRes) * RoundUp(vRes);
+        data = AllocLarge<T>(nAlloc);
+        FirstTouch(data, nAlloc);
         if (d)
             for (int v = 0; v < vRes; ++v)
                 for (int u = 0; u < uRes; ++u) (*this)(u, v) = d[v * uRes + u];
@@ -135,8 +191,8 @@ public:
     int uSize() const { return uRes; }
     int vSize() const { return vRes; }
     ~BlockedArray() {
-        for (int i = 0; i < uRes * vRes; ++i) data[i].~T();
-        FreeAligned(data);
+        for (int i = 0; i < nAlloc; ++i) data[i].~T();
+        FreeLarge(data, nAlloc * sizeof(T));
     }
     int Block(int a) const { return a >> logBlockSize; }
     int Offset(int a) const { return (a & (BlockSize() - 1)); }
@@ -163,6 +219,7 @@ private:
     // BlockedArray Private Data
     T* data;
     const int uRes, vRes, uBlocks;
+    int nAlloc;
 };
 
 #endif // !MEOMERY_H
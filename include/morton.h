@@ -0,0 +1,91 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <vector>
+#include "rtweekend.h"
+
+// Morton Code Utilities
+inline uint32_t LeftShift3(uint32_t x) {
+    CHECK_LE(x, (1 << 10));
+    if (x == (1 << 10)) --x;
+#ifdef PBRT_HAVE_BINARY_CONSTANTS
+    x = (x | (x << 16)) & 0b00000011000000000000000011111111;
+    // x = ---- --98 ---- ---- ---- ---- 7654 3210
+    x = (x | (x << 8)) & 0b00000011000000001111000000001111;
+    // x = ---- --98 ---- ---- 7654 ---- ---- 3210
+    x = (x | (x << 4)) & 0b00000011000011000011000011000011;
+    // x = ---- --98 ---- 76-- --54 ---- 32-- --10
+    x = (x | (x << 2)) & 0b00001001001001001001001001001001;
+    // x = ---- 9--8 --7- -6-- 5--4 --3- -2-- 1--0
+#else
+    x = (x | (x << 16)) & 0x30000ff;
+    // x = ---- --98 ---- ---- ---- ---- 7654 3210
+    x = (x | (x << 8)) & 0x300f00f;
+    // x = ---- --98 ---- ---- 7654 ---- ---- 3210
+    x = (x | (x << 4)) & 0x30c30c3;
+    // x = ---- --98 ---- 76-- --54 ---- 32-- --10
+    x = (x | (x << 2)) & 0x9249249;
+    // x = ---- 9--8 --7- -6-- 5--4 --3- -2-- 1--0
+#endif // PBRT_HAVE_BINARY_CONSTANTS
+    return x;
+}
+
+inline uint32_t EncodeMorton3(const Vector3f& v) {
+    CHECK_GE(v.x, 0);
+    CHECK_GE(v.y, 0);
+    CHECK_GE(v.z, 0);
+    return (LeftShift3(v.z) << 2) | (LeftShift3(v.y) << 1) | LeftShift3(v.x);
+}
+
+// Stable sort of *_v_ by the low 30 bits of _key_(element), least
+// significant digits first
+template <typename T, typename KeyFunc>
+void RadixSort(std::vector<T>* v, KeyFunc key) {
+    std::vector<T> tempVector(v->size());
+    constexpr int bitsPerPass = 6;
+    constexpr int nBits = 30;
+    static_assert((nBits % bitsPerPass) == 0,
+        "Radix sort bitsPerPass must evenly divide nBits");
+    constexpr int nPasses = nBits / bitsPerPass;
+
+    for (int pass = 0; pass < nPasses; ++pass) {
+        // Perform one pass of radix sort, sorting _bitsPerPass_ bits
+        int lowBit = pass * bitsPerPass;
+
+        // Set in and out vector pointers for radix sort pass
+        std::vector<T>& in = (pass & 1) ? tempVector : *v;
+        std::vector<T>& out = (pass & 1) ? *v : tempVector;
+
+        // Count number of zero bits in array for current radix sort bit
+        constexpr int nBuckets = 1 << bitsPerPass;
+        int bucketCount[nBuckets] = { 0 };
+        constexpr int bitMask = (1 << bitsPerPass) - 1;
+        for (const T& e : in) {
+            int bucket = (key(e) >> lowBit) & bitMask;
+            CHECK_GE(bucket, 0);
+            CHECK_LT(bucket, nBuckets);
+            ++bucketCount[bucket];
+        }
+
+        // Compute starting index in output array for each bucket
+        int outIndex[nBuckets];
+        outIndex[0] = 0;
+        for (int i = 1; i < nBuckets; ++i)
+            outIndex[i] = outIndex[i - 1] + bucketCount[i - 1];
+
+        // Store sorted values in output array
+        for (const T& e : in) {
+            int bucket = (key(e) >> lowBit) & bitMask;
+            out[outIndex[bucket]++] = e;
+        }
+    }
+    // Copy final result from _tempVector_, if needed
+    if (nPasses & 1) std::swap(*v, tempVector);
+}
+
+#endif // MORTON_H
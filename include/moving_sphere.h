@@ -14,8 +14,14 @@ public:
         : center0(cen0), center1(cen1), time0(_time0), time1(_time1), radius(r), mat_ptr(m)
     {};
 
-    virtual bool hit(
-        const ray& r, Float t_min, Float t_max, hit_record& rec) const override;
+    virtual bool intersect(
+        const ray& r, Float t_min, Float t_max, hit_info& hit) const override;
+    virtual void fill_record(
+        const ray& r, const hit_info& hit, hit_record& rec) const override;
+
+    virtual void compile_materials(MaterialTable& table) override {
+        material_id = table.AddMaterial(mat_ptr.get());
+    }
 
     virtual bool bounding_box(
         Float _time0, Float _time1, aabb& output_box) const override;
@@ -29,11 +35,11 @@ public:
     shared_ptr<material> mat_ptr;
 };
 
-point3 moving_sphere::center(Float time) const {
+inline point3 moving_sphere::center(Float time) const {
     return center0 + ((time - time0) / (time1 - time0)) * (center1 - center0);
 }
 
-bool moving_sphere::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const {
+inline bool moving_sphere::intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const {
     vec3 oc = r.origin() - center(r.Time());
     auto a = r.direction().LengthSquared();
     auto half_b = Dot(oc, r.direction());
@@ -51,16 +57,23 @@ bool moving_sphere::hit(const ray& r, Float t_min, Float t_max, hit_record& rec)
             return false;
     }
 
-    rec.time = root;
+    hit.t = root;
+    hit.object = this;
+    hit.nInstances = 0;
+    return true;
+}
+
+inline void moving_sphere::fill_record(const ray& r, const hit_info& hit, hit_record& rec) const {
+    rec.time = hit.t;
     rec.p = r.at(rec.time);
     auto outward_normal = (rec.p - center(r.Time())) / radius;
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mat_ptr;
-
-    return true;
+    rec.mat_ptr = mat_ptr.get();
+    rec.material_id = material_id;
+    rec.area_light = area_light;
 }
 
-bool moving_sphere::bounding_box(Float _time0, Float _time1, aabb& output_box) const {
+inline bool moving_sphere::bounding_box(Float _time0, Float _time1, aabb& output_box) const {
     aabb box0(
         center(_time0) - vec3(radius, radius, radius),
         center(_time0) + vec3(radius, radius, radius));
@@ -0,0 +1,289 @@
+#include "options.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+
+Options PbrtOptions;
+
+// Options Local Definitions
+static bool ParseInt(const std::string& s, int* v) {
+    char* end;
+    errno = 0;
+    long r = strtol(s.c_str(), &end, 10);
+    if (s.empty() || *end != '\0' || errno == ERANGE || r < INT_MIN || r > INT_MAX)
+        return false;
+    *v = (int)r;
+    return true;
+}
+
+static bool ParseUInt64(const std::string& s, uint64_t* v) {
+    char* end;
+    if (s.empty() || !isdigit((unsigned char)s[0])) return false;
+    errno = 0;
+    unsigned long long r = strtoull(s.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE) return false;
+    *v = (uint64_t)r;
+    return true;
+}
+
+static bool ParseFloat(const std::string& s, Float* v) {
+    char* end;
+    double r = strtod(s.c_str(), &end);
+    if (s.empty() || *end != '\0') return false;
+    *v = (Float)r;
+    return true;
+}
+
+// Options Definitions
+bool ParseOptions(const std::vector<std::string>& args, Options* options,
+    std::string* error) {
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        // Fetches the value(s) following _arg_
+        auto value = [&](size_t k = 1) -> bool {
+            if (i + k < args.size()) return true;
+            *error = "missing value for " + arg;
+            return false;
+        };
+        auto intArg = [&](int* v, int minValue) -> bool {
+            if (!value()) return false;
+            if (!ParseInt(args[++i], v) || *v < minValue) {
+                *error = "bad value '" + args[i] + "' for " + arg;
+                return false;
+            }
+            return true;
+        };
+
+        if (arg == "--help" || arg == "-h")
+            options->help = true;
+        else if (arg == "--list")
+            options->listScenes = true;
+        else if (arg == "--quiet")
+            options->quiet = true;
+        else if (arg == "--denoise")
+            options->denoise = true;
+        else if (arg == "--aov")
+            options->aovs = true;
+        else if (arg == "--bench")
+            options->bench = true;
+        else if (arg == "--merge")
+            options->merge = true;
+        else if (arg == "--nthreads" || arg == "--threads") {
+            if (!intArg(&options->nThreads, 0)) return false;
+        }
+        else if (arg == "--spp") {
+            if (!intArg(&options->spp, 1)) return false;
+        }
+        else if (arg == "--width") {
+            if (!intArg(&options->xResolution, 1)) return false;
+        }
+        else if (arg == "--height") {
+            if (!intArg(&options->yResolution, 1)) return false;
+        }
+        else if (arg == "--tile") {
+            if (!intArg(&options->tileSize, 1)) return false;
+        }
+        else if (arg == "--sort-rays")
+            options->sortRays = true;
+        else if (arg == "--wavefront-paths") {
+            if (!intArg(&options->wavefrontPaths, 1)) return false;
+        }
+        else if (arg == "--maxdepth") {
+            if (!intArg(&options->maxDepth, 1)) return false;
+        }
+        else if (arg == "--bake") {
+            if (!intArg(&options->bakeResolution, 0)) return false;
+        }
+        else if (arg == "--launch") {
+            if (!intArg(&options->launch, 1)) return false;
+        }
+        else if (arg == "--part") {
+            if (!intArg(&options->part, 0) || !intArg(&options->nParts, 1)) return false;
+            if (options->part >= options->nParts) {
+                *error = "--part k n needs k < n";
+                return false;
+            }
+        }
+        else if (arg == "--sample-range") {
+            if (!intArg(&options->sampleBegin, 0) || !intArg(&options->sampleEnd, 1)) return false;
+            if (options->sampleBegin >= options->sampleEnd) {
+                *error = "--sample-range a b needs a < b";
+                return false;
+            }
+        }
+        else if (arg == "--serve") {
+            if (!value()) return false;
+            options->serveSocket = args[++i];
+        }
+        else if (arg == "--connect") {
+            if (!value()) return false;
+            options->connectSocket = args[++i];
+        }
+        else if (arg == "--fov") {
+            if (!value()) return false;
+            if (!ParseFloat(args[++i], &options->fov) || options->fov <= 0 || options->fov >= 180) {
+                *error = "bad value '" + args[i] + "' for " + arg;
+                return false;
+            }
+        }
+        else if (arg == "--camera") {
+            // ex ey ez lx ly lz: eye and look-at point
+            if (!value(6)) return false;
+            Float c[6];
+            for (int k = 0; k < 6; ++k)
+                if (!ParseFloat(args[i + 1 + k], &c[k])) {
+                    *error = "bad value '" + args[i + 1 + k] + "' for " + arg;
+                    return false;
+                }
+            i += 6;
+            for (int k = 0; k < 3; ++k) {
+                options->lookFrom[k] = c[k];
+                options->lookAt[k] = c[3 + k];
+            }
+            options->setCamera = true;
+        }
+        else if (arg == "--partial") {
+            if (!value()) return false;
+            options->partialFile = args[++i];
+        }
+        else if (arg == "--seed") {
+            if (!value()) return false;
+            if (!ParseUInt64(args[++i], &options->seed)) {
+                *error = "bad value '" + args[i] + "' for " + arg;
+                return false;
+            }
+        }
+        else if (arg == "--integrator") {
+            if (!value()) return false;
+            options->integrator = args[++i];
+            if (options->integrator != "path" && options->integrator != "normals" &&
+                options->integrator != "wavefront") {
+                *error = "unknown integrator '" + options->integrator + "'";
+                return false;
+            }
+        }
+        else if (arg == "--outfile" || arg == "-o") {
+            if (!value()) return false;
+            options->imageFile = args[++i];
+        }
+        else if (arg == "--bench-out") {
+            if (!value()) return false;
+            options->benchFile = args[++i];
+        }
+        else if (arg == "--assets") {
+            if (!value()) return false;
+            options->assetDir = args[++i];
+        }
+        else if (arg == "--batch") {
+            if (!value()) return false;
+            options->batchFile = args[++i];
+        }
+        else if (arg == "--cropwindow") {
+            // x0 x1 y0 y1, as in pbrt's "cropwindow" film parameter
+            if (!value(4)) return false;
+            Float c[4];
+            for (int k = 0; k < 4; ++k)
+                if (!ParseFloat(args[i + 1 + k], &c[k])) {
+                    *error = "bad value '" + args[i + 1 + k] + "' for " + arg;
+                    return false;
+                }
+            i += 4;
+            options->cropWindow[0][0] = Clamp(std::min(c[0], c[1]), 0, 1);
+            options->cropWindow[0][1] = Clamp(std::max(c[0], c[1]), 0, 1);
+            options->cropWindow[1][0] = Clamp(std::min(c[2], c[3]), 0, 1);
+            options->cropWindow[1][1] = Clamp(std::max(c[2], c[3]), 0, 1);
+        }
+        else if (!arg.empty() && arg[0] == '-') {
+            *error = "unknown option " + arg;
+            return false;
+        }
+        else
+            options->scenes.push_back(arg);
+    }
+    return true;
+}
+
+std::vector<std::string> SplitArguments(const std::string& line) {
+    std::vector<std::string> args;
+    std::string cur;
+    bool inQuotes = false, haveArg = false;
+    for (char c : line) {
+        if (c == '"') {
+            inQuotes = !inQuotes;
+            haveArg = true;
+        }
+        else if (!inQuotes && c == '#')
+            break;
+        else if (!inQuotes && isspace((unsigned char)c)) {
+            if (haveArg) args.push_back(cur);
+            cur.clear();
+            haveArg = false;
+        }
+        else {
+            cur += c;
+            haveArg = true;
+        }
+    }
+    if (haveArg) args.push_back(cur);
+    return args;
+}
+
+void PrintUsage(const char* program) {
+    fprintf(stderr,
+        "usage: %s [options] [scene | file.pbrt ...]\n"
+        "Rendering options:\n"
+        "  --list               List the registered scenes.\n"
+        "  --width n, --height n\n"
+        "                       Image resolution (default: the scene's).\n"
+        "  --spp n              Samples per pixel (default: the scene's).\n"
+        "  --nthreads n         Number of threads (default: all cores).\n"
+        "  --tile n             Tile edge in pixels (default 16).\n"
+        "  --integrator name    path (default), wavefront or normals.\n"
+        "  --wavefront-paths n  Paths in flight for the wavefront integrator\n"
+        "                       (default 65536).\n"
+        "  --sort-rays          Wavefront: trace secondary rays sorted by\n"
+        "                       direction octant and origin Morton code.\n"
+        "  --maxdepth n         Path depth limit (default 50).\n"
+        "  --seed n             Sampler seed (default 0).\n"
+        "  --bake n             Bake procedural textures into n^3 grids.\n"
+        "  --cropwindow x0 x1 y0 y1\n"
+        "                       Render only this [0,1]^2 subwindow.\n"
+        "  --camera ex ey ez lx ly lz\n"
+        "                       Place the camera at e looking at l.\n"
+        "  --fov degrees        Vertical field of view (default: the scene's).\n"
+        "  --outfile, -o file   Output image (default: the scene file's, else render.png).\n"
+        "  --denoise            Denoise the image guided by the AOVs; the raw\n"
+        "                       render goes to <stem>_noisy<ext>.\n"
+        "  --aov                Also write the albedo, normal, depth and ID\n"
+        "                       buffers to <stem>_albedo<ext> etc.\n"
+        "  --assets dir         Directory for textures and meshes (default image).\n"
+        "  --quiet              No progress output.\n"
+        "Distributed rendering:\n"
+        "  --part k n           Render only the tiles whose index is k modulo n.\n"
+        "  --sample-range a b   Take samples a to b-1 of every pixel.\n"
+        "  --partial file       Write the samples to a partial film file\n"
+        "                       instead of an image.\n"
+        "  --merge part ...     Merge partial films into the image (-o), or\n"
+        "                       into another partial film with --partial.\n"
+        "  --launch n           Render with n local worker processes, each\n"
+        "                       taking every n-th tile, and merge their films.\n"
+        "Batch and benchmark:\n"
+        "  --batch file         Render one job per line of file; each line\n"
+        "                       holds options applied on top of these.\n"
+        "  --bench              Headless timing of the given (or all) scenes.\n"
+        "  --bench-out file     Write benchmark JSON to file (default stdout).\n"
+        "Render server:\n"
+        "  --serve socket       Keep running, rendering the jobs sent to the\n"
+        "                       local socket; built scenes stay resident.\n"
+        "  --connect socket     Send this job to the server on socket.\n",
+        program);
+}
+
+std::string AssetPath(const std::string& name) {
+    const std::string& dir = PbrtOptions.assetDir;
+    if (dir.empty()) return name;
+    char last = dir[dir.size() - 1];
+    return (last == '/' || last == '\\') ? dir + name : dir + "/" + name;
+}
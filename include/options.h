@@ -0,0 +1,82 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "rtweekend.h"
+
+// Options Declarations
+// Settings for one render job. Zero resolution or spp means "use the
+// scene's own"; the crop window is in [0,1]^2 with (0,0) at the top left.
+struct Options {
+    std::vector<std::string> scenes;
+    int nThreads = 0;
+    int xResolution = 0, yResolution = 0;
+    int spp = 0;
+    int tileSize = 16;
+    int maxDepth = 50;
+    std::string integrator = "path";
+    // Paths traced together by the wavefront integrator, and whether it
+    // sorts secondary rays before tracing them
+    int wavefrontPaths = 1 << 16;
+    bool sortRays = false;
+    uint64_t seed = 0;
+    std::string imageFile;
+    Float cropWindow[2][2] = { { 0, 1 }, { 0, 1 } };
+    std::string assetDir = "image";
+    bool quiet = false;
+    // Denoise the image (see denoise.h); write the AOV buffers
+    bool denoise = false, aovs = false;
+    // Grid resolution procedural textures are baked at (0: not baked)
+    int bakeResolution = 0;
+    // Headless benchmark (see RunBenchmark() in PBRT.cpp)
+    bool bench = false;
+    std::string benchFile;
+    // Job list, one command line per line
+    std::string batchFile;
+    // Distributed rendering: render only the tiles whose index is _part_
+    // modulo _nParts_, and samples [_sampleBegin_, _sampleEnd_) of each
+    // pixel (all if _sampleEnd_ is 0), into the partial film _partialFile_;
+    // merge partial films; or render with _launch_ local worker processes
+    int part = 0, nParts = 1;
+    int sampleBegin = 0, sampleEnd = 0;
+    std::string partialFile;
+    bool merge = false;
+    int launch = 0;
+    // Camera overrides: eye and look-at point (with _setCamera_), and the
+    // vertical field of view in degrees (0: the scene's)
+    bool setCamera = false;
+    Float lookFrom[3] = { 0, 0, 0 }, lookAt[3] = { 0, 0, 0 };
+    Float fov = 0;
+    // Render server: listen on _serveSocket_ for jobs, or send this job to
+    // the server listening on _connectSocket_
+    std::string serveSocket, connectSocket;
+    bool listScenes = false;
+    bool help = false;
+};
+
+// Options of the job being rendered; read by code that has no other
+// access to them (asset loading, the path depth limit).
+extern Options PbrtOptions;
+
+// Parses _args_ (without the program name) on top of *_options_. Returns
+// false and sets *_error_ for unknown flags or malformed values.
+bool ParseOptions(const std::vector<std::string>& args, Options* options,
+    std::string* error);
+
+// Splits one job-list line into arguments: whitespace separated, with
+// double quotes grouping and '#' starting a comment.
+std::vector<std::string> SplitArguments(const std::string& line);
+
+void PrintUsage(const char* program);
+
+// Resolves _name_ against the asset directory (textures, meshes, maps).
+std::string AssetPath(const std::string& name);
+
+#endif // OPTIONS_H
@@ -1,5 +1,5 @@
 #include "parallel.h"
-#include "memory.h"
+#include "meomery.h"
 //#include "stats.h"
 #include <list>
 #include <thread>
@@ -11,6 +11,7 @@ static bool shutdownThreads = false;
 class ParallelForLoop;
 static ParallelForLoop* workList = nullptr;
 static std::mutex workListMutex;
+static int nThreadsRequested = 0;
 
 // Bookkeeping variables to help with the implementation of
 // MergeWorkerThreadStats().
@@ -26,17 +27,14 @@ class ParallelForLoop {
 public:
     // ParallelForLoop Public Methods
     ParallelForLoop(std::function<void(int64_t)> func1D, int64_t maxIndex,
-        int chunkSize, uint64_t profilerState)
+        int chunkSize)
         : func1D(std::move(func1D)),
         maxIndex(maxIndex),
-        chunkSize(chunkSize),
-        profilerState(profilerState) {}
-    ParallelForLoop(const std::function<void(Point2i)>& f, const Point2i& count,
-        uint64_t profilerState)
+        chunkSize(chunkSize) {}
+    ParallelForLoop(const std::function<void(Point2i)>& f, const Point2i& count)
         : func2D(f),
         maxIndex(count.x* count.y),
-        chunkSize(1),
-        profilerState(profilerState) {
+        chunkSize(1) {
         nX = count.x;
     }
 
@@ -46,7 +44,6 @@ public:
     std::function<void(Point2i)> func2D;
     const int64_t maxIndex;
     const int chunkSize;
-    uint64_t profilerState;
     int64_t nextIndex = 0;
     int activeWorkers = 0;
     ParallelForLoop* next = nullptr;
@@ -77,13 +74,8 @@ static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
     //LOG(INFO) << "Started execution in worker thread " << tIndex;
     ThreadIndex = tIndex;
 
-    // Give the profiler a chance to do per-thread initialization for
-    // the worker thread before the profiling system actually stops running.
-    ProfilerWorkerThreadInit();
-
     // The main thread sets up a barrier so that it can be sure that all
-    // workers have called ProfilerWorkerThreadInit() before it continues
-    // (and actually starts the profiling system).
+    // workers are running before it continues.
     barrier->Wait();
 
     // Release our reference to the Barrier so that it's freed once all of
@@ -93,7 +85,6 @@ static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
     std::unique_lock<std::mutex> lock(workListMutex);
     while (!shutdownThreads) {
         if (reportWorkerStats) {
-            ReportThreadStats();
             if (--reporterCount == 0)
                 // Once all worker threads have merged their stats, wake up
                 // the main thread.
@@ -124,17 +115,13 @@ static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
             // Run loop indices in _[indexStart, indexEnd)_
             lock.unlock();
             for (int64_t index = indexStart; index < indexEnd; ++index) {
-                uint64_t oldState = ProfilerState;
-                ProfilerState = loop.profilerState;
                 if (loop.func1D) {
                     loop.func1D(index);
                 }
                 // Handle other types of loops
                 else {
-                    CHECK(loop.func2D);
                     loop.func2D(Point2i(index % loop.nX, index / loop.nX));
                 }
-                ProfilerState = oldState;
             }
             lock.lock();
 
@@ -149,8 +136,6 @@ static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
 // Parallel Definitions
 void ParallelFor(std::function<void(int64_t)> func, int64_t count,
     int chunkSize) {
-    CHECK(threads.size() > 0 || MaxThreadIndex() == 1);
-
     // Run iterations immediately if not using threads or if _count_ is small
     if (threads.empty() || count < chunkSize) {
         for (int64_t i = 0; i < count; ++i) func(i);
@@ -158,8 +143,7 @@ void ParallelFor(std::function<void(int64_t)> func, int64_t count,
     }
 
     // Create and enqueue _ParallelForLoop_ for this loop
-    ParallelForLoop loop(std::move(func), count, chunkSize,
-        CurrentProfilerState());
+    ParallelForLoop loop(std::move(func), count, chunkSize);
     workListMutex.lock();
     loop.next = workList;
     workList = &loop;
@@ -185,17 +169,13 @@ void ParallelFor(std::function<void(int64_t)> func, int64_t count,
         // Run loop indices in _[indexStart, indexEnd)_
         lock.unlock();
         for (int64_t index = indexStart; index < indexEnd; ++index) {
-            uint64_t oldState = ProfilerState;
-            ProfilerState = loop.profilerState;
             if (loop.func1D) {
                 loop.func1D(index);
             }
             // Handle other types of loops
             else {
-                CHECK(loop.func2D);
                 loop.func2D(Point2i(index % loop.nX, index / loop.nX));
             }
-            ProfilerState = oldState;
         }
         lock.lock();
 
@@ -204,22 +184,20 @@ void ParallelFor(std::function<void(int64_t)> func, int64_t count,
     }
 }
 
-PBRT_THREAD_LOCAL int ThreadIndex;
+thread_local int ThreadIndex;
 
 int MaxThreadIndex() {
-    return PbrtOptions.nThreads == 0 ? NumSystemCores() : PbrtOptions.nThreads;
+    return nThreadsRequested == 0 ? NumSystemCores() : nThreadsRequested;
 }
 
 void ParallelFor2D(std::function<void(Point2i)> func, const Point2i& count) {
-    CHECK(threads.size() > 0 || MaxThreadIndex() == 1);
-
     if (threads.empty() || count.x * count.y <= 1) {
         for (int y = 0; y < count.y; ++y)
             for (int x = 0; x < count.x; ++x) func(Point2i(x, y));
         return;
     }
 
-    ParallelForLoop loop(std::move(func), count, CurrentProfilerState());
+    ParallelForLoop loop(std::move(func), count);
     {
         std::lock_guard<std::mutex> lock(workListMutex);
         loop.next = workList;
@@ -245,17 +223,13 @@ void ParallelFor2D(std::function<void(Point2i)> func, const Point2i& count) {
         // Run loop indices in _[indexStart, indexEnd)_
         lock.unlock();
         for (int64_t index = indexStart; index < indexEnd; ++index) {
-            uint64_t oldState = ProfilerState;
-            ProfilerState = loop.profilerState;
             if (loop.func1D) {
                 loop.func1D(index);
             }
             // Handle other types of loops
             else {
-                CHECK(loop.func2D);
                 loop.func2D(Point2i(index % loop.nX, index / loop.nX));
             }
-            ProfilerState = oldState;
         }
         lock.lock();
 
@@ -268,15 +242,14 @@ int NumSystemCores() {
     return std::max(1u, std::thread::hardware_concurrency());
 }
 
-void ParallelInit() {
+void ParallelInit(int nThreads) {
     CHECK_EQ(threads.size(), 0);
-    int nThreads = MaxThreadIndex();
+    nThreadsRequested = nThreads;
+    nThreads = MaxThreadIndex();
     ThreadIndex = 0;
 
-    // Create a barrier so that we can be sure all worker threads get past
-    // their call to ProfilerWorkerThreadInit() before we return from this
-    // function.  In turn, we can be sure that the profiling system isn't
-    // started until after all worker threads have done that.
+    // Create a barrier so that we can be sure all worker threads have
+    // started before we return from this function.
     std::shared_ptr<Barrier> barrier = std::make_shared<Barrier>(nThreads);
 
     // Launch one fewer worker thread than the total number we want doing
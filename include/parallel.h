@@ -70,7 +70,8 @@ void ParallelFor2D(std::function<void(Point2i)> func, const Point2i& count);
 int MaxThreadIndex();
 int NumSystemCores();
 
-void ParallelInit();
+// _nThreads_ == 0 uses one thread per system core.
+void ParallelInit(int nThreads = 0);
 void ParallelCleanup();
 void MergeWorkerThreadStats();
 
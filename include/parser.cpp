@@ -0,0 +1,1179 @@
+#include "parser.h"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <deque>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "localsocket.h"
+#include "options.h"
+#include "parallel.h"
+#include "transform.h"
+#include "texture.h"
+#include "material.h"
+#include "sphere.h"
+#include "moving_sphere.h"
+#include "triangle.h"
+#include "light.h"
+#include "medium.h"
+#include "constant_medium.h"
+#include "loadobj.h"
+#include "assetcache.h"
+
+// Parser Local Declarations
+namespace {
+
+// Read-only view of a whole file. The file is mapped rather than read so
+// that large scene descriptions (meshes written inline as trianglemesh
+// arrays) are streamed through the tokenizer by the OS pager instead of
+// being copied into memory up front.
+class MappedFile {
+public:
+    ~MappedFile() {
+#ifdef _WIN32
+        if (ptr && !buffer.size()) UnmapViewOfFile(ptr);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (map) munmap(map, len);
+        if (fd >= 0) close(fd);
+#endif
+    }
+    bool Open(const std::string& filename) {
+#ifdef _WIN32
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+            nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size)) return false;
+        len = (size_t)size.QuadPart;
+        if (len == 0) return true;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+            ptr = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (ptr) return true;
+#else
+        fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) return false;
+        len = (size_t)st.st_size;
+        if (len == 0) return true;
+        map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, len, MADV_SEQUENTIAL);
+            ptr = (const char*)map;
+            return true;
+        }
+        map = nullptr;
+#endif
+        // Mapping can fail (pipes, some network filesystems); fall back to
+        // reading the whole file.
+        std::ifstream in(filename, std::ios::binary);
+        if (!in) return false;
+        buffer.assign(std::istreambuf_iterator<char>(in),
+            std::istreambuf_iterator<char>());
+        ptr = buffer.data();
+        len = buffer.size();
+        return true;
+    }
+    const char* data() const { return ptr; }
+    size_t size() const { return len; }
+
+private:
+    const char* ptr = nullptr;
+    size_t len = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+    void* map = nullptr;
+#endif
+    std::vector<char> buffer;
+};
+
+// Thrown for malformed input; caught by ParseSceneFile() and reported
+// through its _error_ argument.
+struct ParseError {
+    std::string message;
+};
+
+// A token points into the mapped file; quoted strings keep their quotes.
+struct Token {
+    const char* ptr = nullptr;
+    size_t len = 0;
+    const std::string* file = nullptr;
+    int line = 0;
+    std::string Location() const {
+        return *file + ":" + std::to_string(line) + ": ";
+    }
+    bool IsString() const { return len >= 2 && ptr[0] == '"'; }
+    bool Is(const char* s) const {
+        return len == strlen(s) && memcmp(ptr, s, len) == 0;
+    }
+    std::string Text() const { return std::string(ptr, len); }
+    // Contents of a quoted string, with escapes resolved
+    std::string Dequoted() const {
+        std::string s;
+        s.reserve(len);
+        for (size_t i = 1; i + 1 < len; ++i) {
+            char c = ptr[i];
+            if (c == '\\' && i + 2 < len) {
+                c = ptr[++i];
+                if (c == 'n') c = '\n';
+                else if (c == 't') c = '\t';
+            }
+            s += c;
+        }
+        return s;
+    }
+};
+
+class Tokenizer {
+public:
+    // _filename_ must outlive the tokens, which refer to it
+    Tokenizer(std::unique_ptr<MappedFile> file, const std::string* filename)
+        : filename(filename), file(std::move(file)) {
+        pos = this->file->data();
+        end = pos + this->file->size();
+    }
+    // Returns false at the end of the file.
+    bool Next(Token* tok) {
+        for (;;) {
+            while (pos < end && isspace((unsigned char)*pos)) {
+                if (*pos == '\n') ++line;
+                ++pos;
+            }
+            if (pos == end) return false;
+            if (*pos != '#') break;
+            while (pos < end && *pos != '\n') ++pos;
+        }
+        const char* start = pos;
+        tok->file = filename;
+        tok->line = line;
+        if (*pos == '"') {
+            ++pos;
+            while (pos < end && *pos != '"') {
+                if (*pos == '\n')
+                    throw ParseError{ Location(line) + "unterminated string" };
+                if (*pos == '\\' && pos + 1 < end) ++pos;
+                ++pos;
+            }
+            if (pos == end)
+                throw ParseError{ Location(line) + "unterminated string" };
+            ++pos;
+        }
+        else if (*pos == '[' || *pos == ']')
+            ++pos;
+        else
+            while (pos < end && !isspace((unsigned char)*pos) && *pos != '"' &&
+                *pos != '[' && *pos != ']' && *pos != '#')
+                ++pos;
+        tok->ptr = start;
+        tok->len = pos - start;
+        return true;
+    }
+    std::string Location(int l) const {
+        return *filename + ":" + std::to_string(l) + ": ";
+    }
+
+    const std::string* const filename;
+
+private:
+    std::unique_ptr<MappedFile> file;
+    const char* pos;
+    const char* end;
+    int line = 1;
+};
+
+// One "type name" value of a directive's parameter list
+struct ParamItem {
+    std::string type, name;
+    std::vector<Float> floats;
+    std::vector<std::string> strings;
+    Token decl;
+    mutable bool lookedUp = false;
+};
+
+class ParamSet {
+public:
+    std::vector<ParamItem> items;
+
+    const ParamItem* Find(const std::string& name,
+        std::initializer_list<const char*> types) const {
+        for (const ParamItem& p : items) {
+            if (p.name != name) continue;
+            for (const char* t : types)
+                if (p.type == t) {
+                    p.lookedUp = true;
+                    return &p;
+                }
+        }
+        return nullptr;
+    }
+    Float FindFloat(const std::string& name, Float d) const {
+        const ParamItem* p = Find(name, { "float" });
+        return (p && !p->floats.empty()) ? p->floats[0] : d;
+    }
+    int FindInt(const std::string& name, int d) const {
+        const ParamItem* p = Find(name, { "integer" });
+        return (p && !p->floats.empty()) ? (int)p->floats[0] : d;
+    }
+    std::string FindString(const std::string& name, const std::string& d) const {
+        const ParamItem* p = Find(name, { "string", "texture" });
+        return (p && !p->strings.empty()) ? p->strings[0] : d;
+    }
+    bool FindRGB(const std::string& name, color* c) const {
+        const ParamItem* p = Find(name, { "rgb", "color" });
+        if (!p || p->floats.size() < 3) return false;
+        *c = color(p->floats[0], p->floats[1], p->floats[2]);
+        return true;
+    }
+    color FindRGB(const std::string& name, const color& d) const {
+        color c;
+        return FindRGB(name, &c) ? c : d;
+    }
+    bool FindPoint(const std::string& name, point3* pt) const {
+        const ParamItem* p = Find(name, { "point", "point3" });
+        if (!p || p->floats.size() < 3) return false;
+        *pt = point3(p->floats[0], p->floats[1], p->floats[2]);
+        return true;
+    }
+    const std::vector<Float>* FindFloats(const std::string& name,
+        std::initializer_list<const char*> types) const {
+        const ParamItem* p = Find(name, types);
+        return p ? &p->floats : nullptr;
+    }
+    void ReportUnused() const {
+        for (const ParamItem& p : items)
+            if (!p.lookedUp)
+                std::cerr << p.decl.Location() << "warning: parameter \""
+                << p.type << " " << p.name << "\" unused\n";
+    }
+};
+
+// A material together with the radiance it emits, so that shapes using
+// a "diffuse_light" material are registered as area lights
+struct MaterialRef {
+    shared_ptr<material> mat;
+    bool emits = false;
+    color L;
+};
+
+// A medium defined by MakeNamedMedium, with the single-scattering albedo
+// its phase function scatters with
+struct NamedMedium {
+    shared_ptr<Medium> medium;
+    color albedo;
+};
+
+struct GraphicsState {
+    MaterialRef material;
+    std::map<std::string, shared_ptr<texture>> textures;
+    std::map<std::string, MaterialRef> namedMaterials;
+    bool areaLight = false;
+    color areaL;
+    bool reverseOrientation = false;
+    // Medium filling the shapes that follow ("" for none)
+    std::string insideMedium;
+};
+
+class SceneParser {
+public:
+    SceneParser(SceneConfig* scene, AssetCache* assets) : scene(scene), assets(assets) {
+        graphicsState.material.mat = make_shared<lambertian>(color(.5, .5, .5));
+    }
+    void PushFile(const std::string& filename, const Token* from);
+    void Parse();
+    void Finish(std::string* loadErrors);
+
+private:
+    // SceneParser Private Methods
+    bool NextToken(Token* tok);
+    Token ExpectToken(const char* what);
+    std::string ExpectString(const char* what);
+    Float ExpectNumber();
+    ParamSet ParseParams();
+    void Warning(const Token& tok, const std::string& msg) const {
+        std::cerr << tok.Location() << "warning: " << msg << "\n";
+    }
+    void Directive(const Token& tok);
+    template <typename F>
+    void ApplyTransform(F f) {
+        for (int i = 0; i < 2; ++i)
+            if (activeTransformBits & (1 << i)) curTransform[i] = f(curTransform[i]);
+    }
+    void Camera(const Token& tok, const std::string& type, const ParamSet& ps);
+    void WorldBegin();
+    shared_ptr<texture> TextureParam(const ParamSet& ps, const std::string& name,
+        const color& d, const Token& tok);
+    MaterialRef MakeMaterial(const std::string& type, const ParamSet& ps,
+        const Token& tok);
+    void MakeTexture(const std::string& name, const std::string& cls,
+        const ParamSet& ps, const Token& tok);
+    void MakeMedium(const std::string& name, const ParamSet& ps, const Token& tok);
+    void Light(const std::string& type, const ParamSet& ps, const Token& tok);
+    void Shape(const std::string& type, const ParamSet& ps, const Token& tok);
+    void AddShapes(const std::vector<shared_ptr<::Shape>>& shapes,
+        const MaterialRef& mat, bool areaLight, const color& areaL,
+        const NamedMedium& medium);
+    void AddObject(shared_ptr<hittable> object, const MaterialRef& mat,
+        bool areaLight, const color& L, const NamedMedium& medium);
+    // Also records the file in the scene's _files_
+    std::string ResolveFilename(const std::string& name, const Token& tok);
+
+    // SceneParser Private Data
+    SceneConfig* scene;
+    AssetCache* assets;
+    std::vector<std::unique_ptr<Tokenizer>> tokenizers;
+    std::deque<std::string> filenames;
+    Token ungetToken;
+    bool hasUnget = false;
+
+    Transform curTransform[2];
+    int activeTransformBits = 3;
+    Float transformStartTime = 0, transformEndTime = 1;
+    // World space is mirrored across the camera's vertical plane, so that
+    // the right-handed camera renders pbrt's left-handed view unflipped
+    Transform worldFrame;
+    // Shapes under the same CTM share its Transform objects
+    TransformCache transformCache;
+    std::map<std::string, std::pair<Transform, Transform>> namedCoordinateSystems;
+    std::map<std::string, NamedMedium> namedMedia;
+    GraphicsState graphicsState;
+    std::vector<GraphicsState> pushedGraphicsStates;
+    std::vector<std::pair<Transform, Transform>> pushedTransforms;
+    std::vector<int> pushedActiveTransformBits;
+    bool inWorld = false, inObject = false;
+
+    // Camera and film settings, resolved at WorldBegin
+    Transform cameraToWorld;
+    Float fov = 90, lensRadius = 0, focalDistance = 0;
+    int xResolution = 0, yResolution = 0;
+
+    // Shapes accumulated for the world's BVH, and the emitters among them
+    hittable_list shapes;
+    std::vector<std::pair<shared_ptr<hittable>, color>> areaLights;
+    std::vector<shared_ptr<::Light>> lights;
+
+    // Asset loads run in parallel after parsing; each may schedule a
+    // _finish_ that runs afterwards on the main thread, in file order.
+    struct AssetLoad {
+        std::function<bool()> load;
+        std::function<void()> finish;
+        std::string what;
+    };
+    std::vector<AssetLoad> loads;
+};
+
+// Parser Local Definitions
+void SceneParser::PushFile(const std::string& filename, const Token* from) {
+    std::string where = from ? from->Location() : std::string();
+    if (tokenizers.size() > 32)
+        throw ParseError{ where + "Include nested too deeply" };
+    std::unique_ptr<MappedFile> file(new MappedFile);
+    filenames.push_back(filename);
+    if (!file->Open(filename))
+        throw ParseError{ where + "cannot open scene file '" + filename + "'" };
+    tokenizers.push_back(std::unique_ptr<Tokenizer>(
+        new Tokenizer(std::move(file), &filenames.back())));
+}
+
+bool SceneParser::NextToken(Token* tok) {
+    if (hasUnget) {
+        hasUnget = false;
+        *tok = ungetToken;
+        return true;
+    }
+    while (!tokenizers.empty()) {
+        if (tokenizers.back()->Next(tok)) return true;
+        // Keep the outermost file for error locations after the last token
+        if (tokenizers.size() == 1) return false;
+        tokenizers.pop_back();
+    }
+    return false;
+}
+
+Token SceneParser::ExpectToken(const char* what) {
+    Token tok;
+    if (!NextToken(&tok))
+        throw ParseError{ *tokenizers.back()->filename +
+            ": premature end of file; expected " + what };
+    return tok;
+}
+
+std::string SceneParser::ExpectString(const char* what) {
+    Token tok = ExpectToken(what);
+    if (!tok.IsString())
+        throw ParseError{ tok.Location() + "expected " + what + ", got '" +
+            tok.Text() + "'" };
+    return tok.Dequoted();
+}
+
+static bool ParseNumber(const Token& tok, Float* v) {
+    // Tokens aren't NUL terminated; numbers are short
+    char buf[64];
+    if (tok.len == 0 || tok.len >= sizeof(buf)) return false;
+    memcpy(buf, tok.ptr, tok.len);
+    buf[tok.len] = '\0';
+    char* end;
+    double d = strtod(buf, &end);
+    if (*end != '\0') return false;
+    *v = (Float)d;
+    return true;
+}
+
+Float SceneParser::ExpectNumber() {
+    Token tok = ExpectToken("a number");
+    Float v;
+    if (!ParseNumber(tok, &v))
+        throw ParseError{ tok.Location() + "expected a number, got '" +
+            tok.Text() + "'" };
+    return v;
+}
+
+ParamSet SceneParser::ParseParams() {
+    ParamSet ps;
+    Token tok;
+    while (NextToken(&tok)) {
+        if (!tok.IsString()) {
+            ungetToken = tok;
+            hasUnget = true;
+            break;
+        }
+        // "type name" followed by a single value or a bracketed list
+        ParamItem item;
+        item.decl = tok;
+        std::string decl = tok.Dequoted();
+        size_t b = decl.find_first_not_of(" \t");
+        size_t e = decl.find_first_of(" \t", b);
+        size_t n = decl.find_first_not_of(" \t", e);
+        if (b == std::string::npos || e == std::string::npos || n == std::string::npos)
+            throw ParseError{ tok.Location() + "bad parameter declaration \"" + decl + "\"" };
+        item.type = decl.substr(b, e - b);
+        item.name = decl.substr(n, decl.find_last_not_of(" \t") + 1 - n);
+        if (item.type == "normal3") item.type = "normal";
+        else if (item.type == "vector3") item.type = "vector";
+        else if (item.type == "point3") item.type = "point";
+
+        auto addValue = [&](const Token& v) {
+            Float f;
+            if (v.IsString())
+                item.strings.push_back(v.Dequoted());
+            else if (v.Is("true") || v.Is("false"))
+                item.floats.push_back(v.Is("true") ? 1 : 0);
+            else if (ParseNumber(v, &f))
+                item.floats.push_back(f);
+            else
+                throw ParseError{ v.Location() + "bad value '" + v.Text() +
+                    "' for parameter \"" + decl + "\"" };
+        };
+        Token v = ExpectToken("a parameter value");
+        if (v.Is("[")) {
+            for (;;) {
+                v = ExpectToken("']'");
+                if (v.Is("]")) break;
+                addValue(v);
+            }
+        }
+        else
+            addValue(v);
+        ps.items.push_back(std::move(item));
+    }
+    return ps;
+}
+
+void SceneParser::Parse() {
+    Token tok;
+    while (NextToken(&tok))
+        Directive(tok);
+    if (!pushedGraphicsStates.empty())
+        std::cerr << *tokenizers.back()->filename
+        << ": warning: missing AttributeEnd at end of file\n";
+}
+
+void SceneParser::Directive(const Token& tok) {
+    auto check = [&](bool world, const char* name) {
+        if (world != inWorld)
+            throw ParseError{ tok.Location() + name + " not allowed " +
+                (inWorld ? "inside" : "outside") + " the world block" };
+    };
+    if (tok.Is("Identity"))
+        ApplyTransform([&](const Transform&) { return worldFrame; });
+    else if (tok.Is("Translate")) {
+        Float x = ExpectNumber(), y = ExpectNumber(), z = ExpectNumber();
+        ApplyTransform([&](const Transform& t) { return t * Translate(vec3(x, y, z)); });
+    }
+    else if (tok.Is("Scale")) {
+        Float x = ExpectNumber(), y = ExpectNumber(), z = ExpectNumber();
+        ApplyTransform([&](const Transform& t) { return t * ::Scale(x, y, z); });
+    }
+    else if (tok.Is("Rotate")) {
+        Float a = ExpectNumber(), x = ExpectNumber(), y = ExpectNumber(),
+            z = ExpectNumber();
+        ApplyTransform([&](const Transform& t) { return t * Rotate(a, vec3(x, y, z)); });
+    }
+    else if (tok.Is("LookAt")) {
+        Float v[9];
+        for (int i = 0; i < 9; ++i) v[i] = ExpectNumber();
+        Transform lookAt = ::LookAt(point3(v[0], v[1], v[2]),
+            point3(v[3], v[4], v[5]), vec3(v[6], v[7], v[8]));
+        ApplyTransform([&](const Transform& t) { return t * lookAt; });
+    }
+    else if (tok.Is("Transform") || tok.Is("ConcatTransform")) {
+        bool concat = tok.Is("ConcatTransform");
+        Float m[16];
+        Token b = ExpectToken("'['");
+        if (!b.Is("["))
+            throw ParseError{ b.Location() + "expected '[' after " + tok.Text() };
+        for (int i = 0; i < 16; ++i) m[i] = ExpectNumber();
+        Token e = ExpectToken("']'");
+        if (!e.Is("]"))
+            throw ParseError{ e.Location() + "expected ']' after 16 matrix values" };
+        // pbrt writes matrices column-major
+        Transform t = Transpose(Transform(Matrix4x4(m[0], m[1], m[2], m[3], m[4],
+            m[5], m[6], m[7], m[8], m[9], m[10], m[11], m[12], m[13], m[14], m[15])));
+        ApplyTransform([&](const Transform& cur) {
+            return concat ? cur * t : worldFrame * t;
+        });
+    }
+    else if (tok.Is("CoordinateSystem"))
+        namedCoordinateSystems[ExpectString("a name")] = { curTransform[0], curTransform[1] };
+    else if (tok.Is("CoordSysTransform")) {
+        std::string name = ExpectString("a name");
+        auto it = namedCoordinateSystems.find(name);
+        if (it == namedCoordinateSystems.end())
+            Warning(tok, "coordinate system \"" + name + "\" not declared");
+        else {
+            curTransform[0] = it->second.first;
+            curTransform[1] = it->second.second;
+        }
+    }
+    else if (tok.Is("ActiveTransform")) {
+        Token which = ExpectToken("StartTime, EndTime or All");
+        if (which.Is("StartTime")) activeTransformBits = 1;
+        else if (which.Is("EndTime")) activeTransformBits = 2;
+        else if (which.Is("All")) activeTransformBits = 3;
+        else
+            throw ParseError{ which.Location() + "unknown ActiveTransform '" +
+                which.Text() + "'" };
+    }
+    else if (tok.Is("TransformTimes")) {
+        transformStartTime = ExpectNumber();
+        transformEndTime = ExpectNumber();
+    }
+    else if (tok.Is("ReverseOrientation"))
+        graphicsState.reverseOrientation = !graphicsState.reverseOrientation;
+    else if (tok.Is("Include") || tok.Is("Import")) {
+        std::string name = ResolveFilename(ExpectString("a file name"), tok);
+        PushFile(name, &tok);
+    }
+    else if (tok.Is("Camera")) {
+        check(false, "Camera");
+        std::string type = ExpectString("a camera type");
+        Camera(tok, type, ParseParams());
+    }
+    else if (tok.Is("Film")) {
+        check(false, "Film");
+        ExpectString("a film type");
+        ParamSet ps = ParseParams();
+        xResolution = ps.FindInt("xresolution", xResolution);
+        yResolution = ps.FindInt("yresolution", yResolution);
+        scene->image_file = ps.FindString("filename", scene->image_file);
+        ps.Find("cropwindow", { "float" });
+        ps.ReportUnused();
+    }
+    else if (tok.Is("Sampler")) {
+        check(false, "Sampler");
+        ExpectString("a sampler type");
+        ParamSet ps = ParseParams();
+        scene->samples_per_pixel = ps.FindInt("pixelsamples", scene->samples_per_pixel);
+    }
+    else if (tok.Is("Integrator") || tok.Is("PixelFilter") ||
+        tok.Is("Accelerator")) {
+        // Settings of pbrt's own renderer; the command line chooses ours
+        ExpectString("a type");
+        ParseParams();
+    }
+    else if (tok.Is("MakeNamedMedium")) {
+        std::string name = ExpectString("a medium name");
+        MakeMedium(name, ParseParams(), tok);
+    }
+    else if (tok.Is("MediumInterface")) {
+        graphicsState.insideMedium = ExpectString("a medium name");
+        // Rays don't track the medium they are in, so the exterior medium
+        // only matters when it differs from the interior of another shape
+        Token t;
+        if (NextToken(&t)) {
+            if (!t.IsString()) { ungetToken = t; hasUnget = true; }
+        }
+    }
+    else if (tok.Is("WorldBegin")) {
+        check(false, "WorldBegin");
+        WorldBegin();
+    }
+    else if (tok.Is("WorldEnd")) {
+        check(true, "WorldEnd");
+        inWorld = false;
+    }
+    else if (tok.Is("AttributeBegin") || tok.Is("TransformBegin")) {
+        if (tok.Is("AttributeBegin"))
+            pushedGraphicsStates.push_back(graphicsState);
+        pushedTransforms.push_back({ curTransform[0], curTransform[1] });
+        pushedActiveTransformBits.push_back(activeTransformBits);
+    }
+    else if (tok.Is("AttributeEnd") || tok.Is("TransformEnd")) {
+        if (pushedTransforms.empty() ||
+            (tok.Is("AttributeEnd") && pushedGraphicsStates.empty())) {
+            Warning(tok, "unmatched " + tok.Text() + " ignored");
+            return;
+        }
+        if (tok.Is("AttributeEnd")) {
+            graphicsState = std::move(pushedGraphicsStates.back());
+            pushedGraphicsStates.pop_back();
+        }
+        curTransform[0] = pushedTransforms.back().first;
+        curTransform[1] = pushedTransforms.back().second;
+        pushedTransforms.pop_back();
+        activeTransformBits = pushedActiveTransformBits.back();
+        pushedActiveTransformBits.pop_back();
+    }
+    else if (tok.Is("Texture")) {
+        check(true, "Texture");
+        std::string name = ExpectString("a texture name");
+        ExpectString("a texture type");
+        std::string cls = ExpectString("a texture class");
+        MakeTexture(name, cls, ParseParams(), tok);
+    }
+    else if (tok.Is("Material")) {
+        check(true, "Material");
+        std::string type = ExpectString("a material type");
+        graphicsState.material = MakeMaterial(type, ParseParams(), tok);
+    }
+    else if (tok.Is("MakeNamedMaterial")) {
+        check(true, "MakeNamedMaterial");
+        std::string name = ExpectString("a material name");
+        ParamSet ps = ParseParams();
+        std::string type = ps.FindString("type", "");
+        if (type.empty())
+            throw ParseError{ tok.Location() + "no \"string type\" for named material \"" +
+                name + "\"" };
+        graphicsState.namedMaterials[name] = MakeMaterial(type, ps, tok);
+    }
+    else if (tok.Is("NamedMaterial")) {
+        check(true, "NamedMaterial");
+        std::string name = ExpectString("a material name");
+        auto it = graphicsState.namedMaterials.find(name);
+        if (it == graphicsState.namedMaterials.end())
+            throw ParseError{ tok.Location() + "named material \"" + name + "\" not defined" };
+        graphicsState.material = it->second;
+    }
+    else if (tok.Is("AreaLightSource")) {
+        check(true, "AreaLightSource");
+        std::string type = ExpectString("an area light type");
+        ParamSet ps = ParseParams();
+        if (type != "diffuse") {
+            Warning(tok, "area light \"" + type + "\" unknown; using \"diffuse\"");
+        }
+        graphicsState.areaLight = true;
+        graphicsState.areaL = ps.FindRGB("L", color(1, 1, 1)) *
+            ps.FindFloat("scale", 1);
+        ps.Find("twosided", { "bool" });
+        ps.ReportUnused();
+    }
+    else if (tok.Is("LightSource")) {
+        check(true, "LightSource");
+        std::string type = ExpectString("a light type");
+        Light(type, ParseParams(), tok);
+    }
+    else if (tok.Is("Shape")) {
+        check(true, "Shape");
+        std::string type = ExpectString("a shape type");
+        ParamSet ps = ParseParams();
+        if (inObject) return;
+        Shape(type, ps, tok);
+    }
+    else if (tok.Is("ObjectBegin")) {
+        check(true, "ObjectBegin");
+        Warning(tok, "object instancing not supported; skipping \"" +
+            ExpectString("an object name") + "\"");
+        inObject = true;
+    }
+    else if (tok.Is("ObjectEnd"))
+        inObject = false;
+    else if (tok.Is("ObjectInstance"))
+        ExpectString("an object name");
+    else
+        throw ParseError{ tok.Location() + "unknown directive '" + tok.Text() + "'" };
+}
+
+void SceneParser::Camera(const Token& tok, const std::string& type,
+    const ParamSet& ps) {
+    if (type != "perspective")
+        Warning(tok, "camera \"" + type + "\" unsupported; using \"perspective\"");
+    cameraToWorld = Inverse(curTransform[0]);
+    namedCoordinateSystems["camera"] = { Inverse(curTransform[0]), Inverse(curTransform[1]) };
+    fov = ps.FindFloat("fov", fov);
+    lensRadius = ps.FindFloat("lensradius", lensRadius);
+    focalDistance = ps.FindFloat("focaldistance", focalDistance);
+    ps.Find("shutteropen", { "float" });
+    ps.Find("shutterclose", { "float" });
+    ps.ReportUnused();
+}
+
+void SceneParser::WorldBegin() {
+    inWorld = true;
+    // Camera
+    point3 eye = cameraToWorld(point3(0, 0, 0));
+    point3 look = cameraToWorld(point3(0, 0, 1));
+    vec3 up = cameraToWorld(vec3(0, 1, 0));
+    scene->lookfrom = eye;
+    scene->lookat = look;
+    scene->vup = up;
+    if (xResolution > 0 || yResolution > 0) {
+        int xres = xResolution > 0 ? xResolution : 1280;
+        int yres = yResolution > 0 ? yResolution : 720;
+        scene->image_width = xres;
+        scene->aspect_ratio = Float(xres) / Float(yres);
+    }
+    // pbrt's fov spans the shorter image axis; ours is always vertical
+    Float aspect = scene->aspect_ratio;
+    scene->vfov = aspect >= 1 ? fov
+        : Degrees(2 * std::atan(std::tan(Radians(fov) / 2) / aspect));
+    scene->aperture = 2 * lensRadius;
+    scene->focus_dist = focalDistance > 0 ? focalDistance : (look - eye).Length();
+
+    worldFrame = cameraToWorld * ::Scale(-1, 1, 1) * Inverse(cameraToWorld);
+    curTransform[0] = curTransform[1] = worldFrame;
+    activeTransformBits = 3;
+    namedCoordinateSystems["world"] = { worldFrame, worldFrame };
+    auto& cam = namedCoordinateSystems["camera"];
+    cam = { worldFrame * cam.first, worldFrame * cam.second };
+}
+
+std::string SceneParser::ResolveFilename(const std::string& name,
+    const Token& tok) {
+    auto exists = [](const std::string& f) { return (bool)std::ifstream(f); };
+    std::string resolved = name;
+    if (!(name.empty() || name[0] == '/' || name[0] == '\\' ||
+        (name.size() > 1 && name[1] == ':'))) {
+        // Relative to the file being parsed, as pbrt does; then the asset
+        // directory the built-in scenes use
+        const std::string& cur = *tok.file;
+        size_t slash = cur.find_last_of("/\\");
+        resolved = slash == std::string::npos ? name : cur.substr(0, slash + 1) + name;
+        if (!exists(resolved) && exists(AssetPath(name)))
+            resolved = AssetPath(name);
+    }
+    if (!resolved.empty())
+        scene->files.push_back(AbsolutePath(resolved));
+    return resolved;
+}
+
+shared_ptr<texture> SceneParser::TextureParam(const ParamSet& ps,
+    const std::string& name, const color& d, const Token& tok) {
+    if (const ParamItem* p = ps.Find(name, { "texture" })) {
+        std::string texName = p->strings.empty() ? "" : p->strings[0];
+        auto it = graphicsState.textures.find(texName);
+        if (it == graphicsState.textures.end())
+            throw ParseError{ tok.Location() + "texture \"" + texName + "\" not defined" };
+        return it->second;
+    }
+    if (const ParamItem* p = ps.Find(name, { "float" }))
+        if (!p->floats.empty()) {
+            Float v = p->floats[0];
+            return make_shared<solid_color>(color(v, v, v));
+        }
+    return make_shared<solid_color>(ps.FindRGB(name, d));
+}
+
+void SceneParser::MakeTexture(const std::string& name, const std::string& cls,
+    const ParamSet& ps, const Token& tok) {
+    shared_ptr<texture> tex;
+    if (cls == "imagemap") {
+        std::string filename = ps.FindString("filename", "");
+        if (filename.empty())
+            throw ParseError{ tok.Location() + "no filename for imagemap texture \"" +
+                name + "\"" };
+        auto image = make_shared<image_texture>();
+        std::string path = ResolveFilename(filename, tok);
+        AssetCache* cache = assets;
+        loads.push_back({
+            [image, path, cache] {
+                return cache ? cache->LoadImage(path, image) : image->load(path);
+            },
+            nullptr, path });
+        tex = image;
+    }
+    else if (cls == "checkerboard") {
+        // Checks are 3D, in world space with period 2*Pi/10 (see
+        // checker_texture); pbrt's uv scales don't apply
+        tex = make_shared<checker_texture>(
+            TextureParam(ps, "tex1", color(1, 1, 1), tok),
+            TextureParam(ps, "tex2", color(0, 0, 0), tok));
+    }
+    else if (cls == "noise" || cls == "fbm" || cls == "marble")
+        tex = make_shared<noise_texture>(ps.FindFloat("scale", 1));
+    else {
+        if (cls != "constant")
+            Warning(tok, "texture class \"" + cls + "\" unsupported; using \"constant\"");
+        tex = TextureParam(ps, "value", color(1, 1, 1), tok);
+    }
+    ps.ReportUnused();
+    graphicsState.textures[name] = tex;
+}
+
+MaterialRef SceneParser::MakeMaterial(const std::string& type,
+    const ParamSet& ps, const Token& tok) {
+    MaterialRef m;
+    if (type == "" || type == "none" || type == "interface")
+        m.mat = nullptr;
+    else if (type == "metal") {
+        color albedo = ps.FindRGB("Kd", color(.8, .8, .8));
+        albedo = ps.FindRGB("albedo", albedo);
+        Float fuzz = ps.FindFloat("fuzz", ps.FindFloat("roughness", 0));
+        m.mat = make_shared<metal>(albedo, fuzz);
+    }
+    else if (type == "glass" || type == "dielectric") {
+        Float eta = ps.FindFloat("eta", ps.FindFloat("index", 1.5));
+        m.mat = make_shared<dielectric>(eta);
+    }
+    else if (type == "diffuse_light") {
+        m.L = ps.FindRGB("L", color(1, 1, 1)) * ps.FindFloat("scale", 1);
+        m.mat = make_shared<diffuse_light>(m.L);
+        m.emits = true;
+    }
+    else {
+        if (type != "matte" && type != "lambertian")
+            Warning(tok, "material \"" + type + "\" unsupported; using \"matte\"");
+        m.mat = make_shared<lambertian>(TextureParam(ps, "Kd", color(.5, .5, .5), tok));
+    }
+    ps.Find("type", { "string" });
+    ps.ReportUnused();
+    return m;
+}
+
+void SceneParser::Light(const std::string& type, const ParamSet& ps,
+    const Token& tok) {
+    Transform lightToWorld = curTransform[0];
+    color scale = ps.FindRGB("scale", color(1, 1, 1));
+    if (type == "point") {
+        point3 from(0, 0, 0);
+        ps.FindPoint("from", &from);
+        Color I = Color::FromRGB(ps.FindRGB("I", color(1, 1, 1)) * scale,
+            SpectrumType::Illuminant);
+        lights.push_back(make_shared<PointLight>(
+            lightToWorld * Translate(vec3(from)), I));
+    }
+    else if (type == "distant") {
+        point3 from(0, 0, 0), to(0, 0, 1);
+        ps.FindPoint("from", &from);
+        ps.FindPoint("to", &to);
+        Color L = Color::FromRGB(ps.FindRGB("L", color(1, 1, 1)) * scale,
+            SpectrumType::Illuminant);
+        lights.push_back(make_shared<DistantLight>(lightToWorld, L, from - to));
+    }
+    else if (type == "infinite") {
+        Color L = Color::FromRGB(ps.FindRGB("L", color(1, 1, 1)) * scale,
+            SpectrumType::Illuminant);
+        int nSamples = ps.FindInt("samples", ps.FindInt("nsamples", 1));
+        std::string mapname = ps.FindString("mapname", "");
+        if (!mapname.empty()) mapname = ResolveFilename(mapname, tok);
+        // The environment map is read and its sampling distribution built
+        // with the other assets
+        auto light = std::make_shared<shared_ptr<::Light>>();
+        auto* lightList = &lights;
+        size_t slot = lights.size();
+        lights.push_back(nullptr);
+        loads.push_back({
+            [=] {
+                *light = make_shared<InfiniteAreaLight>(lightToWorld, L, nSamples, mapname);
+                return true;
+            },
+            [=] { (*lightList)[slot] = *light; },
+            mapname });
+    }
+    else
+        Warning(tok, "light \"" + type + "\" unsupported; ignored");
+    ps.ReportUnused();
+}
+
+void SceneParser::MakeMedium(const std::string& name, const ParamSet& ps,
+    const Token& tok) {
+    std::string type = ps.FindString("type", "");
+    if (type.empty())
+        throw ParseError{ tok.Location() + "no \"string type\" for named medium \"" +
+            name + "\"" };
+    // pbrt's defaults (its "Skin1" preset, in mm^-1)
+    color sig_a = ps.FindRGB("sigma_a", color(.0011, .0024, .014));
+    color sig_s = ps.FindRGB("sigma_s", color(2.55, 3.21, 3.77));
+    Float scale = ps.FindFloat("scale", 1);
+    if (ps.FindFloat("g", 0) != 0)
+        Warning(tok, "anisotropic phase functions not supported; using g = 0");
+    ps.Find("preset", { "string" });
+    // Extinction is gray; the color goes into the scattering albedo
+    color sig_t = sig_a + sig_s;
+    NamedMedium m;
+    for (int c = 0; c < 3; ++c)
+        m.albedo[c] = sig_t[c] > 0 ? sig_s[c] / sig_t[c] : 0;
+    Float sigma_t = scale * (sig_t.x + sig_t.y + sig_t.z) / 3;
+
+    if (type == "homogeneous")
+        m.medium = make_shared<HomogeneousMedium>(sigma_t);
+    else if (type == "heterogeneous") {
+        int nx = ps.FindInt("nx", 1), ny = ps.FindInt("ny", 1), nz = ps.FindInt("nz", 1);
+        if (nx < 1 || ny < 1 || nz < 1)
+            throw ParseError{ tok.Location() + "heterogeneous medium \"" + name +
+                "\" needs positive nx, ny and nz" };
+        // Large volumes come from a raw float file, which is read straight
+        // into the sparse grid
+        std::shared_ptr<const SparseGrid> grid;
+        std::string filename = ps.FindString("filename", "");
+        if (!filename.empty()) {
+            std::string err;
+            grid = SparseGrid::ReadRaw(ResolveFilename(filename, tok), nx, ny, nz, &err);
+            if (!grid)
+                throw ParseError{ tok.Location() + err };
+        }
+        else {
+            const std::vector<Float>* density = ps.FindFloats("density", { "float" });
+            if (!density || density->size() != size_t(nx) * ny * nz)
+                throw ParseError{ tok.Location() + "heterogeneous medium \"" + name +
+                    "\" needs nx*ny*nz \"float density\" values or a \"string filename\"" };
+            grid = std::make_shared<const SparseGrid>(nx, ny, nz, density->data());
+        }
+        point3 p0(0, 0, 0), p1(1, 1, 1);
+        ps.FindPoint("p0", &p0);
+        ps.FindPoint("p1", &p1);
+        // The grid stays axis-aligned in world space; rotated media get
+        // the bounds of their rotated box
+        aabb bounds = curTransform[0](aabb(p0, p1));
+        m.medium = make_shared<GridDensityMedium>(sigma_t, bounds, grid);
+    }
+    else {
+        Warning(tok, "medium \"" + type + "\" unsupported; ignored");
+        return;
+    }
+    ps.Find("type", { "string" });
+    ps.ReportUnused();
+    namedMedia[name] = m;
+}
+
+void SceneParser::AddObject(shared_ptr<hittable> object, const MaterialRef& mat,
+    bool areaLight, const color& L, const NamedMedium& medium) {
+    if (medium.medium)
+        shapes.add(make_shared<constant_medium>(object, medium.medium, medium.albedo));
+    if (!mat.mat) return;
+    shapes.add(object);
+    if (areaLight) areaLights.push_back({ object, L });
+}
+
+void SceneParser::AddShapes(const std::vector<shared_ptr<::Shape>>& tris,
+    const MaterialRef& mat, bool areaLight, const color& areaL,
+    const NamedMedium& medium) {
+    if (tris.empty()) return;
+    hittable_list mesh;
+    for (const auto& s : tris) {
+        auto h = make_shared<shape_hittable>(s, mat.mat);
+        mesh.add(h);
+        // Each triangle of an emissive mesh is its own light, as in pbrt
+        if (areaLight) areaLights.push_back({ h, areaL });
+    }
+    auto bvh = make_shared<bvh_node>(mesh, transformStartTime, transformEndTime);
+    if (medium.medium)
+        shapes.add(make_shared<constant_medium>(bvh, medium.medium, medium.albedo));
+    if (mat.mat) shapes.add(bvh);
+}
+
+void SceneParser::Shape(const std::string& type, const ParamSet& ps,
+    const Token& tok) {
+    MaterialRef mat = graphicsState.material;
+    bool areaLight = graphicsState.areaLight || mat.emits;
+    color areaL = graphicsState.areaLight ? graphicsState.areaL : mat.L;
+    if (graphicsState.areaLight)
+        mat.mat = make_shared<diffuse_light>(areaL);
+    // Shapes that are neither surfaces nor medium boundaries are skipped
+    NamedMedium medium;
+    if (!graphicsState.insideMedium.empty()) {
+        auto it = namedMedia.find(graphicsState.insideMedium);
+        if (it == namedMedia.end())
+            throw ParseError{ tok.Location() + "named medium \"" +
+                graphicsState.insideMedium + "\" not defined" };
+        medium = it->second;
+    }
+    if (!mat.mat && !medium.medium) return;
+    bool reverse = graphicsState.reverseOrientation;
+    shared_ptr<Transform> objectToWorld, worldToObject;
+    transformCache.Lookup(curTransform[0], &objectToWorld, &worldToObject);
+    bool animated = curTransform[0] != curTransform[1];
+
+    if (type == "sphere") {
+        Float radius = ps.FindFloat("radius", 1);
+        Float zmin = ps.FindFloat("zmin", -radius), zmax = ps.FindFloat("zmax", radius);
+        Float phimax = ps.FindFloat("phimax", 360);
+        const Transform& t = curTransform[0];
+        Float sx = t(vec3(1, 0, 0)).Length(), sy = t(vec3(0, 1, 0)).Length(),
+            sz = t(vec3(0, 0, 1)).Length();
+        bool uniform = std::abs(sx - sy) < 1e-4f * sx && std::abs(sx - sz) < 1e-4f * sx;
+        bool whole = zmin <= -radius && zmax >= radius && phimax >= 360;
+        point3 c0 = curTransform[0](point3(0, 0, 0));
+        point3 c1 = curTransform[1](point3(0, 0, 0));
+        if (animated) {
+            if (!uniform || !whole)
+                Warning(tok, "animated spheres only move; scale and clipping ignored");
+            AddObject(make_shared<moving_sphere>(c0, c1, transformStartTime,
+                transformEndTime, radius * sx, mat.mat), mat, areaLight, areaL, medium);
+        }
+        else if (uniform && whole)
+            AddObject(make_shared<sphere>(c0, radius * sx, mat.mat), mat, areaLight,
+                areaL, medium);
+        else
+            AddObject(make_shared<shape_hittable>(make_shared<Sphere>(objectToWorld,
+                worldToObject, reverse, radius, zmin, zmax, phimax), mat.mat),
+                mat, areaLight, areaL, medium);
+    }
+    else if (type == "trianglemesh") {
+        if (animated)
+            Warning(tok, "animated triangle meshes not supported; using the start transform");
+        const std::vector<Float>* P = ps.FindFloats("P", { "point" });
+        const std::vector<Float>* indices = ps.FindFloats("indices", { "integer" });
+        const std::vector<Float>* N = ps.FindFloats("N", { "normal" });
+        const std::vector<Float>* uvs = ps.FindFloats("uv", { "float", "point2" });
+        if (!uvs) uvs = ps.FindFloats("st", { "float", "point2" });
+        if (!P || P->size() < 9 || P->size() % 3 != 0)
+            throw ParseError{ tok.Location() + "trianglemesh needs \"point P\" with "
+                "a multiple of 3 values" };
+        int nVertices = (int)(P->size() / 3);
+        std::vector<int> vi;
+        if (indices)
+            for (Float f : *indices) vi.push_back((int)f);
+        else if (nVertices == 3)
+            vi = { 0, 1, 2 };
+        if (vi.empty() || vi.size() % 3 != 0)
+            throw ParseError{ tok.Location() + "trianglemesh needs \"integer indices\" "
+                "with a multiple of 3 values" };
+        for (int i : vi)
+            if (i < 0 || i >= nVertices)
+                throw ParseError{ tok.Location() + "trianglemesh index " +
+                    std::to_string(i) + " out of range" };
+        std::vector<Point3f> p(nVertices);
+        for (int i = 0; i < nVertices; ++i)
+            p[i] = Point3f((*P)[3 * i], (*P)[3 * i + 1], (*P)[3 * i + 2]);
+        std::vector<Normal3f> n;
+        if (N && N->size() == P->size()) {
+            n.resize(nVertices);
+            for (int i = 0; i < nVertices; ++i)
+                n[i] = Normal3f((*N)[3 * i], (*N)[3 * i + 1], (*N)[3 * i + 2]);
+        }
+        else if (N)
+            Warning(tok, "\"normal N\" doesn't match \"point P\"; discarding");
+        std::vector<Point2f> uv;
+        if (uvs && uvs->size() == 2 * (size_t)nVertices) {
+            uv.resize(nVertices);
+            for (int i = 0; i < nVertices; ++i)
+                uv[i] = Point2f((*uvs)[2 * i], (*uvs)[2 * i + 1]);
+        }
+        else if (uvs)
+            Warning(tok, "\"uv\" doesn't match \"point P\"; discarding");
+        AddShapes(CreateTriangleMesh(objectToWorld, worldToObject, reverse,
+            (int)vi.size() / 3, vi.data(), nVertices, p.data(), nullptr,
+            n.empty() ? nullptr : n.data(), uv.empty() ? nullptr : uv.data(), nullptr),
+            mat, areaLight, areaL, medium);
+    }
+    else if (type == "plymesh" || type == "objmesh") {
+        if (animated)
+            Warning(tok, "animated triangle meshes not supported; using the start transform");
+        std::string filename = ps.FindString("filename", "");
+        if (filename.empty())
+            throw ParseError{ tok.Location() + type + " needs \"string filename\"" };
+        std::string path = ResolveFilename(filename, tok);
+        // Read (through Assimp) on a worker; the triangles are created and
+        // added to the scene afterwards
+        auto model = std::make_shared<shared_ptr<Model>>();
+        AssetCache* cache = assets;
+        loads.push_back({
+            [model, path, cache] {
+                if (cache)
+                    *model = cache->LoadModel(path);
+                else
+                    *model = make_shared<Model>(path);
+                return *model && !(*model)->meshes.empty();
+            },
+            [=] {
+                for (const Mesh& m : (*model)->meshes)
+                    AddShapes(CreateTriangleMesh(objectToWorld, worldToObject, reverse,
+                        m.f_num, m.f_indics, m.v_num, m.v_pos, m.vt, m.vn, m.uv, nullptr),
+                        mat, areaLight, areaL, medium);
+            },
+            path });
+    }
+    else
+        Warning(tok, "shape \"" + type + "\" unsupported; ignored");
+    ps.ReportUnused();
+}
+
+void SceneParser::Finish(std::string* loadErrors) {
+    if (!loads.empty()) {
+        std::vector<char> ok(loads.size(), 0);
+        ParallelInit(PbrtOptions.nThreads);
+        ParallelFor([&](int64_t i) { ok[i] = loads[i].load(); }, loads.size());
+        ParallelCleanup();
+        for (size_t i = 0; i < loads.size(); ++i) {
+            if (!ok[i]) {
+                *loadErrors += (loadErrors->empty() ? "" : "\n") +
+                    std::string("cannot load '") + loads[i].what + "'";
+                continue;
+            }
+            if (loads[i].finish) loads[i].finish();
+        }
+    }
+
+    // One BVH over everything; area lights are registered on the world
+    // list even though their shapes live inside it
+    if (!shapes.objects.empty())
+        scene->world.add(make_shared<bvh_node>(shapes, transformStartTime,
+            transformEndTime));
+    for (const auto& al : areaLights)
+        scene->world.add_area_light(al.first,
+            Color::FromRGB(al.second, SpectrumType::Illuminant));
+    for (const auto& light : lights)
+        if (light) scene->world.add_light(light);
+}
+
+}  // namespace
+
+// Scene File Parser Definitions
+bool ParseSceneFile(const std::string& filename, SceneConfig* scene,
+    std::string* error, AssetCache* assets) {
+    try {
+        SceneParser parser(scene, assets);
+        scene->files.push_back(AbsolutePath(filename));
+        parser.PushFile(filename, nullptr);
+        parser.Parse();
+        std::string loadErrors;
+        parser.Finish(&loadErrors);
+        if (!loadErrors.empty()) {
+            *error = filename + ": " + loadErrors;
+            return false;
+        }
+    }
+    catch (const ParseError& e) {
+        *error = e.message;
+        return false;
+    }
+    return true;
+}
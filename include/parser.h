@@ -0,0 +1,40 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <string>
+#include "scene.h"
+
+class AssetCache;
+
+// Scene File Parser Declarations
+// Reads a scene written in (a subset of) the pbrt-v3 scene description
+// format into *_scene_:
+//   - transforms: Identity, Translate, Scale, Rotate, LookAt, Transform,
+//     ConcatTransform, CoordinateSystem, CoordSysTransform,
+//     ActiveTransform, TransformTimes, ReverseOrientation
+//   - Camera "perspective", Film, Sampler "pixelsamples"
+//   - Texture "imagemap", "checkerboard", "noise", "constant"
+//   - Material "matte"/"lambertian", "metal", "glass"/"dielectric",
+//     "diffuse_light", MakeNamedMaterial, NamedMaterial
+//   - AreaLightSource "diffuse", LightSource "point", "distant",
+//     "infinite"
+//   - Shape "sphere", "trianglemesh", "plymesh"/"objmesh"
+//   - MakeNamedMedium "homogeneous", "heterogeneous", MediumInterface;
+//     shapes given an inside medium bound a constant_medium
+//   - AttributeBegin/End, TransformBegin/End, Include
+// Anything else is skipped with a warning. The file is memory-mapped and
+// tokenized as it is parsed; image textures, meshes and environment maps
+// it references are loaded afterwards, in parallel; given an _assets_
+// cache, image textures and meshes whose contents it already holds are
+// taken from it rather than decoded again. The scene's _files_ lists
+// every file read, by absolute path.
+// Returns false and sets *_error_ ("file:line: message") on failure.
+bool ParseSceneFile(const std::string& filename, SceneConfig* scene,
+    std::string* error, AssetCache* assets = nullptr);
+
+#endif // PARSER_H
@@ -31,9 +31,21 @@ public:
     onb uvw;
 };
 
+// Uniform over all directions, for isotropic phase functions
+class sphere_pdf : public pdf {
+public:
+    virtual Float value(const vec3& direction) const override {
+        return 1 / (4 * Pi);
+    }
+
+    virtual vec3 generate() const override {
+        return random_unit_vector();
+    }
+};
+
 class hittable_pdf : public pdf {
 public:
-    hittable_pdf(shared_ptr<hittable> p, const point3& origin) : ptr(p), o(origin) {}
+    hittable_pdf(const hittable* p, const point3& origin) : ptr(p), o(origin) {}
 
     virtual Float value(const vec3& direction) const override {
         return ptr->pdf_value(o, direction);
@@ -45,12 +57,14 @@ public:
 
 public:
     point3 o;
-    shared_ptr<hittable> ptr;
+    const hittable* ptr;
 };
 
+// pdfs are allocated per bounce from the thread's MemoryArena, so the
+// mixture only keeps non-owning pointers to its two components.
 class mixture_pdf : public pdf {
 public:
-    mixture_pdf(shared_ptr<pdf> p0, shared_ptr<pdf> p1) {
+    mixture_pdf(const pdf* p0, const pdf* p1) {
         p[0] = p0;
         p[1] = p1;
     }
@@ -67,6 +81,6 @@ public:
     }
 
 public:
-    shared_ptr<pdf> p[2];
+    const pdf* p[2];
 };
 #endif
\ No newline at end of file
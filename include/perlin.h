@@ -0,0 +1,171 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PERLIN_H
+#define PERLIN_H
+
+#include "rtweekend.h"
+#include "vec3.h"
+#include <algorithm>
+#include <cmath>
+
+// Perlin Declarations
+// Gradient noise over 256 random unit gradients. The gradients are kept as
+// three separate coordinate tables and the permutations as plain arrays,
+// so the eight corner lookups of a cell are independent gathers, which
+// the batch entry points below issue lane by lane across many points.
+class perlin {
+public:
+    // Perlin Public Methods
+    perlin() {
+        for (int i = 0; i < point_count; ++i) {
+            vec3 g = unit_vector(vec3::random(-1, 1));
+            gradX[i] = g.x;
+            gradY[i] = g.y;
+            gradZ[i] = g.z;
+        }
+        perlin_generate_perm(perm_x);
+        perlin_generate_perm(perm_y);
+        perlin_generate_perm(perm_z);
+    }
+
+    Float noise(const point3& p) const {
+        Float fx = std::floor(p.x), fy = std::floor(p.y), fz = std::floor(p.z);
+        return Interp(int(fx), int(fy), int(fz), p.x - fx, p.y - fy, p.z - fz);
+    }
+
+    // Noise at the _n_ points _p_, computed lane-wise over blocks of
+    // points: the offsets and corner hashes go to SoA arrays, then each of
+    // the eight corners is gathered and dotted for the whole block, then
+    // the blend runs across the block. Results match noise(p) exactly.
+    void noise(int n, const point3* p, Float* result) const {
+        constexpr int blockSize = 16;
+        Float u[blockSize], v[blockSize], w[blockSize];
+        int hash[8][blockSize];
+        Float c[8][blockSize];
+        for (int start = 0; start < n; start += blockSize) {
+            int count = std::min(blockSize, n - start);
+            const point3* ps = p + start;
+            for (int s = 0; s < count; ++s) {
+                // Truncate and step down for negative coordinates, the same
+                // as std::floor() but without a library call per lane
+                int i = int(ps[s].x), j = int(ps[s].y), k = int(ps[s].z);
+                i -= ps[s].x < i;
+                j -= ps[s].y < j;
+                k -= ps[s].z < k;
+                u[s] = ps[s].x - i;
+                v[s] = ps[s].y - j;
+                w[s] = ps[s].z - k;
+                int x0 = perm_x[i & 255], x1 = perm_x[(i + 1) & 255];
+                int y0 = perm_y[j & 255], y1 = perm_y[(j + 1) & 255];
+                int z0 = perm_z[k & 255], z1 = perm_z[(k + 1) & 255];
+                hash[0][s] = x0 ^ y0 ^ z0;
+                hash[1][s] = x0 ^ y0 ^ z1;
+                hash[2][s] = x0 ^ y1 ^ z0;
+                hash[3][s] = x0 ^ y1 ^ z1;
+                hash[4][s] = x1 ^ y0 ^ z0;
+                hash[5][s] = x1 ^ y0 ^ z1;
+                hash[6][s] = x1 ^ y1 ^ z0;
+                hash[7][s] = x1 ^ y1 ^ z1;
+            }
+            // Corner _corner_ is offset by its bits (x, y, z) = (4, 2, 1)
+            for (int corner = 0; corner < 8; ++corner) {
+                Float dx = (corner & 4) ? 1 : 0, dy = (corner & 2) ? 1 : 0,
+                    dz = (corner & 1) ? 1 : 0;
+                for (int s = 0; s < count; ++s) {
+                    int h = hash[corner][s];
+                    c[corner][s] = gradX[h] * (u[s] - dx) + gradY[h] * (v[s] - dy) +
+                        gradZ[h] * (w[s] - dz);
+                }
+            }
+            for (int s = 0; s < count; ++s) {
+                Float uu = u[s] * u[s] * (3 - 2 * u[s]);
+                Float vv = v[s] * v[s] * (3 - 2 * v[s]);
+                Float ww = w[s] * w[s] * (3 - 2 * w[s]);
+                Float c00 = c[0][s] + ww * (c[1][s] - c[0][s]);
+                Float c01 = c[2][s] + ww * (c[3][s] - c[2][s]);
+                Float c10 = c[4][s] + ww * (c[5][s] - c[4][s]);
+                Float c11 = c[6][s] + ww * (c[7][s] - c[6][s]);
+                Float c0 = c00 + vv * (c01 - c00), c1 = c10 + vv * (c11 - c10);
+                result[start + s] = c0 + uu * (c1 - c0);
+            }
+        }
+    }
+
+    // Sum of _depth_ octaves of noise. All octaves are evaluated in one
+    // batch; scaling by powers of two is exact, so this matches summing
+    // them one at a time.
+    Float turb(const point3& p, int depth = 7) const {
+        constexpr int maxOctaves = 16;
+        point3 octaves[maxOctaves];
+        Float values[maxOctaves];
+        Float accum = 0, weight = 1, scale = 1;
+        for (int start = 0; start < depth; start += maxOctaves) {
+            int count = std::min(maxOctaves, depth - start);
+            for (int o = 0; o < count; ++o, scale *= 2)
+                octaves[o] = point3(scale * p.x, scale * p.y, scale * p.z);
+            noise(count, octaves, values);
+            for (int o = 0; o < count; ++o, weight *= 0.5f)
+                accum += weight * values[o];
+        }
+        return std::abs(accum);
+    }
+
+private:
+    // Perlin Private Methods
+    static void perlin_generate_perm(int* p) {
+        for (int i = 0; i < perlin::point_count; i++)
+            p[i] = i;
+
+        permute(p, point_count);
+    }
+
+    static void permute(int* p, int n) {
+        for (int i = n - 1; i > 0; i--) {
+            int target = RandomInt(0, i);
+            int tmp = p[i];
+            p[i] = p[target];
+            p[target] = tmp;
+        }
+    }
+
+    // Dot product of gradient _h_ with the offset (_x_, _y_, _z_) from the
+    // lattice corner it belongs to
+    Float Corner(int h, Float x, Float y, Float z) const {
+        return gradX[h] * x + gradY[h] * y + gradZ[h] * z;
+    }
+
+    // Noise in the cell with lower corner (_i_, _j_, _k_) at offset
+    // (_u_, _v_, _w_): the eight corner dot products blended with the
+    // Hermite-smoothed offsets
+    Float Interp(int i, int j, int k, Float u, Float v, Float w) const {
+        int x0 = perm_x[i & 255], x1 = perm_x[(i + 1) & 255];
+        int y0 = perm_y[j & 255], y1 = perm_y[(j + 1) & 255];
+        int z0 = perm_z[k & 255], z1 = perm_z[(k + 1) & 255];
+        Float c000 = Corner(x0 ^ y0 ^ z0, u, v, w);
+        Float c001 = Corner(x0 ^ y0 ^ z1, u, v, w - 1);
+        Float c010 = Corner(x0 ^ y1 ^ z0, u, v - 1, w);
+        Float c011 = Corner(x0 ^ y1 ^ z1, u, v - 1, w - 1);
+        Float c100 = Corner(x1 ^ y0 ^ z0, u - 1, v, w);
+        Float c101 = Corner(x1 ^ y0 ^ z1, u - 1, v, w - 1);
+        Float c110 = Corner(x1 ^ y1 ^ z0, u - 1, v - 1, w);
+        Float c111 = Corner(x1 ^ y1 ^ z1, u - 1, v - 1, w - 1);
+
+        Float uu = u * u * (3 - 2 * u);
+        Float vv = v * v * (3 - 2 * v);
+        Float ww = w * w * (3 - 2 * w);
+        Float c00 = c000 + ww * (c001 - c000), c01 = c010 + ww * (c011 - c010);
+        Float c10 = c100 + ww * (c101 - c100), c11 = c110 + ww * (c111 - c110);
+        Float c0 = c00 + vv * (c01 - c00), c1 = c10 + vv * (c11 - c10);
+        return c0 + uu * (c1 - c0);
+    }
+
+    // Perlin Private Data
+    static const int point_count = 256;
+    Float gradX[point_count], gradY[point_count], gradZ[point_count];
+    int perm_x[point_count], perm_y[point_count], perm_z[point_count];
+};
+
+#endif // PERLIN_H
@@ -7,13 +7,13 @@
 // GeometricPrimitive Method Definitions
 GeometricPrimitive::GeometricPrimitive(const std::shared_ptr<Shape>& shape,
     const std::shared_ptr<Material>& material,
-    const std::shared_ptr<AreaLight>& areaLight//,
-    //const MediumInterface& mediumInterface
+    const std::shared_ptr<AreaLight>& areaLight,
+    const MediumInterface& mediumInterface
     )
     : shape(shape),
     material(material),
-    areaLight(areaLight)//,
-    //mediumInterface(mediumInterface) 
+    areaLight(areaLight),
+    mediumInterface(mediumInterface)
 {
    // primitiveMemory += sizeof(*this);
 }
@@ -34,13 +34,15 @@ bool GeometricPrimitive::Intersect(const Ray& r,
     if (!shape->Intersect(r, &tHit, isect)) return false;
     r.tMax = tHit;
     isect->primitive = this;
+    isect->area_light = areaLight.get();
     CHECK_GE(Dot(isect->n, isect->shading.n), 0.);
     // Initialize _SurfaceInteraction::mediumInterface_ after _Shape_
-    // intersection
-    //if (mediumInterface.IsMediumTransition())
-    //    isect->mediumInterface = mediumInterface;
-    //else
-    //    isect->mediumInterface = MediumInterface(r.medium);
+    // intersection; rays don't track the medium they travel through, so
+    // surfaces that aren't medium boundaries leave it empty
+    if (mediumInterface.IsMediumTransition())
+        isect->mediumInterface = mediumInterface;
+    else
+        isect->mediumInterface = MediumInterface();
     return true;
 }
 
@@ -53,11 +55,11 @@ const Material* GeometricPrimitive::GetMaterial() const {
 }
 
 void GeometricPrimitive::ComputeScatteringFunctions(
-    SurfaceInteraction* isect,/* MemoryArena& arena,*/ TransportMode mode,
+    SurfaceInteraction* isect, MemoryArena& arena, TransportMode mode,
     bool allowMultipleLobes) const {
     //ProfilePhase p(Prof::ComputeScatteringFuncs);
     if (material)
-        material->ComputeScatteringFunctions(isect, /*arena,*/ mode,
+        material->ComputeScatteringFunctions(isect, arena, mode,
             allowMultipleLobes);
     CHECK_GE(Dot(isect->n, isect->shading.n), 0.);
 }
@@ -106,7 +108,7 @@ const Material* Aggregate::GetMaterial() const {
 }
 
 void Aggregate::ComputeScatteringFunctions(SurfaceInteraction* isect,
-    //MemoryArena& arena,
+    MemoryArena& arena,
     TransportMode mode,
     bool allowMultipleLobes) const {
     std::cerr <<
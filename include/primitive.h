@@ -7,13 +7,28 @@
 #define PRIMITIVE_H
 
 #include "ray.h"
-#include "material.h"
 #include "transform.h"
+#include "meomery.h"
+#include "medium.h"
 
 class aabb;
 class SurfaceInteraction;
 class AreaLight;
 
+enum class TransportMode { Radiance, Importance };
+
+class Material {
+public:
+    // Material Interface
+    virtual void ComputeScatteringFunctions(SurfaceInteraction* si,
+        MemoryArena& arena,
+        TransportMode mode,
+        bool allowMultipleLobes) const = 0;
+    virtual ~Material() {}
+    //static void Bump(const std::shared_ptr<Texture<Float>>& d,
+    //    SurfaceInteraction* si);
+};
+
 
 class Primitive {
 public:
@@ -25,7 +40,7 @@ public:
     //virtual const AreaLight* GetAreaLight() const = 0;
     virtual const Material* GetMaterial() const = 0;
     virtual void ComputeScatteringFunctions(SurfaceInteraction* isect,
-        //MemoryArena& arena,
+        MemoryArena& arena,
         TransportMode mode,
         bool allowMultipleLobes) const = 0;
 };
@@ -39,14 +54,14 @@ public:
     virtual bool IntersectP(const Ray& r) const;
     GeometricPrimitive(const std::shared_ptr<Shape>& shape,
         const std::shared_ptr<Material>& material,
-        const std::shared_ptr<AreaLight>& areaLight//,
-        //const MediumInterface& mediumInterface
+        const std::shared_ptr<AreaLight>& areaLight,
+        const MediumInterface& mediumInterface = MediumInterface()
     );
     GeometricPrimitive(const std::shared_ptr<Shape>& shape);
     const AreaLight* GetAreaLight() const;
     const Material* GetMaterial() const;
     void ComputeScatteringFunctions(SurfaceInteraction* isect,
-        //MemoryArena& arena, 
+        MemoryArena& arena,
         TransportMode mode,
         bool allowMultipleLobes) const;
 
@@ -55,7 +70,7 @@ private:
     std::shared_ptr<Shape> shape;
     std::shared_ptr<Material> material;
     std::shared_ptr<AreaLight> areaLight;
-    //MediumInterface mediumInterface;
+    MediumInterface mediumInterface;
 };
 
 // TransformedPrimitive Declarations
@@ -69,7 +84,7 @@ public:
     const AreaLight* GetAreaLight() const { return nullptr; }
     const Material* GetMaterial() const { return nullptr; }
     void ComputeScatteringFunctions(SurfaceInteraction* isect,
-        /*MemoryArena& arena,*/ TransportMode mode,
+        MemoryArena& arena, TransportMode mode,
         bool allowMultipleLobes) const {
         //LOG(FATAL) <<
         //    "TransformedPrimitive::ComputeScatteringFunctions() shouldn't be "
@@ -93,7 +108,7 @@ public:
     const AreaLight* GetAreaLight() const;
     const Material* GetMaterial() const;
     void ComputeScatteringFunctions(SurfaceInteraction* isect,
-        /*MemoryArena& arena,*/ TransportMode mode,
+        MemoryArena& arena, TransportMode mode,
         bool allowMultipleLobes) const;
 };
 
@@ -0,0 +1,55 @@
+#include "raysort.h"
+#include "morton.h"
+
+// Ray Sorting Local Definitions
+namespace {
+
+struct RayKey {
+    uint32_t index;
+    uint32_t key;
+};
+
+inline uint32_t Octant(const vec3& d) {
+    return (d.x < 0) | ((d.y < 0) << 1) | ((d.z < 0) << 2);
+}
+
+}  // namespace
+
+// Ray Sorting Definitions
+uint32_t RaySortKey(const point3& o, const vec3& d, const aabb& bounds) {
+    constexpr int mortonBits = 9;
+    constexpr Float mortonScale = (1 << mortonBits) - 1;
+    // Origins outside the bounds are clamped to its faces
+    vec3 offset = bounds.Offset(o);
+    for (int c = 0; c < 3; ++c)
+        offset[c] = offset[c] > 0 ? std::min(offset[c], (Float)1) * mortonScale : 0;
+    return (Octant(d) << (3 * mortonBits)) | EncodeMorton3(offset);
+}
+
+void SortRays(const point3* o, const vec3* d, size_t n, const aabb& bounds,
+    std::vector<uint32_t>* order) {
+    std::vector<RayKey> keys(n);
+#pragma omp parallel for schedule(static)
+    for (int64_t i = 0; i < (int64_t)n; ++i) {
+        keys[i].index = uint32_t(i);
+        keys[i].key = RaySortKey(o[i], d[i], bounds);
+    }
+    RadixSort(&keys, [](const RayKey& k) { return k.key; });
+    order->resize(n);
+    for (size_t i = 0; i < n; ++i)
+        (*order)[i] = keys[i].index;
+}
+
+void RayCoherence::Add(const point3* o, const vec3* d, const uint32_t* order,
+    size_t n, const aabb& bounds) {
+    Float diagonal = (bounds.pMax - bounds.pMin).Length();
+    if (n < 2 || !(diagonal > 0))
+        return;
+    for (size_t k = 1; k < n; ++k) {
+        size_t a = order ? order[k - 1] : k - 1, b = order ? order[k] : k;
+        cosine += Dot(unit_vector(d[a]), unit_vector(d[b]));
+        distance += (o[b] - o[a]).Length() / diagonal;
+        octantChanges += Octant(d[a]) != Octant(d[b]);
+    }
+    pairs += n - 1;
+}
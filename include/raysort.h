@@ -0,0 +1,43 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef RAYSORT_H
+#define RAYSORT_H
+
+#include <vector>
+#include "rtweekend.h"
+#include "aabb.h"
+
+// Ray Sorting Declarations
+// Sort key for a ray from _o_ along _d_: the direction's octant in the top
+// 3 of 30 bits, then the Morton code of the origin's offset within
+// _bounds_ at 9 bits per axis. Rays with equal keys start close together
+// and head the same way, so they tend to visit the same BVH nodes.
+uint32_t RaySortKey(const point3& o, const vec3& d, const aabb& bounds);
+
+// Sets *_order_ to the indices of the _n_ rays with origins _o_ and
+// directions _d_, stably sorted by RaySortKey()
+void SortRays(const point3* o, const vec3* d, size_t n, const aabb& bounds,
+    std::vector<uint32_t>* order);
+
+// How alike consecutive rays of a sequence are, for judging how coherent
+// BVH traversal in that order is: the mean cosine between the directions
+// of neighboring rays, the mean distance between their origins relative
+// to the scene's diagonal, and the fraction of neighbors in different
+// direction octants (which a packet of rays can't share)
+struct RayCoherence {
+    // Adds the rays _o_[_order_[i]], _d_[_order_[i]] for i in [0, _n_),
+    // with _order_ null for the identity
+    void Add(const point3* o, const vec3* d, const uint32_t* order, size_t n,
+        const aabb& bounds);
+    double MeanCosine() const { return pairs ? cosine / pairs : 0; }
+    double MeanDistance() const { return pairs ? distance / pairs : 0; }
+    double OctantChanges() const { return pairs ? double(octantChanges) / pairs : 0; }
+
+    double cosine = 0, distance = 0;
+    int64_t octantChanges = 0, pairs = 0;
+};
+
+#endif // RAYSORT_H
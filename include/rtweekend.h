@@ -3,10 +3,16 @@
 #define RTWEEKEND_H
 
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <limits>
 #include <memory>
 #include <random>
 
+#ifndef PBRT_CONSTEXPR
+#define PBRT_CONSTEXPR constexpr
+#endif
+
 #ifdef PBRT_Float_AS_Float
 typedef double Float;
 #else
@@ -56,6 +62,11 @@ using std::sqrt;
 
 const Float Infinity = std::numeric_limits<Float>::infinity();
 const Float Pi = 3.1415926535897932385;
+const Float InvPi = 0.31830988618379067154;
+const Float Inv2Pi = 0.15915494309189533577;
+const Float Inv4Pi = 0.07957747154594766788;
+const Float PiOver2 = 1.57079632679489661923;
+const Float PiOver4 = 0.78539816339744830961;
 
 // Utility Functions
 inline uint32_t FloatToBits(float f) {
@@ -143,10 +154,33 @@ inline Float Radians(Float deg) { return (Pi / Float(180)) * deg; }
 inline Float Degrees(Float rad) { return (Float(180) / Pi) * rad; }
 
 
+// Each thread owns its generator, so OpenMP workers neither race on nor
+// serialize through a shared engine.
+inline std::mt19937& RandomGenerator() {
+    static thread_local std::mt19937 generator;
+    return generator;
+}
+
+// 64-bit finalizer from MurmurHash3; turns structured keys (seed, pixel)
+// into well-distributed generator seeds.
+inline uint64_t MixBits(uint64_t v) {
+    v ^= (v >> 31);
+    v *= 0x7fb5d329728ea185ULL;
+    v ^= (v >> 27);
+    v *= 0x81dadef4bc2dd44dULL;
+    v ^= (v >> 33);
+    return v;
+}
+
+// Reseeds the calling thread's generator. The renderer seeds once per pixel
+// so an image only depends on the seed, not on how pixels are scheduled.
+inline void SeedRandom(uint64_t seed) {
+    RandomGenerator().seed((std::mt19937::result_type)(seed ^ (seed >> 32)));
+}
+
 inline Float RandomFloat() {
-    static std::uniform_real_distribution<Float> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    return distribution(generator);
+    static thread_local std::uniform_real_distribution<Float> distribution(0.0, 1.0);
+    return distribution(RandomGenerator());
 }
 
 inline Float RandomFloat(Float min, Float max) {
@@ -165,6 +199,14 @@ inline Float Clamp(Float x, Float min, Float max) {
     return x;
 }
 
+inline Float SafeSqrt(Float x) {
+    return std::sqrt(std::max((Float)0, x));
+}
+
+inline Float SafeACos(Float x) {
+    return std::acos(Clamp(x, -1, 1));
+}
+
 inline Float Lerp(Float t, Float v1, Float v2) {
     return (1 - t) * v1 + t * v2;
 }
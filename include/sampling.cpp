@@ -0,0 +1,140 @@
+#include "sampling.h"
+
+// Sampling Function Definitions
+Point2f ConcentricSampleDisk(const Point2f& u) {
+    // Map uniform random numbers to $[-1,1]^2$
+    Point2f uOffset(2.f * u.x - 1, 2.f * u.y - 1);
+
+    // Handle degeneracy at the origin
+    if (uOffset.x == 0 && uOffset.y == 0) return Point2f(0, 0);
+
+    // Apply concentric mapping to point
+    Float theta, r;
+    if (std::abs(uOffset.x) > std::abs(uOffset.y)) {
+        r = uOffset.x;
+        theta = PiOver4 * (uOffset.y / uOffset.x);
+    }
+    else {
+        r = uOffset.y;
+        theta = PiOver2 - PiOver4 * (uOffset.x / uOffset.y);
+    }
+    return Point2f(r * std::cos(theta), r * std::sin(theta));
+}
+
+Vector3f UniformSampleSphere(const Point2f& u) {
+    Float z = 1 - 2 * u.x;
+    Float r = std::sqrt(std::max((Float)0, (Float)1 - z * z));
+    Float phi = 2 * Pi * u.y;
+    return Vector3f(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+Float UniformSpherePdf() { return Inv4Pi; }
+
+Vector3f UniformSampleCone(const Point2f& u, Float cosThetaMax) {
+    Float cosTheta = ((Float)1 - u.x) + u.x * cosThetaMax;
+    Float sinTheta = std::sqrt((Float)1 - cosTheta * cosTheta);
+    Float phi = u.y * 2 * Pi;
+    return Vector3f(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta,
+        cosTheta);
+}
+
+Float UniformConePdf(Float cosThetaMax) {
+    return 1 / (2 * Pi * (1 - cosThetaMax));
+}
+
+Point2f UniformSampleTriangle(const Point2f& u) {
+    Float su0 = std::sqrt(u.x);
+    return Point2f(1 - su0, u.y * su0);
+}
+
+// Distribution2D Method Definitions
+Distribution2D::Distribution2D(const Float* func, int nu, int nv) {
+    pConditionalV.reserve(nv);
+    for (int v = 0; v < nv; ++v) {
+        // Compute conditional sampling distribution for $\tilde{v}$
+        pConditionalV.emplace_back(new Distribution1D(&func[v * nu], nu));
+    }
+    // Compute marginal sampling distribution $p[\tilde{v}]$
+    std::vector<Float> marginalFunc;
+    marginalFunc.reserve(nv);
+    for (int v = 0; v < nv; ++v)
+        marginalFunc.push_back(pConditionalV[v]->funcInt);
+    pMarginal.reset(new Distribution1D(&marginalFunc[0], nv));
+}
+
+// AliasTable Method Definitions
+AliasTable::AliasTable(const std::vector<Float>& weights) : bins(weights.size()) {
+    // Normalize _weights_ to compute alias table PDF
+    double sum = 0;
+    for (Float w : weights) sum += w;
+    for (size_t i = 0; i < weights.size(); ++i)
+        bins[i].p = sum > 0 ? Float(weights[i] / sum) : Float(1) / weights.size();
+
+    // Create alias table work lists
+    struct Outcome {
+        Float pHat;
+        int index;
+    };
+    std::vector<Outcome> under, over;
+    for (size_t i = 0; i < bins.size(); ++i) {
+        // Add outcome _i_ to an alias table work list
+        Float pHat = bins[i].p * bins.size();
+        if (pHat < 1)
+            under.push_back(Outcome{ pHat, (int)i });
+        else
+            over.push_back(Outcome{ pHat, (int)i });
+    }
+
+    // Process under and over work item together
+    while (!under.empty() && !over.empty()) {
+        Outcome un = under.back(), ov = over.back();
+        under.pop_back();
+        over.pop_back();
+
+        // Initialize probability and alias for _un_
+        bins[un.index].q = un.pHat;
+        bins[un.index].alias = ov.index;
+
+        // Push excess probability on to work list
+        Float pExcess = un.pHat + ov.pHat - 1;
+        if (pExcess < 1)
+            under.push_back(Outcome{ pExcess, ov.index });
+        else
+            over.push_back(Outcome{ pExcess, ov.index });
+    }
+
+    // Handle remaining alias table work items; leftovers are only off by
+    // round-off, so they always keep their own bin
+    while (!over.empty()) {
+        bins[over.back().index].q = 1;
+        bins[over.back().index].alias = -1;
+        over.pop_back();
+    }
+    while (!under.empty()) {
+        bins[under.back().index].q = 1;
+        bins[under.back().index].alias = -1;
+        under.pop_back();
+    }
+}
+
+int AliasTable::Sample(Float u, Float* pmf, Float* uRemapped) const {
+    // Compute alias table _offset_ and remapped random sample _up_
+    int offset = std::min<int>(u * bins.size(), bins.size() - 1);
+    Float up = std::min<Float>(u * bins.size() - offset, OneMinusEpsilon);
+
+    if (up < bins[offset].q) {
+        // Return sample for alias table at _offset_
+        if (pmf) *pmf = bins[offset].p;
+        if (uRemapped) *uRemapped = std::min<Float>(up / bins[offset].q, OneMinusEpsilon);
+        return offset;
+    }
+    else {
+        // Return sample for alias table at _alias[offset]_
+        int alias = bins[offset].alias;
+        if (pmf) *pmf = bins[alias].p;
+        if (uRemapped)
+            *uRemapped = std::min<Float>((up - bins[offset].q) / (1 - bins[offset].q),
+                OneMinusEpsilon);
+        return alias;
+    }
+}
@@ -0,0 +1,140 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include "rtweekend.h"
+#include "vec3.h"
+#include <memory>
+#include <vector>
+
+#ifdef PBRT_FLOAT_AS_DOUBLE
+static const Float OneMinusEpsilon = 0x1.fffffffffffffp-1;
+#else
+static const Float OneMinusEpsilon = 0x1.fffffep-1;
+#endif
+
+// Sampling Declarations
+Point2f ConcentricSampleDisk(const Point2f& u);
+Vector3f UniformSampleSphere(const Point2f& u);
+Float UniformSpherePdf();
+Vector3f UniformSampleCone(const Point2f& u, Float thetamax);
+Float UniformConePdf(Float thetamax);
+Point2f UniformSampleTriangle(const Point2f& u);
+
+inline Float BalanceHeuristic(int nf, Float fPdf, int ng, Float gPdf) {
+    return (nf * fPdf) / (nf * fPdf + ng * gPdf);
+}
+
+inline Float PowerHeuristic(int nf, Float fPdf, int ng, Float gPdf) {
+    Float f = nf * fPdf, g = ng * gPdf;
+    if (f == 0 && g == 0) return 0;
+    return (f * f) / (f * f + g * g);
+}
+
+struct Distribution1D {
+    // Distribution1D Public Methods
+    Distribution1D(const Float* f, int n) : func(f, f + n), cdf(n + 1) {
+        // Compute integral of step function at $x_i$
+        cdf[0] = 0;
+        for (int i = 1; i < n + 1; ++i) cdf[i] = cdf[i - 1] + func[i - 1] / n;
+
+        // Transform step function integral into CDF
+        funcInt = cdf[n];
+        if (funcInt == 0) {
+            for (int i = 1; i < n + 1; ++i) cdf[i] = Float(i) / Float(n);
+        }
+        else {
+            for (int i = 1; i < n + 1; ++i) cdf[i] /= funcInt;
+        }
+    }
+    int Count() const { return (int)func.size(); }
+    Float SampleContinuous(Float u, Float* pdf, int* off = nullptr) const {
+        // Find surrounding CDF segments and _offset_
+        int offset = FindInterval((int)cdf.size(),
+            [&](int index) { return cdf[index] <= u; });
+        if (off) *off = offset;
+        // Compute offset along CDF segment
+        Float du = u - cdf[offset];
+        if ((cdf[offset + 1] - cdf[offset]) > 0) {
+            du /= (cdf[offset + 1] - cdf[offset]);
+        }
+
+        // Compute PDF for sampled offset
+        if (pdf) *pdf = (funcInt > 0) ? func[offset] / funcInt : 0;
+
+        // Return $x\in{}[0,1)$ corresponding to sample
+        return (offset + du) / Count();
+    }
+    int SampleDiscrete(Float u, Float* pdf = nullptr,
+        Float* uRemapped = nullptr) const {
+        // Find surrounding CDF segments and _offset_
+        int offset = FindInterval((int)cdf.size(),
+            [&](int index) { return cdf[index] <= u; });
+        if (pdf) *pdf = (funcInt > 0) ? func[offset] / (funcInt * Count()) : 0;
+        if (uRemapped)
+            *uRemapped = (u - cdf[offset]) / (cdf[offset + 1] - cdf[offset]);
+        return offset;
+    }
+    Float DiscretePDF(int index) const {
+        return func[index] / (funcInt * Count());
+    }
+
+    // Distribution1D Public Data
+    std::vector<Float> func, cdf;
+    Float funcInt;
+};
+
+// Piecewise-constant 2D distribution over $[0,1]^2$: a marginal density
+// over rows and one conditional density per row, each sampled by binary
+// search of its CDF.
+class Distribution2D {
+public:
+    // Distribution2D Public Methods
+    Distribution2D(const Float* data, int nu, int nv);
+    Point2f SampleContinuous(const Point2f& u, Float* pdf) const {
+        Float pdfs[2];
+        int v;
+        Float d1 = pMarginal->SampleContinuous(u.y, &pdfs[1], &v);
+        Float d0 = pConditionalV[v]->SampleContinuous(u.x, &pdfs[0]);
+        *pdf = pdfs[0] * pdfs[1];
+        return Point2f(d0, d1);
+    }
+    Float Pdf(const Point2f& p) const {
+        int iu = Clamp(int(p.x * pConditionalV[0]->Count()), 0,
+            pConditionalV[0]->Count() - 1);
+        int iv =
+            Clamp(int(p.y * pMarginal->Count()), 0, pMarginal->Count() - 1);
+        return pConditionalV[iv]->func[iu] / pMarginal->funcInt;
+    }
+
+private:
+    // Distribution2D Private Data
+    std::vector<std::unique_ptr<Distribution1D>> pConditionalV;
+    std::unique_ptr<Distribution1D> pMarginal;
+};
+
+// Walker/Vose alias table: O(1) sampling of a discrete distribution,
+// used to pick lights in proportion to their power.
+class AliasTable {
+public:
+    // AliasTable Public Methods
+    AliasTable() = default;
+    AliasTable(const std::vector<Float>& weights);
+    int Sample(Float u, Float* pmf = nullptr, Float* uRemapped = nullptr) const;
+    Float PMF(int index) const { return bins[index].p; }
+    int size() const { return (int)bins.size(); }
+
+private:
+    // AliasTable Private Data
+    struct Bin {
+        Float q, p;
+        int alias;
+    };
+    std::vector<Bin> bins;
+};
+
+#endif // !SAMPLING_H
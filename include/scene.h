@@ -0,0 +1,41 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <string>
+#include <vector>
+#include "hittable_list.h"
+#include "materialtable.h"
+#include "primitive.h"
+
+// Everything needed to render a scene: its geometry and lights plus the
+// camera and film settings it was composed for. Built either by one of the
+// registered scene functions in PBRT.cpp or by ParseSceneFile().
+struct SceneConfig {
+    hittable_list world;
+    // pbrt-style primitives (triangle meshes) traced alongside _world_
+    std::vector<shared_ptr<Primitive>> prims;
+    // _world_'s materials, filled in by BuildScene()
+    MaterialTable materials;
+    color background = color(0, 0, 0);
+    point3 lookfrom = point3(13, 2, 3);
+    point3 lookat = point3(0, 0, 0);
+    vec3 vup = vec3(0, 1, 0);
+    Float vfov = 20;
+    Float aperture = 0;
+    Float focus_dist = 10;
+    Float aspect_ratio = 16.0 / 9.0;
+    int image_width = 400;
+    int samples_per_pixel = 20;
+    // Output image named by a scene file, if any
+    std::string image_file;
+    // The scene file, the files it includes and the assets it loads, by
+    // absolute path
+    std::vector<std::string> files;
+};
+
+#endif // SCENE_H
@@ -15,7 +15,7 @@ Shape::Shape(shared_ptr<Transform> ObjectToWorld, shared_ptr<Transform> WorldToO
 
 Bounds3f Shape::WorldBound() const { return (*ObjectToWorld)(ObjectBound()); }
 
-/*Interaction Shape::Sample(const Interaction& ref, const Point2f& u,
+Interaction Shape::Sample(const Interaction& ref, const Point2f& u,
     Float* pdf) const {
     Interaction intr = Sample(u, pdf);
     Vector3f wi = intr.p - ref.p;
@@ -33,7 +33,7 @@ Bounds3f Shape::WorldBound() const { return (*ObjectToWorld)(ObjectBound()); }
 
 Float Shape::Pdf(const Interaction& ref, const Vector3f& wi) const {
     // Intersect sample ray with area light geometry
-    Ray ray = ref.SpawnRay(wi);
+    Ray ray(ref.p, wi);
     Float tHit;
     SurfaceInteraction isectLight;
     // Ignore any alpha textures used for trimming the shape when performing
@@ -48,7 +48,7 @@ Float Shape::Pdf(const Interaction& ref, const Vector3f& wi) const {
     return pdf;
 }
 
-Float Shape::SolidAngle(const Point3f& p, int nSamples) const {
+/*Float Shape::SolidAngle(const Point3f& p, int nSamples) const {
     Interaction ref(p, Normal3f(), Vector3f(), Vector3f(0, 0, 1), 0,
         MediumInterface{});
     double solidAngle = 0;
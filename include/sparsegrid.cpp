@@ -0,0 +1,141 @@
+#include "sparsegrid.h"
+#include <cstdio>
+
+// SparseGrid Method Definitions
+SparseGrid::SparseGrid(int nx, int ny, int nz) {
+    res[0] = std::max(1, nx);
+    res[1] = std::max(1, ny);
+    res[2] = std::max(1, nz);
+    for (int a = 0; a < 3; ++a) {
+        brickRes[a] = (res[a] + brickSize - 1) / brickSize;
+        tileRes[a] = (brickRes[a] + tileSize - 1) / tileSize;
+    }
+    brickRefs.assign(size_t(brickRes[0]) * brickRes[1] * brickRes[2], 0);
+}
+
+SparseGrid::SparseGrid(int nx, int ny, int nz, const Float* values)
+    : SparseGrid(nx, ny, nz, [=](int x, int y, int z) {
+        return values[(size_t(z) * ny + y) * nx + x];
+    })
+{}
+
+void SparseGrid::SetBrick(int bx, int by, int bz, const Float* values) {
+    // Only the samples inside the grid count
+    const int n = brickSize;
+    int ex = std::min(n, res[0] - bx * n), ey = std::min(n, res[1] - by * n),
+        ez = std::min(n, res[2] - bz * n);
+    Float first = values[0];
+    bool isUniform = true;
+    for (int z = 0; z < ez; ++z)
+        for (int y = 0; y < ey; ++y)
+            for (int x = 0; x < ex; ++x)
+                isUniform &= values[(z * n + y) * n + x] == first;
+
+    int32_t& ref = brickRefs[BrickIndex(bx, by, bz)];
+    if (isUniform) {
+        if (first == 0)
+            ref = 0;
+        else {
+            uniform.push_back(first);
+            ref = -int32_t(uniform.size());
+        }
+        return;
+    }
+    std::unique_ptr<Float[]> brick(new Float[n * n * n]);
+    for (int i = 0; i < n * n * n; ++i) brick[i] = 0;
+    for (int z = 0; z < ez; ++z)
+        for (int y = 0; y < ey; ++y)
+            for (int x = 0; x < ex; ++x)
+                brick[(z * n + y) * n + x] = values[(z * n + y) * n + x];
+    bricks.push_back(std::move(brick));
+    ref = int32_t(bricks.size());
+}
+
+void SparseGrid::Finalize() {
+    // Largest sample of each brick
+    std::vector<Float> brickMax(brickRefs.size(), 0);
+    const int n = brickSize;
+    for (size_t i = 0; i < brickRefs.size(); ++i) {
+        int32_t ref = brickRefs[i];
+        if (ref < 0)
+            brickMax[i] = uniform[-ref - 1];
+        else if (ref > 0) {
+            const Float* b = bricks[ref - 1].get();
+            brickMax[i] = *std::max_element(b, b + n * n * n);
+        }
+        maxValue = std::max(maxValue, brickMax[i]);
+    }
+
+    // Lookups inside a brick interpolate samples up to one beyond its
+    // edges, so its majorant covers the neighboring bricks too
+    brickMajorants.assign(brickRefs.size(), 0);
+    for (int bz = 0; bz < brickRes[2]; ++bz)
+        for (int by = 0; by < brickRes[1]; ++by)
+            for (int bx = 0; bx < brickRes[0]; ++bx) {
+                Float m = 0;
+                for (int z = std::max(0, bz - 1); z <= std::min(brickRes[2] - 1, bz + 1); ++z)
+                    for (int y = std::max(0, by - 1); y <= std::min(brickRes[1] - 1, by + 1); ++y)
+                        for (int x = std::max(0, bx - 1); x <= std::min(brickRes[0] - 1, bx + 1); ++x)
+                            m = std::max(m, brickMax[BrickIndex(x, y, z)]);
+                brickMajorants[BrickIndex(bx, by, bz)] = m;
+            }
+
+    tileMajorants.assign(size_t(tileRes[0]) * tileRes[1] * tileRes[2], 0);
+    for (int bz = 0; bz < brickRes[2]; ++bz)
+        for (int by = 0; by < brickRes[1]; ++by)
+            for (int bx = 0; bx < brickRes[0]; ++bx) {
+                Float& m = tileMajorants[(size_t(bz / tileSize) * tileRes[1] +
+                    by / tileSize) * tileRes[0] + bx / tileSize];
+                m = std::max(m, brickMajorants[BrickIndex(bx, by, bz)]);
+            }
+}
+
+size_t SparseGrid::MemoryBytes() const {
+    return sizeof(*this) + brickRefs.size() * sizeof(int32_t) +
+        bricks.size() * (sizeof(bricks[0]) + brickSize * brickSize * brickSize * sizeof(Float)) +
+        uniform.size() * sizeof(Float) +
+        (brickMajorants.size() + tileMajorants.size()) * sizeof(Float);
+}
+
+std::unique_ptr<SparseGrid> SparseGrid::ReadRaw(const std::string& filename,
+    int nx, int ny, int nz, std::string* error) {
+    FILE* f = std::fopen(filename.c_str(), "rb");
+    if (!f) {
+        *error = "cannot open '" + filename + "'";
+        return nullptr;
+    }
+    std::unique_ptr<SparseGrid> grid(new SparseGrid(nx, ny, nz));
+    nx = grid->res[0];
+    ny = grid->res[1];
+    nz = grid->res[2];
+
+    // Read one slab of bricks at a time and cut it into bricks
+    const int n = brickSize;
+    std::vector<float> slab(size_t(nx) * ny * n);
+    Float values[n * n * n];
+    for (int bz = 0; bz < grid->brickRes[2]; ++bz) {
+        int slices = std::min(n, nz - bz * n);
+        size_t count = size_t(nx) * ny * slices;
+        if (std::fread(slab.data(), sizeof(float), count, f) != count) {
+            std::fclose(f);
+            *error = "'" + filename + "' is shorter than " + std::to_string(nx) +
+                "x" + std::to_string(ny) + "x" + std::to_string(nz) + " floats";
+            return nullptr;
+        }
+        for (int by = 0; by < grid->brickRes[1]; ++by)
+            for (int bx = 0; bx < grid->brickRes[0]; ++bx) {
+                for (int z = 0; z < n; ++z)
+                    for (int y = 0; y < n; ++y)
+                        for (int x = 0; x < n; ++x) {
+                            int gx = bx * n + x, gy = by * n + y;
+                            values[(z * n + y) * n + x] =
+                                (gx < nx && gy < ny && z < slices) ?
+                                slab[(size_t(z) * ny + gy) * nx + gx] : 0;
+                        }
+                grid->SetBrick(bx, by, bz, values);
+            }
+    }
+    std::fclose(f);
+    grid->Finalize();
+    return grid;
+}
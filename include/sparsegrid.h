@@ -0,0 +1,225 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SPARSEGRID_H
+#define SPARSEGRID_H
+
+#include "rtweekend.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// SparseGrid Declarations
+// Scalar grid of _nx_ x _ny_ x _nz_ samples stored VDB-style in three
+// levels: tiles of 4^3 bricks, bricks of 8^3 samples, and the samples.
+// Only bricks holding varying values are allocated; bricks that are empty
+// or hold a single value take one reference each. Every brick and tile
+// keeps a majorant, the largest value trilinear interpolation can produce
+// inside it, and Traverse() walks the tiles and then the bricks of
+// non-empty tiles with a DDA, so empty space costs one step per tile.
+//
+// Positions are in sample space: sample (x, y, z) sits at
+// (x + .5, y + .5, z + .5) and the grid covers [0, n] on each axis.
+class SparseGrid {
+public:
+    // SparseGrid Public Methods
+    // Empty grid; bricks are added with SetBrick() and Finalize() must be
+    // called before lookups
+    SparseGrid(int nx, int ny, int nz);
+    // Grid holding _density_(x, y, z) for every sample
+    template <typename Func>
+    SparseGrid(int nx, int ny, int nz, Func density);
+    // Grid holding a dense array, x fastest
+    SparseGrid(int nx, int ny, int nz, const Float* values);
+    // Reads _nx_ x _ny_ x _nz_ raw 32-bit floats (x fastest) from
+    // _filename_ eight z slices at a time, so the dense data never has to
+    // fit in memory. Returns nullptr and sets *_error_ on failure.
+    static std::unique_ptr<SparseGrid> ReadRaw(const std::string& filename,
+        int nx, int ny, int nz, std::string* error);
+
+    // Stores the 8^3 samples of brick (_bx_, _by_, _bz_), x fastest;
+    // samples outside the grid are ignored
+    void SetBrick(int bx, int by, int bz, const Float* values);
+    // Computes the brick and tile majorants
+    void Finalize();
+
+    int Resolution(int axis) const { return res[axis]; }
+    Float Lookup(int x, int y, int z) const;
+    // Trilinear interpolation at sample-space point (_sx_, _sy_, _sz_);
+    // samples outside the grid count as zero
+    Float Interpolate(Float sx, Float sy, Float sz) const;
+    // Calls _f_(t0, t1, majorant) for the bricks that the sample-space ray
+    // _o_ + t _d_ crosses between _tMin_ and _tMax_, front to back, until
+    // _f_ returns false. Tiles with a zero majorant are skipped whole.
+    template <typename Func>
+    void Traverse(const Float o[3], const Float d[3], Float tMin, Float tMax,
+        Func f) const;
+    Float MaxValue() const { return maxValue; }
+    size_t AllocatedBricks() const { return bricks.size(); }
+    size_t MemoryBytes() const;
+
+    static const int brickSize = 8, tileSize = 4;
+
+private:
+    // SparseGrid Private Methods
+    size_t BrickIndex(int bx, int by, int bz) const {
+        return (size_t(bz) * brickRes[1] + by) * brickRes[0] + bx;
+    }
+    // Walks the cells of size _cellSize_ of a grid with _cellRes_ cells
+    // per axis, calling _f_(cell, t0, t1); returns false if _f_ stopped it
+    template <typename Func>
+    static bool WalkCells(const Float o[3], const Float d[3], Float tMin,
+        Float tMax, Float cellSize, const int cellRes[3], Func f);
+
+    // SparseGrid Private Data
+    int res[3], brickRes[3], tileRes[3];
+    // Per brick: 0 if empty, i > 0 for _bricks_[i - 1], i < 0 for the
+    // uniform value _uniform_[-i - 1]
+    std::vector<int32_t> brickRefs;
+    std::vector<std::unique_ptr<Float[]>> bricks;
+    std::vector<Float> uniform;
+    std::vector<Float> brickMajorants, tileMajorants;
+    Float maxValue = 0;
+};
+
+// SparseGrid Inline Functions
+template <typename Func>
+SparseGrid::SparseGrid(int nx, int ny, int nz, Func density)
+    : SparseGrid(nx, ny, nz) {
+    const int n = brickSize;
+    Float values[n * n * n];
+    for (int bz = 0; bz < brickRes[2]; ++bz)
+        for (int by = 0; by < brickRes[1]; ++by)
+            for (int bx = 0; bx < brickRes[0]; ++bx) {
+                for (int z = 0; z < n; ++z)
+                    for (int y = 0; y < n; ++y)
+                        for (int x = 0; x < n; ++x) {
+                            int gx = bx * n + x, gy = by * n + y, gz = bz * n + z;
+                            values[(z * n + y) * n + x] =
+                                (gx < nx && gy < ny && gz < nz) ? density(gx, gy, gz) : 0;
+                        }
+                SetBrick(bx, by, bz, values);
+            }
+    Finalize();
+}
+
+inline Float SparseGrid::Lookup(int x, int y, int z) const {
+    if (x < 0 || y < 0 || z < 0 || x >= res[0] || y >= res[1] || z >= res[2])
+        return 0;
+    int32_t ref = brickRefs[BrickIndex(x >> 3, y >> 3, z >> 3)];
+    if (ref == 0) return 0;
+    if (ref < 0) return uniform[-ref - 1];
+    return bricks[ref - 1][((z & 7) * brickSize + (y & 7)) * brickSize + (x & 7)];
+}
+
+inline Float SparseGrid::Interpolate(Float sx, Float sy, Float sz) const {
+    Float gx = sx - .5f, gy = sy - .5f, gz = sz - .5f;
+    int x = (int)std::floor(gx), y = (int)std::floor(gy), z = (int)std::floor(gz);
+    Float dx = gx - x, dy = gy - y, dz = gz - z;
+
+    // Gather the eight samples; when they all lie in one allocated brick
+    // they are read from it directly
+    Float v[8];
+    if (x >= 0 && y >= 0 && z >= 0 && (x & 7) < 7 && (y & 7) < 7 && (z & 7) < 7 &&
+        x + 1 < res[0] && y + 1 < res[1] && z + 1 < res[2]) {
+        int32_t ref = brickRefs[BrickIndex(x >> 3, y >> 3, z >> 3)];
+        if (ref <= 0) return ref == 0 ? 0 : uniform[-ref - 1];
+        const Float* b = bricks[ref - 1].get() +
+            ((z & 7) * brickSize + (y & 7)) * brickSize + (x & 7);
+        const int row = brickSize, slice = brickSize * brickSize;
+        v[0] = b[0];           v[1] = b[1];
+        v[2] = b[row];         v[3] = b[row + 1];
+        v[4] = b[slice];       v[5] = b[slice + 1];
+        v[6] = b[slice + row]; v[7] = b[slice + row + 1];
+    }
+    else
+        for (int i = 0; i < 8; ++i)
+            v[i] = Lookup(x + (i & 1), y + ((i >> 1) & 1), z + (i >> 2));
+
+    Float d00 = Lerp(dx, v[0], v[1]), d10 = Lerp(dx, v[2], v[3]);
+    Float d01 = Lerp(dx, v[4], v[5]), d11 = Lerp(dx, v[6], v[7]);
+    return Lerp(dz, Lerp(dy, d00, d10), Lerp(dy, d01, d11));
+}
+
+template <typename Func>
+bool SparseGrid::WalkCells(const Float o[3], const Float d[3], Float tMin,
+    Float tMax, Float cellSize, const int cellRes[3], Func f) {
+    // Set up the 3D DDA at the cell holding the point at _tMin_
+    int cell[3], step[3], stop[3];
+    Float nextT[3], deltaT[3];
+    for (int a = 0; a < 3; ++a) {
+        Float p = o[a] + tMin * d[a];
+        cell[a] = std::min(std::max(int(p / cellSize), 0), cellRes[a] - 1);
+        if (d[a] > 0) {
+            nextT[a] = tMin + ((cell[a] + 1) * cellSize - p) / d[a];
+            deltaT[a] = cellSize / d[a];
+            step[a] = 1;
+            stop[a] = cellRes[a];
+        }
+        else if (d[a] < 0) {
+            nextT[a] = tMin + (cell[a] * cellSize - p) / d[a];
+            deltaT[a] = -cellSize / d[a];
+            step[a] = -1;
+            stop[a] = -1;
+        }
+        else {
+            nextT[a] = Infinity;
+            deltaT[a] = 0;
+            step[a] = 0;
+            stop[a] = -1;
+        }
+    }
+
+    // Walk the cells front to back
+    Float t0 = tMin;
+    while (true) {
+        int axis = nextT[0] < nextT[1] ? (nextT[0] < nextT[2] ? 0 : 2)
+            : (nextT[1] < nextT[2] ? 1 : 2);
+        Float tExit = std::min(tMax, nextT[axis]);
+        if (tExit > t0 && !f(cell, t0, tExit))
+            return false;
+        if (tExit >= tMax) return true;
+        t0 = tExit;
+        cell[axis] += step[axis];
+        if (cell[axis] == stop[axis]) return true;
+        nextT[axis] += deltaT[axis];
+    }
+}
+
+template <typename Func>
+void SparseGrid::Traverse(const Float o[3], const Float d[3], Float tMin,
+    Float tMax, Func f) const {
+    // Clip the ray to the grid
+    for (int a = 0; a < 3; ++a) {
+        if (d[a] == 0) {
+            if (o[a] < 0 || o[a] > res[a]) return;
+            continue;
+        }
+        Float tNear = -o[a] / d[a], tFar = (res[a] - o[a]) / d[a];
+        if (tNear > tFar) std::swap(tNear, tFar);
+        tMin = std::max(tMin, tNear);
+        tMax = std::min(tMax, tFar);
+    }
+    if (tMin >= tMax) return;
+
+    // Walk the tiles, and the bricks of each tile that isn't empty
+    const Float tileExtent = brickSize * tileSize;
+    WalkCells(o, d, tMin, tMax, tileExtent, tileRes,
+        [&](const int* tile, Float t0, Float t1) {
+            if (tileMajorants[(size_t(tile[2]) * tileRes[1] + tile[1]) * tileRes[0] +
+                tile[0]] == 0)
+                return true;
+            return WalkCells(o, d, t0, t1, brickSize, brickRes,
+                [&](const int* brick, Float b0, Float b1) {
+                    return f(b0, b1,
+                        brickMajorants[BrickIndex(brick[0], brick[1], brick[2])]);
+                });
+        });
+}
+
+#endif // SPARSEGRID_H
@@ -1,4 +1,5 @@
 #include "spectrum.h"
+#include <algorithm>
 
 // Spectrum Method Definitions
 bool SpectrumSamplesSorted(const Float* lambda, const Float* vals, int n) {
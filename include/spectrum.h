@@ -185,7 +185,7 @@ public:
         for (int i = 0; i < nSpectrumSamples; i++)
             c[i] /= f;
         CHECKNAN(HasNaNs());
-        return ret;
+        return *this;
     }
 
     CoefficientSpectrum operator-() const {
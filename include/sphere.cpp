@@ -1,4 +1,139 @@
 #include "sphere.h"
+#include "sampling.h"
+#include <algorithm>
+#include <limits>
+
+// Sphere Quadratic Definitions
+bool SphereQuadraticEFloat(const Ray& ray, const Vector3f& oErr,
+    const Vector3f& dErr, Float radius, EFloat* t0, EFloat* t1) {
+    // Compute quadratic sphere coefficients
+
+    // Initialize _EFloat_ ray coordinate values
+    EFloat ox(ray.o.x, oErr.x), oy(ray.o.y, oErr.y), oz(ray.o.z, oErr.z);
+    EFloat dx(ray.d.x, dErr.x), dy(ray.d.y, dErr.y), dz(ray.d.z, dErr.z);
+    EFloat a = dx * dx + dy * dy + dz * dz;
+    EFloat b = 2 * (dx * ox + dy * oy + dz * oz);
+    EFloat c = ox * ox + oy * oy + oz * oz - EFloat(radius) * EFloat(radius);
+
+    // Solve quadratic equation for _t_ values
+    return Quadratic(a, b, c, t0, t1);
+}
+
+// Plain arithmetic in _T_, followed by a forward error analysis of the
+// same expressions. Each bound is the rounding error of the expression,
+// from the gamma(n) model of pbrt's Section 3.9, plus the error the ray's
+// own _oErr_ and _dErr_ induce in it.
+template <typename T>
+bool SphereQuadraticFast(const Ray& ray, const Vector3f& oErr,
+    const Vector3f& dErr, Float radius, EFloat* t0, EFloat* t1) {
+    const T eps = std::numeric_limits<T>::epsilon() * T(0.5);
+    auto g = [eps](int n) { return (n * eps) / (1 - n * eps); };
+    T ox = ray.o.x, oy = ray.o.y, oz = ray.o.z;
+    T dx = ray.d.x, dy = ray.d.y, dz = ray.d.z;
+    T r = radius;
+
+    // Compute quadratic sphere coefficients, with _bh_ = b/2
+    T a = dx * dx + dy * dy + dz * dz;
+    T bh = dx * ox + dy * oy + dz * oz;
+    T o2 = ox * ox + oy * oy + oz * oz;
+    T c = o2 - r * r;
+
+    // Compute the discriminant bh^2 - ac as a (r^2 - |f|^2), where _f_ is
+    // the vector from the center to the closest point on the ray's line;
+    // unlike b^2 - 4ac, this doesn't cancel for rays far from the sphere
+    T s = bh / a;
+    T fx = ox - s * dx, fy = oy - s * dy, fz = oz - s * dz;
+    T f2 = fx * fx + fy * fy + fz * fz;
+    T discrim = a * (r * r - f2);
+    if (discrim < 0) return false;
+
+    // Bound the coefficients' errors
+    T adx = std::abs(dx), ady = std::abs(dy), adz = std::abs(dz);
+    T aox = std::abs(ox), aoy = std::abs(oy), aoz = std::abs(oz);
+    T eox = oErr.x, eoy = oErr.y, eoz = oErr.z;
+    T edx = dErr.x, edy = dErr.y, edz = dErr.z;
+    T aErr = g(3) * a + 2 * (adx * edx + ady * edy + adz * edz) +
+        (edx * edx + edy * edy + edz * edz);
+    T absDO = adx * aox + ady * aoy + adz * aoz;
+    T bhErr = g(3) * absDO + (adx * eox + ady * eoy + adz * eoz) +
+        (edx * aox + edy * aoy + edz * aoz) + (edx * eox + edy * eoy + edz * eoz);
+    T cErr = g(4) * (o2 + r * r) + 2 * (aox * eox + aoy * eoy + aoz * eoz) +
+        (eox * eox + eoy * eoy + eoz * eoz);
+
+    // Bound the discriminant's error: rounding in the _f_ form, then the
+    // ray error through its gradient (-2af with respect to _o_, and
+    // 2(r^2 - |o|^2) d + 2 bh o with respect to _d_) plus second-order terms
+    T sErr = g(3) * absDO / a + g(5) * std::abs(s);
+    T fErrX = adx * sErr + g(2) * (aox + std::abs(s * dx));
+    T fErrY = ady * sErr + g(2) * (aoy + std::abs(s * dy));
+    T fErrZ = adz * sErr + g(2) * (aoz + std::abs(s * dz));
+    T f2Err = 2 * (std::abs(fx) * fErrX + std::abs(fy) * fErrY + std::abs(fz) * fErrZ) +
+        (fErrX * fErrX + fErrY * fErrY + fErrZ * fErrZ) + g(3) * f2;
+    T rr = r * r - o2;
+    T discrimErr = a * f2Err + g(5) * a * (r * r + f2) +
+        2 * a * (std::abs(fx) * eox + std::abs(fy) * eoy + std::abs(fz) * eoz) +
+        2 * (std::abs(rr * dx + bh * ox) * edx + std::abs(rr * dy + bh * oy) * edy +
+            std::abs(rr * dz + bh * oz) * edz) +
+        2 * (bhErr * bhErr + aErr * cErr);
+
+    // The square root of the discriminant's interval bounds _rootDiscrim_
+    T rootDiscrim = std::sqrt(discrim);
+    T rootLo = std::sqrt(std::max(T(0), discrim - discrimErr));
+    T rootHi = std::sqrt(discrim + discrimErr);
+    T rootErr = std::max(rootDiscrim - rootLo, rootHi - rootDiscrim) +
+        g(1) * rootDiscrim;
+
+    // Compute quadratic _t_ values and their error bounds
+    T q = bh < 0 ? rootDiscrim - bh : -(bh + rootDiscrim);
+    T qErr = bhErr + rootErr + g(1) * std::abs(q);
+    if (a <= aErr) return false;
+    T tq = q / a;
+    T tqErr = (qErr + std::abs(tq) * aErr) / (a - aErr) + g(2) * std::abs(tq);
+    T tc, tcErr;
+    if (std::abs(q) > qErr) {
+        tc = c / q;
+        tcErr = (cErr + std::abs(tc) * qErr) / (std::abs(q) - qErr) + g(2) * std::abs(tc);
+    }
+    else {
+        // _q_ is within error of zero, so c/q can't be bounded; fall back
+        // to the cancelling form (-b/2 - q)/a of the other root
+        tc = (-2 * bh - q) / a;
+        tcErr = (2 * bhErr + qErr + std::abs(tc) * aErr) / (a - aErr) +
+            g(3) * (std::abs(tc) + 2 * std::abs(bh / a));
+    }
+
+    // Round the bounds up for the conversion to _Float_ and the error
+    // accumulated while computing them
+    const Float slack = 1 + gamma(3);
+    *t0 = EFloat((Float)tq, slack * (Float)(tqErr + g(1) * std::abs(tq)));
+    *t1 = EFloat((Float)tc, slack * (Float)(tcErr + g(1) * std::abs(tc)));
+    if ((float)*t0 > (float)*t1) std::swap(*t0, *t1);
+
+    // The exact roots lie on either side of the parabola's vertex -b/2a
+    // and, when the origin is certainly inside the sphere (c < 0), on
+    // either side of zero. For grazing rays spawned off the surface the
+    // discriminant's error widens the t intervals past both, so without
+    // this the far root's interval would reach behind the origin
+    T tv = -bh / a;
+    T tvErr = (bhErr + std::abs(tv) * aErr) / (a - aErr) + g(2) * std::abs(tv);
+    EFloat vertex((Float)tv, slack * (Float)(tvErr + g(1) * std::abs(tv)));
+    Float hi0 = std::min(t0->UpperBound(), vertex.UpperBound());
+    Float lo1 = std::max(t1->LowerBound(), vertex.LowerBound());
+    if (c + cErr < 0) {
+        hi0 = std::min(hi0, -std::numeric_limits<Float>::denorm_min());
+        lo1 = std::max(lo1, std::numeric_limits<Float>::denorm_min());
+    }
+    Float lo0 = std::min(t0->LowerBound(), hi0);
+    Float hi1 = std::max(t1->UpperBound(), lo1);
+    *t0 = EFloat::FromBounds(Clamp((Float)*t0, lo0, hi0), lo0, hi0);
+    *t1 = EFloat::FromBounds(Clamp((Float)*t1, lo1, hi1), lo1, hi1);
+    return true;
+}
+
+template bool SphereQuadraticFast<float>(const Ray&, const Vector3f&,
+    const Vector3f&, Float, EFloat*, EFloat*);
+template bool SphereQuadraticFast<double>(const Ray&, const Vector3f&,
+    const Vector3f&, Float, EFloat*, EFloat*);
 
 // Sphere Method Definitions
 Bounds3f Sphere::ObjectBound() const {
@@ -15,18 +150,9 @@ bool Sphere::Intersect(const Ray& r, Float* tHit, SurfaceInteraction* isect,
     Vector3f oErr, dErr;
     Ray ray = (*WorldToObject)(r, &oErr, &dErr);
 
-    // Compute quadratic sphere coefficients
-
-    // Initialize _EFloat_ ray coordinate values
-    EFloat ox(ray.o.x, oErr.x), oy(ray.o.y, oErr.y), oz(ray.o.z, oErr.z);
-    EFloat dx(ray.d.x, dErr.x), dy(ray.d.y, dErr.y), dz(ray.d.z, dErr.z);
-    EFloat a = dx * dx + dy * dy + dz * dz;
-    EFloat b = 2 * (dx * ox + dy * oy + dz * oz);
-    EFloat c = ox * ox + oy * oy + oz * oz - EFloat(radius) * EFloat(radius);
-
     // Solve quadratic equation for _t_ values
     EFloat t0, t1;
-    if (!Quadratic(a, b, c, &t0, &t1)) return false;
+    if (!SphereQuadratic(ray, oErr, dErr, radius, &t0, &t1)) return false;
 
     // Check quadric shape _t0_ and _t1_ for nearest intersection
     if (t0.UpperBound() > ray.tMax || t1.LowerBound() <= 0) return false;
@@ -123,18 +249,9 @@ bool Sphere::IntersectP(const Ray& r, bool testAlphaTexture) const {
     Vector3f oErr, dErr;
     Ray ray = (*WorldToObject)(r, &oErr, &dErr);
 
-    // Compute quadratic sphere coefficients
-
-    // Initialize _EFloat_ ray coordinate values
-    EFloat ox(ray.o.x, oErr.x), oy(ray.o.y, oErr.y), oz(ray.o.z, oErr.z);
-    EFloat dx(ray.d.x, dErr.x), dy(ray.d.y, dErr.y), dz(ray.d.z, dErr.z);
-    EFloat a = dx * dx + dy * dy + dz * dz;
-    EFloat b = 2 * (dx * ox + dy * oy + dz * oz);
-    EFloat c = ox * ox + oy * oy + oz * oz - EFloat(radius) * EFloat(radius);
-
     // Solve quadratic equation for _t_ values
     EFloat t0, t1;
-    if (!Quadratic(a, b, c, &t0, &t1)) return false;
+    if (!SphereQuadratic(ray, oErr, dErr, radius, &t0, &t1)) return false;
 
     // Check quadric shape _t0_ and _t1_ for nearest intersection
     if (t0.UpperBound() > ray.tMax || t1.LowerBound() <= 0) return false;
@@ -176,18 +293,18 @@ bool Sphere::IntersectP(const Ray& r, bool testAlphaTexture) const {
 
 Float Sphere::Area() const { return phiMax * radius * (zMax - zMin); }
 
-//Interaction Sphere::Sample(const Point2f& u, Float* pdf) const {
-//    Point3f pObj = Point3f(0, 0, 0) + radius * UniformSampleSphere(u);
-//    Interaction it;
-//    it.n = Normalize((*ObjectToWorld)(Normal3f(pObj.x, pObj.y, pObj.z)));
-//    if (reverseOrientation) it.n *= -1;
-//    // Reproject _pObj_ to sphere surface and compute _pObjError_
-//    pObj *= radius / Distance(pObj, Point3f(0, 0, 0));
-//    Vector3f pObjError = gamma(5) * Abs((Vector3f)pObj);
-//    it.p = (*ObjectToWorld)(pObj, pObjError, &it.pError);
-//    *pdf = 1 / Area();
-//    return it;
-//}
+Interaction Sphere::Sample(const Point2f& u, Float* pdf) const {
+    Point3f pObj = Point3f(0, 0, 0) + radius * UniformSampleSphere(u);
+    Interaction it;
+    it.n = Normalize((*ObjectToWorld)(Normal3f(pObj.x, pObj.y, pObj.z)));
+    if (reverseOrientation) it.n *= -1;
+    // Reproject _pObj_ to sphere surface and compute _pObjError_
+    pObj = pObj * (radius / Distance(pObj, Point3f(0, 0, 0)));
+    Vector3f pObjError = gamma(5) * Abs((Vector3f)pObj);
+    it.p = (*ObjectToWorld)(pObj, pObjError, &it.pError);
+    *pdf = 1 / Area();
+    return it;
+}
 //
 //Interaction Sphere::Sample(const Interaction& ref, const Point2f& u,
 //    Float* pdf) const {
@@ -10,6 +10,16 @@
 #include "shape.h"
 
 #include "efloat.h"
+#include "onb.h"
+#include "sampling.h"
+
+// Sphere::Intersect() and IntersectP() solve the ray-sphere quadratic with
+// pbrt-v3's EFloat interval arithmetic. Define PBRT_SPHERE_INTERSECT_FLOAT
+// (or _DOUBLE) to solve in plain Float (or double) arithmetic and bound its
+// error analytically instead: about five times faster, and never outside
+// the exact roots, but grazing rays spawned inward off small, distant
+// spheres miss the far side somewhat more often (see SphereRobustness in
+// pbrt_bench).
 
 class sphere : public hittable {
 public:
@@ -17,9 +27,18 @@ public:
     sphere(point3 cen, Float r, shared_ptr<material> m)
         : center(cen), radius(r), mat_ptr(m) {};
 
-    virtual bool hit(
-        const ray& r, Float t_min, Float t_max, hit_record& rec) const override;
+    virtual bool intersect(
+        const ray& r, Float t_min, Float t_max, hit_info& hit) const override;
+    virtual void fill_record(
+        const ray& r, const hit_info& hit, hit_record& rec) const override;
+
+    virtual void compile_materials(MaterialTable& table) override {
+        material_id = table.AddMaterial(mat_ptr.get());
+    }
     virtual bool bounding_box(Float time0, Float time1, aabb& output_box) const override;
+    virtual Float pdf_value(const point3& o, const vec3& v) const override;
+    virtual vec3 random(const vec3& o) const override;
+    virtual Float area() const override { return 4 * Pi * radius * radius; }
 public:
     point3 center;
     Float radius;
@@ -41,7 +60,7 @@ private:
     }
 };
 
-inline bool sphere::hit(const ray& r, Float t_min, Float t_max, hit_record& rec) const {
+inline bool sphere::intersect(const ray& r, Float t_min, Float t_max, hit_info& hit) const {
     vec3 oc = r.origin() - center;
     auto a = r.direction().LengthSquared();
     auto half_b = Dot(oc, r.direction());
@@ -59,15 +78,22 @@ inline bool sphere::hit(const ray& r, Float t_min, Float t_max, hit_record& rec)
             return false;
     }
 
-    rec.time = root;
+    hit.t = root;
+    hit.object = this;
+    hit.nInstances = 0;
+    return true;
+}
+
+inline void sphere::fill_record(const ray& r, const hit_info& hit, hit_record& rec) const {
+    rec.time = hit.t;
     rec.p = r.at(rec.time);
     vec3 outward_normal = (rec.p - center) / radius;
     rec.set_face_normal(r, outward_normal);
     point3 p = point3(outward_normal.x, outward_normal.y, outward_normal.z);
     get_sphere_uv(p, rec.u, rec.v);
-    rec.mat_ptr = mat_ptr;
-
-    return true;
+    rec.mat_ptr = mat_ptr.get();
+    rec.material_id = material_id;
+    rec.area_light = area_light;
 }
 
 inline bool sphere::bounding_box(Float time0, Float time1, aabb& output_box) const {
@@ -77,6 +103,30 @@ inline bool sphere::bounding_box(Float time0, Float time1, aabb& output_box) con
     return true;
 }
 
+// Directions are drawn uniformly from the cone the sphere subtends at _o_,
+// or from all directions when _o_ is inside the sphere
+inline Float sphere::pdf_value(const point3& o, const vec3& v) const {
+    hit_info hit;
+    if (!intersect(ray(o, v), 0.001, Infinity, hit))
+        return 0;
+
+    Float distanceSquared = (center - o).LengthSquared();
+    if (distanceSquared <= radius * radius)
+        return UniformSpherePdf();
+    auto cos_theta_max = sqrt(std::max((Float)0, 1 - radius * radius / distanceSquared));
+    return UniformConePdf(cos_theta_max);
+}
+
+inline vec3 sphere::random(const vec3& o) const {
+    vec3 direction = center - point3(o);
+    if (direction.LengthSquared() <= radius * radius)
+        return random_unit_vector();
+    auto cos_theta_max = sqrt(std::max((Float)0, 1 - radius * radius / direction.LengthSquared()));
+    onb uvw;
+    uvw.build_from_w(direction);
+    return uvw.local(UniformSampleCone(Point2f(RandomFloat(), RandomFloat()), cos_theta_max));
+}
+
 class Sphere : public Shape {
 public:
     // Sphere Public Methods
@@ -102,7 +152,8 @@ public:
         bool testAlphaTexture) const;
     bool IntersectP(const Ray& ray, bool testAlphaTexture) const;
     Float Area() const;
-    //Interaction Sample(const Point2f& u, Float* pdf) const;
+    using Shape::Sample;  // Bring in the other Sample() overload.
+    Interaction Sample(const Point2f& u, Float* pdf) const;
     //Interaction Sample(const Interaction& ref, const Point2f& u,
     //    Float* pdf) const;
     //Float Pdf(const Interaction& ref, const Vector3f& wi) const;
@@ -115,6 +166,27 @@ private:
     const Float thetaMin, thetaMax, phiMax;
 };
 
+// Finds the parametric distances *_t0_ <= *_t1_ at which _ray_, given in
+// the sphere's object space with coordinate error bounds _oErr_ and
+// _dErr_, meets the origin-centered sphere of radius _radius_. The
+// intervals of the results conservatively bound the exact roots.
+bool SphereQuadraticEFloat(const Ray& ray, const Vector3f& oErr,
+    const Vector3f& dErr, Float radius, EFloat* t0, EFloat* t1);
+template <typename T>
+bool SphereQuadraticFast(const Ray& ray, const Vector3f& oErr,
+    const Vector3f& dErr, Float radius, EFloat* t0, EFloat* t1);
+
+inline bool SphereQuadratic(const Ray& ray, const Vector3f& oErr,
+    const Vector3f& dErr, Float radius, EFloat* t0, EFloat* t1) {
+#if defined(PBRT_SPHERE_INTERSECT_FLOAT)
+    return SphereQuadraticFast<Float>(ray, oErr, dErr, radius, t0, t1);
+#elif defined(PBRT_SPHERE_INTERSECT_DOUBLE)
+    return SphereQuadraticFast<double>(ray, oErr, dErr, radius, t0, t1);
+#else
+    return SphereQuadraticEFloat(ray, oErr, dErr, radius, t0, t1);
+#endif
+}
+
 //std::shared_ptr<Shape> CreateSphereShape(const Transform* o2w,
 //    const Transform* w2o,
 //    bool reverseOrientation,
@@ -3,8 +3,12 @@
 
 #include "rtweekend.h"
 #include "rtw_stb_image.h"
+#include "perlin.h"
+#include "aabb.h"
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include <string>
+#include <vector>
 
 
 class texture {
@@ -39,12 +43,14 @@ class checker_texture : public texture {
             : even(make_shared<solid_color>(c1)) , odd(make_shared<solid_color>(c2)) {}
 
         virtual color value(Float u, Float v, const point3& p) const override {
+            return is_odd(p) ? odd->value(u, v, p) : even->value(u, v, p);
+        }
+
+        // Whether _p_ is in an odd cell, which shows the _odd_ texture
+        static bool is_odd(const point3& p) {
             auto sines = sin(10*p.x)*sin(10*p.y)*sin(10*p.z);
             //auto sines = sin(100 * u) * sin(100 * v);
-            if (sines < 0)
-                return odd->value(u, v, p);
-            else
-                return even->value(u, v, p);
+            return sines < 0;
         }
 
     public:
@@ -52,134 +58,161 @@ class checker_texture : public texture {
         shared_ptr<texture> even;
 };
 
-class perlin {
+class noise_texture : public texture {
 public:
-    perlin() {
-        ranvec = new vec3[point_count];
-        for (int i = 0; i < point_count; ++i) {
-            ranvec[i] = unit_vector(vec3::random(-1, 1));
-        }
-
-
-        perm_x = perlin_generate_perm();
-        perm_y = perlin_generate_perm();
-        perm_z = perlin_generate_perm();
-    }
+    noise_texture() {}
+    noise_texture(Float sc) : scale(sc) {}
 
-    ~perlin() {
-        delete[] ranvec;
-        delete[] perm_x;
-        delete[] perm_y;
-        delete[] perm_z;
+    virtual color value(Float u, Float v, const point3& p) const override {
+        return evaluate(noise, scale, p);
     }
 
-    Float noise(const point3& p) const {
-        auto u = p.x - floor(p.x);
-        auto v = p.y - floor(p.y);
-        auto w = p.z - floor(p.z);
-        auto i = static_cast<int>(floor(p.x));
-        auto j = static_cast<int>(floor(p.y));
-        auto k = static_cast<int>(floor(p.z));
-        vec3 c[2][2][2];
-
-        for (int di = 0; di < 2; di++)
-            for (int dj = 0; dj < 2; dj++)
-                for (int dk = 0; dk < 2; dk++)
-                    c[di][dj][dk] = ranvec[
-                        perm_x[(i + di) & 255] ^
-                            perm_y[(j + dj) & 255] ^
-                            perm_z[(k + dk) & 255]
-                    ];
-
-        return perlin_interp(c, u, v, w);
+    static color evaluate(const perlin& noise, Float scale, const point3& p) {
+        return color(1.0,1.0,1.0) * 0.5 * (1 + sin(scale * p.z + 10 * noise.turb(p)));
     }
 
-    Float turb(const point3& p, int depth = 7) const {
-        auto accum = 0.0;
-        auto temp_p = p;
-        auto weight = 1.0;
+public:
+    perlin noise;
+    Float scale;
+};
 
-        for (int i = 0; i < depth; i++) {
-            accum += weight * noise(temp_p);
-            weight *= 0.5;
-            temp_p = point3(2 * temp_p.x, 2 * temp_p.y, 2 * temp_p.z);
+// Solid texture evaluated once at the vertices of a regular grid over
+// _bounds_ and trilinearly interpolated from then on, for procedural
+// textures too costly to evaluate at every hit. Points outside the grid
+// are passed on to the source texture. Only for textures that depend on
+// the position alone (checker_texture, noise_texture): the source is
+// evaluated at u = v = 0.
+class baked_texture : public texture {
+public:
+    // _resolution_ is the number of grid vertices along the longest axis
+    // of _bounds_; the other axes get the same spacing
+    baked_texture(shared_ptr<texture> src, const aabb& bounds, int resolution)
+        : source(src), origin(bounds.min()) {
+        vec3 extent = bounds.max() - bounds.min();
+        Float spacing = std::max(MaxComponent(extent), Float(1e-4)) /
+            std::max(resolution - 1, 1);
+        invSpacing = 1 / spacing;
+        for (int a = 0; a < 3; ++a) {
+            res[a] = std::max(2, int(std::ceil(extent[a] * invSpacing)) + 1);
+            nBricks[a] = (res[a] + brickSize - 1) / brickSize;
+        }
+        int brickCount = nBricks[0] * nBricks[1] * nBricks[2];
+        voxels.resize(size_t(brickCount) * brickSize * brickSize * brickSize);
+
+        // Bake brick by brick, each in one pass over its own storage
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int b = 0; b < brickCount; ++b) {
+            int bx = b % nBricks[0], by = (b / nBricks[0]) % nBricks[1],
+                bz = b / (nBricks[0] * nBricks[1]);
+            for (int z = bz * brickSize; z < std::min((bz + 1) * brickSize, res[2]); ++z)
+                for (int y = by * brickSize; y < std::min((by + 1) * brickSize, res[1]); ++y)
+                    for (int x = bx * brickSize; x < std::min((bx + 1) * brickSize, res[0]); ++x) {
+                        point3 p(origin.x + x * spacing, origin.y + y * spacing,
+                            origin.z + z * spacing);
+                        voxels[Offset(x, y, z)] = source->value(0, 0, p);
+                    }
         }
+    }
 
-        return fabs(accum);
+    virtual color value(Float u, Float v, const point3& p) const override {
+        Float gx = (p.x - origin.x) * invSpacing;
+        Float gy = (p.y - origin.y) * invSpacing;
+        Float gz = (p.z - origin.z) * invSpacing;
+        if (!(gx >= 0 && gy >= 0 && gz >= 0 && gx <= res[0] - 1 &&
+            gy <= res[1] - 1 && gz <= res[2] - 1))
+            return source->value(u, v, p);
+        int x = std::min(int(gx), res[0] - 2);
+        int y = std::min(int(gy), res[1] - 2);
+        int z = std::min(int(gz), res[2] - 2);
+        Float dx = gx - x, dy = gy - y, dz = gz - z;
+        auto lerp = [](Float t, const color& a, const color& b) { return a + t * (b - a); };
+        color c00 = lerp(dx, voxels[Offset(x, y, z)], voxels[Offset(x + 1, y, z)]);
+        color c10 = lerp(dx, voxels[Offset(x, y + 1, z)], voxels[Offset(x + 1, y + 1, z)]);
+        color c01 = lerp(dx, voxels[Offset(x, y, z + 1)], voxels[Offset(x + 1, y, z + 1)]);
+        color c11 = lerp(dx, voxels[Offset(x, y + 1, z + 1)], voxels[Offset(x + 1, y + 1, z + 1)]);
+        return lerp(dz, lerp(dy, c00, c10), lerp(dy, c01, c11));
     }
 
 private:
-    static const int point_count = 256;
-    Float* ranFloat;
-    int* perm_x;
-    int* perm_y;
-    int* perm_z;
-    vec3* ranvec;
-
-    static int* perlin_generate_perm() {
-        auto p = new int[point_count];
-
-        for (int i = 0; i < perlin::point_count; i++)
-            p[i] = i;
+    // Voxels are stored in 8x8x8 bricks, so the eight voxels of a lookup
+    // are nearly always within one brick rather than spread over four rows
+    // of a large grid
+    static constexpr int brickSize = 8;
+    size_t Offset(unsigned x, unsigned y, unsigned z) const {
+        size_t brick = (size_t(z / brickSize) * nBricks[1] + y / brickSize) *
+            nBricks[0] + x / brickSize;
+        return brick * (brickSize * brickSize * brickSize) +
+            ((z % brickSize) * brickSize + y % brickSize) * brickSize + x % brickSize;
+    }
 
-        permute(p, point_count);
+    shared_ptr<texture> source;
+    point3 origin;
+    Float invSpacing;
+    int res[3], nBricks[3];
+    std::vector<color> voxels;
+};
 
-        return p;
-    }
+// Floating-point RGB image such as a Radiance .hdr or OpenEXR lat-long
+// environment map; integer files (8- or 16-bit PNG, TIFF, ...) are
+// rescaled so that their largest value maps to 1.
+class hdr_image {
+public:
+    hdr_image() : width(0), height(0) {}
 
-    static void permute(int* p, int n) {
-        for (int i = n - 1; i > 0; i--) {
-            int target = RandomInt(0, i);
-            int tmp = p[i];
-            p[i] = p[target];
-            p[target] = tmp;
+    hdr_image(const std::string& filename) : width(0), height(0) {
+        cv::Mat image = cv::imread(filename, cv::IMREAD_ANYDEPTH | cv::IMREAD_COLOR);
+        if (image.empty()) {
+            std::cerr << "ERROR: Could not load image file '" << filename << "'.\n";
+            return;
         }
+        cv::cvtColor(image, image, cv::COLOR_BGR2RGB);
+        image.convertTo(image, CV_32FC3, DepthScale(image.depth()));
+        width = image.cols;
+        height = image.rows;
+        texels.resize(width * height);
+        for (int j = 0; j < height; ++j)
+            for (int i = 0; i < width; ++i) {
+                const cv::Vec3f& c = image.at<cv::Vec3f>(j, i);
+                texels[j * width + i] = color(c[0], c[1], c[2]);
+            }
     }
 
-    static Float trilinear_interp(Float c[2][2][2], Float u, Float v, Float w) {
-        auto accum = 0.0;
-        for (int i = 0; i < 2; i++)
-            for (int j = 0; j < 2; j++)
-                for (int k = 0; k < 2; k++)
-                    accum += (i * u + (1 - i) * (1 - u)) *
-                    (j * v + (1 - j) * (1 - v)) *
-                    (k * w + (1 - k) * (1 - w)) * c[i][j][k];
-
-        return accum;
+    // Constant image, used when no file is given
+    hdr_image(const color& c) : width(1), height(1), texels(1, c) {}
+
+    // Factor that maps the largest value of an OpenCV _depth_ to 1
+    static double DepthScale(int depth) {
+        switch (depth) {
+        case CV_8U: return 1.0 / 255.0;
+        case CV_8S: return 1.0 / 127.0;
+        case CV_16U: return 1.0 / 65535.0;
+        case CV_16S: return 1.0 / 32767.0;
+        case CV_32S: return 1.0 / 2147483647.0;
+        default: return 1.0;
+        }
     }
 
-    static Float perlin_interp(vec3 c[2][2][2], Float u, Float v, Float w) {
-        auto uu = u * u * (3 - 2 * u);
-        auto vv = v * v * (3 - 2 * v);
-        auto ww = w * w * (3 - 2 * w);
-        auto accum = 0.0;
-
-        for (int i = 0; i < 2; i++)
-            for (int j = 0; j < 2; j++)
-                for (int k = 0; k < 2; k++) {
-                    vec3 weight_v(u - i, v - j, w - k);
-                    accum += (i * uu + (1 - i) * (1 - uu))
-                        * (j * vv + (1 - j) * (1 - vv))
-                        * (k * ww + (1 - k) * (1 - ww))
-                        * Dot(c[i][j][k], weight_v);
-                }
-
-        return accum;
+    color texel(int i, int j) const {
+        i = Clamp(i, 0, width - 1);
+        j = Clamp(j, 0, height - 1);
+        return texels[j * width + i];
     }
-};
-
-class noise_texture : public texture {
-public:
-    noise_texture() {}
-    noise_texture(Float sc) : scale(sc) {}
 
-    virtual color value(Float u, Float v, const point3& p) const override {
-        return color(1.0,1.0,1.0) * 0.5 * (1 + sin(scale * p.z + 10 * noise.turb(p)));
+    // Bilinear lookup; _s_ wraps around (longitude), _t_ is clamped
+    color lookup(Float s, Float t) const {
+        Float x = s * width - 0.5f, y = t * height - 0.5f;
+        int x0 = (int)std::floor(x), y0 = (int)std::floor(y);
+        Float dx = x - x0, dy = y - y0;
+        auto wrap = [&](int i) { return ((i % width) + width) % width; };
+        return (1 - dx) * (1 - dy) * texel(wrap(x0), y0) +
+            dx * (1 - dy) * texel(wrap(x0 + 1), y0) +
+            (1 - dx) * dy * texel(wrap(x0), y0 + 1) +
+            dx * dy * texel(wrap(x0 + 1), y0 + 1);
     }
 
 public:
-    perlin noise;
-    Float scale;
+    int width, height;
+    std::vector<color> texels;
 };
 
 class image_texture : public texture {
@@ -189,12 +222,24 @@ public:
     image_texture()
         : data(nullptr), width(0), height(0), bytes_per_scanline(0) {}
 
-    image_texture(cv::String filename) {
-     
+    image_texture(cv::String filename)
+        : data(nullptr), width(0), height(0), bytes_per_scanline(0) {
+        load(filename);
+    }
+
+    // Separate from construction so that scene loading can create the
+    // texture first and fill it in from a worker thread.
+    bool load(const cv::String& filename) {
         image_mat = cv::imread(filename);
+        if (image_mat.empty()) {
+            std::cerr << "ERROR: Could not load texture image file '" << filename << "'.\n";
+            width = height = 0;
+            return false;
+        }
         cv::cvtColor(image_mat, image_mat, cv::COLOR_BGR2RGB);
         width = image_mat.cols;
         height = image_mat.rows;
+        return true;
        /* auto components_per_pixel = bytes_per_pixel;
 
         data = stbi_load(
@@ -208,10 +253,21 @@ public:
         bytes_per_scanline = bytes_per_pixel * width;*/
     }
 
+    // Takes the decoded pixels of _other_, which both then share
+    void share(const image_texture& other) {
+        image_mat = other.image_mat;
+        width = other.width;
+        height = other.height;
+    }
+
     ~image_texture() {
         delete data;
     }
     virtual color value(Float u, Float v, const point3& p) const override {
+        // If we have no texture data, then return solid cyan as a debugging aid.
+        if (width == 0 || height == 0)
+            return color(0, 1, 1);
+
         // Clamp input texture coordinates to [0,1] x [1,0]
         u = Clamp(u, 0.0, 1.0);
         v = 1.0 - Clamp(v, 0.0, 1.0);  // Flip V to image coordinates
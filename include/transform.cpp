@@ -256,6 +256,52 @@ void IntervalFindZeros(Float c1, Float c2, Float c3, Float c4, Float c5,
     }
 }
 
+// TransformCache Method Definitions
+size_t TransformCache::MatrixHash::operator()(const Matrix4x4& m) const {
+    uint64_t h = 0;
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j) {
+            // Adding zero folds -0 into +0, which compare equal
+            Float v = m.m[i][j] + Float(0);
+            uint64_t bits = 0;
+            memcpy(&bits, &v, sizeof(v));
+            h = MixBits(h ^ bits);
+        }
+    return (size_t)h;
+}
+
+void TransformCache::Lookup(const Transform& t, std::shared_ptr<Transform>* tCached,
+    std::shared_ptr<Transform>* tCachedInverse) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iter = table.find(t.GetMatrix());
+    if (iter == table.end()) {
+        // Store _t_ and its inverse together, so looking up either one
+        // later returns the same pair
+        Entry e;
+        e.t = std::make_shared<Transform>(t);
+        if (t.GetInverseMatrix() == t.GetMatrix())
+            e.tInv = e.t;
+        else {
+            auto inv = table.find(t.GetInverseMatrix());
+            e.tInv = inv != table.end() ? inv->second.t
+                : std::make_shared<Transform>(Inverse(t));
+            table[t.GetInverseMatrix()] = { e.tInv, e.t };
+        }
+        iter = table.insert({ t.GetMatrix(), e }).first;
+    }
+    if (tCached) *tCached = iter->second.t;
+    if (tCachedInverse) *tCachedInverse = iter->second.tInv;
+}
+
+size_t TransformCache::Size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return table.size();
+}
+
+void TransformCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    table.clear();
+}
 
 // AnimatedTransform Method Definitions
 AnimatedTransform::AnimatedTransform(const Transform* startTransform,
@@ -274,11 +320,20 @@ AnimatedTransform::AnimatedTransform(const Transform* startTransform,
     // Flip _R[1]_ if needed to select shortest path
     if (Dot(R[0], R[1]) < 0) R[1] = -R[1];
     hasRotation = Dot(R[0], R[1]) < 0.9995f;
-    // Compute terms of motion derivative function
+    // Precompute interpolation keys
     if (hasRotation) {
         Float cosTheta = Dot(R[0], R[1]);
-        Float theta = std::acos(Clamp(cosTheta, -1, 1));
-        Quaternion qperp = Normalize(R[1] - R[0] * cosTheta);
+        theta = std::acos(Clamp(cosTheta, -1, 1));
+        qperp = Normalize(R[1] - R[0] * cosTheta);
+    }
+    scaleAnimated = S[0] != S[1];
+    if (!scaleAnimated) {
+        Matrix4x4 inv = Inverse(S[0]);
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j) sInv[i][j] = inv.m[i][j];
+    }
+    // Compute terms of motion derivative function
+    if (hasRotation) {
 
         Float t0x = T[0].x;
         Float t0y = T[0].y;
@@ -1017,20 +1072,206 @@ void AnimatedTransform::Interpolate(Float time, Transform* t) const {
         return;
     }
     Float dt = (time - startTime) / (endTime - startTime);
+    Float thetap = theta * dt;
+    Evaluate(dt, std::cos(thetap), std::sin(thetap), t);
+}
+
+void AnimatedTransform::Interpolate(int n, const Float* times, Float* m,
+    Float* mInv) const {
+    // Copies _t_ into lane _k_
+    auto store = [&](const Transform& t, int k) {
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j) {
+                m[(4 * i + j) * n + k] = t.GetMatrix().m[i][j];
+                mInv[(4 * i + j) * n + k] = t.GetInverseMatrix().m[i][j];
+            }
+    };
+    if (!actuallyAnimated) {
+        for (int k = 0; k < n; ++k) store(*startTransform, k);
+        return;
+    }
+
+    // Lanes are processed _batchSize_ at a time in SoA scratch arrays
+    const int batchSize = 64;
+    Float dt[batchSize], q[4][batchSize], r[9][batchSize];
+    Float s[9][batchSize], si[9][batchSize], det[batchSize];
+    Float invDuration = 1 / (endTime - startTime);
+    for (int start = 0; start < n; start += batchSize) {
+        int count = std::min(batchSize, n - start);
+        const Float* time = times + start;
+        for (int k = 0; k < count; ++k)
+            dt[k] = Clamp((time[k] - startTime) * invDuration, 0, 1);
+
+        // Interpolate rotation, as in Evaluate(). _theta_ is at most pi,
+        // so the sine and cosine come from Taylor polynomials of the half
+        // angle (at most pi/2, truncation error below 1e-7) and the double
+        // angle formulas, which vectorize where std::sin and std::cos don't
+        if (hasRotation)
+            for (int k = 0; k < count; ++k) {
+                Float x = 0.5f * theta * dt[k], x2 = x * x;
+                Float sh = x * (1 + x2 * (-1.f / 6 + x2 * (1.f / 120 +
+                    x2 * (-1.f / 5040 + x2 * (1.f / 362880 + x2 * (-1.f / 39916800))))));
+                Float ch = 1 + x2 * (-0.5f + x2 * (1.f / 24 + x2 * (-1.f / 720 +
+                    x2 * (1.f / 40320 + x2 * (-1.f / 3628800 + x2 * (1.f / 479001600))))));
+                Float c = 1 - 2 * sh * sh, sn = 2 * sh * ch;
+                q[0][k] = R[0].v.x * c + qperp.v.x * sn;
+                q[1][k] = R[0].v.y * c + qperp.v.y * sn;
+                q[2][k] = R[0].v.z * c + qperp.v.z * sn;
+                q[3][k] = R[0].w * c + qperp.w * sn;
+            }
+        else
+            for (int k = 0; k < count; ++k) {
+                Float x = Lerp(dt[k], R[0].v.x, R[1].v.x);
+                Float y = Lerp(dt[k], R[0].v.y, R[1].v.y);
+                Float z = Lerp(dt[k], R[0].v.z, R[1].v.z);
+                Float w = Lerp(dt[k], R[0].w, R[1].w);
+                Float invLen = 1 / std::sqrt(x * x + y * y + z * z + w * w);
+                q[0][k] = x * invLen;
+                q[1][k] = y * invLen;
+                q[2][k] = z * invLen;
+                q[3][k] = w * invLen;
+            }
+        for (int k = 0; k < count; ++k) {
+            Float x = q[0][k], y = q[1][k], z = q[2][k], w = q[3][k];
+            r[0][k] = 1 - 2 * (y * y + z * z);
+            r[1][k] = 2 * (x * y - z * w);
+            r[2][k] = 2 * (x * z + y * w);
+            r[3][k] = 2 * (x * y + z * w);
+            r[4][k] = 1 - 2 * (x * x + z * z);
+            r[5][k] = 2 * (y * z - x * w);
+            r[6][k] = 2 * (x * z - y * w);
+            r[7][k] = 2 * (y * z + x * w);
+            r[8][k] = 1 - 2 * (x * x + y * y);
+        }
+
+        // Interpolate scale and find its inverse
+        for (int e = 0; e < 9; ++e) {
+            Float s0 = S[0].m[e / 3][e % 3], s1 = S[1].m[e / 3][e % 3];
+            for (int k = 0; k < count; ++k) s[e][k] = Lerp(dt[k], s0, s1);
+        }
+        if (scaleAnimated)
+            for (int k = 0; k < count; ++k) {
+                Float c0 = s[4][k] * s[8][k] - s[5][k] * s[7][k];
+                Float c1 = s[5][k] * s[6][k] - s[3][k] * s[8][k];
+                Float c2 = s[3][k] * s[7][k] - s[4][k] * s[6][k];
+                det[k] = s[0][k] * c0 + s[1][k] * c1 + s[2][k] * c2;
+                Float invDet = det[k] != 0 ? 1 / det[k] : 0;
+                si[0][k] = c0 * invDet;
+                si[1][k] = (s[2][k] * s[7][k] - s[1][k] * s[8][k]) * invDet;
+                si[2][k] = (s[1][k] * s[5][k] - s[2][k] * s[4][k]) * invDet;
+                si[3][k] = c1 * invDet;
+                si[4][k] = (s[0][k] * s[8][k] - s[2][k] * s[6][k]) * invDet;
+                si[5][k] = (s[2][k] * s[3][k] - s[0][k] * s[5][k]) * invDet;
+                si[6][k] = c2 * invDet;
+                si[7][k] = (s[1][k] * s[6][k] - s[0][k] * s[7][k]) * invDet;
+                si[8][k] = (s[0][k] * s[4][k] - s[1][k] * s[3][k]) * invDet;
+            }
+        else
+            for (int e = 0; e < 9; ++e)
+                for (int k = 0; k < count; ++k) si[e][k] = sInv[e / 3][e % 3];
+
+        // Compose $T R S$ and $S^{-1} R^T T^{-1}$ entry by entry
+        for (int i = 0; i < 3; ++i) {
+            Float* mRow = m + 4 * i * n + start;
+            Float* mInvRow = mInv + 4 * i * n + start;
+            for (int j = 0; j < 3; ++j)
+                for (int k = 0; k < count; ++k) {
+                    mRow[j * n + k] = r[3 * i][k] * s[j][k] +
+                        r[3 * i + 1][k] * s[3 + j][k] + r[3 * i + 2][k] * s[6 + j][k];
+                    mInvRow[j * n + k] = si[3 * i][k] * r[3 * j][k] +
+                        si[3 * i + 1][k] * r[3 * j + 1][k] +
+                        si[3 * i + 2][k] * r[3 * j + 2][k];
+                }
+            Float t0 = T[0][i], t1 = T[1][i];
+            for (int k = 0; k < count; ++k) mRow[3 * n + k] = Lerp(dt[k], t0, t1);
+        }
+        for (int i = 0; i < 3; ++i) {
+            Float* mInvRow = mInv + 4 * i * n + start;
+            for (int k = 0; k < count; ++k)
+                mInvRow[3 * n + k] = -(mInvRow[k] * m[3 * n + start + k] +
+                    mInvRow[n + k] * m[7 * n + start + k] +
+                    mInvRow[2 * n + k] * m[11 * n + start + k]);
+        }
+
+        // Times outside the interval take the end transforms exactly, and
+        // singular scales go through the scalar path to report them
+        for (int k = 0; k < count; ++k) {
+            if (time[k] <= startTime)
+                store(*startTransform, start + k);
+            else if (time[k] >= endTime)
+                store(*endTransform, start + k);
+            else if (scaleAnimated && det[k] == 0) {
+                Transform t;
+                Interpolate(time[k], &t);
+                store(t, start + k);
+            }
+        }
+    }
+}
+
+void AnimatedTransform::Evaluate(Float dt, Float cosThetap, Float sinThetap,
+    Transform* t) const {
     // Interpolate translation at _dt_
     Vector3f trans = (1 - dt) * T[0] + dt * T[1];
 
-    // Interpolate rotation at _dt_
-    Quaternion rotate = Slerp(dt, R[0], R[1]);
+    // Interpolate rotation at _dt_; as in Slerp(), nearly parallel
+    // quaternions are linearly interpolated instead
+    Quaternion q = hasRotation ? R[0] * cosThetap + qperp * sinThetap
+        : Normalize((1 - dt) * R[0] + dt * R[1]);
+    Float xx = q.v.x * q.v.x, yy = q.v.y * q.v.y, zz = q.v.z * q.v.z;
+    Float xy = q.v.x * q.v.y, xz = q.v.x * q.v.z, yz = q.v.y * q.v.z;
+    Float wx = q.v.x * q.w, wy = q.v.y * q.w, wz = q.v.z * q.w;
+    // Rotation matrix of _q_, as built by Quaternion::ToTransform()
+    Float r[3][3] = { { 1 - 2 * (yy + zz), 2 * (xy - wz), 2 * (xz + wy) },
+                      { 2 * (xy + wz), 1 - 2 * (xx + zz), 2 * (yz - wx) },
+                      { 2 * (xz - wy), 2 * (yz + wx), 1 - 2 * (xx + yy) } };
 
-    // Interpolate scale at _dt_
-    Matrix4x4 scale;
+    // Interpolate scale at _dt_ and find its inverse
+    Float s[3][3], si[3][3];
     for (int i = 0; i < 3; ++i)
         for (int j = 0; j < 3; ++j)
-            scale.m[i][j] = Lerp(dt, S[0].m[i][j], S[1].m[i][j]);
+            s[i][j] = Lerp(dt, S[0].m[i][j], S[1].m[i][j]);
+    if (scaleAnimated) {
+        Float det = s[0][0] * (s[1][1] * s[2][2] - s[1][2] * s[2][1]) -
+            s[0][1] * (s[1][0] * s[2][2] - s[1][2] * s[2][0]) +
+            s[0][2] * (s[1][0] * s[2][1] - s[1][1] * s[2][0]);
+        if (det == 0) {
+            // Degenerate scale; let Transform report the singular matrix
+            Matrix4x4 scale;
+            for (int i = 0; i < 3; ++i)
+                for (int j = 0; j < 3; ++j) scale.m[i][j] = s[i][j];
+            *t = Translate(trans) * q.ToTransform() * Transform(scale);
+            return;
+        }
+        Float invDet = 1 / det;
+        si[0][0] = (s[1][1] * s[2][2] - s[1][2] * s[2][1]) * invDet;
+        si[0][1] = (s[0][2] * s[2][1] - s[0][1] * s[2][2]) * invDet;
+        si[0][2] = (s[0][1] * s[1][2] - s[0][2] * s[1][1]) * invDet;
+        si[1][0] = (s[1][2] * s[2][0] - s[1][0] * s[2][2]) * invDet;
+        si[1][1] = (s[0][0] * s[2][2] - s[0][2] * s[2][0]) * invDet;
+        si[1][2] = (s[0][2] * s[1][0] - s[0][0] * s[1][2]) * invDet;
+        si[2][0] = (s[1][0] * s[2][1] - s[1][1] * s[2][0]) * invDet;
+        si[2][1] = (s[0][1] * s[2][0] - s[0][0] * s[2][1]) * invDet;
+        si[2][2] = (s[0][0] * s[1][1] - s[0][1] * s[1][0]) * invDet;
+    }
+    else
+        memcpy(si, sInv, sizeof(si));
 
-    // Compute interpolated matrix as product of interpolated components
-    *t = Translate(trans) * rotate.ToTransform() * Transform(scale);
+    // Compose $T R S$ and its inverse $S^{-1} R^T T^{-1}$ directly rather
+    // than through general matrix products and inversion
+    Matrix4x4 m, mInv;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            m.m[i][j] = r[i][0] * s[0][j] + r[i][1] * s[1][j] + r[i][2] * s[2][j];
+            mInv.m[i][j] =
+                si[i][0] * r[j][0] + si[i][1] * r[j][1] + si[i][2] * r[j][2];
+        }
+        m.m[i][3] = trans[i];
+    }
+    for (int i = 0; i < 3; ++i)
+        mInv.m[i][3] = -(mInv.m[i][0] * trans.x + mInv.m[i][1] * trans.y +
+                         mInv.m[i][2] * trans.z);
+    *t = Transform(m, mInv);
 }
 
 Ray AnimatedTransform::operator()(const Ray& r) const {
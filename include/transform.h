@@ -7,6 +7,9 @@
 #include "aabb.h"
 #include "hittable.h"
 #include "quaternion.h"
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 // Matrix4x4 Declarations
 struct Matrix4x4 {
@@ -442,6 +445,37 @@ inline ray Transform::operator()(const ray& r, const vec3& oErrorIn,
     return ray(o, d, r.time, r.tMin, r.tMax, r.depth);
 }
 
+// TransformCache Declarations
+// Hands out one shared copy of each distinct transform, keyed on its
+// matrix, along with its inverse. Shapes built through the cache share
+// Transform objects instead of each holding a fresh pair; the returned
+// transforms must not be modified.
+class TransformCache {
+  public:
+    // TransformCache Public Methods
+    void Lookup(const Transform &t, std::shared_ptr<Transform> *tCached,
+                std::shared_ptr<Transform> *tCachedInverse);
+    std::shared_ptr<Transform> Lookup(const Transform &t) {
+        std::shared_ptr<Transform> tCached;
+        Lookup(t, &tCached, nullptr);
+        return tCached;
+    }
+    // Number of distinct transforms stored, inverses included
+    size_t Size() const;
+    void Clear();
+
+  private:
+    // TransformCache Private Data
+    struct MatrixHash {
+        size_t operator()(const Matrix4x4 &m) const;
+    };
+    struct Entry {
+        std::shared_ptr<Transform> t, tInv;
+    };
+    mutable std::mutex mutex;
+    std::unordered_map<Matrix4x4, Entry, MatrixHash> table;
+};
+
 // AnimatedTransform Declarations
 class AnimatedTransform {
   public:
@@ -451,6 +485,12 @@ class AnimatedTransform {
     static void Decompose(const Matrix4x4 &m, Vector3f *T, Quaternion *R,
                           Matrix4x4 *S);
     void Interpolate(Float time, Transform *t) const;
+    // Interpolates the transforms at the _n_ _times_ of a ray packet
+    // lane by lane, without building Transforms: entry (i, j) of the
+    // upper 3x4 of lane k's matrix goes to _m_[(4 * i + j) * n + k], and
+    // likewise for its inverse in _mInv_. Each entry is computed in a loop
+    // over the lanes, so the arithmetic vectorizes.
+    void Interpolate(int n, const Float *times, Float *m, Float *mInv) const;
     Ray operator()(const Ray &r) const;
     RayDifferential operator()(const RayDifferential &r) const;
     Point3f operator()(Float time, const Point3f &p) const;
@@ -462,6 +502,13 @@ class AnimatedTransform {
     Bounds3f BoundPointMotion(const Point3f &p) const;
 
   private:
+    // AnimatedTransform Private Methods
+    // Builds the transform at fraction _dt_ of the interval from the
+    // interpolation keys; _cosThetap_ and _sinThetap_ are the cosine and
+    // sine of _theta_ * _dt_ (unused without rotation)
+    void Evaluate(Float dt, Float cosThetap, Float sinThetap,
+                  Transform *t) const;
+
     // AnimatedTransform Private Data
     const Transform *startTransform, *endTransform;
     const Float startTime, endTime;
@@ -470,6 +517,13 @@ class AnimatedTransform {
     Quaternion R[2];
     Matrix4x4 S[2];
     bool hasRotation;
+    // Interpolation keys: the angle between R[0] and R[1] and the unit
+    // quaternion orthogonal to R[0] towards R[1], so the Slerp() needs no
+    // acos or normalization, and the inverse scale when it doesn't change
+    Float theta = 0;
+    Quaternion qperp;
+    bool scaleAnimated = false;
+    Float sInv[3][3];
     struct DerivativeTerm {
         DerivativeTerm() {}
         DerivativeTerm(Float c, Float x, Float y, Float z)
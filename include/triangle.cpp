@@ -1,5 +1,6 @@
 #include "efloat.h"
 #include "triangle.h"
+#include "sampling.h"
 
 TriangleMesh::TriangleMesh(
     shared_ptr<Transform> ObjectToWorld, int nTriangles, const int* vertexIndices,
@@ -21,20 +22,23 @@ TriangleMesh::TriangleMesh(
     //        (fIndices ? sizeof(*fIndices) : 0));
 
     // Transform mesh vertices to world space
-    p.reset(new Point3f[nVertices]);
+    p = MakeLargeArray<Point3f>(nVertices);
+#pragma omp parallel for schedule(static)
     for (int i = 0; i < nVertices; ++i) p[i] = (*ObjectToWorld)(P[i]);
 
     // Copy _UV_, _N_, and _S_ vertex data, if present
     if (UV) {
-        uv.reset(new Point2f[nVertices]);
+        uv = MakeLargeArray<Point2f>(nVertices);
         memcpy(uv.get(), UV, nVertices * sizeof(Point2f));
     }
     if (N) {
-        n.reset(new Normal3f[nVertices]);
+        n = MakeLargeArray<Normal3f>(nVertices);
+#pragma omp parallel for schedule(static)
         for (int i = 0; i < nVertices; ++i) n[i] = (*ObjectToWorld)(N[i]);
     }
     if (S) {
-        s.reset(new Vector3f[nVertices]);
+        s = MakeLargeArray<Vector3f>(nVertices);
+#pragma omp parallel for schedule(static)
         for (int i = 0; i < nVertices; ++i) s[i] = (*ObjectToWorld)(S[i]);
     }
 
@@ -88,6 +92,15 @@ Bounds3f Triangle::WorldBound() const
 
 bool Triangle::Intersect(const Ray& ray, Float* tHit, SurfaceInteraction* isect,
     bool testAlphaTexture) const
+{
+    Float t, b[3];
+    if (!IntersectBarycentric(ray, &t, b) || !InteractionAt(ray, b, isect))
+        return false;
+    *tHit = t;
+    return true;
+}
+
+bool Triangle::IntersectBarycentric(const Ray& ray, Float* tHit, Float b[3]) const
 {
     //++nTests;
     // Get triangle vertices in _p0_, _p1_, and _p2_
@@ -191,6 +204,22 @@ bool Triangle::Intersect(const Ray& ray, Float* tHit, SurfaceInteraction* isect,
         std::abs(invDet);
     if (t <= deltaT) return false;
 
+    b[0] = b0;
+    b[1] = b1;
+    b[2] = b2;
+    *tHit = t;
+    //++nHits;
+    return true;
+}
+
+bool Triangle::InteractionAt(const Ray& ray, const Float b[3],
+    SurfaceInteraction* isect) const
+{
+    const Point3f& p0 = mesh->p[v[0]];
+    const Point3f& p1 = mesh->p[v[1]];
+    const Point3f& p2 = mesh->p[v[2]];
+    Float b0 = b[0], b1 = b[1], b2 = b[2];
+
     // Compute triangle partial derivatives
     Vector3f dpdu, dpdv;
     Point2f uv[3];
@@ -324,8 +353,6 @@ bool Triangle::Intersect(const Ray& ray, Float* tHit, SurfaceInteraction* isect,
         isect->SetShadingGeometry(ss, ts, dndu, dndv, true);
     }
 
-    *tHit = t;
-    //++nHits;
     return true;
 }
 
@@ -483,4 +510,47 @@ Float Triangle::Area() const
     const Point3f& p1 = mesh->p[v[1]];
     const Point3f& p2 = mesh->p[v[2]];
     return 0.5 * Cross(p1 - p0, p2 - p0).Length();
+}
+
+DirectionCone Triangle::NormalBounds() const {
+    const Point3f& p0 = mesh->p[v[0]];
+    const Point3f& p1 = mesh->p[v[1]];
+    const Point3f& p2 = mesh->p[v[2]];
+    Normal3f n = Normalize(Normal3f(Cross(p1 - p0, p2 - p0)));
+    // Orient the geometric normal the same way Sample() does
+    if (mesh->n) {
+        Normal3f ns = mesh->n[v[0]] + mesh->n[v[1]] + mesh->n[v[2]];
+        n = Faceforward(n, Vector3f(ns));
+    }
+    else if (reverseOrientation ^ transformSwapsHandedness)
+        n *= -1;
+    return DirectionCone(Vector3f(n));
+}
+
+Interaction Triangle::Sample(const Point2f& u, Float* pdf) const {
+    Point2f b = UniformSampleTriangle(u);
+    // Get triangle vertices in _p0_, _p1_, and _p2_
+    const Point3f& p0 = mesh->p[v[0]];
+    const Point3f& p1 = mesh->p[v[1]];
+    const Point3f& p2 = mesh->p[v[2]];
+    Interaction it;
+    it.p = b.x * p0 + b.y * p1 + (1 - b.x - b.y) * p2;
+    // Compute surface normal for sampled point on triangle
+    it.n = Normalize(Normal3f(Cross(p1 - p0, p2 - p0)));
+    // Ensure correct orientation of the geometric normal; follow the same
+    // approach as was used in Triangle::Intersect().
+    if (mesh->n) {
+        Normal3f ns(b.x * mesh->n[v[0]] + b.y * mesh->n[v[1]] +
+            (1 - b.x - b.y) * mesh->n[v[2]]);
+        it.n = Faceforward(it.n, Vector3f(ns));
+    }
+    else if (reverseOrientation ^ transformSwapsHandedness)
+        it.n *= -1;
+
+    // Compute error bounds for sampled point on triangle
+    Point3f pAbsSum =
+        Abs(b.x * p0) + Abs(b.y * p1) + Abs((1 - b.x - b.y) * p2);
+    it.pError = gamma(6) * Vector3f(pAbsSum.x, pAbsSum.y, pAbsSum.z);
+    *pdf = 1 / Area();
+    return it;
 }
\ No newline at end of file
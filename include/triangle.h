@@ -7,6 +7,7 @@
 #define TRIANGLE_H
 
 #include "shape.h"
+#include "meomery.h"
 
 #include <map>
 
@@ -24,10 +25,10 @@ struct TriangleMesh {
     // TriangleMesh Data
     const int nTriangles, nVertices;
     std::vector<int> vertexIndices;
-    std::unique_ptr<Point3f[]> p;
-    std::unique_ptr<Normal3f[]> n;
-    std::unique_ptr<Vector3f[]> s;
-    std::unique_ptr<Point2f[]> uv;
+    LargeArray<Point3f> p;
+    LargeArray<Normal3f> n;
+    LargeArray<Vector3f> s;
+    LargeArray<Point2f> uv;
     //std::shared_ptr<Texture<Float>> alphaMask, shadowAlphaMask;
     std::vector<int> faceIndices;
 };
@@ -49,11 +50,18 @@ public:
     Bounds3f WorldBound() const;
     bool Intersect(const Ray& ray, Float* tHit, SurfaceInteraction* isect,
         bool testAlphaTexture = true) const;
+    // The two halves of Intersect(): the hit test, which only finds the
+    // hit distance and barycentric coordinates _b_, and the surface
+    // interaction at _b_. InteractionAt() fails for degenerate triangles.
+    bool IntersectBarycentric(const Ray& ray, Float* tHit, Float b[3]) const;
+    bool InteractionAt(const Ray& ray, const Float b[3],
+        SurfaceInteraction* isect) const;
     bool IntersectP(const Ray& ray, bool testAlphaTexture = true) const;
     Float Area() const;
+    DirectionCone NormalBounds() const;
 
-    //using Shape::Sample;  // Bring in the other Sample() overload.
-   // Interaction Sample(const Point2f& u, Float* pdf) const;
+    using Shape::Sample;  // Bring in the other Sample() overload.
+    Interaction Sample(const Point2f& u, Float* pdf) const;
 
     // Returns the solid angle subtended by the triangle w.r.t. the given
     // reference point p.
@@ -80,4 +88,11 @@ private:
     int faceIndex;
 };
 
+std::vector<std::shared_ptr<Shape>> CreateTriangleMesh(
+    shared_ptr<Transform> ObjectToWorld, shared_ptr<Transform> WorldToObject,
+    bool reverseOrientation, int nTriangles,
+    const int* vertexIndices, int nVertices, const Point3f* p,
+    const Vector3f* s, const Normal3f* n, const Point2f* uv,
+    const int* faceIndices);
+
 #endif // !TRIANGLE_H
@@ -17,20 +17,20 @@ public:
     vec3(Float e0, Float e1, Float e2) : x(e0), y(e1), z(e2) {}
     explicit vec3(const Normal& n);
     explicit vec3(const point3& p);
-    vec3 Abs() { x = abs(x); y = abs(y); z = abs(z); }
+    vec3 Abs() { x = abs(x); y = abs(y); z = abs(z); return *this; }
 
     vec3 operator-() const { return vec3(-x, -y, -z); }
     Float operator[](int i) const {
         IN_RANGE((i >= 0 && i < 3));
         if (i == 0) return x;
         if (i == 1) return y;
-        if (i == 2) return z;
+        return z;
     }
     Float& operator[](int i) { 
         IN_RANGE((i >= 0 && i < 3));
         if (i == 0) return x;
         if (i == 1) return y;
-        if (i == 2) return z;
+        return z;
     }
 
     vec3& operator+=(const vec3& v) {
@@ -232,6 +232,20 @@ inline vec3 random_unit_vector() {
      *v3 = Cross(v1, *v2);
  }
 
+ inline vec3 SphericalDirection(Float sinTheta, Float cosTheta, Float phi) {
+     return vec3(Clamp(sinTheta, -1, 1) * std::cos(phi),
+         Clamp(sinTheta, -1, 1) * std::sin(phi), Clamp(cosTheta, -1, 1));
+ }
+
+ inline Float SphericalTheta(const vec3& v) {
+     return std::acos(Clamp(v.z, -1, 1));
+ }
+
+ inline Float SphericalPhi(const vec3& v) {
+     Float p = std::atan2(v.y, v.x);
+     return (p < 0) ? (p + 2 * Pi) : p;
+ }
+
  class point2 {
  public:
      point2() { x = y = 0; }
@@ -265,13 +279,13 @@ inline vec3 random_unit_vector() {
      Float& operator[](int i) {
          IN_RANGE((i == 0 || i == 1));
          if (i == 0) return this->x;
-         if (i == 1) return this->y;
+         return this->y;
      }
 
      Float operator[](int i) const {
          IN_RANGE((i == 0 || i == 1));
          if (i == 0) return this->x;
-         if (i == 1) return this->y;
+         return this->y;
      }
 
      Float x; Float y;
@@ -286,20 +300,20 @@ inline vec3 random_unit_vector() {
      point3() { x = y = z = 0; }
      point3(Float e0, Float e1, Float e2) : x(e0), y(e1), z(e2) {}
      point3(vec3 v):x(v.x),y(v.y),z(v.z){}
-     point3 Abs() { x = ::Abs(x); y = ::Abs(y); z = ::Abs(z); }
+     point3 Abs() { x = ::Abs(x); y = ::Abs(y); z = ::Abs(z); return *this; }
 
      point3 operator-() const { return point3(-x, -y, -z); }
      Float operator[](int i) const {
          IN_RANGE((i >= 0 && i < 3));
          if (i == 0) return x;
          if (i == 1) return y;
-         if (i == 2) return z;
+         return z;
      }
      Float& operator[](int i) {
          IN_RANGE((i >= 0 && i < 3));
          if (i == 0) return x;
          if (i == 1) return y;
-         if (i == 2) return z;
+         return z;
      }
 
      point3 operator+(const vec3& v) {
@@ -406,7 +420,7 @@ inline vec3 random_unit_vector() {
      Normal() { x = y = z = 0; }
      Normal(Float e0, Float e1, Float e2) : x(e0), y(e1), z(e2) {}
      explicit Normal(const vec3& v) :x(v.x), y(v.y), z(v.z) {}
-     Normal Abs() { x = ::Abs(x); y = ::Abs(y); z = ::Abs(z); }
+     Normal Abs() { x = ::Abs(x); y = ::Abs(y); z = ::Abs(z); return *this; }
      bool operator==(const Normal& n) const {
          return x == n.x && y == n.y && z == n.z;
      }
@@ -419,13 +433,13 @@ inline vec3 random_unit_vector() {
          IN_RANGE((i >= 0 && i < 3));
          if (i == 0) return x;
          if (i == 1) return y;
-         if (i == 2) return z;
+         return z;
      }
      Float& operator[](int i) {
          IN_RANGE((i >= 0 && i < 3));
          if (i == 0) return x;
          if (i == 1) return y;
-         if (i == 2) return z;
+         return z;
      }
 
      Normal operator+(const Normal& n) {